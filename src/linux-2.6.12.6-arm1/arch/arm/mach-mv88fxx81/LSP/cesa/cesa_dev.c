@@ -36,6 +36,7 @@ extern void desTest(int iter, int reqSize, int checkMode);
 extern void tripleDesTest(int iter, int reqSize, int checkMode);
 extern void mdTest(int iter, int reqSize, int checkMode);
 extern void shaTest(int iter, int reqSize, int checkMode);
+extern void fragPipeTest(int idx, int caseIdx, int iter, int checkMode);
 
 int run_cesa_test(CESA_TEST *cesa_test)
 {
@@ -65,6 +66,10 @@ int run_cesa_test(CESA_TEST *cesa_test)
 		case(SHA1):
                         shaTest(cesa_test->iter, cesa_test->req_size, cesa_test->checkmode);
                         break;
+		case(FRAG_PIPE):
+			fragPipeTest(cesa_test->session_id, cesa_test->data_id, cesa_test->iter,
+					cesa_test->checkmode);
+			break;
 		default:
 			dprintk("%s(unknown test 0x%x)\n", __FUNCTION__, cesa_test->test);
 			return -EINVAL;
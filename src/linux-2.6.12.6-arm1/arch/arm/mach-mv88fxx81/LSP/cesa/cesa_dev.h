@@ -19,6 +19,7 @@ typedef enum {
 	TRI_DES,
 	MD5,
 	SHA1,
+	FRAG_PIPE,
 	MAX_CESA_TEST_TYPE	
 } CESA_TEST_TYPE;
 
@@ -27,8 +28,8 @@ typedef struct {
 	unsigned int	  	iter;		/* How many interation to run */
 	unsigned int	  	req_size;	/* request buffer size */
 	unsigned int		checkmode;	/* check mode: verify or not */
-	unsigned int		session_id; 	/* relevant only for single test */
-	unsigned int		data_id;   	/* relevant only for single test */
+	unsigned int		session_id; 	/* relevant only for single and frag test */
+	unsigned int		data_id;   	/* relevant only for single and frag test */
 } CESA_TEST;
 
 typedef enum {
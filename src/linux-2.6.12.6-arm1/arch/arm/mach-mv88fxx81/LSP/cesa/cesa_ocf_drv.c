@@ -37,8 +37,11 @@ disclaimer.
 #include <linux/mm.h>
 #include <linux/skbuff.h>
 #include <linux/random.h>
+#include <linux/proc_fs.h>
+#include <asm/uaccess.h>
 #include <asm/scatterlist.h>
 #include <linux/spinlock.h>
+#include <asm/arch/mvtrace.h>
 #include <cryptodev.h>
 #include <uio.h>
 
@@ -101,9 +104,13 @@ struct cesa_ocf_data {
 	short					 frag_wa_encrypt;
 	short					 frag_wa_decrypt;
 	short					 frag_wa_auth;
+	/* open MD5/SHA1, see CRD_F_HASH_CONT and CRD_F_HASH_MORE */
+	MV_CESA_MAC_STREAM			 stream;
 };
 
 #define DIGEST_BUF_SIZE	32
+struct cesa_ocf_batch;
+
 struct cesa_ocf_process {
 	MV_CESA_COMMAND 			cesa_cmd;
 	MV_CESA_MBUF 				cesa_mbuf;	
@@ -112,6 +119,14 @@ struct cesa_ocf_process {
 	int					digest_len;
 	struct cryptop 				*crp;
 	int 					need_cb;
+	int					verify;
+	struct cesa_ocf_batch			*batch;
+};
+
+/* one request with several cipher descriptors, see cesa_ocf_process_batch() */
+struct cesa_ocf_batch {
+	atomic_t				left;	/* actions not completed */
+	struct cesa_ocf_process			cmd[0];
 };
 
 /* global variables */
@@ -120,6 +135,7 @@ static struct cesa_ocf_data 	*cesa_ocf_sessions[CESA_OCF_MAX_SES];
 static int			cesa_block = 0;
 //static spinlock_t 		cesa_lock;
 static u32			cesaReadyMap = 0;
+static struct proc_dir_entry	*cesa_proc;
 
 /* static APIs */
 static int 		cesa_ocf_process	(void *, struct cryptop *, int);
@@ -299,6 +315,122 @@ ocf_check_action(struct cryptop *crp, struct cesa_ocf_data *cesa_ocf_cur_ses) {
 }
 #endif
 
+/*
+ * Process a request with several cipher descriptors, each with an
+ * explicit IV over its own part of a contiguous buffer.  dm-crypt sends
+ * a page worth of sectors this way.  Every descriptor is one HAL action
+ * on its part of the buffer, all of them queued at once; the request is
+ * done when the last one completes.
+ */
+static int
+cesa_ocf_process_batch(struct cryptop *crp, struct cesa_ocf_data *cesa_ocf_cur_ses)
+{
+	struct cesa_ocf_batch *batch;
+	struct cesa_ocf_process *cesa_ocf_cmd;
+	MV_CESA_COMMAND	*cesa_cmd;
+	struct cryptodesc *crd;
+	int count = 0, i = 0, status;
+
+	if (crp->crp_flags & (CRYPTO_F_SKBUF | CRYPTO_F_IOV)) {
+		printk("%s,%d: batch needs a contiguous buffer\n", __FILE__, __LINE__);
+		goto p_error;
+	}
+	for (crd = crp->crp_desc; crd; crd = crd->crd_next, count++) {
+		if ((crd->crd_alg != cesa_ocf_cur_ses->cipher_alg) ||
+		    !(crd->crd_flags & CRD_F_IV_EXPLICIT) ||
+		    (crd->crd_skip + crd->crd_len > crp->crp_ilen)) {
+			printk("%s,%d: unsupported batch descriptor\n", __FILE__, __LINE__);
+			goto p_error;
+		}
+	}
+	if (count + 4 > CESA_Q_SIZE) {
+		printk("%s,%d: batch of %d too big\n", __FILE__, __LINE__, count);
+		goto p_error;
+	}
+
+	/* queue the whole batch or nothing, keeping the reserve below */
+	if (cesaReqResources < count + 4) {
+		cesa_block = 1;
+		return ERESTART;
+	}
+
+	batch = kmalloc(sizeof(struct cesa_ocf_batch) +
+			count * sizeof(struct cesa_ocf_process), GFP_ATOMIC);
+	if (batch == NULL) {
+		printk("%s,%d: ENOBUFS \n", __FILE__, __LINE__);
+		goto p_error;
+	}
+	atomic_set(&batch->left, count);
+
+	mv_trace(MV_TRACE_CESA, MV_TRACE_CESA_SUBMIT, (u32)crp, crp->crp_ilen);
+	for (crd = crp->crp_desc; crd; crd = crd->crd_next, i++) {
+		cesa_ocf_cmd = &batch->cmd[i];
+		memset(cesa_ocf_cmd, 0, sizeof(struct cesa_ocf_process));
+		cesa_ocf_cmd->crp = crp;
+		cesa_ocf_cmd->need_cb = 1;
+		cesa_ocf_cmd->batch = batch;
+
+		cesa_cmd = &cesa_ocf_cmd->cesa_cmd;
+		cesa_cmd->pReqPrv = (void *)cesa_ocf_cmd;
+		if (crd->crd_flags & CRD_F_ENCRYPT) {
+			cesa_cmd->sessionId = cesa_ocf_cur_ses->sid_encrypt;
+			if ((crd->crd_flags & CRD_F_IV_PRESENT) == 0)
+				memcpy(crp->crp_buf + crd->crd_inject, crd->crd_iv,
+				       cesa_ocf_cur_ses->ivlen);
+		}
+		else {
+			cesa_cmd->sessionId = cesa_ocf_cur_ses->sid_decrypt;
+		}
+
+		/* the IV, then this descriptor's part of the buffer */
+		cesa_ocf_cmd->cesa_bufs[0].bufVirtPtr = crd->crd_iv;
+		cesa_ocf_cmd->cesa_bufs[0].bufSize = cesa_ocf_cur_ses->ivlen;
+		cesa_ocf_cmd->cesa_bufs[1].bufVirtPtr = crp->crp_buf + crd->crd_skip;
+		cesa_ocf_cmd->cesa_bufs[1].bufSize = crd->crd_len;
+		cesa_ocf_cmd->cesa_mbuf.pFrags = cesa_ocf_cmd->cesa_bufs;
+		cesa_ocf_cmd->cesa_mbuf.numFrags = 2;
+		cesa_ocf_cmd->cesa_mbuf.mbufSize = cesa_ocf_cur_ses->ivlen + crd->crd_len;
+
+		cesa_cmd->pSrc = &cesa_ocf_cmd->cesa_mbuf;
+		cesa_cmd->pDst = &cesa_ocf_cmd->cesa_mbuf;
+		cesa_cmd->ivFromUser = 1;
+		cesa_cmd->ivOffset = 0;
+		cesa_cmd->cryptoOffset = cesa_ocf_cur_ses->ivlen;
+		cesa_cmd->cryptoLength = crd->crd_len;
+
+		status = mvCesaAction(cesa_cmd);
+		if ((status != MV_NO_MORE) && (status != MV_OK)) {
+			printk("%s,%d: cesa action failed, status = 0x%x\n", __FILE__, __LINE__, status);
+			break;
+		}
+	}
+
+	if (i < count) {
+		/* the queued part still completes, the last one of it ends the request */
+		crp->crp_etype = EINVAL;
+		if (atomic_sub_and_test(count - i, &batch->left)) {
+			kfree(batch);
+			crypto_done(crp);
+		}
+	}
+
+	if(cesaReqResources <= 4){
+		cesa_block = 1;
+	}
+
+	if(!cesa_block)
+		crypto_unblock(cesa_ocf_id, CRYPTO_SYMQ);
+
+#ifdef CESA_OCF_POLLING
+	cesa_interrupt_polling();
+#endif
+	return 0;
+p_error:
+	crp->crp_etype = EINVAL;
+	crypto_done(crp);
+	return 0;
+}
+
 /*
  * Process a request.
  */
@@ -311,7 +443,7 @@ cesa_ocf_process(void *arg, struct cryptop *crp, int hint)
 	struct cryptodesc *crd;
 	struct cesa_ocf_data *cesa_ocf_cur_ses;
 	int sid = 0, temp_len = 0, i;
-	int encrypt = 0, decrypt = 0, auth = 0;
+	int encrypt = 0, decrypt = 0, auth = 0, hash = 0;
 	int  status;
 	struct sk_buff *skb = NULL;
 	struct uio *uiop = NULL;
@@ -351,6 +483,11 @@ cesa_ocf_process(void *arg, struct cryptop *crp, int hint)
 	crp->crp_etype = 0;
 	cesa_ocf_cur_ses = cesa_ocf_sessions[sid];
 
+	/* several cipher operations in one request */
+	if(crp->crp_desc && crp->crp_desc->crd_next && !cesa_ocf_cur_ses->auth_alg) {
+		return cesa_ocf_process_batch(crp, cesa_ocf_cur_ses);
+	}
+
 #ifdef RT_DEBUG
 	if(ocf_check_action(crp, cesa_ocf_cur_ses)){
 		goto p_error;
@@ -584,6 +721,8 @@ cesa_ocf_process(void *arg, struct cryptop *crp, int hint)
 
 			/* digest + mac */
 			cesa_cmd->digestOffset = crd->crd_inject;
+			cesa_ocf_cmd->verify = crd->crd_flags & CRD_F_MAC_VERIFY;
+			hash = crd->crd_flags & (CRD_F_HASH_CONT | CRD_F_HASH_MORE);
 
 			if ((crp->crp_flags & CRYPTO_F_IOV) && crp->crp_mac) {
 				
@@ -625,9 +764,44 @@ cesa_ocf_process(void *arg, struct cryptop *crp, int hint)
 	}
 
 
+	/* an open hash, the HAL carries its state from one request to the next */
+	if(hash) {
+		if(cesa_ocf_cur_ses->cipher_alg ||
+		   ((cesa_ocf_cur_ses->auth_alg != CRYPTO_MD5) &&
+		    (cesa_ocf_cur_ses->auth_alg != CRYPTO_SHA1))) {
+			printk("%s,%d: open hash needs an MD5 or SHA1 only session\n", __FILE__, __LINE__);
+			goto p_error;
+		}
+		if(!(hash & CRD_F_HASH_CONT))
+			mvCesaMacStreamInit(&cesa_ocf_cur_ses->stream,
+				(cesa_ocf_cur_ses->auth_alg == CRYPTO_MD5) ? MV_CESA_MAC_MD5 : MV_CESA_MAC_SHA1);
+		cesa_ocf_cur_ses->stream.last = (hash & CRD_F_HASH_MORE) ? MV_FALSE : MV_TRUE;
+		mvCesaMacStreamSet(cesa_cmd->sessionId, &cesa_ocf_cur_ses->stream);
+	}
+	else if(!cesa_ocf_cur_ses->cipher_alg) {
+		mvCesaMacStreamSet(cesa_cmd->sessionId, NULL);
+	}
+
 	/* send action to HAL */
+	mv_trace(MV_TRACE_CESA, MV_TRACE_CESA_SUBMIT, (u32)crp, crp->crp_ilen);
 	status = mvCesaAction(cesa_cmd);
 
+	/* too short to be fragmented: the open hash is continued right here */
+	if(hash && (status == MV_NOT_ALLOWED)) {
+		status = mvCesaMacStreamSw(cesa_cmd);
+		if(status != MV_OK) {
+			printk("%s,%d: cesa hash failed, status = 0x%x\n", __FILE__, __LINE__, status);
+			goto p_error;
+		}
+		if(cesa_ocf_cmd->digest_len) {
+			memcpy(crp->crp_mac, cesa_ocf_cmd->digest, cesa_ocf_cmd->digest_len);
+		}
+		kfree(cesa_ocf_cmd);
+		mv_trace(MV_TRACE_CESA, MV_TRACE_CESA_DONE, (u32)crp, crp->crp_etype);
+		crypto_done(crp);
+		return 0;
+	}
+
 	/* action not allowed */
 	if(status == MV_NOT_ALLOWED) {
 #ifdef CESA_OCF_SPLIT
@@ -778,9 +952,9 @@ cesa_callback(unsigned long dummy)
 		cesa_ocf_cmd = result[i].pReqPrv;
 		crp = cesa_ocf_cmd->crp; 
 
-		// ignore HMAC error.
-		//if(result->retCode)
-		//	crp->crp_etype = EIO;	
+		/* HMAC errors only matter to those who asked for the check */
+		if(result[i].retCode && cesa_ocf_cmd->verify)
+			crp->crp_etype = EBADMSG;
 
 		if(cesa_block && cesa_ocf_cmd->need_cb) {	
 			crypto_unblock(cesa_ocf_id, CRYPTO_SYMQ);
@@ -792,6 +966,15 @@ cesa_callback(unsigned long dummy)
 			cesa_interrupt_polling();
 		}	
 #endif
+		if(cesa_ocf_cmd->batch) {
+			/* only the last action of a batch completes the request */
+			if(!atomic_dec_and_test(&cesa_ocf_cmd->batch->left))
+				continue;
+			mv_trace(MV_TRACE_CESA, MV_TRACE_CESA_DONE, (u32)crp, crp->crp_etype);
+			kfree(cesa_ocf_cmd->batch);
+			crypto_done(crp);
+			continue;
+		}
 		if(cesa_ocf_cmd->need_cb) {
 			if(cesa_ocf_cmd->digest_len) {
 				memcpy(crp->crp_mac ,cesa_ocf_cmd->digest, cesa_ocf_cmd->digest_len);
@@ -799,6 +982,7 @@ cesa_callback(unsigned long dummy)
 			if(debug) {
 				mvCesaDebugMbuf("DST BUFFER", cesa_ocf_cmd->cesa_cmd.pDst, 0, cesa_ocf_cmd->cesa_cmd.pDst->mbufSize);
 			}
+			mv_trace(MV_TRACE_CESA, MV_TRACE_CESA_DONE, (u32)crp, crp->crp_etype);
 			crypto_done(crp);
 		}
 		kfree(cesa_ocf_cmd);
@@ -1155,6 +1339,71 @@ cesa_ocf_freesession(void *arg, u_int64_t tid)
 }
 
 
+/*
+ * /proc/cesa: SRAM key cache counters, then the cache use of every open
+ * HAL session.  "pin <sid>" and "unpin <sid>" keep a session's keys in
+ * SRAM, or let them be replaced again.
+ */
+static int
+cesa_proc_read(char *page, char **start, off_t off, int count, int *eof,
+		void *data)
+{
+	int len, sid;
+
+	len = sprintf(page, "cacheSA %d pinned %d hits %u misses %u evicts %u\n",
+		      cesaCacheSaNum, cesaCachePinned, cesaStats.cacheHitCount,
+		      cesaStats.cacheMissCount, cesaStats.cacheEvictCount);
+	for (sid = 0; sid < cesaMaxSA && len < PAGE_SIZE - 80; sid++) {
+		MV_CESA_SA *pSA = &pCesaSAD[sid];
+
+		if (!pSA->valid)
+			continue;
+		len += sprintf(page + len, "sid %3d req %u hits %u loads %u%s\n",
+			       sid, pSA->count, pSA->cacheHits, pSA->cacheLoads,
+			       pSA->pinned ? " pinned" : "");
+	}
+	*eof = 1;
+	return len;
+}
+
+static int
+cesa_proc_write(struct file *file, const char __user *buffer,
+		unsigned long count, void *data)
+{
+	char str[16], *p;
+	unsigned long flags;
+	MV_BOOL pin;
+	MV_STATUS status;
+	int sid;
+
+	if (count >= sizeof(str))
+		return -EINVAL;
+	if (copy_from_user(str, buffer, count))
+		return -EFAULT;
+	str[count] = '\0';
+
+	if (strncmp(str, "pin ", 4) == 0) {
+		pin = MV_TRUE;
+		p = str + 4;
+	} else if (strncmp(str, "unpin ", 6) == 0) {
+		pin = MV_FALSE;
+		p = str + 6;
+	} else
+		return -EINVAL;
+	sid = simple_strtoul(p, NULL, 0);
+
+	/* the cache is replaced from the interrupt too */
+	local_irq_save(flags);
+	status = mvCesaSessionPin(sid, pin);
+	local_irq_restore(flags);
+
+	if (status == MV_FULL)
+		return -ENOSPC;
+	if (status != MV_OK)
+		return -EINVAL;
+	return count;
+}
+
 /*
  * our driver startup and shutdown routines
  */
@@ -1193,6 +1442,12 @@ cesa_ocf_init(void)
 
 	memset(cesa_ocf_sessions, 0, sizeof(struct cesa_ocf_data *) * CESA_OCF_MAX_SES);
 
+	cesa_proc = create_proc_entry("cesa", S_IFREG | S_IRUGO | S_IWUSR, NULL);
+	if (cesa_proc) {
+		cesa_proc->read_proc = cesa_proc_read;
+		cesa_proc->write_proc = cesa_proc_write;
+	}
+
 	crypto_register(cesa_ocf_id, CRYPTO_AES_CBC, 0, 0, cesa_ocf_newsession, cesa_ocf_freesession, cesa_ocf_process, NULL);
 #define	REGISTER(alg) \
 	crypto_register(cesa_ocf_id, alg, 0,0,NULL,NULL,NULL,NULL)
@@ -1215,6 +1470,9 @@ cesa_ocf_exit(void)
 	crypto_unregister_all(cesa_ocf_id);
 	cesa_ocf_id = -1;
 
+	if (cesa_proc)
+		remove_proc_entry("cesa", NULL);
+
 	free_irq(CESA_IRQ, NULL);
 	
 	/* mask and clear Int */
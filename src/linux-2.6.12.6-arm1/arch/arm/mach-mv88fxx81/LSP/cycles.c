@@ -0,0 +1,87 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * The free running cycle counter, see asm/arch/cycles.h, and the
+ * sched_clock() built on it.
+ */
+#include <linux/config.h>
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/time.h>
+#include <asm/system.h>
+#include <asm/div64.h>
+#include <asm/arch/cycles.h>
+
+#include "mvCntmr.h"
+
+extern u32 mvTclk;
+
+u32 mv_cycles_ns_mult;
+u32 mv_cycles_us_mult;
+EXPORT_SYMBOL(mv_cycles_ns_mult);
+EXPORT_SYMBOL(mv_cycles_us_mult);
+
+static u32 mv_cycles_last;
+static u32 mv_cycles_wraps;
+
+/*
+ * The high half counts the wraps seen.  The tick calls this, so a wrap
+ * is never missed as long as ticks are not held off for 2^32 cycles.
+ */
+unsigned long long mv_cycles64(void)
+{
+	unsigned long flags;
+	u32 now, wraps;
+
+	local_irq_save(flags);
+	now = mv_cycles();
+	if (now < mv_cycles_last)
+		mv_cycles_wraps++;
+	mv_cycles_last = now;
+	wraps = mv_cycles_wraps;
+	local_irq_restore(flags);
+
+	return (unsigned long long)wraps << 32 | now;
+}
+EXPORT_SYMBOL(mv_cycles64);
+
+/* nanoseconds since mv_cycles_init(), 0 before it */
+unsigned long long sched_clock(void)
+{
+	return mv_cycles_to_ns(mv_cycles64());
+}
+
+void __init mv_cycles_init(void)
+{
+	u64 mult;
+
+	mult = (u64)NSEC_PER_SEC << MV_CYCLES_NS_SHIFT;
+	do_div(mult, mvTclk);
+	mv_cycles_ns_mult = mult;
+
+	mult = (u64)USEC_PER_SEC << 32;
+	do_div(mult, mvTclk);
+	mv_cycles_us_mult = mult;
+
+	mvCntmrFreeRunStart();
+	mv_cycles_last = mv_cycles();
+
+	printk(KERN_INFO "mv88fxx81: %u.%03u MHz cycle counter\n",
+	       mvTclk / 1000000, mvTclk / 1000 % 1000);
+}
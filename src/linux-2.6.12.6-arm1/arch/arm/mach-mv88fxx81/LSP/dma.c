@@ -21,9 +21,16 @@
 #include <linux/slab.h>
 #include <linux/string.h>
 #include <linux/sysdev.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include <linux/hardirq.h>
+#include <linux/time.h>
 #include <asm/mach/time.h>
 #include <asm/uaccess.h>
+#include <asm/semaphore.h>
+#include <asm/system.h>
 #include <linux/proc_fs.h>
+#include <asm/arch/mvtrace.h>
 
 #include "mvIdma.h"
 
@@ -193,6 +200,7 @@ unsigned int wait_for_idma(MV_U32   channel)
                     return 1;
                 }		
 	}
+	mv_trace(MV_TRACE_IDMA, MV_TRACE_IDMA_END, channel, timeout);
 	DPRINTK("IDMA complete in %x cause %x \n", timeout, temp);
 
 
@@ -231,9 +239,188 @@ unsigned int wait_for_idma(MV_U32   channel)
 
 }
 
+/*
+ * CPU or IDMA.  Index 0 of the arrays below is copy_from_user, index 1
+ * copy_to_user (the to_user argument of dma_copy()).
+ *
+ * Copies larger than dma_threshold[] bytes go to the IDMA engine.  The
+ * thresholds come from timing both paths over a range of sizes, at boot
+ * and again whenever the D-cache configuration changes, or on
+ * "echo calibrate > /proc/dma_copy".  The IDMA is used from the smallest
+ * size above which it won at every size measured.
+ */
+#define DMA_CAL_SIZES		9		/* 256 bytes .. 64K */
+#define DMA_CAL_MIN		256
+#define DMA_CAL_MAX		(DMA_CAL_MIN << (DMA_CAL_SIZES - 1))
+#define DMA_CAL_BYTES		(128 * 1024)	/* copied per measurement */
+#define DMA_THRESHOLD_NEVER	(~0UL)
+
+static unsigned long dma_threshold[2] = { 1260, 1260 };
+
+static struct {
+	unsigned long cpu[2], dma[2];
+	unsigned long long cpu_bytes[2], dma_bytes[2];
+	unsigned long calibrations;
+	unsigned long last_calibration;		/* jiffies */
+	unsigned long mbs[2][2][DMA_CAL_SIZES];	/* [to_user][idma][size] */
+} dma_stats;
+
+static int dma_ready;
+static int dma_cal_pending;
+static u32 dma_cal_cache_state;
+static DECLARE_MUTEX(dma_cal_sem);
+
+/* D-cache and write buffer enables, and the write-allocate bit */
+static inline u32 dma_cache_state(void)
+{
+	u32 extra;
+
+	asm volatile("mrc p15, 0, %0, c14, c0, 0" : "=r" (extra));
+	return (get_cr() & (CR_C | CR_W)) | (extra & (1 << 28));
+}
+
+/*
+ * What dma_copy() does to pin and release a real user buffer, done to
+ * the vmalloc one: allocate the page array, look up and take a
+ * reference to every page under mmap_sem, and drop them again.
+ */
+static void dma_cal_pin(unsigned long uaddr, unsigned long n)
+{
+	int nr_pages = ((uaddr & ~PAGE_MASK) + n + ~PAGE_MASK) >> PAGE_SHIFT;
+	struct page **pages;
+	int i;
+
+	pages = kmalloc(nr_pages * sizeof(*pages), GFP_KERNEL);
+	if (!pages)
+		return;
+	down_read(&init_mm.mmap_sem);
+	for (i = 0; i < nr_pages; i++) {
+		pages[i] = vmalloc_to_page((void *)((uaddr & PAGE_MASK) +
+						    (i << PAGE_SHIFT)));
+		get_page(pages[i]);
+	}
+	up_read(&init_mm.mmap_sem);
+	for (i = 0; i < nr_pages; i++)
+		page_cache_release(pages[i]);
+	kfree(pages);
+}
+
+/* MB/s of @size byte copies by the CPU or by dma_copy() */
+static unsigned long dma_cal_time(void *to, void *from, unsigned long size,
+				  int to_user, int idma)
+{
+	unsigned long loops = DMA_CAL_BYTES / size, i, usecs;
+	struct timeval start, end;
+
+	do_gettimeofday(&start);
+	for (i = 0; i < loops; i++) {
+		if (idma) {
+			dma_cal_pin((unsigned long)(to_user ? to : from), size);
+			dma_copy(to, from, size, to_user);
+		} else if (to_user)
+			__cpu_copy_to_user(to, from, size);
+		else
+			__cpu_copy_from_user(to, from, size);
+	}
+	do_gettimeofday(&end);
+
+	usecs = (end.tv_sec - start.tv_sec) * USEC_PER_SEC +
+		end.tv_usec - start.tv_usec;
+	return loops * size / (usecs ? usecs : 1);
+}
+
+/*
+ * A vmalloc buffer stands in for the user one: like pinned user pages it
+ * is not physically contiguous, so dma_copy() moves it a page at a time.
+ * dma_copy() does not pin kernel pages, so each timed IDMA copy goes
+ * through dma_cal_pin() as well, to pay what a user copy pays.
+ */
+static void dma_calibrate(void)
+{
+	unsigned long kbuf, threshold;
+	void *ubuf;
+	mm_segment_t old_fs;
+	int to_user, i;
+
+	down(&dma_cal_sem);
+	kbuf = __get_free_pages(GFP_KERNEL, get_order(DMA_CAL_MAX));
+	ubuf = vmalloc(DMA_CAL_MAX);
+	if (!kbuf || !ubuf) {
+		printk(KERN_WARNING "dma_copy: no memory for calibration\n");
+		goto out;
+	}
+	memset((void *)kbuf, 0x5a, DMA_CAL_MAX);
+	memset(ubuf, 0xa5, DMA_CAL_MAX);
+
+	dma_cal_cache_state = dma_cache_state();
+	old_fs = get_fs();
+	set_fs(KERNEL_DS);
+	for (to_user = 0; to_user < 2; to_user++) {
+		void *to = to_user ? ubuf : (void *)kbuf;
+		void *from = to_user ? (void *)kbuf : ubuf;
+
+		for (i = 0; i < DMA_CAL_SIZES; i++) {
+			dma_stats.mbs[to_user][0][i] =
+				dma_cal_time(to, from, DMA_CAL_MIN << i, to_user, 0);
+			dma_stats.mbs[to_user][1][i] =
+				dma_cal_time(to, from, DMA_CAL_MIN << i, to_user, 1);
+			cond_resched();
+		}
+
+		threshold = DMA_THRESHOLD_NEVER;
+		for (i = DMA_CAL_SIZES - 1; i >= 0; i--) {
+			if (dma_stats.mbs[to_user][1][i] <=
+			    dma_stats.mbs[to_user][0][i])
+				break;
+			threshold = (DMA_CAL_MIN << i) - 1;
+		}
+		dma_threshold[to_user] = threshold;
+	}
+	set_fs(old_fs);
+
+	dma_stats.calibrations++;
+	dma_stats.last_calibration = jiffies;
+	printk(KERN_INFO "dma_copy: IDMA used above %ld bytes to user, "
+	       "%ld bytes from user (-1: never)\n",
+	       (long)dma_threshold[1], (long)dma_threshold[0]);
+out:
+	if (ubuf)
+		vfree(ubuf);
+	if (kbuf)
+		free_pages(kbuf, get_order(DMA_CAL_MAX));
+	up(&dma_cal_sem);
+}
+
+static void dma_calibrate_work(void *data)
+{
+	dma_calibrate();
+	dma_cal_pending = 0;
+}
+
+static DECLARE_WORK(dma_cal_work, dma_calibrate_work, NULL);
+
+/* account for and decide one copy larger than IDMA_MIN_COPY */
+static inline int dma_use_idma(unsigned long n, int to_user)
+{
+	if (dma_ready && !dma_cal_pending &&
+	    unlikely(dma_cache_state() != dma_cal_cache_state)) {
+		dma_cal_pending = 1;
+		schedule_work(&dma_cal_work);
+	}
+
+	/* dma_copy() pins user pages, which may sleep */
+	if (!dma_ready || n <= dma_threshold[to_user] ||
+	    in_atomic() || irqs_disabled()) {
+		dma_stats.cpu[to_user]++;
+		dma_stats.cpu_bytes[to_user] += n;
+		return 0;
+	}
+	dma_stats.dma[to_user]++;
+	dma_stats.dma_bytes[to_user] += n;
+	return 1;
+}
+
 static struct proc_dir_entry *dma_proc_entry;
-static int dma_to_user = 0;
-static int dma_from_user = 0;
 #ifdef RT_DEBUG
 static int dma_activations = 0;
 #endif
@@ -242,17 +429,61 @@ static int dma_read_proc(char *, char **, off_t, int, int *, void *);
 static int dma_read_proc(char *buf, char **start, off_t offset, int len,
 						 int *eof, void *data)
 {
+	static const char *dir[2] = { "from", "to" };
+	int to_user, i;
+
 	len = 0;
 
-	len += sprintf(buf + len, "Number of DMA copy to user %d copy from user %d \n", dma_to_user, dma_from_user);
+	len += sprintf(buf + len, "Number of DMA copy to user %lu copy from user %lu \n", dma_stats.dma[1], dma_stats.dma[0]);
 #ifdef RT_DEBUG
 	len += sprintf(buf + len, "Number of dma activations %d\n", dma_activations);
 	len += sprintf(buf + len, "Number of wait for dma loops %d\n", dma_wait_loops);
 #endif
-        
+
+	len += sprintf(buf + len, "Copies over %d bytes:\n", IDMA_MIN_COPY);
+	for (to_user = 1; to_user >= 0; to_user--) {
+		len += sprintf(buf + len, "  %-4s user: cpu %lu (%llu bytes) "
+			       "idma %lu (%llu bytes), idma ", dir[to_user],
+			       dma_stats.cpu[to_user], dma_stats.cpu_bytes[to_user],
+			       dma_stats.dma[to_user], dma_stats.dma_bytes[to_user]);
+		if (dma_threshold[to_user] == DMA_THRESHOLD_NEVER)
+			len += sprintf(buf + len, "never\n");
+		else
+			len += sprintf(buf + len, "above %lu bytes\n",
+				       dma_threshold[to_user]);
+	}
+
+	len += sprintf(buf + len, "Calibrated %lu times, last %lu s ago%s\n",
+		       dma_stats.calibrations,
+		       (jiffies - dma_stats.last_calibration) / HZ,
+		       dma_cal_pending ? ", pending" : "");
+	len += sprintf(buf + len, "  %6s  %-17s %-17s\n", "size",
+		       "to user MB/s", "from user MB/s");
+	for (i = 0; i < DMA_CAL_SIZES; i++)
+		len += sprintf(buf + len, "  %6d  cpu %4lu idma %4lu  "
+			       "cpu %4lu idma %4lu\n", DMA_CAL_MIN << i,
+			       dma_stats.mbs[1][0][i], dma_stats.mbs[1][1][i],
+			       dma_stats.mbs[0][0][i], dma_stats.mbs[0][1][i]);
+
 	return len;
 }
 
+static int dma_write_proc(struct file *file, const char __user *buffer,
+			  unsigned long count, void *data)
+{
+	char cmd[16];
+	unsigned long len = min(count, (unsigned long)sizeof(cmd) - 1);
+
+	if (copy_from_user(cmd, buffer, len))
+		return -EFAULT;
+	cmd[len] = 0;
+
+	if (strncmp(cmd, "calibrate", 9))
+		return -EINVAL;
+	dma_calibrate();
+	return count;
+}
+
 #if 0
 
 /*=======================================================================*/
@@ -304,9 +535,10 @@ void * dma_memcpy(void *to, const void *from, __kernel_size_t n)
 /*=======================================================================*/
 unsigned long dma_copy_to_user(void *to, const void *from, unsigned long n)
 {
-    dma_to_user++;
     DPRINTK(KERN_CRIT "dma_copy_to_user(%#10x, 0x%#10x, %lu): entering\n", (u32) to, (u32) from, n);
-    
+
+        if (!dma_use_idma(n, 1))
+                return __cpu_copy_to_user(to, from, n);
         return  dma_copy(to, from, n, 1);
 }
 
@@ -332,8 +564,9 @@ unsigned long dma_copy_to_user(void *to, const void *from, unsigned long n)
 /*=======================================================================*/
 unsigned long dma_copy_from_user(void *to, const void *from, unsigned long n)
 {
-	dma_from_user++;
 	DPRINTK(KERN_CRIT "dma_copy_from_user(0x%x, 0x%x, %lu): entering\n", (u32) to, (u32) from, n);
+	if (!dma_use_idma(n, 0))
+		return __cpu_copy_from_user(to, from, n);
 	return  dma_copy(to, from, n, 0);
 }
 
@@ -378,9 +611,9 @@ static unsigned long dma_copy(void *to, const void *from, unsigned long n, unsig
 		DPRINTK("Fixing up starting address %d bytes\n", 32 - unaligned_to);
 
 		if(to_user)
-			__arch_copy_to_user(to, from, 32 - unaligned_to);
+			__cpu_copy_to_user(to, from, 32 - unaligned_to);
 		else
-			__arch_copy_from_user(to, from, 32 - unaligned_to);
+			__cpu_copy_from_user(to, from, 32 - unaligned_to);
 
 		temp = (u32)to + (32 - unaligned_to);
 		to = (void *)temp;
@@ -404,9 +637,9 @@ static unsigned long dma_copy(void *to, const void *from, unsigned long n, unsig
 		DPRINTK("Fixing ending alignment %d bytes\n", unaligned_to);
 
 		if(to_user)
-			__arch_copy_to_user((void *)tmp_to, (void *)tmp_from, unaligned_to);
+			__cpu_copy_to_user((void *)tmp_to, (void *)tmp_from, unaligned_to);
 		else
-			__arch_copy_from_user((void *)tmp_to, (void *)tmp_from, unaligned_to);
+			__cpu_copy_from_user((void *)tmp_to, (void *)tmp_from, unaligned_to);
 
                 /*it's ok, n supposed to be greater than 32 bytes at this point*/
 		n -= unaligned_to;
@@ -527,9 +760,9 @@ static unsigned long dma_copy(void *to, const void *from, unsigned long n, unsig
             {
         	DPRINTK(" chunk %d too small , use memcpy \n",chunk);
         	if(to_user)
-	       	    __arch_copy_to_user((void *)to, (void *)from, chunk);
+	       	    __cpu_copy_to_user((void *)to, (void *)from, chunk);
 	        else
-		    __arch_copy_from_user((void *)to, (void *)from, chunk);
+		    __cpu_copy_from_user((void *)to, (void *)from, chunk);
             }
             else
             {
@@ -574,6 +807,7 @@ static unsigned long dma_copy(void *to, const void *from, unsigned long n, unsig
 		    /* Start DMA */
                     DPRINTK(" activate DMA: channel %d from %x to %x len %x\n",
                             current_dma_channel, phys_from, phys_to, chunk);
+		    mv_trace(MV_TRACE_IDMA, MV_TRACE_IDMA_START, current_dma_channel, chunk);
 		    mvDmaTransfer(current_dma_channel, phys_from, phys_to, chunk, 0);
                     current_dma_channel = NEXT_CHANNEL(current_dma_channel); 
 #ifdef RT_DEBUG
@@ -631,9 +865,9 @@ error:
         if(n != 0)
         {
        	    if(to_user)
-                return __arch_copy_to_user((void *)to, (void *)from, n);
+                return __cpu_copy_to_user((void *)to, (void *)from, n);
 	            else
-                return __arch_copy_from_user((void *)to, (void *)from, n);
+                return __cpu_copy_from_user((void *)to, (void *)from, n);
         }
         return 0;
 }
@@ -655,9 +889,13 @@ int mv_dma_init(void)
         MV_REG_WRITE(IDMA_CTRL_LOW_REG(CPY_CHAN2), CPY_IDMA_CTRL_LOW_VALUE);
 
         current_dma_channel = CPY_CHAN1;
-	dma_proc_entry = create_proc_entry("dma_copy", S_IFREG | S_IRUGO, 0);
+
+	dma_calibrate();
+	dma_ready = 1;
+
+	dma_proc_entry = create_proc_entry("dma_copy", S_IFREG | S_IRUGO | S_IWUSR, 0);
 	dma_proc_entry->read_proc = dma_read_proc;
-	dma_proc_entry->write_proc = NULL;
+	dma_proc_entry->write_proc = dma_write_proc;
 	dma_proc_entry->nlink = 1;
 
 	printk(KERN_INFO "Done. \n");
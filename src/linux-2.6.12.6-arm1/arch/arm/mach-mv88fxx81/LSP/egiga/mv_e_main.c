@@ -34,6 +34,7 @@ disclaimer.
 #include <linux/pci.h>
 #include <linux/ip.h>
 #include <linux/in.h>
+#include <asm/arch/mvtrace.h>
 
 #include "mvOs.h"
 #include "mvSysHwConfig.h"
@@ -172,6 +173,8 @@ static int egiga_qd_load( int port, char *mac_addr, int mtu, int irq );
 #else
  #define RX_BUFFER_SIZE(MTU, PRIV) (MTU + WRAP)
 #endif
+/* 32(extra for cache prefetch) + 8(to align on 8B) */
+#define RX_SKB_SIZE(MTU, PRIV) (RX_BUFFER_SIZE(MTU, PRIV) + 32 + 8)
 
 int egigaDescRxQ[MV_ETH_RX_Q_NUM] =
 {
@@ -309,6 +312,7 @@ typedef struct _egiga_priv
 #endif
     struct timer_list rx_fill_timer;
     unsigned rx_fill_flag;
+    struct skb_recycle_pool *skb_pool;	/* rx buffers back from the stack */
     u32 rx_coal;
     u32 tx_coal;
     u32 rxcause;
@@ -342,6 +346,7 @@ static int egiga_start_internals( struct net_device *dev );
 static int egiga_stop( struct net_device *dev );
 static int egiga_close( struct net_device *dev );
 static int egiga_stop_internals( struct net_device *dev );
+static void egiga_destroy_skb_pool( struct net_device *dev );
 static int egiga_down_internals( struct net_device *dev );
 static int egiga_tx( struct sk_buff *skb, struct net_device *dev );
 static u32 egiga_tx_done( struct net_device *dev );
@@ -1363,9 +1368,15 @@ static int egiga_start( struct net_device *dev )
 static int egiga_start_internals( struct net_device *dev )
 {
     unsigned int status;
-    unsigned int queue;
+    unsigned int queue, rx_desc = 0;
 
     egiga_priv *priv = dev->priv;
+
+    /* rx buffers freed by the stack come back here instead of slab */
+    for(queue = 0; queue < MV_ETH_RX_Q_NUM; queue++)
+	rx_desc += EGIGA_Q_DESC(queue);
+    if( priv->skb_pool == NULL )
+	priv->skb_pool = skb_recycle_pool_create( dev, RX_SKB_SIZE( dev->mtu, priv), rx_desc, GFP_ATOMIC );
  
     /* fill rx ring with buffers */
     for(queue = 0; queue < MV_ETH_RX_Q_NUM; queue++) {
@@ -1449,6 +1460,11 @@ static int egiga_close( struct net_device *dev )
         hwState = HW_INIT;
 #endif		
     }
+
+#ifdef CONFIG_QUARTER_DECK
+    if(active_ifs == 0)
+#endif
+    egiga_destroy_skb_pool( dev );
     
     return 0;
 
@@ -1505,6 +1521,11 @@ static int egiga_stop( struct net_device *dev )
 #endif		
     }
 
+#ifdef CONFIG_QUARTER_DECK
+    if(active_ifs == 0)
+#endif
+    egiga_destroy_skb_pool( dev );
+
     return 0;
 }
 
@@ -1617,6 +1638,26 @@ static int egiga_stop_internals( struct net_device *dev )
     return -1;
 }
 
+/***********************************************************
+ * egiga_destroy_skb_pool --                               *
+ *   drop the rx recycle pool once the port is quiet.      *
+ *   called after egiga_stop_internals(), not under lock.  *
+ ***********************************************************/
+static void egiga_destroy_skb_pool( struct net_device *dev )
+{
+    egiga_priv *priv = dev->priv;
+
+    /* a pending rx fill would allocate from the pool */
+    del_timer_sync( &priv->rx_fill_timer );
+    priv->rx_fill_flag = 0;
+
+    /* the skb's still out there go to slab when freed */
+    if( priv->skb_pool ) {
+	skb_recycle_pool_destroy( priv->skb_pool );
+	priv->skb_pool = NULL;
+    }
+}
+
 
 /*********************************************************** 
  * egiga_tx --                                             *
@@ -1780,6 +1821,7 @@ static int egiga_tx( struct sk_buff *skb , struct net_device *dev )
 
     /* check status */
     if( status == MV_OK ) {
+        mv_trace( MV_TRACE_NET, MV_TRACE_NET_TX_KICK, priv->port, skb->len );
         stats->tx_bytes += skb->len;
         stats->tx_packets ++;
         dev->trans_start = jiffies;
@@ -1974,6 +2016,9 @@ static int egiga_poll( struct net_device *dev, int *budget )
     *budget -= rx_work_done;
     dev->quota -= rx_work_done;
 
+    mv_trace( MV_TRACE_NET, MV_TRACE_NET_RX_POLL, priv->port,
+              (rx_work_done << 16) | tx_work_done );
+
     EGIGA_DBG( EGIGA_DBG_INT, ("poll work done: tx-%d rx-%d\n",tx_work_done,rx_work_done) );
 
     if( ((tx_work_done==0) && (rx_work_done==0)) || (!netif_running(dev)) ) {
@@ -2228,9 +2273,13 @@ static u32 egiga_rx_fill( struct net_device *dev, unsigned int queue, int total
     while( total-- ) {
 
         /* allocate a buffer */
-	buf_size = RX_BUFFER_SIZE( dev->mtu, priv) + 32 /* 32(extra for cache prefetch) */ + 8 /* +8 to align on 8B */;
+	buf_size = RX_SKB_SIZE( dev->mtu, priv);
 
-        skb = dev_alloc_skb( buf_size ); 
+	/* the pool is set up for the mtu and header size at start */
+	if( priv->skb_pool && priv->skb_pool->size == buf_size )
+	    skb = skb_recycle_alloc( priv->skb_pool );
+	else
+            skb = dev_alloc_skb( buf_size ); 
 	if( !skb ) {
 	    EGIGA_DBG( EGIGA_DBG_RX_FILL, ("%s: rx_fill cannot allocate skb\n", dev->name) );
 	    EGIGA_STAT( EGIGA_STAT_RX_FILL, (priv->egiga_stat.rx_fill_alloc_skb_fail[queue]++) );
@@ -87,6 +87,7 @@ disclaimer.
 #include <asm/dma.h>
 #include <asm/system.h>
 #include <asm/io.h>
+#include <asm/arch/mvtrace.h>
 
 #include "mvLinuxIalHt.h"
 #include "mvRegs.h"
@@ -529,6 +530,7 @@ static int __devinit  mv_ial_probe_device(struct pci_dev *pcidev,
                              pMvSataAdapter);
     /* let SAL report only the BUS RESET UA event*/
     pAdapter->ataScsiAdapterExt->UAMask = MV_BIT0;
+    mv_ial_lib_poll_init(pAdapter);
     /* enable device interrupts even if no storage devices connected now*/
     if (request_irq(pcidev->irq, mv_ial_lib_int_handler,
                     (SA_INTERRUPT | SA_SAMPLE_RANDOM | SA_SHIRQ), "mvSata",
@@ -580,6 +582,7 @@ static int __devinit  mv_ial_probe_device(struct pci_dev *pcidev,
         mvLogMsg(MV_IAL_LOG_ID, MV_DEBUG_ERROR, "[%d]: mvAdapterStartInitialization"
                  " Failed\n", pMvSataAdapter->adapterId);
         free_irq (pcidev->irq, pMvSataAdapter);
+        tasklet_kill(&pAdapter->pollTasklet);
         kfree(pAdapter->ataScsiAdapterExt);
         iounmap(pMvSataAdapter->adapterIoBaseAddress);
         mv_ial_lib_free_edma_queues(pAdapter);
@@ -604,6 +607,7 @@ static int __devinit  mv_ial_probe_device(struct pci_dev *pcidev,
             mvLogMsg(MV_IAL_LOG_ID, MV_DEBUG_ERROR, "[%d]: scsi_add_host() failed.\n"
                      , pMvSataAdapter->adapterId);
             free_irq (pcidev->irq, pMvSataAdapter);
+            tasklet_kill(&pAdapter->pollTasklet);
             kfree(pAdapter->ataScsiAdapterExt);
             iounmap(pMvSataAdapter->adapterIoBaseAddress);
             mv_ial_lib_free_edma_queues(pAdapter);
@@ -753,6 +757,7 @@ static int __devinit mv_ial_init_soc_sata(void)
                              pMvSataAdapter);
     /* let SAL report only the BUS RESET UA event*/
     pAdapter->ataScsiAdapterExt->UAMask = MV_BIT0;
+    mv_ial_lib_poll_init(pAdapter);
     /* enable device interrupts even if no storage devices connected now*/
     if (request_irq(SATA_IRQ_NUM, mv_ial_lib_int_handler,
                     (SA_INTERRUPT | SA_SAMPLE_RANDOM | SA_SHIRQ), "mvSata",
@@ -787,6 +792,7 @@ static int __devinit mv_ial_init_soc_sata(void)
         mvLogMsg(MV_IAL_LOG_ID, MV_DEBUG_ERROR, "[%d]: mvAdapterStartInitialization"
                  " Failed\n", pMvSataAdapter->adapterId);
         free_irq (SATA_IRQ_NUM, pMvSataAdapter);
+        tasklet_kill(&pAdapter->pollTasklet);
         kfree(pAdapter->ataScsiAdapterExt);
         mv_ial_lib_free_edma_queues(pAdapter);
         mv_ial_free_scsi_hosts(pAdapter, MV_TRUE);
@@ -806,6 +812,7 @@ static int __devinit mv_ial_init_soc_sata(void)
             mvLogMsg(MV_IAL_LOG_ID, MV_DEBUG_ERROR, "[%d]: scsi_add_host() failed.\n"
                      , pMvSataAdapter->adapterId);
             free_irq (SATA_IRQ_NUM , pMvSataAdapter);
+            tasklet_kill(&pAdapter->pollTasklet);
             kfree(pAdapter->ataScsiAdapterExt);
             mv_ial_lib_free_edma_queues(pAdapter);
             mv_ial_free_scsi_hosts(pAdapter, MV_TRUE);
@@ -977,6 +984,7 @@ int mv_ial_ht_release (struct Scsi_Host *pHost)
         mvLogMsg(MV_IAL_LOG_ID, MV_DEBUG,
                      "[%d] freeing Adapter resources.\n", pAdapter->mvSataAdapter.adapterId);
         free_irq (pAdapter->pcidev->irq, pMvSataAdapter);
+        tasklet_kill(&pAdapter->pollTasklet);
         kfree(pAdapter->ataScsiAdapterExt);
         iounmap(pMvSataAdapter->adapterIoBaseAddress);
         mv_ial_lib_free_edma_queues(pAdapter);
@@ -1024,6 +1032,7 @@ static void __devexit mv_ial_remove_device(struct pci_dev *pdev)
     if (pdev != NULL) /* pci device */
     {
         free_irq (pAdapter->pcidev->irq, &pAdapter->mvSataAdapter);
+        tasklet_kill(&pAdapter->pollTasklet);
 	kfree(pAdapter->ataScsiAdapterExt);
 	iounmap(pAdapter->mvSataAdapter.adapterIoBaseAddress);
 	mv_ial_lib_free_edma_queues(pAdapter);
@@ -1034,6 +1043,7 @@ static void __devexit mv_ial_remove_device(struct pci_dev *pdev)
     else /* Soc sata*/
     {
         free_irq (SATA_IRQ_NUM, &pAdapter->mvSataAdapter);
+        tasklet_kill(&pAdapter->pollTasklet);
 	kfree(pAdapter->ataScsiAdapterExt);
 	mv_ial_lib_free_edma_queues(pAdapter);
 	kfree(pAdapter);
@@ -1174,6 +1184,8 @@ int mv_ial_ht_queuecommand (struct scsi_cmnd * SCpnt, void (*done) (struct scsi_
     completion_info->pSALBlock->ScsiCdb = SCpnt->cmnd;
     completion_info->pSALBlock->ScsiCdbLength = SCpnt->cmd_len;
     completion_info->pSALBlock->senseBufferLength = SCSI_SENSE_BUFFERSIZE;
+    mv_trace(MV_TRACE_SATA, MV_TRACE_SATA_QUEUE, (u32)SCpnt,
+             (channel << 24) | (SCpnt->request_bufflen & 0xffffff));
     if (*cmd != SCSI_OPCODE_MVSATA_SMART)
     {
         mvExecuteScsiCommand(completion_info->pSALBlock, MV_TRUE);
@@ -1365,6 +1377,21 @@ int mv_ial_ht_proc_info(struct Scsi_Host *pshost,
                          pMvSataAdapter->adapterId);
             }
         }
+        /* The format is 'poll_mode <0|1> [budget]' */
+        else if (!strncmp (buffer, "poll_mode", strlen ("poll_mode")))
+        {
+            int enable, budget = 0;
+            i = sscanf (buffer + strlen ("poll_mode"), "%d %d\n", &enable, &budget);
+            if ((i >= 1) && (budget >= 0))
+            {
+                mv_ial_lib_set_poll_mode (pAdapter, enable ? MV_TRUE : MV_FALSE, budget);
+            }
+            else
+            {
+                mvLogMsg(MV_IAL_LOG_ID, MV_DEBUG,"[%d]: Error in poll mode parameters\n",
+                         pMvSataAdapter->adapterId);
+            }
+        }
         spin_unlock_irqrestore (&pAdapter->adapter_lock, lock_flags);
         return length;
     }
@@ -1397,6 +1424,43 @@ int mv_ial_ht_proc_info(struct Scsi_Host *pshost,
         {
             goto out;
         }
+        /*
+         * Polled completions: every command reaped by a poll beyond the one
+         * interrupt that started the poll saved an interrupt.
+         */
+        len += snprintf (buffer + len,length - len, "\nPolled completions: %s, budget %d\n",
+                         pAdapter->pollMode == MV_TRUE ? "on" : "off",
+                         pAdapter->pollBudget);
+        if (len >= length)
+        {
+            goto out;
+        }
+        if (pAdapter->procNumOfPolls)
+        {
+            u32 saved = 0;
+
+            if (pAdapter->procNumOfPolledCmnds > pAdapter->procNumOfPollInterrupts)
+            {
+                saved = pAdapter->procNumOfPolledCmnds -
+                        pAdapter->procNumOfPollInterrupts;
+            }
+            len += snprintf (buffer + len,length - len,
+                             "interrupts %d, polls %d (%d empty, %d out of budget), passes %d\n"
+                             "commands %d, interrupts saved %d, commands per poll %d.%02d\n",
+                             pAdapter->procNumOfPollInterrupts,
+                             pAdapter->procNumOfPolls,
+                             pAdapter->procNumOfEmptyPolls,
+                             pAdapter->procNumOfPollBudgetOut,
+                             pAdapter->procNumOfPollPasses,
+                             pAdapter->procNumOfPolledCmnds, saved,
+                             pAdapter->procNumOfPolledCmnds / pAdapter->procNumOfPolls,
+                             (pAdapter->procNumOfPolledCmnds % pAdapter->procNumOfPolls) *
+                             100 / pAdapter->procNumOfPolls);
+            if (len >= length)
+            {
+                goto out;
+            }
+        }
         if (pAdapter->pcidev)
         {
             len += snprintf (buffer + len, length - len, "\nPCI location: Bus %d, Slot %d\n",
@@ -70,6 +70,7 @@ disclaimer.
 
 #include <linux/blkdev.h>
 #include <linux/spinlock.h>
+#include <linux/interrupt.h>
 /* Common forward declarations for all Linux-versions: */
 
 /* Interfaces to the midlevel Linux SCSI driver */
@@ -167,6 +168,16 @@ typedef struct IALAdapter
     u32                  requestQueueSize;
     u32                  responseQueueSize;
     u32                 procNumOfInterrupts;
+    /* polled completions, see mv_ial_lib_poll */
+    struct tasklet_struct pollTasklet;
+    MV_BOOLEAN          pollMode;
+    u32                 pollBudget;
+    u32                 procNumOfPollInterrupts;
+    u32                 procNumOfPolls;
+    u32                 procNumOfPollPasses;
+    u32                 procNumOfPolledCmnds;
+    u32                 procNumOfEmptyPolls;
+    u32                 procNumOfPollBudgetOut;
     MV_IAL_COMMON_ADAPTER_EXTENSION ialCommonExt;
     MV_BOOLEAN          stopAsyncTimer;
     struct timer_list   asyncStartTimer;
@@ -48,6 +48,7 @@ disclaimer.
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,0)
     #include <linux/workqueue.h>
 #endif
+#include <asm/arch/mvtrace.h>
 
 #include "mvLinuxIalLib.h"
 #include "mvIALCommon.h"
@@ -56,6 +57,17 @@ disclaimer.
     #define scsi_to_pci_dma_dir(scsi_dir) ((int)(scsi_dir))
 #endif
 
+/*
+ * Polled completions (see mv_ial_lib_poll). Also set per adapter by
+ * writing 'poll_mode <0|1> [budget]' to /proc/scsi/mvSata/<host>.
+ */
+static int poll_mode = 0;
+static int poll_budget = MV_IAL_POLL_BUDGET_DEFAULT;
+module_param(poll_mode, int, 0);
+module_param(poll_budget, int, 0);
+MODULE_PARM_DESC(poll_mode, "reap SATA completions from a tasklet, interrupts masked");
+MODULE_PARM_DESC(poll_budget, "commands completed per poll");
+
 
 /* Connect / disconnect timers. */
 /* Note that the disconnect timer should be smaller than the SCSI */
@@ -73,6 +85,7 @@ struct rescan_wrapper
 
 
 static void *mv_ial_lib_prd_allocate(IAL_HOST_T *pHost);
+static int mv_ial_lib_complete_done (IAL_ADAPTER_T *pAdapter);
 
 static int mv_ial_lib_add_buffer_to_prd_table(MV_SATA_ADAPTER   *pMvSataAdapter,
                                               MV_SATA_EDMA_PRD_ENTRY *pPRD_table,
@@ -241,9 +254,13 @@ struct scsi_cmnd * mv_ial_lib_get_first_cmnd (struct IALAdapter *pAdapter, MV_U8
  *
  *  Parameters:     cmnd - First command in scsi commands chain
  *
+ *  Returns:        Number of commands completed.
+ *
  ******************************************************************************/
-void mv_ial_lib_do_done (struct scsi_cmnd *cmnd)
+int mv_ial_lib_do_done (struct scsi_cmnd *cmnd)
 {
+    int done = 0;
+
     /* Call done function for all commands in queue */
     while (cmnd)
     {
@@ -252,13 +269,17 @@ void mv_ial_lib_do_done (struct scsi_cmnd *cmnd)
 
         if (cmnd->scsi_done == NULL)
         {
-            return;
+            return done;
         }
         mvLogMsg(MV_IAL_LOG_ID, MV_DEBUG, "Calling done to command @ %p "
                  "scsi_done = %p\n",cmnd, cmnd->scsi_done);
+        mv_trace(MV_TRACE_SATA, MV_TRACE_SATA_COMPLETE, (u32)cmnd,
+                 cmnd->result);
         cmnd->scsi_done(cmnd);
         cmnd = temp;
+        done++;
     }
+    return done;
 }
 
 
@@ -385,7 +406,6 @@ irqreturn_t mv_ial_lib_int_handler (int irq, void *dev_id, struct pt_regs *regs)
     IAL_ADAPTER_T       *pAdapter;
     unsigned long       flags;
     int                 handled = 0;
-    struct scsi_cmnd *cmnds_done_list = NULL;
     pAdapter = (IAL_ADAPTER_T *)dev_id;
 
 /*
@@ -394,6 +414,20 @@ irqreturn_t mv_ial_lib_int_handler (int irq, void *dev_id, struct pt_regs *regs)
  */
     spin_lock_irqsave(&pAdapter->adapter_lock, flags);
 
+    if (pAdapter->pollMode == MV_TRUE)
+    {
+        /* mask the adapter, mv_ial_lib_poll does the rest */
+        if (mvSataCheckPendingInterrupt(&pAdapter->mvSataAdapter) == MV_TRUE)
+        {
+            handled = 1;
+            pAdapter->procNumOfInterrupts ++;
+            pAdapter->procNumOfPollInterrupts ++;
+            tasklet_schedule(&pAdapter->pollTasklet);
+        }
+        spin_unlock_irqrestore(&pAdapter->adapter_lock, flags);
+        return IRQ_RETVAL(handled);
+    }
+
     if (mvSataInterruptServiceRoutine(&pAdapter->mvSataAdapter) == MV_TRUE)
     {
         handled = 1;
@@ -405,30 +439,167 @@ irqreturn_t mv_ial_lib_int_handler (int irq, void *dev_id, struct pt_regs *regs)
     /* Check if there are commands in the done queue to be completed */
     if (handled == 1)
     {
-        MV_U8 i;
+        mv_ial_lib_complete_done(pAdapter);
+    }
+    return IRQ_RETVAL(handled);
+}
 
-        for (i = 0; i < pAdapter->maxHosts; i++)
+/****************************************************************
+ *  Name:   mv_ial_lib_complete_done
+ *
+ *  Description:    Complete the commands in the done queues of all
+ *                  the adapter's channels.
+ *
+ *  Parameters:     pAdapter - the adapter, its lock not held.
+ *
+ *  Returns:        Number of commands completed.
+ *
+ ****************************************************************/
+static int mv_ial_lib_complete_done (IAL_ADAPTER_T *pAdapter)
+{
+    struct scsi_cmnd *cmnds_done_list = NULL;
+    unsigned long flags;
+    int done = 0;
+    MV_U8 i;
+
+    for (i = 0; i < pAdapter->maxHosts; i++)
+    {
+        spin_lock_irqsave(&pAdapter->adapter_lock, flags);
+        cmnds_done_list = mv_ial_lib_get_first_cmnd(pAdapter, i);
+        spin_unlock_irqrestore(&pAdapter->adapter_lock, flags);
+        if (cmnds_done_list)
         {
-            spin_lock_irqsave(&pAdapter->adapter_lock, flags);
-            cmnds_done_list = mv_ial_lib_get_first_cmnd(pAdapter, i);
-            spin_unlock_irqrestore(&pAdapter->adapter_lock, flags);
-            if (cmnds_done_list)
-            {
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,0)
-                spin_lock_irqsave(&io_request_lock, flags);
+            spin_lock_irqsave(&io_request_lock, flags);
 #else
-                spin_lock_irqsave(pAdapter->host[i]->scsihost->host_lock, flags);
+            spin_lock_irqsave(pAdapter->host[i]->scsihost->host_lock, flags);
 #endif
-                mv_ial_lib_do_done(cmnds_done_list);
+            done += mv_ial_lib_do_done(cmnds_done_list);
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,0)
-                spin_unlock_irqrestore(&io_request_lock, flags);
+            spin_unlock_irqrestore(&io_request_lock, flags);
 #else
-                spin_unlock_irqrestore(pAdapter->host[i]->scsihost->host_lock, flags);
+            spin_unlock_irqrestore(pAdapter->host[i]->scsihost->host_lock, flags);
 #endif
-            }
         }
     }
-    return IRQ_RETVAL(handled);
+    return done;
+}
+
+/****************************************************************
+ *  Name:   mv_ial_lib_poll
+ *
+ *  Description:    Completion tasklet of the polled mode.
+ *
+ *                  The adapter runs the MV_SATA_INTERRUPT_HANDLING_IN_TASK
+ *                  scheme: the interrupt handler masks it, and every pass
+ *                  here services the pending events, which unmasks it
+ *                  again.  As long as events keep coming the adapter is
+ *                  masked again at once, under the lock so no interrupt
+ *                  gets in between, and served by the next pass.  When
+ *                  the budget is used up the adapter stays masked and the
+ *                  tasklet is rescheduled, so other softirqs get to run.
+ *
+ *  Parameters:     data - the adapter.
+ *
+ ****************************************************************/
+void mv_ial_lib_poll (unsigned long data)
+{
+    IAL_ADAPTER_T   *pAdapter = (IAL_ADAPTER_T *)data;
+    MV_SATA_ADAPTER *pMvSataAdapter = &pAdapter->mvSataAdapter;
+    unsigned long   flags;
+    u32             done = 0, passes = 0;
+
+    spin_lock_irqsave(&pAdapter->adapter_lock, flags);
+    pAdapter->procNumOfPolls ++;
+    while ((pAdapter->pollMode == MV_TRUE) &&
+           (mvSataCheckPendingInterrupt(pMvSataAdapter) == MV_TRUE))
+    {
+        if ((done >= pAdapter->pollBudget) || (passes >= pAdapter->pollBudget))
+        {
+            pAdapter->procNumOfPollBudgetOut ++;
+            tasklet_schedule(&pAdapter->pollTasklet);
+            break;
+        }
+        mvSataInterruptServiceRoutine(pMvSataAdapter);
+        mvSataScsiPostIntService(pAdapter->ataScsiAdapterExt);
+        passes ++;
+        spin_unlock_irqrestore(&pAdapter->adapter_lock, flags);
+
+        done += mv_ial_lib_complete_done(pAdapter);
+
+        spin_lock_irqsave(&pAdapter->adapter_lock, flags);
+    }
+    if (passes == 0)
+    {
+        pAdapter->procNumOfEmptyPolls ++;
+    }
+    pAdapter->procNumOfPollPasses += passes;
+    pAdapter->procNumOfPolledCmnds += done;
+    spin_unlock_irqrestore(&pAdapter->adapter_lock, flags);
+}
+
+/****************************************************************
+ *  Name:   mv_ial_lib_set_poll_mode
+ *
+ *  Description:    Switch an adapter between interrupt and polled
+ *                  completions.
+ *
+ *  Parameters:     pAdapter - the adapter, its lock held.
+ *                  enable - MV_TRUE for polled completions.
+ *                  budget - commands per poll, 0 leaves it as it is.
+ *
+ ****************************************************************/
+void mv_ial_lib_set_poll_mode (IAL_ADAPTER_T *pAdapter, MV_BOOLEAN enable,
+                               u32 budget)
+{
+    MV_SATA_ADAPTER *pMvSataAdapter = &pAdapter->mvSataAdapter;
+
+    if (budget)
+    {
+        pAdapter->pollBudget = budget;
+    }
+    if (enable == pAdapter->pollMode)
+    {
+        return;
+    }
+    pAdapter->pollMode = enable;
+    if (enable == MV_TRUE)
+    {
+        mvSataSetInterruptsScheme(pMvSataAdapter,
+                                  MV_SATA_INTERRUPT_HANDLING_IN_TASK);
+    }
+    else
+    {
+        mvSataSetInterruptsScheme(pMvSataAdapter,
+                                  MV_SATA_INTERRUPT_HANDLING_IN_ISR);
+        /* a poll may be pending with the adapter masked by the handler */
+        if (pMvSataAdapter->interruptsAreMasked == MV_FALSE)
+        {
+            mvSataUnmaskAdapterInterrupt(pMvSataAdapter);
+        }
+    }
+    mvLogMsg(MV_IAL_LOG_ID, MV_DEBUG, "[%d]: %s completions, budget %d\n",
+             pMvSataAdapter->adapterId, enable == MV_TRUE ? "polled" : "interrupt",
+             pAdapter->pollBudget);
+}
+
+/****************************************************************
+ *  Name:   mv_ial_lib_poll_init
+ *
+ *  Description:    Set up the polled mode of a new adapter, before
+ *                  its interrupt is requested.
+ *
+ *  Parameters:     pAdapter - the adapter.
+ *
+ ****************************************************************/
+void mv_ial_lib_poll_init (IAL_ADAPTER_T *pAdapter)
+{
+    tasklet_init(&pAdapter->pollTasklet, mv_ial_lib_poll,
+                 (unsigned long)pAdapter);
+    pAdapter->pollMode = MV_FALSE;
+    pAdapter->pollBudget = MV_IAL_POLL_BUDGET_DEFAULT;
+    mv_ial_lib_set_poll_mode(pAdapter, poll_mode ? MV_TRUE : MV_FALSE,
+                             poll_budget > 0 ? poll_budget : 0);
 }
 
 /****************************************************************
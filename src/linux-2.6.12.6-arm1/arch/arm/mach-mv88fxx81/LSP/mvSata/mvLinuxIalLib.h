@@ -79,6 +79,14 @@ int mv_ial_lib_generate_prd(MV_SATA_ADAPTER *pMvSataAdapter, struct scsi_cmnd *S
 /* Interrupt Service Routine*/
 irqreturn_t mv_ial_lib_int_handler (int irq, void *dev_id, struct pt_regs *regs);
 
+/* Polled completions */
+#define MV_IAL_POLL_BUDGET_DEFAULT          32
+
+void mv_ial_lib_poll (unsigned long data);
+void mv_ial_lib_poll_init (struct IALAdapter *pAdapter);
+void mv_ial_lib_set_poll_mode (struct IALAdapter *pAdapter, MV_BOOLEAN enable,
+                               u32 budget);
+
 
 /* Event Notification */
 MV_BOOLEAN mv_ial_lib_udma_command_completion_call_back(MV_SATA_ADAPTER *pMvSataAdapter,
@@ -101,7 +109,7 @@ void mv_ial_lib_add_done_queue (struct IALAdapter *pAdapter,
 struct scsi_cmnd * mv_ial_lib_get_first_cmnd (struct IALAdapter *pAdapter,
                                        MV_U8 channel);
 
-void mv_ial_lib_do_done (struct scsi_cmnd *cmnd);
+int mv_ial_lib_do_done (struct scsi_cmnd *cmnd);
 
 void mv_ial_block_requests(struct IALAdapter *pAdapter, MV_U8 channelIndex);
 
@@ -0,0 +1,221 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Hot path event rings, see asm/arch/mvtrace.h.
+ *
+ * A record costs an interrupt disable, a counter register read and a
+ * few stores; nothing is formatted or allocated on the hot path.  The
+ * rings overwrite their oldest records, so the last few thousand events
+ * of every subsystem are always there to be looked at.
+ *
+ *	/proc/mvtrace/{net,sata,cesa,idma}	binary snapshots
+ *	/proc/mvtrace/enable			subsystem mask, hex
+ */
+#include <linux/config.h>
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+#include <linux/fs.h>
+#include <linux/proc_fs.h>
+#include <asm/uaccess.h>
+#include <asm/system.h>
+#include <asm/arch/cycles.h>
+#include <asm/arch/mvtrace.h>
+
+#define TRACE_RECORDS		(1 << CONFIG_MV_TRACE_SHIFT)
+#define TRACE_MASK		(TRACE_RECORDS - 1)
+
+static const char *mv_trace_names[MV_TRACE_NR] = {
+	"net", "sata", "cesa", "idma"
+};
+
+extern u32 mvTclk;
+
+/* all subsystems are switched on by mv_trace_init() */
+unsigned long mv_trace_mask;
+EXPORT_SYMBOL(mv_trace_mask);
+
+static struct mv_trace_rec mv_trace_ring[MV_TRACE_NR][TRACE_RECORDS];
+static u32 mv_trace_head[MV_TRACE_NR];
+
+void __mv_trace(unsigned int subsys, unsigned int event, u32 arg0, u32 arg1)
+{
+	struct mv_trace_rec *rec;
+	unsigned long flags;
+	u32 head;
+
+	local_irq_save(flags);
+	head = mv_trace_head[subsys]++;
+	rec = &mv_trace_ring[subsys][head & TRACE_MASK];
+	rec->stamp = mv_cycles();
+	rec->seq = head;
+	rec->event = event;
+	rec->arg0 = arg0;
+	rec->arg1 = arg1;
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(__mv_trace);
+
+/*
+ * A snapshot is taken at open, with interrupts off so that the records
+ * and the head agree, and read() hands it out.
+ */
+struct mv_trace_snap {
+	size_t			size;
+	struct mv_trace_hdr	hdr;
+	struct mv_trace_rec	rec[0];
+};
+
+static int mv_trace_open(struct inode *inode, struct file *file)
+{
+	unsigned int subsys = (unsigned int)PDE(inode)->data;
+	struct mv_trace_snap *snap;
+	unsigned long flags;
+	u32 head, first, n;
+	u64 now;
+
+	snap = vmalloc(sizeof(*snap) + TRACE_RECORDS * sizeof(snap->rec[0]));
+	if (snap == NULL)
+		return -ENOMEM;
+
+	local_irq_save(flags);
+	head = mv_trace_head[subsys];
+	n = head < TRACE_RECORDS ? head : TRACE_RECORDS;
+	first = (head - n) & TRACE_MASK;
+	if (first + n > TRACE_RECORDS) {
+		u32 part = TRACE_RECORDS - first;
+
+		memcpy(snap->rec, &mv_trace_ring[subsys][first],
+		       part * sizeof(snap->rec[0]));
+		memcpy(snap->rec + part, mv_trace_ring[subsys],
+		       (n - part) * sizeof(snap->rec[0]));
+	} else {
+		memcpy(snap->rec, &mv_trace_ring[subsys][first],
+		       n * sizeof(snap->rec[0]));
+	}
+	now = mv_cycles64();
+	local_irq_restore(flags);
+
+	snap->hdr.magic = MV_TRACE_MAGIC;
+	snap->hdr.version = MV_TRACE_VERSION;
+	snap->hdr.subsys = subsys;
+	snap->hdr.tclk = mvTclk;
+	snap->hdr.now_hi = now >> 32;
+	snap->hdr.now_lo = now;
+	snap->hdr.head = head;
+	snap->hdr.nr = n;
+	snap->hdr.pad = 0;
+	snap->size = sizeof(snap->hdr) + n * sizeof(snap->rec[0]);
+
+	file->private_data = snap;
+	return 0;
+}
+
+static ssize_t mv_trace_read(struct file *file, char __user *buf,
+			     size_t count, loff_t *ppos)
+{
+	struct mv_trace_snap *snap = file->private_data;
+	loff_t pos = *ppos;
+
+	if (pos >= snap->size)
+		return 0;
+	if (count > snap->size - pos)
+		count = snap->size - pos;
+	if (copy_to_user(buf, (char *)&snap->hdr + pos, count))
+		return -EFAULT;
+	*ppos = pos + count;
+	return count;
+}
+
+static int mv_trace_release(struct inode *inode, struct file *file)
+{
+	vfree(file->private_data);
+	return 0;
+}
+
+static struct file_operations mv_trace_fops = {
+	.open		= mv_trace_open,
+	.read		= mv_trace_read,
+	.release	= mv_trace_release,
+};
+
+static int mv_trace_enable_read(char *page, char **start, off_t off,
+				int count, int *eof, void *data)
+{
+	int len = 0, i;
+
+	len += sprintf(page, "%lx\n", mv_trace_mask);
+	for (i = 0; i < MV_TRACE_NR; i++)
+		len += sprintf(page + len, "%x %-5s %s %u records\n", 1 << i,
+			       mv_trace_names[i],
+			       mv_trace_mask & (1 << i) ? "on " : "off",
+			       mv_trace_head[i]);
+	*eof = 1;
+	return len;
+}
+
+static int mv_trace_enable_write(struct file *file, const char __user *buffer,
+				 unsigned long count, void *data)
+{
+	char str[16];
+
+	if (count >= sizeof(str))
+		return -EINVAL;
+	if (copy_from_user(str, buffer, count))
+		return -EFAULT;
+	str[count] = '\0';
+
+	mv_trace_mask = simple_strtoul(str, NULL, 16) & ((1 << MV_TRACE_NR) - 1);
+	return count;
+}
+
+static int __init mv_trace_init(void)
+{
+	struct proc_dir_entry *dir, *ent;
+	int i;
+
+	mv_trace_mask = (1 << MV_TRACE_NR) - 1;
+
+	dir = proc_mkdir("mvtrace", NULL);
+	if (dir == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < MV_TRACE_NR; i++) {
+		ent = create_proc_entry(mv_trace_names[i], S_IFREG | S_IRUSR, dir);
+		if (ent == NULL)
+			return -ENOMEM;
+		ent->proc_fops = &mv_trace_fops;
+		ent->data = (void *)i;
+		ent->size = sizeof(struct mv_trace_hdr) +
+			    TRACE_RECORDS * sizeof(struct mv_trace_rec);
+	}
+
+	ent = create_proc_entry("enable", S_IFREG | S_IRUGO | S_IWUSR, dir);
+	if (ent == NULL)
+		return -ENOMEM;
+	ent->read_proc = mv_trace_enable_read;
+	ent->write_proc = mv_trace_enable_write;
+
+	printk(KERN_INFO "mvtrace: %d records per subsystem, mask %lx\n",
+	       TRACE_RECORDS, mv_trace_mask);
+	return 0;
+}
+
+arch_initcall(mv_trace_init);
@@ -0,0 +1,298 @@
+/*
+ * mvtrace_decode - print the mv88fxx81 hot path trace rings
+ *
+ * Userspace tool, not part of the kernel build:
+ *
+ *	arm-linux-gcc -O2 -I../../../../include/asm-arm/arch-mv88fxx81 \
+ *		-o mvtrace_decode mvtrace_decode.c
+ *
+ *	mvtrace_decode [-s] file...
+ *
+ * The files are /proc/mvtrace/{net,sata,cesa,idma}, or copies of them
+ * taken on the target.  Their records are merged into one timeline, in
+ * microseconds from the first event shown.  A completion is printed
+ * with the time since the start it belongs to (same command, crypto
+ * request or IDMA channel), and those latencies are summed up at the
+ * end; -s prints the summary only.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+
+typedef uint16_t __u16;
+typedef uint32_t __u32;
+
+#include "mvtrace.h"
+
+struct event {
+	unsigned long long	time;		/* Tclk cycles */
+	unsigned int		subsys;
+	struct mv_trace_rec	rec;
+};
+
+/* indexed by subsystem, then event; keep in sync with mvtrace.h */
+static const char *subsys_names[MV_TRACE_NR] = {
+	"net", "sata", "cesa", "idma"
+};
+
+static const char *event_names[MV_TRACE_NR][2] = {
+	{ "rx_poll", "tx_kick" },
+	{ "queue", "complete" },
+	{ "submit", "done" },
+	{ "start", "end" },
+};
+
+/* the start event of every subsystem that has start/end pairs */
+static const int pair_start[MV_TRACE_NR] = {
+	-1, MV_TRACE_SATA_QUEUE, MV_TRACE_CESA_SUBMIT, MV_TRACE_IDMA_START
+};
+
+#define MAX_PENDING	256
+
+static struct {
+	unsigned int		subsys;
+	__u32			key;
+	unsigned long long	time;
+} pending[MAX_PENDING];
+static int nr_pending;
+
+static struct {
+	unsigned long		count, unmatched;
+	unsigned long long	sum, min, max;
+} lat[MV_TRACE_NR];
+
+static struct event *events;
+static int nr_events, max_events;
+static unsigned int tclk;
+
+static void add_event(unsigned int subsys, unsigned long long time,
+		      const struct mv_trace_rec *rec)
+{
+	if (nr_events == max_events) {
+		max_events = max_events ? max_events * 2 : 4096;
+		events = realloc(events, max_events * sizeof(*events));
+		if (events == NULL) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	events[nr_events].time = time;
+	events[nr_events].subsys = subsys;
+	events[nr_events].rec = *rec;
+	nr_events++;
+}
+
+/*
+ * The records carry the low 32 bits of the clock.  Walking back from
+ * the 64-bit time of the snapshot restores the rest, as long as no two
+ * consecutive records of a ring are 2^32 cycles apart.
+ */
+static int load(const char *path)
+{
+	struct mv_trace_hdr hdr;
+	struct mv_trace_rec *rec;
+	unsigned long long time;
+	__u32 low, i;
+	FILE *f;
+
+	f = fopen(path, "rb");
+	if (f == NULL) {
+		perror(path);
+		return -1;
+	}
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != MV_TRACE_MAGIC ||
+	    hdr.version != MV_TRACE_VERSION || hdr.subsys >= MV_TRACE_NR) {
+		fprintf(stderr, "%s: not an mvtrace ring\n", path);
+		fclose(f);
+		return -1;
+	}
+	if (tclk && hdr.tclk != tclk)
+		fprintf(stderr, "%s: Tclk %u differs from %u\n", path,
+			hdr.tclk, tclk);
+	tclk = hdr.tclk;
+
+	rec = malloc(hdr.nr * sizeof(*rec) + 1);
+	if (rec == NULL || fread(rec, sizeof(*rec), hdr.nr, f) != hdr.nr) {
+		fprintf(stderr, "%s: short ring\n", path);
+		fclose(f);
+		free(rec);
+		return -1;
+	}
+	fclose(f);
+
+	time = (unsigned long long)hdr.now_hi << 32 | hdr.now_lo;
+	low = hdr.now_lo;
+	for (i = hdr.nr; i-- > 0; ) {
+		time -= (__u32)(low - rec[i].stamp);
+		low = rec[i].stamp;
+		if (rec[i].seq != (__u16)(hdr.head - hdr.nr + i))
+			fprintf(stderr, "%s: record %u out of sequence\n",
+				path, i);
+		add_event(hdr.subsys, time, &rec[i]);
+	}
+	free(rec);
+
+	printf("# %s: %s, %u of %u records\n", path,
+	       subsys_names[hdr.subsys], hdr.nr, hdr.head);
+	return 0;
+}
+
+static int cmp_event(const void *a, const void *b)
+{
+	const struct event *x = a, *y = b;
+
+	if (x->time != y->time)
+		return x->time < y->time ? -1 : 1;
+	return 0;
+}
+
+static double usecs(unsigned long long cycles)
+{
+	return cycles * 1e6 / tclk;
+}
+
+/* the time since the matching start, or -1 */
+static long long match(const struct event *e)
+{
+	unsigned int s = e->subsys;
+	int i;
+
+	if (pair_start[s] < 0)
+		return -1;
+
+	if (e->rec.event == pair_start[s]) {
+		for (i = 0; i < nr_pending; i++)
+			if (pending[i].subsys == s && pending[i].key == e->rec.arg0)
+				break;
+		if (i == nr_pending) {
+			if (nr_pending == MAX_PENDING)
+				return -1;
+			nr_pending++;
+		}
+		pending[i].subsys = s;
+		pending[i].key = e->rec.arg0;
+		pending[i].time = e->time;
+		return -1;
+	}
+
+	for (i = 0; i < nr_pending; i++) {
+		if (pending[i].subsys == s && pending[i].key == e->rec.arg0) {
+			unsigned long long d = e->time - pending[i].time;
+
+			pending[i] = pending[--nr_pending];
+			if (lat[s].count == 0 || d < lat[s].min)
+				lat[s].min = d;
+			if (d > lat[s].max)
+				lat[s].max = d;
+			lat[s].sum += d;
+			lat[s].count++;
+			return d;
+		}
+	}
+	lat[s].unmatched++;
+	return -1;
+}
+
+static void print_event(const struct event *e, unsigned long long t0,
+			long long d)
+{
+	const struct mv_trace_rec *r = &e->rec;
+	const char *name = r->event < 2 ? event_names[e->subsys][r->event] : "?";
+
+	printf("%14.3f %-4s %-8s ", usecs(e->time - t0),
+	       subsys_names[e->subsys], name);
+
+	switch (e->subsys) {
+	case MV_TRACE_NET:
+		if (r->event == MV_TRACE_NET_RX_POLL)
+			printf("port %u rx %u tx_done %u", r->arg0,
+			       r->arg1 >> 16, r->arg1 & 0xffff);
+		else
+			printf("port %u len %u", r->arg0, r->arg1);
+		break;
+	case MV_TRACE_SATA:
+		if (r->event == MV_TRACE_SATA_QUEUE)
+			printf("cmd %08x chan %u len %u", r->arg0,
+			       r->arg1 >> 24, r->arg1 & 0xffffff);
+		else
+			printf("cmd %08x result %08x", r->arg0, r->arg1);
+		break;
+	case MV_TRACE_CESA:
+		if (r->event == MV_TRACE_CESA_SUBMIT)
+			printf("crp %08x len %u", r->arg0, r->arg1);
+		else
+			printf("crp %08x error %d", r->arg0, (int)r->arg1);
+		break;
+	default:
+		if (r->event == MV_TRACE_IDMA_START)
+			printf("chan %u len %u", r->arg0, r->arg1);
+		else
+			printf("chan %u polls %u", r->arg0, r->arg1);
+		break;
+	}
+	if (d >= 0)
+		printf("  (+%.3f us)", usecs(d));
+	printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int i, c, summary = 0, errors = 0;
+	unsigned long long t0;
+
+	while ((c = getopt(argc, argv, "s")) != -1) {
+		switch (c) {
+		case 's':
+			summary = 1;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind == argc)
+		goto usage;
+
+	for (i = optind; i < argc; i++)
+		if (load(argv[i]))
+			errors++;
+	if (nr_events == 0) {
+		fprintf(stderr, "no events\n");
+		return 1;
+	}
+
+	qsort(events, nr_events, sizeof(*events), cmp_event);
+	t0 = events[0].time;
+	printf("# %d events over %.3f us, Tclk %u Hz\n", nr_events,
+	       usecs(events[nr_events - 1].time - t0), tclk);
+
+	for (i = 0; i < nr_events; i++) {
+		long long d = match(&events[i]);
+
+		if (!summary)
+			print_event(&events[i], t0, d);
+	}
+
+	printf("# latency (us)    count      min      avg      max  unmatched\n");
+	for (i = 0; i < MV_TRACE_NR; i++) {
+		if (pair_start[i] < 0 || (lat[i].count == 0 && lat[i].unmatched == 0))
+			continue;
+		printf("# %-4s %-8s %8lu %8.1f %8.1f %8.1f %10lu\n",
+		       subsys_names[i], event_names[i][pair_start[i] + 1],
+		       lat[i].count, usecs(lat[i].min),
+		       lat[i].count ? usecs(lat[i].sum) / lat[i].count : 0.0,
+		       usecs(lat[i].max), lat[i].unmatched);
+	}
+	return errors ? 1 : 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-s] file...\n", argv[0]);
+	return 2;
+}
@@ -90,9 +90,24 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 MV_BOOL                 cesaLargeInProc = MV_FALSE;
 
+/*  Pipelined fragment mode.
+ *  Any request larger than MV_CESA_MAX_BUF_SIZE is cut to fragments of one 
+ *  SRAM buffer. Fragments use channel #0 and channel #1 in turn: while the
+ *  accelerator processes fragment N on one channel, IDMA of the other channel
+ *  already copies fragment N+1 to its SRAM buffer. The accelerator is started 
+ *  on the next fragment only when the previous one is finished, so CBC and
+ *  MAC state is chained exactly as in serial mode.
+ *  When FALSE, requests up to 2*MV_CESA_MAX_BUF_SIZE are processed as large 
+ *  and bigger requests are fragmented one double buffer at a time on channel #0.
+ */
+MV_BOOL                 cesaFragPipe = MV_TRUE;
+
 MV_CESA_STATS           cesaStats;   
 MV_CESA_FRAGS           cesaFrags;
 MV_LRU_CACHE*           pCesaCacheLRU = NULL;
+int                     cesaCachePinned = 0;
+int                     cesaCacheSaNum = 0;
+int                     cesaSramSize = 0;
 
 MV_CESA_SA*             pCesaSAD = NULL;
 MV_U16                  cesaMaxSA = 0;
@@ -112,6 +127,24 @@ MV_CESA_CHAN            pCesaChan[MV_CESA_MAX_CHAN];
 MV_U32                  cesaChanReadyMap = 0;
 
 
+/* A 4K SRAM shows up again every 4K of its window */
+static int mvCesaSramSizeDetect(char* pSramBase)
+{
+    volatile MV_U32*    pLow = (MV_U32*)pSramBase;
+    volatile MV_U32*    pHigh = (MV_U32*)(pSramBase + 4*1024);
+    MV_U32              low = *pLow, high = *pHigh;
+    int                 size = MV_CESA_SRAM_SIZE;
+
+    *pLow = 0x5A5A5A5A;
+    *pHigh = 0xA5A5A5A5;
+    if( (*pLow != 0x5A5A5A5A) || (*pHigh != 0xA5A5A5A5) )
+        size = 4*1024;
+    *pHigh = high;
+    *pLow = low;
+
+    return size;
+}
+
 MV_U8*  mvCesaSramAddrGet(void)
 {
 #ifdef MV_CESA_NO_SRAM
@@ -148,6 +181,10 @@ static void        mvCesaHmacIvGet(MV_CESA_MAC_MODE macMode, unsigned char key[]
 static MV_STATUS   mvCesaFragAuthComplete(MV_CESA_COMMAND* pCmd, MV_CESA_SA* pSA, 
                                           int macDataSize);
 
+static void        mvCesaMacStreamIvUpdate(MV_CESA_SA* pSA);
+static void        mvCesaMacStreamHash(MV_CESA_MAC_STREAM* pStream, MV_CESA_MBUF* pMbuf, 
+                                       int offset, int size, MV_U8* pDigest);
+
 static MV_CESA_COMMAND*   mvCesaCtrModeInit(void);
 
 static MV_STATUS   mvCesaCtrModePrepare(MV_CESA_COMMAND *pCtrModeCmd, MV_CESA_COMMAND *pCmd);
@@ -159,9 +196,16 @@ static MV_STATUS   mvCesaCmdProcess(int chan, MV_CESA_COMMAND* pCmd, MV_U8 fixOf
 static MV_STATUS   mvCesaReqProcess(int chan, MV_CESA_REQ* pReq);
 
 static MV_STATUS   mvCesaFragReqProcess(MV_CESA_REQ* pReq);
+static void        mvCesaFragFirstPrepare(MV_CESA_REQ* pReq, MV_CESA_SA* pSA, int copySize,
+                                          int* pCryptoIvOffset, int* pDigestOffset);
+static MV_STATUS   mvCesaFragPipeProcess(MV_CESA_REQ* pReq);
+static void        mvCesaFragPipeLoad(MV_CESA_REQ* pReq, int chan);
+static void        mvCesaFragPipeFire(MV_CESA_REQ* pReq);
 
 static MV_STATUS   mvCesaParamCheck(MV_CESA_SA* pSA, MV_CESA_COMMAND *pCmd, MV_U8* pFixOffset);
-static MV_STATUS   mvCesaFragParamCheck(MV_CESA_SA* pSA, MV_CESA_COMMAND *pCmd);
+static MV_STATUS   mvCesaFragParamCheck(MV_CESA_SA* pSA, MV_CESA_COMMAND *pCmd, 
+                                        int bufSize, MV_BOOL verbose);
+static MV_BOOL     mvCesaFragPipeAllowed(MV_CESA_SA* pSA, MV_CESA_COMMAND *pCmd);
 
 static void        mvCesaFragSizeFind(MV_CESA_SA* pSA, MV_CESA_COMMAND *pCmd, 
                                int cryptoOffset, int macOffset,
@@ -213,8 +257,27 @@ MV_STATUS mvCesaInit (int numOfSession, int queueDepth, char* pSramBase)
         return MV_FAIL;
     }
 
-    mvOsPrintf("mvCesaInit: sessions=%d, queue=%d, pSram=%p\n",
-                numOfSession, queueDepth, pSramBase);
+    /* pSramBase must be 8 byte aligned */
+    if( MV_IS_NOT_ALIGN((MV_ULONG)pSramBase, 8) )
+    {
+        mvOsPrintf("mvCesaInit: pSramBase (%p) must be 8 byte aligned\n",
+                pSramBase);
+        return MV_NOT_ALIGNED;
+    }
+
+    cesaSramSize = mvCesaSramSizeDetect(pSramBase);
+    cesaCacheSaNum = (cesaSramSize - MV_CESA_SRAM_FIXED_SIZE)/sizeof(MV_CESA_CACHE_SA);
+    if(cesaCacheSaNum > MV_CESA_MAX_CACHE_SA)
+        cesaCacheSaNum = MV_CESA_MAX_CACHE_SA;
+    if( (cesaSramSize <= MV_CESA_SRAM_FIXED_SIZE) || (cesaCacheSaNum < 2) )
+    {
+        mvOsPrintf("mvCesaInit: %d bytes SRAM is too small\n", cesaSramSize);
+        return MV_FAIL;
+    }
+
+    mvOsPrintf("mvCesaInit: sessions=%d, queue=%d, pSram=%p (%dK), cacheSA=%d\n",
+                numOfSession, queueDepth, pSramBase, cesaSramSize/1024,
+                cesaCacheSaNum);
 
     memset(pCesaChan, 0, sizeof(pCesaChan));
 
@@ -247,18 +310,11 @@ MV_STATUS mvCesaInit (int numOfSession, int queueDepth, char* pSramBase)
     cesaQueueDepth = queueDepth;
     cesaReqResources = queueDepth;
 
-    /* pSramBase must be 8 byte aligned */
-    if( MV_IS_NOT_ALIGN((MV_ULONG)pSramBase, 8) )
-    {
-        mvOsPrintf("mvCesaInit: pSramBase (%p) must be 8 byte aligned\n",
-                pSramBase);
-        mvCesaFinish();
-        return MV_NOT_ALIGNED;
-    }
     cesaSramVirtPtr = (MV_CESA_SRAM_MAP*)pSramBase;
 
-    memset(cesaSramVirtPtr, 0, sizeof(MV_CESA_SRAM_MAP));
-    for(i=0; i<MV_CESA_MAX_CACHE_SA; i++)
+    memset(cesaSramVirtPtr, 0, MV_CESA_SRAM_FIXED_SIZE +
+                               cesaCacheSaNum*sizeof(MV_CESA_CACHE_SA));
+    for(i=0; i<cesaCacheSaNum; i++)
     {
         cesaSramVirtPtr->cacheSA[i].sid = MV_INVALID;
     }
@@ -320,11 +376,11 @@ MV_STATUS mvCesaInit (int numOfSession, int queueDepth, char* pSramBase)
     MV_REG_WRITE( MV_CESA_CFG_REG, configReg);
 
     /* Initialize LRU cache */
-    pCesaCacheLRU = mvLruCacheInit(MV_CESA_MAX_CACHE_SA);
+    pCesaCacheLRU = mvLruCacheInit(cesaCacheSaNum);
     if(pCesaCacheLRU == NULL)
     {
         mvOsPrintf("mvCesaInit: LRU Cache init for %d elements failed\n",
-                    MV_CESA_MAX_CACHE_SA);
+                    cesaCacheSaNum);
         mvCesaFinish();        
         return MV_NO_RESOURCE;
     }
@@ -332,6 +388,7 @@ MV_STATUS mvCesaInit (int numOfSession, int queueDepth, char* pSramBase)
 
     /* Clear global cesaFrag */
     memset(&cesaFrags, 0, sizeof(MV_CESA_FRAGS));
+    cesaCachePinned = 0;
 
     return MV_OK;
 }
@@ -684,6 +741,9 @@ MV_STATUS   mvCesaSessionOpen(MV_CESA_OPEN_SESSION *pSession, short* pSid)
 
     pCesaSAD[sid].valid = 1;
     pCesaSAD[sid].cacheIdx = MV_INVALID;
+    pCesaSAD[sid].pinned = 0;
+    pCesaSAD[sid].cacheHits = 0;
+    pCesaSAD[sid].cacheLoads = 0;
     return MV_OK;
 }
 
@@ -722,11 +782,221 @@ MV_STATUS mvCesaSessionClose(short sid)
         mvCesaCacheIdxDelete(pCesaCacheLRU, pCesaSAD[sid].cacheIdx);
         cesaSramVirtPtr->cacheSA[pCesaSAD[sid].cacheIdx].sid = MV_INVALID;
     }
+    if(pCesaSAD[sid].pinned)
+    {
+        pCesaSAD[sid].pinned = 0;
+        cesaCachePinned--;
+    }
 
     pCesaSAD[sid].valid = 0;
     return MV_OK;
 }
 
+/*******************************************************************************
+* mvCesaSessionPin - Keep session key material in the SRAM Cache
+*
+* DESCRIPTION:
+*       A pinned session is loaded to the SRAM Cache on its next request as
+*       usual, but then its Cache entry is never selected for replacement, so
+*       a hot SA is not reloaded by IDMA when many SAs are active. 
+*       At most MV_CESA_MAX_PINNED_SA sessions can be pinned.
+*
+* INPUT:
+*       short   sid     - Session identifier.
+*       MV_BOOL pin     - MV_TRUE to pin the session, MV_FALSE to unpin it.
+*
+* RETURN:   
+*       MV_OK        - Session pinned or unpinned.
+*       MV_BAD_PARAM - Session identifier is invalid.
+*       MV_FULL      - Too many pinned sessions.
+*
+*******************************************************************************/
+MV_STATUS mvCesaSessionPin(short sid, MV_BOOL pin)
+{
+    MV_CESA_SA  *pSA;
+
+    if( (sid < 0) || (sid >= cesaMaxSA) || (pCesaSAD[sid].valid == 0) )
+        return MV_BAD_PARAM;
+
+    pSA = &pCesaSAD[sid];
+    if(pin == (pSA->pinned != 0))
+        return MV_OK;
+
+    if(pin)
+    {
+        if(cesaCachePinned >= MV_CESA_MAX_PINNED_SA)
+            return MV_FULL;
+        cesaCachePinned++;
+    }
+    else
+        cesaCachePinned--;
+
+    pSA->pinned = (pin != MV_FALSE);
+    return MV_OK;
+}
+
+/*******************************************************************************
+* mvCesaMacStreamInit - Start new streamed MD5 or SHA1
+*
+* DESCRIPTION:
+*       Set the running state to the initial value of the hash.
+*
+* INPUT:
+*       MV_CESA_MAC_MODE    macMode - MV_CESA_MAC_MD5 or MV_CESA_MAC_SHA1.
+*
+* OUTPUT:
+*       MV_CESA_MAC_STREAM* pStream - Stream to be initialized.
+*
+* RETURN:   None
+*
+*******************************************************************************/
+void    mvCesaMacStreamInit(MV_CESA_MAC_STREAM* pStream, MV_CESA_MAC_MODE macMode)
+{
+    memset(pStream, 0, sizeof(*pStream));
+    pStream->macMode = macMode;
+    pStream->last = MV_FALSE;
+
+    if(macMode == MV_CESA_MAC_MD5)
+    {
+        MV_MD5_CONTEXT  ctx;
+
+        mvMD5Init(&ctx);
+        memcpy(pStream->state, ctx.buf, MV_CESA_MD5_DIGEST_SIZE);
+    }
+    else
+    {
+        MV_SHA1_CTX     ctx;
+
+        mvSHA1Init(&ctx);
+        memcpy(pStream->state, ctx.state, MV_CESA_SHA1_DIGEST_SIZE);
+    }
+}
+
+/*******************************************************************************
+* mvCesaMacStreamSet - Hash the data of several commands as one stream
+*
+* DESCRIPTION:
+*       The HW starts an HMAC from the inner IV of the session, so a session 
+*       of the stream works in HMAC mode with the running state of the stream 
+*       as inner IV. Every command is fragmented and its last fragment is 
+*       hashed by SW (as for commands larger than 16K), which leaves the new 
+*       running state in the stream and in the inner IV for the next command.
+*       The command with pStream->last set completes the hash and returns the
+*       digest, any other command returns the running state instead.
+*
+*       Restrictions while the stream is attached:
+*       - Only one command of the session may be in process.
+*       - macLength must be the whole number of 64 bytes blocks, except for 
+*         the last command.
+*       - Commands shorter than MV_CESA_MAC_STREAM_MIN_SIZE are refused by 
+*         mvCesaAction() with MV_NOT_ALLOWED, use mvCesaMacStreamSw() for them.
+*
+* INPUT:
+*       short               sid     - MAC_ONLY session of MD5 or SHA1.
+*       MV_CESA_MAC_STREAM* pStream - Stream initialized by mvCesaMacStreamInit(). 
+*                                   NULL returns the session to the plain hash.
+*
+* RETURN:   
+*       MV_OK           - Stream attached (or detached).
+*       MV_BAD_PARAM    - Session identifier is invalid or the stream is of 
+*                       other MAC mode.
+*       MV_NOT_ALLOWED  - The session is not MAC_ONLY session of MD5 or SHA1.
+*
+*******************************************************************************/
+MV_STATUS   mvCesaMacStreamSet(short sid, MV_CESA_MAC_STREAM* pStream)
+{
+    MV_CESA_SA          *pSA;
+    MV_CESA_MAC_MODE    macMode;
+
+    if( (sid < 0) || (sid >= cesaMaxSA) || (pCesaSAD[sid].valid == 0) )
+        return MV_BAD_PARAM;
+
+    pSA = &pCesaSAD[sid];
+    if(pSA->pMacStream != NULL)
+        macMode = pSA->pMacStream->macMode;
+    else
+        macMode = (pSA->config & MV_CESA_MAC_MODE_MASK) >> MV_CESA_MAC_MODE_OFFSET;
+
+    if(pStream == NULL)
+    {
+        pSA->config &= ~MV_CESA_MAC_MODE_MASK;
+        pSA->config |= (macMode << MV_CESA_MAC_MODE_OFFSET);
+        pSA->pMacStream = NULL;
+        return MV_OK;
+    }
+
+    if( ((pSA->config & MV_CESA_OPERATION_MASK) != 
+                (MV_CESA_MAC_ONLY << MV_CESA_OPERATION_OFFSET)) ||
+        ((macMode != MV_CESA_MAC_MD5) && (macMode != MV_CESA_MAC_SHA1)) )
+    {
+        mvOsPrintf("mvCesaMacStreamSet: sid=%d is not MD5 or SHA1 session\n", sid);
+        return MV_NOT_ALLOWED;
+    }
+    if(pStream->macMode != macMode)
+        return MV_BAD_PARAM;
+
+    pSA->config &= ~MV_CESA_MAC_MODE_MASK;
+    if(macMode == MV_CESA_MAC_MD5)
+        pSA->config |= (MV_CESA_MAC_HMAC_MD5 << MV_CESA_MAC_MODE_OFFSET);
+    else
+        pSA->config |= (MV_CESA_MAC_HMAC_SHA1 << MV_CESA_MAC_MODE_OFFSET);
+
+    pSA->pMacStream = pStream;
+    mvCesaMacStreamIvUpdate(pSA);
+    return MV_OK;
+}
+
+/*******************************************************************************
+* mvCesaMacStreamSw - Hash a command of the stream by SW
+*
+* DESCRIPTION:
+*       Synchronous counterpart of mvCesaAction() for streamed commands too 
+*       short to be fragmented. The digest (or the running state) is written 
+*       to pCmd->digestOffset, no callback is called.
+*
+* INPUT:
+*       MV_CESA_COMMAND* pCmd - Command of the session with attached stream.
+*
+* RETURN:   
+*       MV_OK           - Command is processed.
+*       MV_BAD_PARAM    - Invalid session or macLength.
+*       MV_NOT_ALLOWED  - No stream is attached to the session.
+*
+*******************************************************************************/
+MV_STATUS   mvCesaMacStreamSw(MV_CESA_COMMAND* pCmd)
+{
+    MV_CESA_SA*         pSA;
+    MV_CESA_MAC_STREAM* pStream;
+    MV_U8               digest[MV_CESA_MAX_DIGEST_SIZE];
+    short               sid = pCmd->sessionId;
+
+    if( (sid >= cesaMaxSA) || (pCesaSAD[sid].valid == 0) )
+        return MV_BAD_PARAM;
+
+    pSA = &pCesaSAD[sid];
+    pStream = pSA->pMacStream;
+    if(pStream == NULL)
+        return MV_NOT_ALLOWED;
+
+    if( (pStream->last == MV_FALSE) &&
+        MV_IS_NOT_ALIGN(pCmd->macLength, MV_CESA_AUTH_BLOCK_SIZE) )
+    {
+        mvOsPrintf("mvCesaMacStreamSw: macLength=%d must be %d byte aligned\n",
+                    pCmd->macLength, MV_CESA_AUTH_BLOCK_SIZE);
+        return MV_BAD_PARAM;
+    }
+    if(pCmd->pSrc != pCmd->pDst)
+        mvCesaMbufCopy(pCmd->pDst, 0, pCmd->pSrc, 0, pCmd->pSrc->mbufSize);
+
+    mvCesaMacStreamHash(pStream, pCmd->pDst, pCmd->macOffset, pCmd->macLength, digest);
+    if(pStream->last == MV_FALSE)
+    {
+        mvCesaMacStreamIvUpdate(pSA);
+        memcpy(digest, pStream->state, pSA->digestSize);
+    }
+    return mvCesaCopyToMbuf(digest, pCmd->pDst, pCmd->digestOffset, pSA->digestSize);
+}
+
 /*******************************************************************************
 * mvCesaAction - Perform crypto operation
 *
@@ -814,12 +1084,37 @@ MV_STATUS   mvCesaAction (MV_CESA_COMMAND *pCmd)
         }
     }
 
+    if(pSA->pMacStream != NULL)
+    {
+        /* Not fragmented command would be completed by HW */
+        if(pCmd->pSrc->mbufSize < MV_CESA_MAC_STREAM_MIN_SIZE)
+            return MV_NOT_ALLOWED;
+
+        if( (pSA->pMacStream->last == MV_FALSE) &&
+            MV_IS_NOT_ALIGN(pCmd->macLength, MV_CESA_AUTH_BLOCK_SIZE) )
+        {
+            mvOsPrintf("mvCesaAction: macLength=%d must be %d byte aligned\n",
+                        pCmd->macLength, MV_CESA_AUTH_BLOCK_SIZE);
+            return MV_BAD_PARAM;
+        }
+    }
+
     /* Check if the packet need small buffer, large buffer or fragmentation */
+    pReq->fragPipe = MV_FALSE;
     if(pCmd->pSrc->mbufSize <= sizeof(cesaSramVirtPtr->buf[0]) )
     {
         /* request size is smaller than single buffer size */
         pReq->fragMode = MV_CESA_FRAG_NONE;
     }
+    else if( (cesaFragPipe == MV_TRUE) && 
+             (mvCesaFragPipeAllowed(pSA, pCmd) == MV_TRUE) &&
+             (mvCesaFragParamCheck(pSA, pCmd, sizeof(cesaSramVirtPtr->buf[0]), 
+                                   MV_FALSE) == MV_OK) )
+    {
+        /* request size is larger than single buffer size - pipelined fragmentation */
+        pReq->fragPipe = MV_TRUE;
+        pReq->fragMode = MV_CESA_FRAG_FIRST;        
+    }
     else if(pCmd->pSrc->mbufSize <= sizeof(cesaSramVirtPtr->buf))
     {
         /* request size is larger than single buffer size, but smaller than double buffer size */
@@ -830,7 +1125,7 @@ MV_STATUS   mvCesaAction (MV_CESA_COMMAND *pCmd)
         /* request size is larger than double buffer size - needs fragmentation */
 
         /* Check restrictions for processing fragmented packets */
-        status = mvCesaFragParamCheck(pSA, pCmd);
+        status = mvCesaFragParamCheck(pSA, pCmd, sizeof(cesaSramVirtPtr->buf), MV_TRUE);
         if(status != MV_OK)
             return status;
 
@@ -934,6 +1229,32 @@ MV_U32  mvCesaChanInProcessGet(void)
     return chanMap;
 }
 
+/*******************************************************************************
+* mvCesaFragPipeSet - Select processing mode of requests larger than SRAM buffer
+*
+* DESCRIPTION:
+*       MV_TRUE selects pipelined fragments of single SRAM buffer, ping-ponged
+*       between the two channels. MV_FALSE selects the serial mode: large 
+*       requests on both buffers of channel #0 and fragments of double buffer.
+*       The mode is sampled by mvCesaAction(), so requests already in the queue
+*       are finished in the mode they were queued with.
+*
+* INPUT:
+*       MV_BOOL pipe    - MV_TRUE for pipelined mode, MV_FALSE for serial mode.
+*
+* RETURN:   None
+*
+*******************************************************************************/
+void    mvCesaFragPipeSet(MV_BOOL pipe)
+{
+    cesaFragPipe = pipe;
+}
+
+MV_BOOL mvCesaFragPipeGet(void)
+{
+    return cesaFragPipe;
+}
+
 /*******************************************************************************
 * mvCesaReadyGet - Get crypto request that processing is finished
 *
@@ -1123,6 +1444,21 @@ MV_STATUS mvCesaReadyGet(MV_U32 chanMap, MV_CESA_RESULT* pResult)
         if(pCesaReqProcess->fragMode == MV_CESA_FRAG_LAST)
         {
             pCesaReqProcess = MV_CESA_REQ_NEXT_PTR(pCesaReqProcess);        
+
+            /* Pipelined LAST fragment on channel #0 released channel #1 */
+            if( (cesaLargeInProc == MV_FALSE) && 
+                (pCesaReqProcess != pCesaReqEmpty) &&
+                (pCesaReqProcess->pCmd->pSrc->mbufSize <= sizeof(cesaSramVirtPtr->buf[0])) &&
+                (pCesaChan[1].state == MV_CESA_READY) )
+            {
+                status = mvCesaReqProcess(1, pCesaReqProcess);
+                if(status != MV_OK)
+                {
+                    mvOsPrintf("CesaReady: ReqProcess error: chan=%d, pReq=%p, status=0x%x\n",
+                                1, pCesaReqProcess, status);
+                }
+                pCesaReqProcess = MV_CESA_REQ_NEXT_PTR(pCesaReqProcess);        
+            }
         }
     }
     else if(pCesaReqProcess != pCesaReqEmpty)
@@ -1467,7 +1803,7 @@ MV_STATUS   mvCesaMbufCopy(MV_CESA_MBUF* pMbufDst, int dstMbufOffset,
 *
 * DESCRIPTION:
 *       This function processes a fragment of fragmented request (First, Middle or Last)
-*       
+*       Requests queued in pipelined mode are passed to mvCesaFragPipeProcess().
 *
 * INPUT:
 *       MV_CESA_REQ* pReq   - Pointer to the request in the request queue.
@@ -1493,6 +1829,9 @@ static MV_STATUS   mvCesaFragReqProcess(MV_CESA_REQ* pReq)
     int                     macTotalLen = 0;
     int                     fixOffset, cryptoOffset, macOffset;
 
+    if(pReq->fragPipe)
+        return mvCesaFragPipeProcess(pReq);
+
     pReq->chanId = 0;
     cesaStats.fragCount++;
 
@@ -1535,92 +1874,9 @@ static MV_STATUS   mvCesaFragReqProcess(MV_CESA_REQ* pReq)
         mvCesaFragSizeFind(pSA, pCmd, cryptoOffset, macOffset, 
                         &copySize, &cryptoDataSize, &macDataSize);
 
-        if( (pSA->config & MV_CESA_OPERATION_MASK) != 
-                (MV_CESA_MAC_ONLY << MV_CESA_OPERATION_OFFSET)) 
-        {
-            /* CryptoIV special processing */
-            if( (pSA->config & MV_CESA_CRYPTO_MODE_MASK) == 
-                (MV_CESA_CRYPTO_CBC << MV_CESA_CRYPTO_MODE_BIT) )
-            {
-                /* In CBC mode for encode direction when IV from user */
-                if( (pCmd->ivFromUser) &&
-                    ((pSA->config & MV_CESA_DIRECTION_MASK) == 
-                        (MV_CESA_DIR_ENCODE << MV_CESA_DIRECTION_BIT)) )
-                {
-                    /* Copy IV from the buffer to SRAM */        
-                    mvCesaCopyFromMbuf(cesaSramVirtPtr->cryptoIV[0], 
-                               pCmd->pSrc, pCmd->ivOffset, pSA->cryptoIvSize); 
-                    mvOsCacheFlush(NULL, cesaSramVirtPtr->cryptoIV[0], 
-                                pSA->cryptoIvSize);
-                    mvOsCacheInvalidate(NULL, cesaSramVirtPtr->cryptoIV[0], 
-                              pSA->cryptoIvSize);
-                }
-
-                /* Special processing when IV is not located in the first fragment */
-                if(pCmd->ivOffset > (copySize - pSA->cryptoIvSize))
-                {
-                    /* Prepare dummy place for cryptoIV in SRAM */
-                    cryptoIvOffset = cesaSramVirtPtr->tempCryptoIV[0] - mvCesaSramAddrGet();
-
-                    /* For Decryption: Copy IV value from pCmd->ivOffset to Special SRAM place */
-                    if((pSA->config & MV_CESA_DIRECTION_MASK) == 
-                            (MV_CESA_DIR_DECODE << MV_CESA_DIRECTION_BIT))
-                    {
-                        mvCesaCopyFromMbuf(cesaSramVirtPtr->tempCryptoIV[0], 
-                                   pCmd->pSrc, pCmd->ivOffset, pSA->cryptoIvSize); 
-                        mvOsCacheFlush(NULL, cesaSramVirtPtr->tempCryptoIV[0], 
-                                    pSA->cryptoIvSize);
-                        mvOsCacheInvalidate(NULL, cesaSramVirtPtr->tempCryptoIV[0], 
-                                  pSA->cryptoIvSize);
-                    }
-                    else
-                    {
-                        /* For Encryption when IV is NOT from User: */
-                        /* Copy IV from Chan to buffer (pCmd->ivOffset) */
-                        if(pCmd->ivFromUser == 0) 
-                        {
-                            /* copy IV value from cryptoIV[0] to Buffer (pCmd->ivOffset) */
-                            mvCesaCopyToMbuf(cesaSramVirtPtr->cryptoIV[0], 
-                                    pCmd->pSrc, pCmd->ivOffset, pSA->cryptoIvSize); 
-                        }
-                    }
-                }
-                else
-                {
-                    cryptoIvOffset = pCmd->ivOffset;
-                }
-            }
-        }
-
-        if( (pSA->config & MV_CESA_OPERATION_MASK) != 
-                (MV_CESA_CRYPTO_ONLY << MV_CESA_OPERATION_OFFSET) )
-        {
-            /* MAC digest special processing on Decode direction */
-            if((pSA->config & MV_CESA_DIRECTION_MASK) == 
-                        (MV_CESA_DIR_DECODE << MV_CESA_DIRECTION_BIT))
-            {
-                /* Save digest from pCmd->digestOffset */
-                mvCesaCopyFromMbuf(cesaFrags.orgDigest, 
-                               pCmd->pSrc, pCmd->digestOffset, pSA->digestSize); 
-
-                /* If pCmd->digestOffset is not located on the first */
-                if(pCmd->digestOffset > (copySize - pSA->digestSize))
-                {
-                    MV_U8  digestZero[MV_CESA_MAX_DIGEST_SIZE];
-
-                    /* Set zeros to pCmd->digestOffset (DRAM) */
-                    memset(digestZero, 0, MV_CESA_MAX_DIGEST_SIZE);
-                    mvCesaCopyToMbuf(digestZero, pCmd->pSrc, pCmd->digestOffset, pSA->digestSize);
+        /* CryptoIV and Digest special processing for FIRST fragment */
+        mvCesaFragFirstPrepare(pReq, pSA, copySize, &cryptoIvOffset, &digestOffset);
 
-                    /* Prepare dummy place for digest in SRAM */
-                    digestOffset = cesaSramVirtPtr->tempDigest[0] - mvCesaSramAddrGet();
-                }
-                else
-                {
-                    digestOffset = pCmd->digestOffset;
-                }
-            }
-        }
         /* Update cache if nessesary */
         if( mvCesaCacheSramUpdate(sid, &pIdmaDesc[i]) == MV_OK)
         {
@@ -1662,7 +1918,8 @@ static MV_STATUS   mvCesaFragReqProcess(MV_CESA_REQ* pReq)
                 /* if packet is bigger then 16K (TotalMacDataLength is 13bit + 1), */
                 /* HW won't be able to calculate the Digest correctly. */
                 if( (mvCtrlModelGet() == MV_5182_DEV_ID) || 
-                    (pCmd->macLength >= (1 << 14)) )
+                    (pCmd->macLength >= (1 << 14)) ||
+                    (pSA->pMacStream != NULL) )
                 {
                     /* Calculate Last block by SW */
                     mvCesaFragAuthComplete(pCmd, pSA, macDataSize);
@@ -1688,7 +1945,8 @@ static MV_STATUS   mvCesaFragReqProcess(MV_CESA_REQ* pReq)
                 (((pSA->config & MV_CESA_MAC_MODE_MASK) == 
                     (MV_CESA_MAC_MD5 << MV_CESA_MAC_MODE_OFFSET)) ||
                 ((pSA->config & MV_CESA_MAC_MODE_MASK) == 
-                    (MV_CESA_MAC_SHA1 << MV_CESA_MAC_MODE_OFFSET))) )
+                    (MV_CESA_MAC_SHA1 << MV_CESA_MAC_MODE_OFFSET)) ||
+                (pSA->pMacStream != NULL)) )
             {
                 macDataSize = pCmd->macLength - cesaFrags.macSize;
                 cesaFrags.newDigestOffset = cesaSramVirtPtr->tempDigest[0] - mvCesaSramAddrGet();
@@ -1758,43 +2016,414 @@ static MV_STATUS   mvCesaFragReqProcess(MV_CESA_REQ* pReq)
 }
 
 /*******************************************************************************
-* mvCesaReqProcess - Process regular (Non-fragmented) request
+* mvCesaFragFirstPrepare - CryptoIV and digest processing for FIRST fragment
 *
 * DESCRIPTION:
-*       This function processes the whole (not fragmented) request
+*       When the IV or the digest of the request are not located in the FIRST
+*       fragment, this function moves them to temporary places in SRAM of
+*       channel #0. The FIRST fragment is always processed on channel #0.
 *
 * INPUT:
-*       MV_CESA_REQ* pReq   - Pointer to the request in the request queue.
+*       MV_CESA_REQ* pReq       - Pointer to the request in the request queue.
+*       MV_CESA_SA*  pSA        - SA of the request.
+*       int          copySize   - Size of the FIRST fragment.
 *
-* RETURN:
-*       MV_OK   - The request is successfully passed to HW for processing.
-*       Other   - Failure. The request will not be processed
+* OUTPUT:
+*       int* pCryptoIvOffset    - Offset of crypto IV for SRAM descriptor.
+*       int* pDigestOffset      - Offset of digest for SRAM descriptor.
+*
+* RETURN:   None
 *
 *******************************************************************************/
-static MV_STATUS   mvCesaReqProcess(int chan, MV_CESA_REQ* pReq)
+static void    mvCesaFragFirstPrepare(MV_CESA_REQ* pReq, MV_CESA_SA* pSA, int copySize,
+                                      int* pCryptoIvOffset, int* pDigestOffset)
 {
-    MV_STATUS   status;
-
-    cesaStats.procCount[chan]++;
+    MV_CESA_COMMAND*    pCmd = pReq->pCmd;
 
-    pReq->chanId = chan;
-    pReq->state = MV_CESA_PROCESS;
-
-    if(pReq->pCmd->pSrc->mbufSize > sizeof(cesaSramVirtPtr->buf[0]) )
+    if( (pSA->config & MV_CESA_OPERATION_MASK) != 
+            (MV_CESA_MAC_ONLY << MV_CESA_OPERATION_OFFSET)) 
     {
-        cesaStats.largeCount++;
-        cesaLargeInProc = MV_TRUE;
-        if(chan != 0)
+        /* CryptoIV special processing */
+        if( (pSA->config & MV_CESA_CRYPTO_MODE_MASK) == 
+            (MV_CESA_CRYPTO_CBC << MV_CESA_CRYPTO_MODE_BIT) )
         {
-            mvOsPrintf("CesaReqProcess ERROR: chan=%d, size=%d\n", 
-                chan, pReq->pCmd->pSrc->mbufSize);
-            return MV_FAIL;
+            /* In CBC mode for encode direction when IV from user */
+            if( (pCmd->ivFromUser) &&
+                ((pSA->config & MV_CESA_DIRECTION_MASK) == 
+                    (MV_CESA_DIR_ENCODE << MV_CESA_DIRECTION_BIT)) )
+            {
+                /* Copy IV from the buffer to SRAM */        
+                mvCesaCopyFromMbuf(cesaSramVirtPtr->cryptoIV[0], 
+                           pCmd->pSrc, pCmd->ivOffset, pSA->cryptoIvSize); 
+                mvOsCacheFlush(NULL, cesaSramVirtPtr->cryptoIV[0], 
+                            pSA->cryptoIvSize);
+                mvOsCacheInvalidate(NULL, cesaSramVirtPtr->cryptoIV[0], 
+                          pSA->cryptoIvSize);
+            }
+
+            /* Special processing when IV is not located in the first fragment */
+            if(pCmd->ivOffset > (copySize - pSA->cryptoIvSize))
+            {
+                /* Prepare dummy place for cryptoIV in SRAM */
+                *pCryptoIvOffset = cesaSramVirtPtr->tempCryptoIV[0] - mvCesaSramAddrGet();
+
+                /* For Decryption: Copy IV value from pCmd->ivOffset to Special SRAM place */
+                if((pSA->config & MV_CESA_DIRECTION_MASK) == 
+                        (MV_CESA_DIR_DECODE << MV_CESA_DIRECTION_BIT))
+                {
+                    mvCesaCopyFromMbuf(cesaSramVirtPtr->tempCryptoIV[0], 
+                               pCmd->pSrc, pCmd->ivOffset, pSA->cryptoIvSize); 
+                    mvOsCacheFlush(NULL, cesaSramVirtPtr->tempCryptoIV[0], 
+                                pSA->cryptoIvSize);
+                    mvOsCacheInvalidate(NULL, cesaSramVirtPtr->tempCryptoIV[0], 
+                              pSA->cryptoIvSize);
+                }
+                else
+                {
+                    /* For Encryption when IV is NOT from User: */
+                    /* Copy IV from Chan to buffer (pCmd->ivOffset) */
+                    if(pCmd->ivFromUser == 0) 
+                    {
+                        /* copy IV value from cryptoIV[0] to Buffer (pCmd->ivOffset) */
+                        mvCesaCopyToMbuf(cesaSramVirtPtr->cryptoIV[0], 
+                                pCmd->pSrc, pCmd->ivOffset, pSA->cryptoIvSize); 
+                    }
+                }
+            }
+            else
+            {
+                *pCryptoIvOffset = pCmd->ivOffset;
+            }
         }
     }
 
-    /* Pass request to HW */
-    status = mvCesaCmdProcess(chan, pReq->pCmd, pReq->fixOffset);
-    if(status != MV_OK)
+    if( (pSA->config & MV_CESA_OPERATION_MASK) != 
+            (MV_CESA_CRYPTO_ONLY << MV_CESA_OPERATION_OFFSET) )
+    {
+        /* MAC digest special processing on Decode direction */
+        if((pSA->config & MV_CESA_DIRECTION_MASK) == 
+                    (MV_CESA_DIR_DECODE << MV_CESA_DIRECTION_BIT))
+        {
+            /* Save digest from pCmd->digestOffset */
+            mvCesaCopyFromMbuf(cesaFrags.orgDigest, 
+                           pCmd->pSrc, pCmd->digestOffset, pSA->digestSize); 
+
+            /* If pCmd->digestOffset is not located on the first */
+            if(pCmd->digestOffset > (copySize - pSA->digestSize))
+            {
+                MV_U8  digestZero[MV_CESA_MAX_DIGEST_SIZE];
+
+                /* Set zeros to pCmd->digestOffset (DRAM) */
+                memset(digestZero, 0, MV_CESA_MAX_DIGEST_SIZE);
+                mvCesaCopyToMbuf(digestZero, pCmd->pSrc, pCmd->digestOffset, pSA->digestSize);
+
+                /* Prepare dummy place for digest in SRAM */
+                *pDigestOffset = cesaSramVirtPtr->tempDigest[0] - mvCesaSramAddrGet();
+            }
+            else
+            {
+                *pDigestOffset = pCmd->digestOffset;
+            }
+        }
+    }
+}
+
+/*******************************************************************************
+* mvCesaFragPipeProcess - Process fragmented request in pipelined mode
+*
+* DESCRIPTION:
+*       Fragments are of single SRAM buffer and use the channels in turn.
+*       On FIRST fragment: start it on channel #0 and copy the second fragment
+*       to SRAM of channel #1. On every finished fragment: start the accelerator
+*       on the fragment already copied to SRAM and copy the next one to SRAM of
+*       the channel just finished.
+*       The accelerator processes one fragment at a time, only the IDMA copy 
+*       to SRAM of the next fragment overlaps processing of the current one.
+*
+* INPUT:
+*       MV_CESA_REQ* pReq   - Pointer to the request in the request queue.
+*
+* RETURN:
+*       MV_OK   - The fragment is successfully passed to HW for processing.
+*       MV_FAIL - No fragment is ready for processing.
+*
+*******************************************************************************/
+static MV_STATUS   mvCesaFragPipeProcess(MV_CESA_REQ* pReq)
+{
+    int     chan;
+
+    if(pReq->fragMode == MV_CESA_FRAG_FIRST)
+    {
+        cesaLargeInProc = MV_TRUE;
+        cesaStats.pipeCount++;
+
+        pReq->state = MV_CESA_PROCESS;
+
+        /* cesaFrags monitors processing of fragmented request between fragments */
+        cesaFrags.sid = pReq->pCmd->sessionId;
+        cesaFrags.bufOffset = 0;
+        cesaFrags.cryptoSize = 0;
+        cesaFrags.macSize = 0;
+        cesaFrags.nextLoaded = MV_FALSE;
+
+        mvCesaFragPipeLoad(pReq, 0);
+        mvCesaFragPipeFire(pReq);
+
+        /* Request is larger than single buffer - there is always second fragment */
+        mvCesaFragPipeLoad(pReq, 1);
+        return MV_OK;
+    }
+
+    /* Continue fragment: channel of the finished fragment is free */
+    if(cesaFrags.nextLoaded == MV_FALSE)
+    {
+        mvOsPrintf("mvCesaFragPipeProcess: no fragment loaded, pReq=%p\n", pReq);
+        return MV_FAIL;
+    }
+    chan = pReq->chanId;
+
+    mvCesaFragPipeFire(pReq);
+
+    if(pReq->fragMode != MV_CESA_FRAG_LAST)
+        mvCesaFragPipeLoad(pReq, chan);
+
+    return MV_OK;
+}
+
+/*******************************************************************************
+* mvCesaFragPipeLoad - Copy next fragment to SRAM of the channel
+*
+* DESCRIPTION:
+*       This function builds IDMA list and SRAM descriptor of the next fragment 
+*       on the channel and starts IDMA. IDMA copies the fragment to SRAM and 
+*       stops on "Ownership for CPU" descriptor until the accelerator of the 
+*       channel is started by mvCesaFragPipeFire().
+*
+* INPUT:
+*       MV_CESA_REQ* pReq   - Pointer to the request in the request queue.
+*       int          chan   - Free CESA channel.
+*
+* RETURN:   None
+*
+*******************************************************************************/
+static void    mvCesaFragPipeLoad(MV_CESA_REQ* pReq, int chan)
+{
+    int                     i, copySize, cryptoDataSize, macDataSize;
+    int                     cryptoIvOffset, digestOffset;
+    MV_U32                  config;
+    MV_U8                   fragMode;
+    MV_CESA_COMMAND*        pCmd = pReq->pCmd;
+    MV_CESA_SA*             pSA = &pCesaSAD[cesaFrags.sid];
+    MV_CESA_MBUF*           pMbuf;
+    MV_DMA_DESC*            pIdmaDesc = pCesaChan[chan].pIdmaList;
+    MV_U8*                  pSramBuf = cesaSramVirtPtr->buf[chan];
+    int                     macTotalLen = 0;
+    int                     fixOffset, cryptoOffset, macOffset;
+
+    cesaStats.fragCount++;
+
+    cryptoIvOffset = digestOffset = 0;
+    cryptoDataSize = macDataSize = 0;
+    fixOffset = cryptoOffset = macOffset = 0;
+    i = 0;
+
+    if(cesaFrags.bufOffset == 0)
+    {
+        /* First fragment */
+        fragMode = MV_CESA_FRAG_FIRST;
+
+        /* fixOffset can be not equal to zero only for FIRST fragment */
+        fixOffset = pReq->fixOffset;
+        cryptoOffset = pCmd->cryptoOffset;
+        macOffset = pCmd->macOffset;
+        copySize = sizeof(cesaSramVirtPtr->buf[0]) - fixOffset;
+
+        mvCesaFragSizeFind(pSA, pCmd, cryptoOffset, macOffset, 
+                        &copySize, &cryptoDataSize, &macDataSize);
+
+        mvCesaFragFirstPrepare(pReq, pSA, copySize, &cryptoIvOffset, &digestOffset);
+
+        /* Update cache if nessesary */
+        if( mvCesaCacheSramUpdate(cesaFrags.sid, &pIdmaDesc[i]) == MV_OK)
+        {
+            i++;
+        }
+    }
+    else if( (pCmd->pSrc->mbufSize - cesaFrags.bufOffset) <= sizeof(cesaSramVirtPtr->buf[0]))
+    {
+        /* Last fragment */
+        fragMode = MV_CESA_FRAG_LAST;
+        copySize = pCmd->pSrc->mbufSize - cesaFrags.bufOffset;
+
+        if( (pSA->config & MV_CESA_OPERATION_MASK) != 
+            (MV_CESA_CRYPTO_ONLY << MV_CESA_OPERATION_OFFSET) )
+        {
+            macDataSize = pCmd->macLength - cesaFrags.macSize;
+
+            /* If pCmd->digestOffset is not located on last fragment */
+            if(pCmd->digestOffset < cesaFrags.bufOffset)
+            {
+                /* Prepare dummy place for digest in SRAM of this channel */
+                digestOffset = cesaSramVirtPtr->tempDigest[chan] - mvCesaSramAddrGet() -
+                                pCesaChan[chan].sramBufOffset;
+            }
+            else
+            {
+                digestOffset = pCmd->digestOffset - cesaFrags.bufOffset;
+            }
+            cesaFrags.newDigestOffset = digestOffset;
+            macTotalLen = pCmd->macLength;
+        }
+        if( (pSA->config & MV_CESA_OPERATION_MASK) != 
+            (MV_CESA_MAC_ONLY << MV_CESA_OPERATION_OFFSET) )
+        {
+            cryptoDataSize = pCmd->cryptoLength - cesaFrags.cryptoSize;
+        }
+        /* cryptoIvOffset - don't care */
+    }
+    else
+    {
+        /* Middle fragment */
+        fragMode = MV_CESA_FRAG_MIDDLE;
+        copySize = sizeof(cesaSramVirtPtr->buf[0]);
+        /* digestOffset and cryptoIvOffset - don't care */
+
+        mvCesaFragSizeFind(pSA, pCmd, cryptoOffset, macOffset,
+                        &copySize, &cryptoDataSize, &macDataSize);
+    }
+    config = pSA->config | (fragMode << MV_CESA_FRAG_MODE_OFFSET);
+
+    /********* Prepare IDMA descriptors to copy from pSrc to SRAM *********/
+    pMbuf = pCmd->pSrc;
+    i += mvCesaIdmaCopyPrepare(pMbuf, pSramBuf + fixOffset, &pIdmaDesc[i], 
+                                MV_FALSE, cesaFrags.bufOffset, copySize);
+
+   /* Add special descriptor Ownership for CPU */ 
+    pIdmaDesc[i].byteCnt = 0;
+    pIdmaDesc[i].phySrcAdd = 0;
+    pIdmaDesc[i].phyDestAdd = 0;
+    pIdmaDesc[i].phyNextDescPtr = MV_32BIT_LE((pCesaChan[chan].idmaPhysAddr + 
+                                                ((i+1)*sizeof(MV_DMA_DESC))));
+    mvOsCacheFlush(NULL, &pIdmaDesc[i], sizeof(MV_DMA_DESC));
+    i++;
+
+    /********* Prepare IDMA descriptors to copy from SRAM to pDst *********/
+    pMbuf = pCmd->pDst;
+    i += mvCesaIdmaCopyPrepare(pMbuf, pSramBuf + fixOffset, &pIdmaDesc[i], 
+                                MV_TRUE, cesaFrags.bufOffset, copySize);
+
+    /* Next field of Last Idma descriptor must be NULL */
+    pIdmaDesc[i-1].phyNextDescPtr = 0;
+    mvOsCacheFlush(NULL, &pIdmaDesc[i-1], sizeof(MV_DMA_DESC));
+
+    mvCesaSramDescrBuild(chan, pSA->cacheIdx, config, 
+                cryptoOffset + fixOffset, cryptoIvOffset + fixOffset, 
+                cryptoDataSize, macOffset + fixOffset, 
+                digestOffset + fixOffset, macDataSize, macTotalLen);
+
+    if(chan != 0)
+    {
+        /* All fragments of the request use crypto IV of channel #0 */
+        cesaSramVirtPtr->desc[chan].cryptoIvOffset = 
+                (MV_U16)(cesaSramVirtPtr->cryptoIV[0] - mvCesaSramAddrGet());
+        mvOsCacheFlush(NULL, &cesaSramVirtPtr->desc[chan], sizeof(MV_CESA_DESC));
+    }
+
+    cesaFrags.bufOffset += copySize;
+    cesaFrags.cryptoSize += cryptoDataSize;
+    cesaFrags.macSize += macDataSize;
+
+    cesaFrags.nextChan = chan;
+    cesaFrags.nextFragMode = fragMode;
+    cesaFrags.nextLoaded = MV_TRUE;
+
+    /* Channel is neither free nor in process */
+    pCesaChan[chan].state = MV_CESA_PENDING;
+
+    if(fragMode != MV_CESA_FRAG_FIRST)
+        cesaStats.pipeFragCount++;
+
+    /* Enable IDMA engine only: accelerator is started by mvCesaFragPipeFire() */
+    MV_REG_WRITE(IDMA_CURR_DESC_PTR_REG(chan), 0);
+    MV_REG_WRITE(IDMA_NEXT_DESC_PTR_REG(chan), (MV_U32)pCesaChan[chan].idmaPhysAddr);
+}
+
+/*******************************************************************************
+* mvCesaFragPipeFire - Start accelerator on the fragment loaded to SRAM
+*
+* DESCRIPTION:
+*       The accelerator waits for IDMA of the channel, so it can be started
+*       before the copy to SRAM is finished.
+*       When LAST fragment is started on channel #0, channel #1 shares nothing
+*       in SRAM with it, and is released for the next requests in the queue.
+*
+* INPUT:
+*       MV_CESA_REQ* pReq   - Pointer to the request in the request queue.
+*
+* RETURN:   None
+*
+*******************************************************************************/
+static void    mvCesaFragPipeFire(MV_CESA_REQ* pReq)
+{
+    int     chan = cesaFrags.nextChan;
+
+    cesaFrags.nextLoaded = MV_FALSE;
+
+    pReq->chanId = chan;
+    if(cesaFrags.nextFragMode == MV_CESA_FRAG_LAST)
+    {
+        pReq->fragMode = MV_CESA_FRAG_LAST;
+        if(chan == 0)
+            cesaLargeInProc = MV_FALSE;
+    }
+    else
+    {
+        pReq->fragMode = MV_CESA_FRAG_MIDDLE;
+    }
+    pCesaChan[chan].state = MV_CESA_PROCESS;
+
+    /* Start Accelerator */
+    MV_REG_WRITE(MV_CESA_CMD_REG, MV_CESA_CMD_CHAN_ENABLE_MASK(chan));
+}
+
+/*******************************************************************************
+* mvCesaReqProcess - Process regular (Non-fragmented) request
+*
+* DESCRIPTION:
+*       This function processes the whole (not fragmented) request
+*
+* INPUT:
+*       MV_CESA_REQ* pReq   - Pointer to the request in the request queue.
+*
+* RETURN:
+*       MV_OK   - The request is successfully passed to HW for processing.
+*       Other   - Failure. The request will not be processed
+*
+*******************************************************************************/
+static MV_STATUS   mvCesaReqProcess(int chan, MV_CESA_REQ* pReq)
+{
+    MV_STATUS   status;
+
+    cesaStats.procCount[chan]++;
+
+    pReq->chanId = chan;
+    pReq->state = MV_CESA_PROCESS;
+
+    if(pReq->pCmd->pSrc->mbufSize > sizeof(cesaSramVirtPtr->buf[0]) )
+    {
+        cesaStats.largeCount++;
+        cesaLargeInProc = MV_TRUE;
+        if(chan != 0)
+        {
+            mvOsPrintf("CesaReqProcess ERROR: chan=%d, size=%d\n", 
+                chan, pReq->pCmd->pSrc->mbufSize);
+            return MV_FAIL;
+        }
+    }
+
+    /* Pass request to HW */
+    status = mvCesaCmdProcess(chan, pReq->pCmd, pReq->fixOffset);
+    if(status != MV_OK)
     {
         mvOsPrintf("mvCesaCmdProcess Failed: chan=%d, status=0x%x\n", 
                      chan, status);
@@ -1991,7 +2620,8 @@ static void    mvCesaSramDescrBuild(int chan, int cacheIdx, MV_U32 config,
 *       This function checks if the required SA has its Cache entry updated
 *   in the SRAM. If SRAM has not Cache values for the SA, function finds
 *   recently used SA in the cache (LRU algorithm), deletes it from the SRAM
-*   and copy to SRAM Cache values of the required SA.
+*   and copy to SRAM Cache values of the required SA. Entries of pinned SAs
+*   are passed over when looking for the entry to replace.
 *   
 *
 * INPUT:
@@ -2012,17 +2642,29 @@ static MV_STATUS   mvCesaCacheSramUpdate(int sid, MV_DMA_DESC *pIdmaDesc)
 
     if(pSA->cacheIdx == MV_INVALID)
     {
+        int     cacheIdx, tries;
+
         status = MV_OK;
+        cesaStats.cacheMissCount++;
+        pSA->cacheLoads++;
 
-        /* Find recently used entry in the LRU database */
-        pSA->cacheIdx = mvCesaCacheIdxFind(pCesaCacheLRU);
+        /* Find recently used entry in the LRU database, not of a pinned SA */
+        for(tries=0; tries<cesaCacheSaNum; tries++)
+        {
+            cacheIdx = mvCesaCacheIdxFind(pCesaCacheLRU);
+            oldSid = cesaSramVirtPtr->cacheSA[cacheIdx].sid;
+            if( (oldSid == MV_INVALID) || (pCesaSAD[oldSid].pinned == 0) )
+                break;
+            mvCesaCacheIdxUpdate(pCesaCacheLRU, cacheIdx);
+        }
+        pSA->cacheIdx = cacheIdx;
 
         /* Update old SA entry used this cache entry */
-        oldSid = cesaSramVirtPtr->cacheSA[pSA->cacheIdx].sid;
         if(oldSid != MV_INVALID)
         {                
             /* Mark cache entry as Invalid for old SA */
             pCesaSAD[oldSid].cacheIdx = MV_INVALID;
+            cesaStats.cacheEvictCount++;
         }
         pSA->cacheSA.sid = sid;
 
@@ -2042,6 +2684,11 @@ static MV_STATUS   mvCesaCacheSramUpdate(int sid, MV_DMA_DESC *pIdmaDesc)
         /* flush the Idma desc */
         mvOsCacheFlush(NULL, pIdmaDesc, sizeof(MV_DMA_DESC));        
     }
+    else
+    {
+        cesaStats.cacheHitCount++;
+        pSA->cacheHits++;
+    }
     /* Mark to LRU algorithm that cacheIdx used now */
     mvCesaCacheIdxUpdate(pCesaCacheLRU, pSA->cacheIdx);
     return status;
@@ -2449,6 +3096,29 @@ static MV_STATUS   mvCesaFragAuthComplete(MV_CESA_COMMAND* pCmd, MV_CESA_SA* pSA
     mvCesaCopyToMbuf(cesaSramVirtPtr->buf[0], pCmd->pDst, cesaFrags.bufOffset, macDataSize); 
 */
     pDigest = (mvCesaSramAddrGet() + cesaFrags.newDigestOffset);
+
+    if(pSA->pMacStream != NULL)
+    {
+        MV_CESA_MAC_STREAM* pStream = pSA->pMacStream;
+        int                 i;
+
+        /* Running state after the fragments processed by HW */
+        for(i=0; i<pSA->digestSize/4; i++)
+        {
+            pStream->state[i] = MV_REG_READ(MV_CESA_AUTH_INIT_VALUE_DIGEST_REG(i));
+        }
+        pStream->countLow += (pCmd->macLength - macDataSize);
+        if(pStream->countLow < (pCmd->macLength - macDataSize))
+            pStream->countHigh++;
+
+        mvCesaMacStreamHash(pStream, pCmd->pDst, cesaFrags.bufOffset, macDataSize, pDigest);
+        if(pStream->last == MV_FALSE)
+        {
+            mvCesaMacStreamIvUpdate(pSA);
+            memcpy(pDigest, pStream->state, pSA->digestSize);
+        }
+        return MV_OK;
+    }
  
     macMode = (pSA->config & MV_CESA_MAC_MODE_MASK) >> MV_CESA_MAC_MODE_OFFSET;
 /*
@@ -2480,6 +3150,135 @@ static MV_STATUS   mvCesaFragAuthComplete(MV_CESA_COMMAND* pCmd, MV_CESA_SA* pSA
     return MV_OK;
 }
 
+/*******************************************************************************
+* mvCesaMacStreamIvUpdate - Load running state of the stream as inner IV
+*
+* DESCRIPTION:
+*       Inner IV is kept 32 bits swapped, as mvCesaHmacIvGet() prepares it.
+*       If the SA is in the SRAM Cache the SRAM copy is updated too, so the
+*       Cache entry should not be reloaded.
+*
+* INPUT:
+*       MV_CESA_SA* pSA - SA with attached stream.
+*
+* RETURN:   None
+*
+*******************************************************************************/
+static void    mvCesaMacStreamIvUpdate(MV_CESA_SA* pSA)
+{
+    MV_U32  *pInnerIV = (MV_U32*)pSA->cacheSA.macInnerIV;
+    MV_U8   *pSramIV;
+    int     i;
+
+    for(i=0; i<MV_CESA_MAX_DIGEST_SIZE/4; i++)
+    {
+        pInnerIV[i] = MV_BYTE_SWAP_32BIT(pSA->pMacStream->state[i]);
+    }
+    if(pSA->cacheIdx != MV_INVALID)
+    {
+        pSramIV = cesaSramVirtPtr->cacheSA[pSA->cacheIdx].macInnerIV;
+        memcpy(pSramIV, pSA->cacheSA.macInnerIV, MV_CESA_MAX_DIGEST_SIZE);
+        mvOsCacheFlush(NULL, pSramIV, MV_CESA_MAX_DIGEST_SIZE);
+        mvOsCacheInvalidate(NULL, pSramIV, MV_CESA_MAX_DIGEST_SIZE);
+    }
+}
+
+/*******************************************************************************
+* mvCesaMacStreamHash - Continue streamed MD5 or SHA1 by SW
+*
+* DESCRIPTION:
+*       Hash the data from the running state of the stream. If pStream->last
+*       is set the hash is completed, otherwise size must be the whole 
+*       number of 64 bytes blocks and the new running state is kept in the 
+*       stream.
+*
+* INPUT:
+*       MV_CESA_MAC_STREAM* pStream - Stream.
+*       MV_CESA_MBUF*       pMbuf   - Mbuf structure where the data is placed.
+*       int                 offset  - Offset of the data in the Mbuf.
+*       int                 size    - Size of the data.
+*
+* OUTPUT:
+*       MV_U8*     pDigest  - Digest, only if pStream->last is set.
+*
+* RETURN:   None
+*
+*******************************************************************************/
+static void    mvCesaMacStreamHash(MV_CESA_MAC_STREAM* pStream, MV_CESA_MBUF* pMbuf, 
+                                   int offset, int size, MV_U8* pDigest)
+{
+    MV_MD5_CONTEXT  md5;
+    MV_SHA1_CTX     sha1;
+    MV_U8           *pData = NULL;
+    int             frag = 0, fragOffset = 0, fragSize = 0;
+
+    /* Nothing to find when only the final padding is left */
+    if(size > 0)
+    {
+        frag = mvCesaMbufOffset(pMbuf, offset, &fragOffset);
+        if(frag == MV_INVALID)
+        {
+            mvOsPrintf("CESA Mbuf Error: offset (%d) out of range\n", offset);
+            return;
+        }
+        pData = pMbuf->pFrags[frag].bufVirtPtr + fragOffset;
+        fragSize = pMbuf->pFrags[frag].bufSize - fragOffset;
+    }
+
+    if(pStream->macMode == MV_CESA_MAC_MD5)
+    {
+        memcpy(md5.buf, pStream->state, MV_CESA_MD5_DIGEST_SIZE);
+        memset(md5.in, 0, 64);
+        md5.bits[0] = (pStream->countLow << 3);
+        md5.bits[1] = (pStream->countHigh << 3) | (pStream->countLow >> 29);
+    }
+    else
+    {
+        memcpy(sha1.state, pStream->state, MV_CESA_SHA1_DIGEST_SIZE);
+        memset(sha1.buffer, 0, 64);
+        sha1.count[0] = (pStream->countLow << 3);
+        sha1.count[1] = (pStream->countHigh << 3) | (pStream->countLow >> 29);
+    }
+
+    while(size > 0)
+    {
+        if(fragSize > size)
+            fragSize = size;
+
+        if(pStream->macMode == MV_CESA_MAC_MD5)
+            mvMD5Update(&md5, pData, fragSize);
+        else
+            mvSHA1Update(&sha1, pData, fragSize);
+
+        pStream->countLow += fragSize;
+        if(pStream->countLow < fragSize)
+            pStream->countHigh++;
+
+        size -= fragSize;
+        if(size > 0)
+        {
+            frag++;
+            pData = pMbuf->pFrags[frag].bufVirtPtr;
+            fragSize = pMbuf->pFrags[frag].bufSize;
+        }
+    }
+
+    if(pStream->macMode == MV_CESA_MAC_MD5)
+    {
+        if(pStream->last)
+            mvMD5Final(pDigest, &md5);
+        else
+            memcpy(pStream->state, md5.buf, MV_CESA_MD5_DIGEST_SIZE);
+    }
+    else
+    {
+        if(pStream->last)
+            mvSHA1Final(pDigest, &sha1);
+        else
+            memcpy(pStream->state, sha1.state, MV_CESA_SHA1_DIGEST_SIZE);
+    }
+}
+
 /*******************************************************************************
 * mvCesaCtrModeInit - 
 *
@@ -2847,12 +3646,15 @@ static MV_STATUS   mvCesaParamCheck(MV_CESA_SA* pSA, MV_CESA_COMMAND *pCmd,
 *
 * INPUT:
 *       MV_CESA_SA* pSA, MV_CESA_COMMAND *pCmd
+*       int bufSize     - SRAM size of the FIRST and LAST fragments.
+*       MV_BOOL verbose - print the reason of failure.
 *
 * RETURN:
 *       MV_STATUS 
 *
 *******************************************************************************/
-static MV_STATUS   mvCesaFragParamCheck(MV_CESA_SA* pSA, MV_CESA_COMMAND *pCmd)
+static MV_STATUS   mvCesaFragParamCheck(MV_CESA_SA* pSA, MV_CESA_COMMAND *pCmd, 
+                                        int bufSize, MV_BOOL verbose)
 {
     int     offset;
 
@@ -2860,19 +3662,21 @@ static MV_STATUS   mvCesaFragParamCheck(MV_CESA_SA* pSA, MV_CESA_COMMAND *pCmd)
                 (MV_CESA_CRYPTO_ONLY << MV_CESA_OPERATION_OFFSET)) )
     {
         /* macOffset must be less that SRAM buffer size */
-        if(pCmd->macOffset > (sizeof(cesaSramVirtPtr->buf) - MV_CESA_AUTH_BLOCK_SIZE))
+        if(pCmd->macOffset > (bufSize - MV_CESA_AUTH_BLOCK_SIZE))
         {
-            mvOsPrintf("mvCesaFragParamCheck: macOffset is too large (%d)\n",
-                        pCmd->macOffset);
+            if(verbose)
+                mvOsPrintf("mvCesaFragParamCheck: macOffset is too large (%d)\n",
+                            pCmd->macOffset);
             return MV_BAD_PARAM;
         }
         /* macOffset+macSize must be more than mbufSize - SRAM buffer size */ 
         if( ((pCmd->macOffset + pCmd->macLength) > pCmd->pSrc->mbufSize) ||
             ((pCmd->pSrc->mbufSize - (pCmd->macOffset + pCmd->macLength)) >=
-             sizeof(cesaSramVirtPtr->buf)) )
+             bufSize) )
         {
-            mvOsPrintf("mvCesaFragParamCheck: macLength is too large (%d), mbufSize=%d\n",
-                        pCmd->macLength, pCmd->pSrc->mbufSize);
+            if(verbose)
+                mvOsPrintf("mvCesaFragParamCheck: macLength is too large (%d), mbufSize=%d\n",
+                            pCmd->macLength, pCmd->pSrc->mbufSize);
             return MV_BAD_PARAM;
         }
     }
@@ -2882,20 +3686,22 @@ static MV_STATUS   mvCesaFragParamCheck(MV_CESA_SA* pSA, MV_CESA_COMMAND *pCmd)
     {
         /* cryptoOffset must be less that SRAM buffer size */
         /* 4 for possible fixOffset */
-        if( (pCmd->cryptoOffset + 4) > (sizeof(cesaSramVirtPtr->buf) - pSA->cryptoBlockSize))
+        if( (pCmd->cryptoOffset + 4) > (bufSize - pSA->cryptoBlockSize))
         {
-            mvOsPrintf("mvCesaFragParamCheck: cryptoOffset is too large (%d)\n",
-                        pCmd->cryptoOffset);
+            if(verbose)
+                mvOsPrintf("mvCesaFragParamCheck: cryptoOffset is too large (%d)\n",
+                            pCmd->cryptoOffset);
             return MV_BAD_PARAM;
         }
 
         /* cryptoOffset+cryptoSize must be more than mbufSize - SRAM buffer size */ 
         if( ((pCmd->cryptoOffset + pCmd->cryptoLength) > pCmd->pSrc->mbufSize) ||
             ((pCmd->pSrc->mbufSize - (pCmd->cryptoOffset + pCmd->cryptoLength)) >=
-             (sizeof(cesaSramVirtPtr->buf) - pSA->cryptoBlockSize)) )
+             (bufSize - pSA->cryptoBlockSize)) )
         {
-            mvOsPrintf("mvCesaFragParamCheck: cryptoLength is too large (%d), mbufSize=%d\n",
-                        pCmd->cryptoLength, pCmd->pSrc->mbufSize);
+            if(verbose)
+                mvOsPrintf("mvCesaFragParamCheck: cryptoLength is too large (%d), mbufSize=%d\n",
+                            pCmd->cryptoLength, pCmd->pSrc->mbufSize);
             return MV_BAD_PARAM;
         }
     }
@@ -2931,22 +3737,50 @@ static MV_STATUS   mvCesaFragParamCheck(MV_CESA_SA* pSA, MV_CESA_COMMAND *pCmd)
 
         if( MV_IS_NOT_ALIGN(offset,  pSA->cryptoBlockSize) )
         {
-            mvOsPrintf("mvCesaFragParamCheck: (cryptoOffset - macOffset) must be %d byte aligned\n",
-                        pSA->cryptoBlockSize);
+            if(verbose)
+                mvOsPrintf("mvCesaFragParamCheck: (cryptoOffset - macOffset) must be %d byte aligned\n",
+                            pSA->cryptoBlockSize);
             return MV_NOT_ALLOWED;
         }
         /* Digest must not be part of CryptoLength */
         if( ((pCmd->digestOffset + pSA->digestSize) > pCmd->cryptoOffset) &&
             (pCmd->digestOffset < (pCmd->cryptoOffset + pCmd->cryptoLength)) )
         {
-            mvOsPrintf("mvCesaFragParamCheck: digestOffset (%d) is part of cryptoLength (%d+%d)\n",
-                        pCmd->digestOffset, pCmd->cryptoOffset, pCmd->cryptoLength);
+            if(verbose)
+                mvOsPrintf("mvCesaFragParamCheck: digestOffset (%d) is part of cryptoLength (%d+%d)\n",
+                            pCmd->digestOffset, pCmd->cryptoOffset, pCmd->cryptoLength);
             return MV_NOT_ALLOWED;
         }
     }
     return MV_OK;
 }
 
+/*******************************************************************************
+* mvCesaFragPipeAllowed - Check if the request can be processed in pipelined mode
+*
+* DESCRIPTION:
+*       The next fragment is prepared before the previous one is finished,
+*       so the requests which digest is completed by SW are not allowed.
+*
+* INPUT:
+*       MV_CESA_SA* pSA, MV_CESA_COMMAND *pCmd
+*
+* RETURN:
+*       MV_BOOL 
+*
+*******************************************************************************/
+static MV_BOOL     mvCesaFragPipeAllowed(MV_CESA_SA* pSA, MV_CESA_COMMAND *pCmd)
+{
+    if( ((pSA->config & MV_CESA_OPERATION_MASK) != 
+                (MV_CESA_CRYPTO_ONLY << MV_CESA_OPERATION_OFFSET)) &&
+        ((mvCtrlModelGet() == MV_5182_DEV_ID) || (pCmd->macLength >= (1 << 14)) ||
+         (pSA->pMacStream != NULL)) )
+    {
+        return MV_FALSE;
+    }
+    return MV_TRUE;
+}
+
 /*******************************************************************************
 * mvCesaFragSizeFind - 
 *
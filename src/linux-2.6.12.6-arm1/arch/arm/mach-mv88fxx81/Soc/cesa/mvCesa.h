@@ -105,13 +105,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #define MV_CESA_MAX_CHAN                2
 
-/* For systems with 4K bytes SRAM memory */
+/* Fits both 4K and 8K bytes SRAM, see the SRAM map below */
 #define MV_CESA_MAX_BUF_SIZE            1600
 
-/* For systems with 8K bytes SRAM memory */
+/* Only for systems with 8K bytes SRAM memory, leaves 9 SA Cache entries */
 /*#define MV_CESA_MAX_BUF_SIZE            3648*/
 
-#define MV_CESA_MAX_CACHE_SA            9
 #define MV_CESA_MAX_MBUF_FRAGS          20
 
 typedef struct
@@ -165,17 +164,38 @@ typedef struct
 
 } MV_CESA_COMMAND;
 
+/* Running MD5/SHA1 of a stream hashed by several commands, see mvCesaMacStreamSet() */
+typedef struct
+{
+    MV_U32              state[MV_CESA_MAX_DIGEST_SIZE/4];
+    MV_U32              countLow;   /* bytes hashed so far */
+    MV_U32              countHigh;
+    MV_CESA_MAC_MODE    macMode;    /* MV_CESA_MAC_MD5 or MV_CESA_MAC_SHA1 */
+    MV_BOOL             last;       /* next command completes the hash */
+
+} MV_CESA_MAC_STREAM;
+
+/* Shorter streamed commands are not fragmented, use mvCesaMacStreamSw() */
+#define MV_CESA_MAC_STREAM_MIN_SIZE     (MV_CESA_MAX_CHAN*MV_CESA_MAX_BUF_SIZE + 1)
+
 
 
 MV_STATUS   mvCesaInit (int numOfSession, int queueDepth, char* pSramBase);
 MV_STATUS   mvCesaFinish (void);
 MV_STATUS   mvCesaSessionOpen(MV_CESA_OPEN_SESSION *pSession, short* pSid);
 MV_STATUS   mvCesaSessionClose(short sid);
+MV_STATUS   mvCesaSessionPin(short sid, MV_BOOL pin);
 MV_STATUS   mvCesaCryptoIvSet(int chan, MV_U8* pIV, int ivSize);
 
+void        mvCesaMacStreamInit(MV_CESA_MAC_STREAM* pStream, MV_CESA_MAC_MODE macMode);
+MV_STATUS   mvCesaMacStreamSet(short sid, MV_CESA_MAC_STREAM* pStream);
+MV_STATUS   mvCesaMacStreamSw(MV_CESA_COMMAND* pCmd);
+
 MV_STATUS   mvCesaAction (MV_CESA_COMMAND* pCmd);
 
 MV_U32      mvCesaChanInProcessGet(void);
+void        mvCesaFragPipeSet(MV_BOOL pipe);
+MV_BOOL     mvCesaFragPipeGet(void);
 MV_STATUS   mvCesaReadyDispatch(MV_U32 chanMask);
 MV_STATUS   mvCesaReadyGet(MV_U32 chanMap, MV_CESA_RESULT* pResult);
 MV_BOOL     mvCesaIsReady(int chan);
@@ -253,7 +273,11 @@ typedef struct
     MV_U8               macKeyLength;
     MV_U8               valid;
     MV_U8               ctrMode;
+    MV_U8               pinned;
     MV_U32              count;
+    MV_U32              cacheHits;
+    MV_U32              cacheLoads;
+    MV_CESA_MAC_STREAM* pMacStream;
 
 } MV_CESA_SA;
 
@@ -265,6 +289,7 @@ typedef struct
     MV_U8               state;
     MV_U8               fragMode;
     MV_U8               fixOffset;
+    MV_U8               fragPipe;
     MV_U16              cpOffset;
     MV_U16              cpSize;
     MV_CESA_COMMAND*    pCmd;
@@ -284,9 +309,25 @@ typedef struct
  *              MV_CESA_MAX_IV_LENGTH*MV_CESA_MAX_CHAN +
  *              MV_CESA_MAX_DIGEST_SIZE*MV_CESA_MAX_CHAN +
  *              sizeof(MV_CESA_CACHE_SA)*MV_CESA_MAX_CACHE_SA
- *            = 1600*2 + 32*2 + 16*2 + 16*2 + 24*2 + 80*9 = 4096 bytes
- *            = 3648*2 + 32*2 + 16*2 + 16*2 + 24*2 + 80*9 = 8192 bytes
+ *            = 1600*2 + 32*2 + 16*2 + 16*2 + 24*2 + 80*60 = 8176 bytes
+ *            = 1600*2 + 32*2 + 16*2 + 16*2 + 24*2 + 80*8  = 4016 bytes
+ *            = 3648*2 + 32*2 + 16*2 + 16*2 + 24*2 + 80*9  = 8192 bytes
+ *
+ * The map is laid out for MV_CESA_SRAM_SIZE, the largest SRAM.  Whatever
+ * the SRAM found by mvCesaInit() leaves after the buffers is used for SA
+ * Cache entries, cesaCacheSaNum of them: with 1600 byte buffers 60 on an
+ * 8K SRAM and 8 on a 4K one.
  */
+#define MV_CESA_SRAM_FIXED_SIZE                                     \
+            (MV_CESA_MAX_CHAN*(MV_CESA_MAX_BUF_SIZE + sizeof(MV_CESA_DESC) + \
+                2*MV_CESA_MAX_IV_LENGTH + MV_CESA_MAX_DIGEST_SIZE + 4))
+
+#define MV_CESA_MAX_CACHE_SA                                        \
+            ((MV_CESA_SRAM_SIZE - MV_CESA_SRAM_FIXED_SIZE)/sizeof(MV_CESA_CACHE_SA))
+
+/* Pinned SAs are never replaced; leave room for the SAs of requests in flight */
+#define MV_CESA_MAX_PINNED_SA           (cesaCacheSaNum/2)
+
 typedef struct
 {
     MV_U8               buf[MV_CESA_MAX_CHAN][MV_CESA_MAX_BUF_SIZE];
@@ -316,11 +357,16 @@ typedef struct
     MV_U32  closedCount;
     MV_U32  fragCount;
     MV_U32  largeCount;
+    MV_U32  pipeCount;
+    MV_U32  pipeFragCount;
     MV_U32  reqCount;
     MV_U32  maxReqCount;
     MV_U32  procCount[MV_CESA_MAX_CHAN];
     MV_U32  readyCount[MV_CESA_MAX_CHAN];
     MV_U32  notReadyCount[MV_CESA_MAX_CHAN];
+    MV_U32  cacheHitCount;
+    MV_U32  cacheMissCount;
+    MV_U32  cacheEvictCount;
 
 } MV_CESA_STATS;
 
@@ -332,15 +378,23 @@ typedef struct
     int                 macSize;
     int                 newDigestOffset;
     MV_U8               orgDigest[MV_CESA_MAX_DIGEST_SIZE];
+    /* Pipelined mode: fragment loaded to SRAM and waiting for the accelerator */
+    MV_BOOL             nextLoaded;
+    int                 nextChan;
+    MV_U8               nextFragMode;
     
 } MV_CESA_FRAGS;
 
 /* External variables */
 extern MV_BOOL          cesaLargeInProc;
+extern MV_BOOL          cesaFragPipe;
 
 extern MV_CESA_STATS    cesaStats;   
 extern MV_CESA_FRAGS    cesaFrags;
 extern MV_LRU_CACHE*    pCesaCacheLRU;
+extern int              cesaCachePinned;
+extern int              cesaCacheSaNum;
+extern int              cesaSramSize;
 
 extern MV_CESA_SA*       pCesaSAD;
 extern MV_U16            cesaMaxSA;
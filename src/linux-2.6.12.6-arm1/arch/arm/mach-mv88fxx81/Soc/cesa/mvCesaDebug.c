@@ -223,7 +223,7 @@ void    mvCesaDebugStatus(void)
 
     mvOsPrintf("sramVirt=%p, sramPhys=0x%x, maxCacheSA=%d, pCacheLRU=%p\n",
                 cesaSramVirtPtr, (MV_U32)mvCesaSramVirtToPhys(NULL, (MV_U8*)cesaSramVirtPtr), 
-                MV_CESA_MAX_CACHE_SA, pCesaCacheLRU);
+                cesaCacheSaNum, pCesaCacheLRU);
 
     mvOsPrintf("pReqQ=%p, qDepth=%d, reqSize=%d bytes, qRes=%d, readyMap=0x%x\n", 
                 pCesaReqFirst, cesaQueueDepth, sizeof(MV_CESA_REQ), 
@@ -349,6 +349,9 @@ void    mvCesaDebugSA(short sid, int mode)
         mvOsPrintf("\n\nCESA SA Entry #%d (%p) - %s (count=%d)\n", 
                     sid, pSA, 
                     pSA->valid ? "Valid" : "Invalid", pSA->count);
+        mvOsPrintf("cacheIdx=%d, cacheHits=%d, cacheLoads=%d%s\n",
+                    pSA->cacheIdx, pSA->cacheHits, pSA->cacheLoads,
+                    pSA->pinned ? ", pinned" : "");
 
         oper = (pSA->config & MV_CESA_OPERATION_MASK) >> MV_CESA_OPERATION_OFFSET;
         dir  = (pSA->config & MV_CESA_DIRECTION_MASK) >> MV_CESA_DIRECTION_BIT;
@@ -429,7 +432,7 @@ void    mvCesaDebugSram(int mode)
         }
     }
     mvOsPrintf("\n");
-    for(idx=0; idx<MV_CESA_MAX_CACHE_SA; idx++)
+    for(idx=0; idx<cesaCacheSaNum; idx++)
     {
         mvCesaDebugCacheSA(&cesaSramVirtPtr->cacheSA[idx], 0);
     }
@@ -459,6 +462,12 @@ void    mvCesaDebugStats(void)
     mvOsPrintf("Req=%d, maxReq=%d, frags=%d, large=%d\n", 
                 cesaStats.reqCount, cesaStats.maxReqCount, 
                 cesaStats.fragCount, cesaStats.largeCount);
+    mvOsPrintf("fragMode=%s, pipe=%d, pipeFrags=%d\n", 
+                cesaFragPipe ? "pipe" : "serial",
+                cesaStats.pipeCount, cesaStats.pipeFragCount);
+    mvOsPrintf("cacheSA=%d, pinned=%d, hits=%d, misses=%d, evicts=%d\n",
+                cesaCacheSaNum, cesaCachePinned, cesaStats.cacheHitCount,
+                cesaStats.cacheMissCount, cesaStats.cacheEvictCount);
 
     mvOsPrintf("\n");
     for(chan=0; chan<MV_CESA_MAX_CHAN; chan++)
@@ -2739,6 +2739,42 @@ void    loopback_test(int idx, int iter, int size, char* pPlainData)
 {
 }
 
+/* Requests larger than SRAM buffer in serial and pipelined fragment modes */
+static int  fragPipeSizes[] = {1024, 2048, 3072, 4096, 6144, 8192, 16384, 0};
+
+void    fragPipeTest(int idx, int caseIdx, int iter, int checkMode)
+{
+    MV_STATUS   status;
+    MV_BOOL     orgPipe = mvCesaFragPipeGet();
+    int         i, pipe, maxSize;
+
+    if(iter == 0)
+        iter = CESA_DEF_ITER_NUM;
+
+    if( testOpen(idx) != MV_OK)
+        return;
+
+    /* Leave place for IV and digest in the test buffers */
+    maxSize = cesaBufNum*cesaBufSize - 64;
+
+    for(i=0; fragPipeSizes[i] != 0; i++)
+    {
+        if(fragPipeSizes[i] > maxSize)
+            break;
+
+        for(pipe=0; pipe<2; pipe++)
+        {
+            mvCesaFragPipeSet(pipe ? MV_TRUE : MV_FALSE);
+
+            status = testRun(idx, caseIdx, iter, fragPipeSizes[i], checkMode);
+            mvOsPrintf("%-6s ", pipe ? "pipe" : "serial");
+            printTestResults(idx, status, checkMode);
+        }
+    }
+    mvCesaFragPipeSet(orgPipe);
+    testClose(idx);
+}
+
 
 #if defined(VXWORKS)
 int testMode = 0;
@@ -2756,10 +2792,14 @@ static unsigned __TASKCONV cesaTask(void* args)
             cesaTest(cesaIteration, cesaReqSize, cesaCheckMode);
             combiTest(cesaIteration, cesaReqSize, cesaCheckMode);
         }
-        else
+        else if(testMode == 2)
         {
             multiSizeTest(cesaIdx, cesaIteration, cesaCheckMode, NULL); 
         }
+        else
+        {
+            fragPipeTest(cesaTestIdx, cesaCaseIdx, cesaIteration, cesaCheckMode);
+        }
     }
     return 0;
 }
@@ -2812,6 +2852,22 @@ void sizeTest(int testIdx, int iter, int checkMode)
     }
 }
 
+void fragTest(int testIdx, int caseIdx, int iter, int checkMode)
+{
+    long    rc;
+
+    cesaIteration = iter;
+        cesaCheckMode = checkMode;
+        testMode = 3;
+        cesaTestIdx = testIdx;
+        cesaCaseIdx = caseIdx;
+    rc = mvOsTaskCreate("CESA_T", 10, 4*1024, cesaTask, NULL, &cesaTaskId);
+    if (rc != MV_OK) 
+    {
+        mvOsPrintf("hMW: Can't create CESA frag test task, rc = %ld\n", rc);
+    }
+}
+
 #endif /* VXWORKS */
 
 extern void    mvCesaDebugSA(short sid, int mode);
@@ -63,6 +63,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 *******************************************************************************/
 
 #include "mvCntmr.h"
+#include "mvCpuIfRegs.h"
 
 /* defines  */       
 #ifdef MV_DEBUG         
@@ -393,3 +394,38 @@ MV_STATUS mvCntmrStart(MV_U32 countNum, MV_U32 value,
 	return MV_OK;
 }
 
+/*******************************************************************************
+* mvCntmrFreeRunStart - 
+*
+* DESCRIPTION:
+*  	Start the watchdog counter as a free running 32 bit counter, counting
+*       down from 0xffffffff at the counter clock and reloading at zero.
+*       The watchdog reset output is masked first, so that the counter can
+*       never reset the system.
+*
+* INPUT:
+*       None.
+*
+* OUTPUT:
+*       None.
+*
+* RETURN:
+*       MV_OK
+*******************************************************************************/
+MV_STATUS mvCntmrFreeRunStart(MV_VOID)
+{
+	MV_U32 cntmrCtrl;
+
+	MV_REG_BIT_RESET(CPU_RSTOUTN_MASK_REG, CRMR_WD_RST_OUT_MASK);
+
+	MV_REG_WRITE(CNTMR_RELOAD_REG(WATCHDOG_NUM), 0xffffffff);
+	MV_REG_WRITE(CNTMR_VAL_REG(WATCHDOG_NUM), 0xffffffff);
+
+	cntmrCtrl = MV_REG_READ(CNTMR_CTRL_REG);
+	cntmrCtrl |= CTCR_ARM_TIMER_EN(WATCHDOG_NUM) |
+		     CTCR_ARM_TIMER_AUTO_EN(WATCHDOG_NUM);
+	MV_REG_WRITE(CNTMR_CTRL_REG, cntmrCtrl);
+
+	return MV_OK;
+}
+
@@ -118,4 +118,7 @@ MV_STATUS mvCntmrDisable(MV_U32 countNum);
 MV_STATUS mvCntmrStart(MV_U32 countNum, MV_U32 value,
                        MV_CNTMR_CTRL *pCtrl);
 
+/* Run the watchdog counter as a free running counter, without reset */
+MV_STATUS mvCntmrFreeRunStart(MV_VOID);
+
 #endif /* __INCmvTmrWtdgh */
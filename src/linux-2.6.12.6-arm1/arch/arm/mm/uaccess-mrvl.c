@@ -0,0 +1,250 @@
+/*
+ *  linux/arch/arm/mm/uaccess-mrvl.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ *  Boot time selection of the Orion copy_to/from_user and
+ *  csum_partial_copy routines (arch/arm/lib/ *-orion.S), and an
+ *  optional /proc benchmark comparing them with the generic ones.
+ */
+#include <linux/config.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/sched.h>
+#include <linux/time.h>
+#include <linux/mm.h>
+#include <linux/proc_fs.h>
+
+#include <asm/uaccess.h>
+#include <asm/checksum.h>
+#include <asm/system.h>
+
+extern unsigned long __orion_copy_from_user(void *to, const void __user *from,
+					    unsigned long n);
+extern unsigned long __orion_copy_to_user(void __user *to, const void *from,
+					  unsigned long n);
+extern unsigned int __orion_csum_partial_copy_nocheck(const char *src,
+						      char *dst, int len,
+						      int sum);
+extern unsigned int __orion_csum_partial_copy_from_user(const char __user *src,
+							char *dst, int len,
+							int sum, int *err_ptr);
+
+/* the generic routines until mrvl_uaccess_init() has run */
+struct cpu_uaccess_fns cpu_uaccess = {
+	.cpu_copy_from_user	= __arch_copy_from_user,
+	.cpu_copy_to_user	= __arch_copy_to_user,
+};
+EXPORT_SYMBOL(cpu_uaccess);
+
+struct cpu_csum_fns cpu_csum = {
+	.copy_nocheck		= csum_partial_copy_nocheck,
+	.copy_from_user		= csum_partial_copy_from_user,
+};
+EXPORT_SYMBOL(cpu_csum);
+
+static int orion_uaccess __initdata = 1;
+
+static int __init orion_uaccess_setup(char *str)
+{
+	if (strcmp(str, "off") == 0)
+		orion_uaccess = 0;
+	return 1;
+}
+
+__setup("orion_uaccess=", orion_uaccess_setup);
+
+static int __init mrvl_uaccess_init(void)
+{
+	/* the Orion routines preload with pld, which needs ARMv5TE */
+	if (!orion_uaccess || cpu_architecture() < CPU_ARCH_ARMv5TE)
+		return 0;
+
+	cpu_uaccess.cpu_copy_from_user = __orion_copy_from_user;
+	cpu_uaccess.cpu_copy_to_user = __orion_copy_to_user;
+	cpu_csum.copy_nocheck = __orion_csum_partial_copy_nocheck;
+	cpu_csum.copy_from_user = __orion_csum_partial_copy_from_user;
+
+	printk(KERN_INFO "Orion: using preloading copy_to/from_user and "
+	       "csum_partial_copy\n");
+	return 0;
+}
+
+core_initcall(mrvl_uaccess_init);
+
+#ifdef CONFIG_MV_UACCESS_BENCH
+/*
+ * /proc/mv_uaccess_bench
+ *
+ * Every routine is timed, generic against Orion, by copying BENCH_BYTES
+ * in blocks of each size at each source/destination alignment.  The
+ * "user" side is a kernel buffer reached under KERNEL_DS, so the ldrt/strt
+ * paths are exercised exactly as for a real user copy, with both buffers
+ * warm in the cache for the small sizes and streaming for the large ones.
+ * Before timing, both variants are run once and their results compared.
+ */
+#define BENCH_MAX	(64 * 1024)
+#define BENCH_BYTES	(8 * 1024 * 1024)
+#define BENCH_ORDER	get_order(BENCH_MAX + L1_CACHE_BYTES)
+
+enum { B_FROM_USER, B_TO_USER, B_CSUM, B_CSUM_USER, B_NR };
+
+static const char *bench_names[B_NR] = {
+	"from_user", "to_user", "csum", "csum_user"
+};
+
+static const unsigned int bench_sizes[] = {
+	64, 256, 1024, 4096, 16384, 65536
+};
+
+static const struct {
+	unsigned int src, dst;
+} bench_align[] = {
+	{ 0, 0 }, { 0, 2 }, { 1, 3 }
+};
+
+static unsigned long bench_call(int fn, int orion, char *dst,
+				const char *src, unsigned int len)
+{
+	int err = 0;
+
+	/* (csum_partial_copy_*) bypasses the cpu_csum macros: the generic one */
+	switch (fn) {
+	case B_FROM_USER:
+		return orion ?
+			__orion_copy_from_user(dst, (const void __user *)src, len) :
+			__arch_copy_from_user(dst, (const void __user *)src, len);
+	case B_TO_USER:
+		return orion ?
+			__orion_copy_to_user((void __user *)dst, src, len) :
+			__arch_copy_to_user((void __user *)dst, src, len);
+	case B_CSUM:
+		return orion ?
+			__orion_csum_partial_copy_nocheck(src, dst, len, 0) :
+			(csum_partial_copy_nocheck)(src, dst, len, 0);
+	default:
+		if (orion)
+			return __orion_csum_partial_copy_from_user(
+				(const char __user *)src, dst, len, 0, &err) + err;
+		return (csum_partial_copy_from_user)(
+			(const char __user *)src, dst, len, 0, &err) + err;
+	}
+}
+
+/* true if both variants copy correctly and return the same value */
+static int bench_check(int fn, char *dst, const char *src, unsigned int len)
+{
+	unsigned long ret[2];
+	int orion;
+
+	for (orion = 0; orion < 2; orion++) {
+		memset(dst, 0, len);
+		ret[orion] = bench_call(fn, orion, dst, src, len);
+		if (memcmp(dst, src, len))
+			return 0;
+	}
+	return ret[0] == ret[1];
+}
+
+/* MB/s, times ten */
+static unsigned long bench_time(int fn, int orion, char *dst,
+				const char *src, unsigned int len)
+{
+	unsigned long loops = BENCH_BYTES / len, i, usecs;
+	struct timeval start, end;
+
+	do_gettimeofday(&start);
+	for (i = 0; i < loops; i++)
+		bench_call(fn, orion, dst, src, len);
+	do_gettimeofday(&end);
+
+	usecs = (end.tv_sec - start.tv_sec) * USEC_PER_SEC +
+		end.tv_usec - start.tv_usec;
+	if (usecs == 0)
+		usecs = 1;
+	return loops * len * 10 / usecs;
+}
+
+static int uaccess_bench_read_proc(char *page, char **start, off_t off,
+				   int count, int *eof, void *data)
+{
+	unsigned long src_buf, dst_buf, mbs[2];
+	mm_segment_t old_fs;
+	int s, a, fn, orion, len = 0;
+
+	/* one run per read, and it all fits in the page */
+	if (off > 0) {
+		*eof = 1;
+		return 0;
+	}
+
+	src_buf = __get_free_pages(GFP_KERNEL, BENCH_ORDER);
+	dst_buf = __get_free_pages(GFP_KERNEL, BENCH_ORDER);
+	if (!src_buf || !dst_buf) {
+		len = -ENOMEM;
+		goto out;
+	}
+	for (s = 0; s < BENCH_MAX + L1_CACHE_BYTES; s++)
+		((char *)src_buf)[s] = s * 7 + (s >> 8);
+
+	len += sprintf(page + len, "MB/s, generic/orion\n%6s %5s", "size",
+		       "align");
+	for (fn = 0; fn < B_NR; fn++)
+		len += sprintf(page + len, " %15s", bench_names[fn]);
+	len += sprintf(page + len, "\n");
+
+	old_fs = get_fs();
+	set_fs(KERNEL_DS);
+	for (s = 0; s < ARRAY_SIZE(bench_sizes); s++) {
+		for (a = 0; a < ARRAY_SIZE(bench_align); a++) {
+			unsigned int size = bench_sizes[s];
+			const char *src = (char *)src_buf + bench_align[a].src;
+			char *dst = (char *)dst_buf + bench_align[a].dst;
+
+			len += sprintf(page + len, "%6u %3u/%u", size,
+				       bench_align[a].src, bench_align[a].dst);
+			for (fn = 0; fn < B_NR; fn++) {
+				if (!bench_check(fn, dst, src, size)) {
+					len += sprintf(page + len, " %15s",
+						       "MISMATCH");
+					continue;
+				}
+				for (orion = 0; orion < 2; orion++)
+					mbs[orion] = bench_time(fn, orion, dst,
+								src, size);
+				len += sprintf(page + len,
+					       " %5lu.%lu/%5lu.%lu",
+					       mbs[0] / 10, mbs[0] % 10,
+					       mbs[1] / 10, mbs[1] % 10);
+				cond_resched();
+			}
+			len += sprintf(page + len, "\n");
+		}
+	}
+	set_fs(old_fs);
+
+	len += sprintf(page + len, "in use: %s\n",
+		       cpu_uaccess.cpu_copy_from_user == __orion_copy_from_user ?
+		       "orion" : "generic");
+	*eof = 1;
+out:
+	if (src_buf)
+		free_pages(src_buf, BENCH_ORDER);
+	if (dst_buf)
+		free_pages(dst_buf, BENCH_ORDER);
+	return len;
+}
+
+static int __init uaccess_bench_init(void)
+{
+	create_proc_read_entry("mv_uaccess_bench", 0400, NULL,
+			       uaccess_bench_read_proc, NULL);
+	return 0;
+}
+
+__initcall(uaccess_bench_init);
+#endif /* CONFIG_MV_UACCESS_BENCH */
@@ -0,0 +1,82 @@
+/**
+ * @file backtrace.c
+ * Call stack sampling for ARM
+ *
+ * @remark Read the file COPYING
+ *
+ * Walks the APCS frame pointer chain, the same frame layout that
+ * arch/arm/lib/backtrace.S follows for oopses: fp points at the saved
+ * pc, with the saved lr, sp and caller's fp in the three words below
+ * it.  Kernel frames need CONFIG_FRAME_POINTER; user frames are only
+ * found in code built with -fno-omit-frame-pointer (-mapcs-frame).
+ */
+
+#include <linux/config.h>
+#include <linux/oprofile.h>
+#include <linux/sched.h>
+#include <linux/mm.h>
+#include <asm/ptrace.h>
+#include <asm/uaccess.h>
+
+#include "op_arm_model.h"
+
+struct frame_tail {
+	struct frame_tail *fp;
+	unsigned long sp;
+	unsigned long lr;
+} __attribute__((packed));
+
+#ifdef CONFIG_FRAME_POINTER
+static struct frame_tail *kernel_backtrace(struct frame_tail *tail)
+{
+	oprofile_add_trace(tail->lr);
+
+	/* frames must move up the stack, or we would loop */
+	if (tail >= tail->fp)
+		return NULL;
+	return tail->fp - 1;
+}
+
+/* the frame must lie within the kernel stack the sample came from */
+static int valid_kernel_stack(struct frame_tail *tail, struct pt_regs *regs)
+{
+	unsigned long tailaddr = (unsigned long)tail;
+	unsigned long stack = (unsigned long)regs;
+	unsigned long stack_base = (stack & ~(THREAD_SIZE - 1)) + THREAD_SIZE;
+
+	return tailaddr > stack && tailaddr < stack_base;
+}
+#endif
+
+static struct frame_tail *user_backtrace(struct frame_tail *tail)
+{
+	struct frame_tail buftail;
+
+	/* we are in interrupt context: a fault just fails the copy */
+	if (!access_ok(VERIFY_READ, tail, sizeof(buftail)))
+		return NULL;
+	if (__copy_from_user_inatomic(&buftail, tail, sizeof(buftail)))
+		return NULL;
+
+	oprofile_add_trace(buftail.lr);
+
+	if (tail >= buftail.fp)
+		return NULL;
+	return buftail.fp - 1;
+}
+
+void arm_backtrace(struct pt_regs * const regs, unsigned int depth)
+{
+	struct frame_tail *tail = ((struct frame_tail *)regs->ARM_fp) - 1;
+
+	if (!user_mode(regs)) {
+#ifdef CONFIG_FRAME_POINTER
+		while (depth-- && tail && valid_kernel_stack(tail, regs))
+			tail = kernel_backtrace(tail);
+#endif
+		return;
+	}
+
+	while (depth-- && tail && !((unsigned long)tail & 3))
+		tail = user_backtrace(tail);
+}
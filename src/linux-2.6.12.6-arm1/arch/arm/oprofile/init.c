@@ -19,13 +19,18 @@ int __init oprofile_arch_init(struct oprofile_operations *ops)
 #ifdef CONFIG_CPU_XSCALE
 	ret = pmu_init(ops, &op_xscale_spec);
 #endif
+#ifdef CONFIG_ARCH_MV88fxx81
+	ret = pmu_init(ops, &op_mv88fxx81_spec);
+#endif
+
+	ops->backtrace = arm_backtrace;
 
 	return ret;
 }
 
 void oprofile_arch_exit(void)
 {
-#ifdef CONFIG_CPU_XSCALE
+#if defined(CONFIG_CPU_XSCALE) || defined(CONFIG_ARCH_MV88fxx81)
 	pmu_exit();
 #endif
 }
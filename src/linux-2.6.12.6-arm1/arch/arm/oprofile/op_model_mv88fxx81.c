@@ -0,0 +1,124 @@
+/**
+ * @file op_model_mv88fxx81.c
+ * Timer based sampling for the Marvell mv88fxx81 (Orion)
+ *
+ * @remark Read the file COPYING
+ *
+ * The ARM926 core of the Orion has no performance counters, so samples
+ * are taken from the second SoC counter/timer (TIMER0 drives the
+ * scheduler tick), at a rate independent of HZ.  The rate in Hz is
+ * counter 0's "count", CONFIG_OPROFILE_MV_TIMER_HZ unless set.
+ *
+ * The model calls itself "timer", so the oprofile tools drive it as
+ * they would the tick based timer mode and sample both kernel and user
+ * mode.  Setting 0/enabled makes 0/kernel and 0/user take effect.
+ */
+
+#include <linux/types.h>
+#include <linux/errno.h>
+#include <linux/sched.h>
+#include <linux/oprofile.h>
+#include <linux/interrupt.h>
+#include <asm/hardware.h>
+#include <asm/io.h>
+#include <asm/irq.h>
+#include <asm/system.h>
+
+#include "op_counter.h"
+#include "op_arm_model.h"
+
+#define PROF_CNTMR		1
+#define PROF_IRQ		TIME_IRQ	/* the bridge interrupt */
+#define PROF_MAX_HZ		20000
+
+#define BRIDGE_CAUSE		(INTER_REGS_BASE + BRIDGE_INT_CAUSE_REG)
+#define BRIDGE_MASK		(INTER_REGS_BASE + BRIDGE_INT_MASK_REG)
+
+/* redefine from mvCntmr, as asm/arch/time.h does */
+struct _mvCntmrCtrl {
+	u32 enable;
+	u32 autoEnable;
+};
+
+extern u32 mvTclk;
+extern u32 mvCntmrStart(u32, u32, struct _mvCntmrCtrl *);
+extern u32 mvCntmrDisable(u32);
+
+static unsigned long prof_reload;
+static int prof_kernel, prof_user;
+
+static irqreturn_t mv_prof_interrupt(int irq, void *dev_id,
+				     struct pt_regs *regs)
+{
+	u32 cause = readl(BRIDGE_CAUSE);
+
+	if (!(cause & readl(BRIDGE_MASK) & TIMER_BIT_MASK(PROF_CNTMR)))
+		return IRQ_NONE;
+
+	/* the cause bits are cleared by writing zero */
+	writel(~TIMER_BIT_MASK(PROF_CNTMR), BRIDGE_CAUSE);
+
+	if (user_mode(regs) ? prof_user : prof_kernel)
+		oprofile_add_sample(regs, 0);
+
+	return IRQ_HANDLED;
+}
+
+static int mv_prof_setup_ctrs(void)
+{
+	unsigned long hz = CONFIG_OPROFILE_MV_TIMER_HZ;
+
+	prof_kernel = prof_user = 1;
+	if (counter_config[0].enabled) {
+		if (counter_config[0].count)
+			hz = counter_config[0].count;
+		prof_kernel = counter_config[0].kernel;
+		prof_user = counter_config[0].user;
+	}
+	if (hz > PROF_MAX_HZ)
+		hz = PROF_MAX_HZ;
+
+	prof_reload = mvTclk / hz;
+	return 0;
+}
+
+static int mv_prof_start(void)
+{
+	struct _mvCntmrCtrl ctrl = { .enable = 1, .autoEnable = 1 };
+	int ret;
+
+	ret = request_irq(PROF_IRQ, mv_prof_interrupt, SA_INTERRUPT | SA_SHIRQ,
+			  "oprofile timer", &prof_reload);
+	if (ret < 0) {
+		printk(KERN_ERR "oprofile: unable to request IRQ%d for the "
+		       "mv88fxx81 timer\n", PROF_IRQ);
+		return ret;
+	}
+
+	mvCntmrStart(PROF_CNTMR, prof_reload, &ctrl);
+	writel(~TIMER_BIT_MASK(PROF_CNTMR), BRIDGE_CAUSE);
+	writel(readl(BRIDGE_MASK) | TIMER_BIT_MASK(PROF_CNTMR), BRIDGE_MASK);
+	return 0;
+}
+
+static void mv_prof_stop(void)
+{
+	writel(readl(BRIDGE_MASK) & ~TIMER_BIT_MASK(PROF_CNTMR), BRIDGE_MASK);
+	mvCntmrDisable(PROF_CNTMR);
+	writel(~TIMER_BIT_MASK(PROF_CNTMR), BRIDGE_CAUSE);
+	free_irq(PROF_IRQ, &prof_reload);
+}
+
+static int mv_prof_init(void)
+{
+	return 0;
+}
+
+struct op_arm_model_spec op_mv88fxx81_spec = {
+	.init		= mv_prof_init,
+	.num_counters	= 1,
+	.setup_ctrs	= mv_prof_setup_ctrs,
+	.start		= mv_prof_start,
+	.stop		= mv_prof_stop,
+	.name		= "timer",
+};
@@ -0,0 +1,671 @@
+/*
+ * crypto-bench - the kernel CryptoAPI, OCF in software and the OCF
+ * hardware driver side by side
+ *
+ *	insmod crypto-bench.ko [backends=7] [modes=7] [alg=<substring>]
+ *		[min_size=16] [max_size=65536] [msecs=250] [depth=16] [batch=8]
+ *
+ * Loading the module runs every selected algorithm, at every power of
+ * two request size from min_size to max_size, in every selected mode on
+ * every selected backend.  With the defaults that takes a few minutes.
+ * The results stay in /proc/crypto-bench until the module is removed,
+ * one comma separated line per test:
+ *
+ *	backend,alg,mode,size,ops,usecs,kbytes_per_sec,latency_usecs,cpu_pct,error
+ *
+ * and then a "crossover,<alg>,<size>" line per algorithm: the smallest
+ * size from which the hardware beats the best software result at every
+ * larger size measured, or "none".
+ *
+ * backends	1 api	CryptoAPI, called directly
+ *		2 sw	OCF, software drivers only (cryptosoft)
+ *		4 hw	OCF, hardware drivers only (CESA)
+ * modes	1 sync	one request at a time
+ *		2 async	depth requests in flight, refilled as they complete
+ *		4 batch	as async, queued with CRYPTO_F_BATCH in groups of batch
+ *
+ * The CryptoAPI is synchronous, so it only runs in sync mode; it is also
+ * the only backend with ECB.  Neither OCF nor the CryptoAPI of this
+ * kernel has CTR, so there is no CTR test.  latency_usecs is the mean
+ * time from dispatch to callback, cpu_pct the share of the run the CPU
+ * was not idle, from the tick accounting.
+ */
+
+#include <linux/config.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+#include <linux/sched.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/crypto.h>
+#include <linux/mm.h>
+#include <linux/proc_fs.h>
+#include <linux/kernel_stat.h>
+#include <linux/scatterlist.h>
+#include <linux/time.h>
+#include <asm/scatterlist.h>
+#include <asm/div64.h>
+#include <cryptodev.h>
+
+static int backends = 7;
+MODULE_PARM(backends, "i");
+MODULE_PARM_DESC(backends, "1 CryptoAPI, 2 OCF software, 4 OCF hardware");
+
+static int modes = 7;
+MODULE_PARM(modes, "i");
+MODULE_PARM_DESC(modes, "1 sync, 2 async, 4 batched");
+
+static char *alg = "";
+MODULE_PARM(alg, "s");
+MODULE_PARM_DESC(alg, "only the algorithms with this in their name");
+
+static int min_size = 16;
+MODULE_PARM(min_size, "i");
+MODULE_PARM_DESC(min_size, "smallest request, bytes");
+
+static int max_size = 65536;
+MODULE_PARM(max_size, "i");
+MODULE_PARM_DESC(max_size, "largest request, bytes");
+
+static int msecs = 250;
+MODULE_PARM(msecs, "i");
+MODULE_PARM_DESC(msecs, "length of each test");
+
+static int depth = 16;
+MODULE_PARM(depth, "i");
+MODULE_PARM_DESC(depth, "requests in flight in async and batched mode");
+
+static int batch = 8;
+MODULE_PARM(batch, "i");
+MODULE_PARM_DESC(batch, "requests per batch in batched mode");
+
+#define BENCH_API	0
+#define BENCH_SW	1
+#define BENCH_HW	2
+#define BENCH_BACKENDS	3
+
+#define BENCH_SYNC	0
+#define BENCH_ASYNC	1
+#define BENCH_BATCH	2
+#define BENCH_MODES	3
+
+#define BENCH_SIZES	16		/* 16 bytes to 512K */
+#define BENCH_MAX_DEPTH	64
+#define BENCH_OUT_SIZE	(128 * 1024)
+
+static const char *backend_names[BENCH_BACKENDS] = { "api", "sw", "hw" };
+static const char *mode_names[BENCH_MODES] = { "sync", "async", "batch" };
+
+static struct bench_alg {
+	char	*name;
+	int	cipher;			/* OCF algorithms, 0 for none */
+	int	mac;
+	char	*tfm;			/* CryptoAPI cipher, in tfm_mode */
+	u32	tfm_mode;
+	char	*hash;			/* CryptoAPI digest, HMAC if mac is */
+	int	keylen;			/* cipher key, bytes */
+	int	ivlen;
+} bench_algs[] = {
+	{ "aes128-ecb", 0, 0, "aes", CRYPTO_TFM_MODE_ECB, NULL, 16, 0 },
+	{ "aes128-cbc", CRYPTO_AES_CBC, 0, "aes", CRYPTO_TFM_MODE_CBC, NULL, 16, 16 },
+	{ "aes256-cbc", CRYPTO_AES_CBC, 0, "aes", CRYPTO_TFM_MODE_CBC, NULL, 32, 16 },
+	{ "des-ecb", 0, 0, "des", CRYPTO_TFM_MODE_ECB, NULL, 8, 0 },
+	{ "des-cbc", CRYPTO_DES_CBC, 0, "des", CRYPTO_TFM_MODE_CBC, NULL, 8, 8 },
+	{ "3des-ecb", 0, 0, "des3_ede", CRYPTO_TFM_MODE_ECB, NULL, 24, 0 },
+	{ "3des-cbc", CRYPTO_3DES_CBC, 0, "des3_ede", CRYPTO_TFM_MODE_CBC, NULL, 24, 8 },
+	{ "md5", 0, CRYPTO_MD5, NULL, 0, "md5", 0, 0 },
+	{ "sha1", 0, CRYPTO_SHA1, NULL, 0, "sha1", 0, 0 },
+	{ "hmac-md5", 0, CRYPTO_MD5_HMAC, NULL, 0, "md5", 0, 0 },
+	{ "hmac-sha1", 0, CRYPTO_SHA1_HMAC, NULL, 0, "sha1", 0, 0 },
+	{ "aes128-cbc+hmac-sha1", CRYPTO_AES_CBC, CRYPTO_SHA1_HMAC,
+			"aes", CRYPTO_TFM_MODE_CBC, "sha1", 16, 16 },
+};
+#define BENCH_ALGS	(sizeof(bench_algs) / sizeof(bench_algs[0]))
+
+static char bench_key[] = "0123456789abcdefghijklmnopqrstuv";
+static char bench_mackey[] = "0123456789abcdefghij";
+#define BENCH_MACKEYLEN	20
+#define BENCH_DIGEST	64		/* room after the data for the MAC */
+
+/* kbytes per second of every test, for the crossover lines */
+static u32 bench_kbps[BENCH_BACKENDS][BENCH_ALGS][BENCH_MODES][BENCH_SIZES];
+
+static char *bench_out;
+static int bench_len;
+static struct proc_dir_entry *bench_proc;
+
+/*
+ * Nanoseconds, from the wall clock: sched_clock() is not exported to
+ * modules.  Good to a microsecond, which is what the results show.
+ */
+static inline unsigned long long bench_clock(void)
+{
+	struct timeval tv;
+
+	do_gettimeofday(&tv);
+	return ((unsigned long long)tv.tv_sec * 1000000 + tv.tv_usec) * 1000;
+}
+
+/*
+ * One test on an OCF backend.  The callback runs in the driver's
+ * completion context, possibly an interrupt: it only hands the request
+ * back to the thread running the test, which refills it.
+ */
+struct bench_run;
+
+struct bench_req {
+	struct bench_run	*run;
+	unsigned char		*buf;
+	unsigned long long	start;
+	struct bench_req	*next;
+};
+
+struct bench_run {
+	struct bench_alg	*alg;
+	int			size;
+	u_int64_t		sid;
+	wait_queue_head_t	wait;
+	spinlock_t		lock;
+	struct bench_req	*done;		/* completed, not refilled yet */
+	unsigned long long	latency;
+	int			error;
+	struct bench_req	req[BENCH_MAX_DEPTH];
+};
+
+struct bench_result {
+	unsigned long		ops;
+	unsigned long long	nsecs;
+	unsigned long long	latency;	/* summed over ops */
+	int			cpu;
+	int			error;
+};
+
+static void
+bench_printf(const char *fmt, ...)
+{
+	va_list args;
+
+	if (bench_len >= BENCH_OUT_SIZE - 1)
+		return;
+	va_start(args, fmt);
+	bench_len += vsnprintf(bench_out + bench_len,
+			BENCH_OUT_SIZE - bench_len, fmt, args);
+	va_end(args);
+	if (bench_len > BENCH_OUT_SIZE - 1)
+		bench_len = BENCH_OUT_SIZE - 1;
+}
+
+static u64
+bench_idle(void)
+{
+	u64 idle = 0;
+	int i;
+
+	for (i = 0; i < NR_CPUS; i++)
+		if (cpu_online(i))
+			idle += kstat_cpu(i).cpustat.idle;
+	return idle;
+}
+
+/* elapsed jiffies and idle ticks into a percentage */
+static int
+bench_cpu(unsigned long ticks, u64 idle)
+{
+	if (ticks == 0)
+		return 100;
+	if (idle > ticks)
+		idle = ticks;
+	return 100 - (int)((u32)idle * 100 / ticks);
+}
+
+static int
+bench_ocf_cb(struct cryptop *crp)
+{
+	struct bench_req *req = (struct bench_req *)crp->crp_opaque;
+	struct bench_run *run = req->run;
+	unsigned long flags;
+
+	if (crp->crp_etype == EAGAIN) {
+		crp->crp_flags &= ~CRYPTO_F_DONE;
+		return crypto_dispatch(crp);
+	}
+
+	spin_lock_irqsave(&run->lock, flags);
+	if (crp->crp_etype && !run->error)
+		run->error = crp->crp_etype;
+	run->sid = crp->crp_sid;
+	run->latency += bench_clock() - req->start;
+	req->next = run->done;
+	run->done = req;
+	spin_unlock_irqrestore(&run->lock, flags);
+
+	crypto_freereq(crp);
+	wake_up(&run->wait);
+	return 0;
+}
+
+static int
+bench_ocf_submit(struct bench_run *run, struct bench_req *req, int flags)
+{
+	struct bench_alg *a = run->alg;
+	struct cryptop *crp;
+	struct cryptodesc *crd;
+	int error;
+
+	crp = crypto_getreq((a->cipher != 0) + (a->mac != 0));
+	if (crp == NULL)
+		return ENOMEM;
+
+	crd = crp->crp_desc;
+	if (a->cipher) {
+		crd->crd_alg = a->cipher;
+		crd->crd_key = bench_key;
+		crd->crd_klen = a->keylen * 8;
+		crd->crd_flags = CRD_F_ENCRYPT | CRD_F_IV_EXPLICIT;
+		memset(crd->crd_iv, 0x5a, a->ivlen);
+		crd->crd_skip = 0;
+		crd->crd_len = run->size;
+		crd->crd_inject = 0;
+		crd = crd->crd_next;
+	}
+	if (a->mac) {
+		crd->crd_alg = a->mac;
+		if (a->mac != CRYPTO_MD5 && a->mac != CRYPTO_SHA1) {
+			crd->crd_key = bench_mackey;
+			crd->crd_klen = BENCH_MACKEYLEN * 8;
+		}
+		crd->crd_skip = 0;
+		crd->crd_len = run->size;
+		crd->crd_inject = run->size;
+	}
+
+	crp->crp_ilen = run->size + BENCH_DIGEST;
+	crp->crp_flags = CRYPTO_F_CBIMM | flags;
+	crp->crp_buf = (caddr_t)req->buf;
+	crp->crp_callback = bench_ocf_cb;
+	crp->crp_sid = run->sid;
+	crp->crp_opaque = (caddr_t)req;
+
+	req->start = bench_clock();
+	error = crypto_dispatch(crp);
+	if (error)
+		crypto_freereq(crp);
+	return error;
+}
+
+static int
+bench_ocf_session(struct bench_run *run, int hard)
+{
+	struct bench_alg *a = run->alg;
+	struct cryptoini crie, cria;
+
+	memset(&crie, 0, sizeof(crie));
+	memset(&cria, 0, sizeof(cria));
+
+	if (a->mac) {
+		cria.cri_alg = a->mac;
+		if (a->mac != CRYPTO_MD5 && a->mac != CRYPTO_SHA1) {
+			cria.cri_key = bench_mackey;
+			cria.cri_klen = BENCH_MACKEYLEN * 8;
+		}
+	}
+	if (a->cipher) {
+		crie.cri_alg = a->cipher;
+		crie.cri_key = bench_key;
+		crie.cri_klen = a->keylen * 8;
+		if (a->mac)
+			crie.cri_next = &cria;
+		return crypto_newsession(&run->sid, &crie, hard);
+	}
+	return crypto_newsession(&run->sid, &cria, hard);
+}
+
+static void
+bench_ocf(struct bench_alg *a, int backend, int mode, int size,
+		struct bench_result *res)
+{
+	struct bench_run *run;
+	struct bench_req *req, *next;
+	unsigned long flags, j0, end;
+	unsigned long long t0;
+	int n, inflight = 0, group, i;
+	u64 idle0;
+
+	memset(res, 0, sizeof(*res));
+	run = kmalloc(sizeof(*run), GFP_KERNEL);
+	if (run == NULL) {
+		res->error = ENOMEM;
+		return;
+	}
+	memset(run, 0, sizeof(*run));
+	run->alg = a;
+	run->size = size;
+	init_waitqueue_head(&run->wait);
+	spin_lock_init(&run->lock);
+
+	n = mode == BENCH_SYNC ? 1 : depth;
+	if (n < 1)
+		n = 1;
+	if (n > BENCH_MAX_DEPTH)
+		n = BENCH_MAX_DEPTH;
+	group = mode == BENCH_BATCH ? batch : 1;
+	if (group < 1)
+		group = 1;
+
+	for (i = 0; i < n; i++) {
+		run->req[i].run = run;
+		run->req[i].buf = kmalloc(size + BENCH_DIGEST, GFP_KERNEL);
+		if (run->req[i].buf == NULL) {
+			res->error = ENOMEM;
+			goto free;
+		}
+		memset(run->req[i].buf, 0xa5, size + BENCH_DIGEST);
+		run->req[i].next = run->done;
+		run->done = &run->req[i];
+	}
+
+	res->error = bench_ocf_session(run, backend == BENCH_HW ? 1 : -1);
+	if (res->error)
+		goto free;
+
+	idle0 = bench_idle();
+	j0 = jiffies;
+	end = j0 + (msecs * HZ + 999) / 1000;
+	t0 = bench_clock();
+
+	for (;;) {
+		/* take what completed, and hand it out again until time is up */
+		spin_lock_irqsave(&run->lock, flags);
+		req = run->done;
+		run->done = NULL;
+		spin_unlock_irqrestore(&run->lock, flags);
+
+		for (i = 0; req; req = next, i++) {
+			next = req->next;
+			if (req->start) {
+				inflight--;
+				res->ops++;
+			}
+			if (time_after_eq(jiffies, end) || run->error)
+				continue;
+			/* in a batch, only the last request kicks the driver */
+			res->error = bench_ocf_submit(run, req,
+					next && (i + 1) % group ? CRYPTO_F_BATCH : 0);
+			if (res->error) {
+				req->start = 0;
+				run->error = res->error;
+				continue;
+			}
+			inflight++;
+		}
+		if (inflight == 0)
+			break;
+		if (!wait_event_timeout(run->wait, run->done != NULL, HZ)) {
+			/* the driver lost requests: leave the run to it */
+			res->error = ETIMEDOUT;
+			res->nsecs = bench_clock() - t0;
+			return;
+		}
+	}
+
+	res->nsecs = bench_clock() - t0;
+	res->cpu = bench_cpu(jiffies - j0, bench_idle() - idle0);
+	res->latency = run->latency;
+	if (run->error)
+		res->error = run->error;
+	crypto_freesession(run->sid);
+free:
+	for (i = 0; i < n; i++)
+		if (run->req[i].buf)
+			kfree(run->req[i].buf);
+	kfree(run);
+}
+
+/*
+ * The CryptoAPI, synchronous: the same work as an OCF request, a cipher
+ * pass and then a digest over the result.
+ */
+static void
+bench_api(struct bench_alg *a, int size, struct bench_result *res)
+{
+	struct crypto_tfm *ctfm = NULL, *htfm = NULL;
+	struct scatterlist sg;
+	unsigned char *buf, iv[16];
+	unsigned long j0, end;
+	unsigned long long t0, t;
+	u64 idle0;
+
+	memset(res, 0, sizeof(*res));
+#ifndef CONFIG_CRYPTO_HMAC
+	if (a->hash && a->mac != CRYPTO_MD5 && a->mac != CRYPTO_SHA1) {
+		res->error = EOPNOTSUPP;
+		return;
+	}
+#endif
+	buf = kmalloc(size + BENCH_DIGEST, GFP_KERNEL);
+	if (buf == NULL) {
+		res->error = ENOMEM;
+		return;
+	}
+	memset(buf, 0xa5, size + BENCH_DIGEST);
+	memset(iv, 0x5a, sizeof(iv));
+
+	if (a->tfm) {
+		ctfm = crypto_alloc_tfm(a->tfm, a->tfm_mode);
+		if (ctfm == NULL ||
+				crypto_cipher_setkey(ctfm, bench_key, a->keylen)) {
+			res->error = EOPNOTSUPP;
+			goto out;
+		}
+	}
+	if (a->hash) {
+		htfm = crypto_alloc_tfm(a->hash, 0);
+		if (htfm == NULL) {
+			res->error = EOPNOTSUPP;
+			goto out;
+		}
+	}
+
+	idle0 = bench_idle();
+	j0 = jiffies;
+	end = j0 + (msecs * HZ + 999) / 1000;
+	t0 = bench_clock();
+
+	while (time_before(jiffies, end)) {
+		t = bench_clock();
+		sg_init_one(&sg, buf, size);
+		if (ctfm) {
+			if (a->ivlen)
+				crypto_cipher_set_iv(ctfm, iv, a->ivlen);
+			crypto_cipher_encrypt(ctfm, &sg, &sg, size);
+		}
+		if (htfm) {
+			if (a->mac == CRYPTO_MD5 || a->mac == CRYPTO_SHA1) {
+				crypto_digest_init(htfm);
+				crypto_digest_update(htfm, &sg, 1);
+				crypto_digest_final(htfm, buf + size);
+			}
+#ifdef CONFIG_CRYPTO_HMAC
+			else {
+				unsigned int klen = BENCH_MACKEYLEN;
+
+				crypto_hmac(htfm, bench_mackey, &klen, &sg, 1,
+						buf + size);
+			}
+#endif
+		}
+		res->latency += bench_clock() - t;
+		res->ops++;
+		cond_resched();
+	}
+
+	res->nsecs = bench_clock() - t0;
+	res->cpu = bench_cpu(jiffies - j0, bench_idle() - idle0);
+out:
+	if (ctfm)
+		crypto_free_tfm(ctfm);
+	if (htfm)
+		crypto_free_tfm(htfm);
+	kfree(buf);
+}
+
+static void
+bench_report(int backend, int ai, int mode, int si, int size,
+		struct bench_result *res)
+{
+	unsigned long long usecs, kbps = 0, lat = 0;
+
+	usecs = res->nsecs;
+	do_div(usecs, 1000);
+	if (usecs) {
+		kbps = (unsigned long long)res->ops * size * 1000000 / 1024;
+		do_div(kbps, (u32)usecs);
+	}
+	if (res->ops) {
+		lat = res->latency;
+		do_div(lat, res->ops);
+		do_div(lat, 1000);
+	}
+	if (!res->error)
+		bench_kbps[backend][ai][mode][si] = kbps;
+
+	bench_printf("%s,%s,%s,%d,%lu,%llu,%llu,%llu,%d,%d\n",
+			backend_names[backend], bench_algs[ai].name,
+			mode_names[mode], size, res->ops, usecs, kbps, lat,
+			res->cpu, res->error);
+}
+
+/* the smallest size from which the hardware stays ahead of software */
+static void
+bench_crossover(int ai, int nsizes)
+{
+	int si, mode, size = -1;
+	u32 sw, hw;
+
+	for (si = 0; si < nsizes; si++) {
+		sw = hw = 0;
+		for (mode = 0; mode < BENCH_MODES; mode++) {
+			sw = max(sw, bench_kbps[BENCH_API][ai][mode][si]);
+			sw = max(sw, bench_kbps[BENCH_SW][ai][mode][si]);
+			hw = max(hw, bench_kbps[BENCH_HW][ai][mode][si]);
+		}
+		if (hw == 0 || sw == 0)
+			continue;
+		if (hw > sw) {
+			if (size < 0)
+				size = min_size << si;
+		} else
+			size = -1;
+	}
+	if (size < 0)
+		bench_printf("crossover,%s,none\n", bench_algs[ai].name);
+	else
+		bench_printf("crossover,%s,%d\n", bench_algs[ai].name, size);
+}
+
+static int
+bench_ocf_ok(struct bench_alg *a)
+{
+	return (a->tfm == NULL || a->cipher) && (a->hash == NULL || a->mac);
+}
+
+static int
+bench_proc_read(char *page, char **start, off_t off, int count, int *eof,
+		void *data)
+{
+	int n;
+
+	if (off >= bench_len) {
+		*eof = 1;
+		return 0;
+	}
+	n = bench_len - off;
+	if (n > count)
+		n = count;
+	memcpy(page, bench_out + off, n);
+	*start = page;
+	if (off + n >= bench_len)
+		*eof = 1;
+	return n;
+}
+
+static int __init
+cryptobench_init(void)
+{
+	struct bench_result res;
+	int ai, backend, mode, si, size, nsizes;
+
+	if (min_size < 16 || max_size < min_size) {
+		printk("crypto-bench: bad size range %d-%d\n", min_size, max_size);
+		return -EINVAL;
+	}
+	for (nsizes = 0; nsizes < BENCH_SIZES &&
+			(min_size << nsizes) <= max_size; nsizes++)
+		;
+
+	bench_out = vmalloc(BENCH_OUT_SIZE);
+	if (bench_out == NULL)
+		return -ENOMEM;
+	bench_len = 0;
+	bench_printf("# backend,alg,mode,size,ops,usecs,kbytes_per_sec,"
+			"latency_usecs,cpu_pct,error\n");
+
+	printk("crypto-bench: running, results in /proc/crypto-bench\n");
+	for (ai = 0; ai < BENCH_ALGS; ai++) {
+		struct bench_alg *a = &bench_algs[ai];
+
+		if (alg && *alg && strstr(a->name, alg) == NULL)
+			continue;
+		for (si = 0; si < nsizes; si++) {
+			size = min_size << si;
+			if (a->ivlen && size % a->ivlen)
+				continue;
+			for (backend = 0; backend < BENCH_BACKENDS; backend++) {
+				if (!(backends & (1 << backend)))
+					continue;
+				if (backend == BENCH_API) {
+					if (!(modes & (1 << BENCH_SYNC)))
+						continue;
+					bench_api(a, size, &res);
+					bench_report(backend, ai, BENCH_SYNC, si, size, &res);
+					continue;
+				}
+				if (!bench_ocf_ok(a))
+					continue;
+				for (mode = 0; mode < BENCH_MODES; mode++) {
+					if (!(modes & (1 << mode)))
+						continue;
+					bench_ocf(a, backend, mode, size, &res);
+					bench_report(backend, ai, mode, si, size, &res);
+				}
+			}
+		}
+		if ((backends & (1 << BENCH_HW)) && bench_ocf_ok(a))
+			bench_crossover(ai, nsizes);
+	}
+
+	bench_proc = create_proc_read_entry("crypto-bench", S_IRUGO, NULL,
+			bench_proc_read, NULL);
+	if (bench_proc == NULL) {
+		vfree(bench_out);
+		return -ENOMEM;
+	}
+	printk("crypto-bench: done\n");
+	return 0;
+}
+
+static void __exit
+cryptobench_exit(void)
+{
+	remove_proc_entry("crypto-bench", NULL);
+	vfree(bench_out);
+}
+
+module_init(cryptobench_init);
+module_exit(cryptobench_exit);
+
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_DESCRIPTION("Compare CryptoAPI, OCF software and OCF hardware crypto speeds");
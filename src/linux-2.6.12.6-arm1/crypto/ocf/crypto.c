@@ -37,6 +37,8 @@ __FBSDID("$FreeBSD: src/sys/opencrypto/crypto.c,v 1.16 2005/01/07 02:29:16 imp E
 #include <linux/spinlock.h>
 #include <linux/version.h>
 #include <linux/interrupt.h>
+#include <linux/proc_fs.h>
+#include <asm/uaccess.h>
 #include <cryptodev.h>
 
 #undef OCF_RET_TASKLET
@@ -183,6 +185,316 @@ static  int crypto_init(void);
 static	struct cryptostats cryptostats;
 
 
+/*
+ * Adaptive dispatch.
+ *
+ * A session a hardware driver takes also gets a session on a software
+ * driver, when there is one for its algorithms and the caller left the
+ * choice of driver to OCF (hard == 0).  crypto_dispatch() then
+ * sends each request of the session to one of the two: small requests,
+ * where the hardware's setup, copies and interrupt cost more than doing
+ * the work on the CPU, go to software, and so does everything while the
+ * hardware has crypto_hw_depth requests in flight or is blocked.  The
+ * request size is the sum of its descriptors; a session's limit is the
+ * largest crypto_sw_max[] of its algorithms.  The defaults are rough
+ * crossovers for CESA on a 500MHz ARM; crypto-bench measures real ones.
+ *
+ * Requests may then complete out of order.  A caller that cannot have
+ * that, such as ESP, sets CRYPTO_F_ORDERED: while the other side still
+ * has requests of the session, such a request goes to the same side.
+ * cryptosoft is synchronous, so in practice an ordered session under
+ * load stays on the hardware.
+ *
+ * The caller never sees the software session: crypto_done() puts the
+ * caller's crp_sid back before the callback.  Requests asking the
+ * driver to verify a MAC always go to the hardware, cryptosoft cannot.
+ *
+ * /proc/ocf-dispatch reports how the requests were split and takes
+ * "adaptive <0|1>", "hw_depth <n>" and "sw_max <alg> <bytes>".
+ */
+static int crypto_adaptive = 1;
+MODULE_PARM(crypto_adaptive, "i");
+MODULE_PARM_DESC(crypto_adaptive,
+	   "Split requests of hardware sessions between hardware and software");
+
+static int crypto_hw_depth = 24;
+MODULE_PARM(crypto_hw_depth, "i");
+MODULE_PARM_DESC(crypto_hw_depth,
+	   "Requests in a hardware driver before software takes new ones");
+
+static int crypto_sw_max[CRYPTO_ALGORITHM_MAX + 1] = {
+	[CRYPTO_DES_CBC]	= 128,
+	[CRYPTO_3DES_CBC]	= 64,
+	[CRYPTO_AES_CBC]	= 256,
+	[CRYPTO_MD5_HMAC]	= 512,
+	[CRYPTO_SHA1_HMAC]	= 256,
+	[CRYPTO_MD5]		= 1024,
+	[CRYPTO_SHA1]		= 512,
+};
+
+#define CRYPTO_ALT_HASH		32
+
+struct crypto_alt {
+	struct list_head	list;
+	u_int64_t		hw;		/* the session the caller has */
+	u_int64_t		sw;
+	int			sw_max;
+	int			hw_pending;	/* requests not yet done */
+	int			sw_pending;
+};
+
+static struct list_head crypto_alt_hash[CRYPTO_ALT_HASH];
+static spinlock_t crypto_alt_lock;
+static int crypto_alt_count;
+
+static struct {
+	unsigned long	hw_ops, hw_bytes;
+	unsigned long	sw_ops, sw_bytes;
+	unsigned long	sw_small;		/* below the size limit */
+	unsigned long	sw_busy;		/* hardware saturated */
+	unsigned long	ordered;		/* kept behind earlier requests */
+} crypto_alt_stats;
+
+static inline struct list_head *
+crypto_alt_bucket(u_int64_t sid)
+{
+	return &crypto_alt_hash[CRYPTO_SESID2LID(sid) % CRYPTO_ALT_HASH];
+}
+
+/* called with crypto_alt_lock held */
+static struct crypto_alt *
+crypto_alt_find(u_int64_t sid)
+{
+	struct crypto_alt *alt;
+
+	list_for_each_entry(alt, crypto_alt_bucket(sid), list)
+		if (alt->hw == sid)
+			return alt;
+	return NULL;
+}
+
+/* give the new hardware session a software twin */
+static void
+crypto_alt_newsession(u_int64_t hw, struct cryptoini *cri)
+{
+	struct crypto_alt *alt;
+	struct cryptoini *cr;
+	unsigned long flags;
+
+	alt = kmalloc(sizeof(*alt), GFP_ATOMIC);
+	if (alt == NULL)
+		return;
+	if (crypto_newsession(&alt->sw, cri, -1)) {
+		kfree(alt);
+		return;
+	}
+	alt->hw = hw;
+	alt->sw_max = 0;
+	alt->hw_pending = alt->sw_pending = 0;
+	for (cr = cri; cr; cr = cr->cri_next)
+		if (cr->cri_alg <= CRYPTO_ALGORITHM_MAX)
+			alt->sw_max = max(alt->sw_max, crypto_sw_max[cr->cri_alg]);
+
+	spin_lock_irqsave(&crypto_alt_lock, flags);
+	list_add(&alt->list, crypto_alt_bucket(hw));
+	crypto_alt_count++;
+	spin_unlock_irqrestore(&crypto_alt_lock, flags);
+}
+
+static void
+crypto_alt_freesession(u_int64_t hw)
+{
+	struct crypto_alt *alt;
+	unsigned long flags;
+
+	spin_lock_irqsave(&crypto_alt_lock, flags);
+	alt = crypto_alt_find(hw);
+	if (alt) {
+		list_del(&alt->list);
+		crypto_alt_count--;
+	}
+	spin_unlock_irqrestore(&crypto_alt_lock, flags);
+
+	if (alt) {
+		crypto_freesession(alt->sw);
+		kfree(alt);
+	}
+}
+
+/* pick the driver for a request of a session with a software twin */
+static void
+crypto_alt_route(struct cryptop *crp)
+{
+	struct crypto_alt *alt;
+	struct cryptodesc *crd;
+	struct cryptocap *cap;
+	unsigned long flags;
+	u_int32_t hid;
+	int len = 0, busy, sw, held = 0;
+
+	spin_lock_irqsave(&crypto_alt_lock, flags);
+	alt = crypto_alt_find(crp->crp_sid);
+	if (alt == NULL)
+		goto out;
+
+	for (crd = crp->crp_desc; crd; crd = crd->crd_next) {
+		/* an open hash lives in the session of one driver */
+		if (crd->crd_flags & (CRD_F_MAC_VERIFY |
+				      CRD_F_HASH_CONT | CRD_F_HASH_MORE)) {
+			len = INT_MAX;
+			break;
+		}
+		len += crd->crd_len;
+	}
+
+	hid = CRYPTO_SESID2HID(crp->crp_sid);
+	if (hid >= crypto_drivers_num)
+		goto out;
+	cap = &crypto_drivers[hid];
+	busy = cap->cc_qblocked ||
+		atomic_read(&cap->cc_inflight) >= crypto_hw_depth;
+
+	sw = len != INT_MAX && (len <= alt->sw_max || busy);
+	/* the other side still has earlier requests of the session */
+	if (len != INT_MAX && (crp->crp_flags & CRYPTO_F_ORDERED) &&
+	    (sw ? alt->hw_pending : alt->sw_pending)) {
+		sw = !sw;
+		held = 1;
+		crypto_alt_stats.ordered++;
+	}
+
+	if (sw) {
+		if (!held && len <= alt->sw_max)
+			crypto_alt_stats.sw_small++;
+		else if (!held)
+			crypto_alt_stats.sw_busy++;
+		crypto_alt_stats.sw_ops++;
+		crypto_alt_stats.sw_bytes += len;
+		crp->crp_osid = crp->crp_sid;
+		crp->crp_sid = alt->sw;
+		crp->crp_flags |= CRYPTO_F_ALTSW;
+		alt->sw_pending++;
+	} else {
+		crypto_alt_stats.hw_ops++;
+		crypto_alt_stats.hw_bytes += len == INT_MAX ? 0 : len;
+		crp->crp_osid = crp->crp_sid;
+		crp->crp_flags |= CRYPTO_F_ALTHW;
+		atomic_inc(&cap->cc_inflight);
+		alt->hw_pending++;
+	}
+out:
+	spin_unlock_irqrestore(&crypto_alt_lock, flags);
+}
+
+/* undo crypto_alt_route() before the caller sees the request again */
+static inline void
+crypto_alt_done(struct cryptop *crp)
+{
+	struct crypto_alt *alt;
+	unsigned long flags;
+	u_int32_t hid;
+
+	spin_lock_irqsave(&crypto_alt_lock, flags);
+	alt = crypto_alt_find(crp->crp_osid);
+	if (alt) {
+		if (crp->crp_flags & CRYPTO_F_ALTHW)
+			alt->hw_pending--;
+		else
+			alt->sw_pending--;
+	}
+	spin_unlock_irqrestore(&crypto_alt_lock, flags);
+
+	if (crp->crp_flags & CRYPTO_F_ALTHW) {
+		hid = CRYPTO_SESID2HID(crp->crp_osid);
+		if (hid < crypto_drivers_num)
+			atomic_dec(&crypto_drivers[hid].cc_inflight);
+	} else
+		crp->crp_sid = crp->crp_osid;
+	crp->crp_flags &= ~(CRYPTO_F_ALTSW | CRYPTO_F_ALTHW);
+}
+
+#ifdef CONFIG_PROC_FS
+static int
+crypto_alt_proc_read(char *page, char **start, off_t off, int count,
+		int *eof, void *data)
+{
+	unsigned long ops;
+	int len, alg, hid;
+	int inflight = 0;
+
+	for (hid = 0; hid < crypto_drivers_num; hid++)
+		inflight += atomic_read(&crypto_drivers[hid].cc_inflight);
+	ops = crypto_alt_stats.hw_ops + crypto_alt_stats.sw_ops;
+
+	len = sprintf(page, "adaptive %d hw_depth %d sessions %d\n",
+			crypto_adaptive, crypto_hw_depth, crypto_alt_count);
+	len += sprintf(page + len, "hw ops %lu bytes %lu inflight %d share %lu%%\n",
+			crypto_alt_stats.hw_ops, crypto_alt_stats.hw_bytes,
+			inflight, ops ? crypto_alt_stats.hw_ops * 100 / ops : 0);
+	len += sprintf(page + len,
+			"sw ops %lu bytes %lu small %lu busy %lu share %lu%%\n",
+			crypto_alt_stats.sw_ops, crypto_alt_stats.sw_bytes,
+			crypto_alt_stats.sw_small, crypto_alt_stats.sw_busy,
+			ops ? crypto_alt_stats.sw_ops * 100 / ops : 0);
+	len += sprintf(page + len, "ordered %lu\n", crypto_alt_stats.ordered);
+	for (alg = 1; alg <= CRYPTO_ALGORITHM_MAX; alg++)
+		if (crypto_sw_max[alg])
+			len += sprintf(page + len, "sw_max %d %d\n", alg,
+					crypto_sw_max[alg]);
+	*eof = 1;
+	return len;
+}
+
+static int
+crypto_alt_proc_write(struct file *file, const char __user *buffer,
+		unsigned long count, void *data)
+{
+	char str[32], *p;
+	int alg;
+
+	if (count >= sizeof(str))
+		return -EINVAL;
+	if (copy_from_user(str, buffer, count))
+		return -EFAULT;
+	str[count] = '\0';
+
+	if (strncmp(str, "adaptive ", 9) == 0)
+		crypto_adaptive = simple_strtoul(str + 9, NULL, 0);
+	else if (strncmp(str, "hw_depth ", 9) == 0)
+		crypto_hw_depth = simple_strtoul(str + 9, NULL, 0);
+	else if (strncmp(str, "sw_max ", 7) == 0) {
+		/* applies to the sessions opened from now on */
+		alg = simple_strtoul(str + 7, &p, 0);
+		if (alg < 1 || alg > CRYPTO_ALGORITHM_MAX)
+			return -EINVAL;
+		crypto_sw_max[alg] = simple_strtoul(p, NULL, 0);
+	} else
+		return -EINVAL;
+	return count;
+}
+#endif /* CONFIG_PROC_FS */
+
+static void
+crypto_alt_init(void)
+{
+#ifdef CONFIG_PROC_FS
+	struct proc_dir_entry *ent;
+#endif
+	int i;
+
+	spin_lock_init(&crypto_alt_lock);
+	for (i = 0; i < CRYPTO_ALT_HASH; i++)
+		INIT_LIST_HEAD(&crypto_alt_hash[i]);
+
+#ifdef CONFIG_PROC_FS
+	ent = create_proc_entry("ocf-dispatch", S_IFREG | S_IRUGO | S_IWUSR, NULL);
+	if (ent) {
+		ent->read_proc = crypto_alt_proc_read;
+		ent->write_proc = crypto_alt_proc_write;
+	}
+#endif
+}
+
 /*
  * Create a new session.
  */
@@ -266,6 +578,10 @@ crypto_newsession(u_int64_t *sid, struct cryptoini *cri, int hard)
 	}
 done:
 	CRYPTO_DRIVER_UNLOCK();
+
+	if (err == 0 && hard == 0 && crypto_adaptive &&
+			(CRYPTO_SESID2CAPS(*sid) & CRYPTOCAP_F_SOFTWARE) == 0)
+		crypto_alt_newsession(*sid, cri);
 	return err;
 }
 
@@ -281,6 +597,9 @@ crypto_freesession(u_int64_t sid)
 	unsigned long d_flags;
 
 	dprintk("%s()\n", __FUNCTION__);
+	if (crypto_alt_count)
+		crypto_alt_freesession(sid);
+
 	CRYPTO_DRIVER_LOCK();
 
 	if (crypto_drivers == NULL) {
@@ -630,7 +949,7 @@ int
 crypto_dispatch(struct cryptop *crp)
 {
 	u_int32_t hid = CRYPTO_SESID2HID(crp->crp_sid);
-	int result;
+	int result, routed = 0;
 	unsigned long q_flags;
 	struct cryptocap *cap;
 
@@ -644,6 +963,12 @@ crypto_dispatch(struct cryptop *crp)
 	}
 	atomic_inc(&crypto_q_cnt);
 
+	/* without a callback crypto_invoke() frees the request */
+	if (crypto_alt_count && crypto_adaptive && crp->crp_callback) {
+		crypto_alt_route(crp);
+		hid = CRYPTO_SESID2HID(crp->crp_sid);
+		routed = 1;
+	}
 	cap = crypto_checkdriver(hid);
 
 	CRYPTO_Q_LOCK();
@@ -697,8 +1022,11 @@ crypto_dispatch(struct cryptop *crp)
 			wake_up_interruptible(&cryptoproc_wait);
 		result = 0;
 	}
-	if (result != 0)
+	if (result != 0) {
 		atomic_dec(&crypto_q_cnt);
+		if (routed && (crp->crp_flags & (CRYPTO_F_ALTSW | CRYPTO_F_ALTHW)))
+			crypto_alt_done(crp);
+	}
 	CRYPTO_Q_UNLOCK();
 
 	return result;
@@ -924,6 +1252,8 @@ crypto_done(struct cryptop *crp)
 				crp->crp_flags);
 	if (crp->crp_etype != 0)
 		cryptostats.cs_errs++;
+	if (crp->crp_flags & (CRYPTO_F_ALTSW | CRYPTO_F_ALTHW))
+		crypto_alt_done(crp);
 	/*
 	 * CBIMM means unconditionally do the callback immediately;
 	 * CBIFSYNC means do the callback immediately only if the
@@ -1340,6 +1670,7 @@ crypto_init(void)
 	spin_lock_init(&crypto_drivers_lock);
 	spin_lock_init(&crypto_q_lock);
 	spin_lock_init(&crypto_ret_q_lock);
+	crypto_alt_init();
 
 	cryptop_zone = kmem_cache_create("cryptop", sizeof(struct cryptop),
 				       0, SLAB_HWCACHE_ALIGN, NULL, NULL);
@@ -1422,6 +1753,10 @@ crypto_exit(void)
 
 	/* XXX flush queues??? */
 
+#ifdef CONFIG_PROC_FS
+	remove_proc_entry("ocf-dispatch", NULL);
+#endif
+
 	/* 
 	 * Reclaim dynamically allocated resources.
 	 */
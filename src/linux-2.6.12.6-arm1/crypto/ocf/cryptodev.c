@@ -52,6 +52,12 @@ __FBSDID("$FreeBSD: src/sys/opencrypto/cryptodev.c,v 1.25 2005/02/27 22:10:25 ph
 #include <linux/file.h>
 #include <linux/miscdevice.h>
 #include <linux/version.h>
+#include <linux/mm.h>
+#include <linux/pagemap.h>
+#include <linux/poll.h>
+#include <linux/spinlock.h>
+#include <linux/smp_lock.h>
+#include <linux/dma-mapping.h>
 #include <asm/uaccess.h>
 
 #include <cryptodev.h>
@@ -81,6 +87,8 @@ struct csession_info {
 	/* u_int16_t	ctxsize; */
 };
 
+struct cring;
+
 struct csession {
 	struct list_head	list;
 	u_int64_t	sid;
@@ -105,13 +113,55 @@ struct csession {
 	struct iovec	iovec;
 	struct uio	uio;
 	int		error;
+	int		hash_open;	/* COP_F_HASH_MORE was last */
+
+	struct cring	*ring;
 };
 
 struct fcrypt {
 	struct list_head	csessions;
 	int		sesn;
+
+	wait_queue_head_t waitq;	/* ring completions */
+	atomic_t	ndone;		/* completions not yet reaped */
+	u_int32_t	ringoff;	/* next mmap() offset */
+	atomic_t	ringmem;	/* bytes in rings not yet freed */
 };
 
+/*
+ * A session's zero-copy ring, see CIOCRING.  The buffer is lowmem so
+ * drivers can DMA from it as from any kernel buffer.  It lives as long
+ * as the session or a mapping of it, whichever goes last.
+ */
+struct cring_req {
+	struct list_head	list;
+	struct cring	*ring;
+	struct iovec	iovec;
+	struct uio	uio;
+	caddr_t		mac;
+	u_int16_t	maclen;
+	u_int32_t	id;
+	int		error;
+};
+
+struct cring {
+	atomic_t	refcnt;		/* the session and every mapping */
+	struct fcrypt	*fcr;
+	unsigned long	addr;
+	int		order;
+	u_int32_t	size;
+	u_int32_t	offset;
+
+	spinlock_t	lock;
+	struct list_head free;
+	struct list_head done;
+	int		busy;		/* with the driver */
+	int		slots;
+	struct cring_req req[0];
+};
+
+#define CRING_CHUNK	8		/* ops copied from user at a time */
+
 static struct csession *csefind(struct fcrypt *, u_int);
 static int csedelete(struct fcrypt *, struct csession *);
 static struct csession *cseadd(struct fcrypt *, struct csession *);
@@ -193,6 +243,11 @@ cryptodev_op(struct csession *cse, struct crypt_op *cop)
 		crda->crd_alg = cse->mac;
 		crda->crd_key = cse->mackey;
 		crda->crd_klen = cse->mackeylen * 8;
+
+		if (cse->hash_open)
+			crda->crd_flags |= CRD_F_HASH_CONT;
+		if (cop->flags & COP_F_HASH_MORE)
+			crda->crd_flags |= CRD_F_HASH_MORE;
 	}
 
 	if (crde) {
@@ -243,7 +298,8 @@ cryptodev_op(struct csession *cse, struct crypt_op *cop)
 		crde->crd_len -= cse->info.blocksize;
 	}
 
-	if (cop->mac) {
+	/* an open hash has no digest, but must not write one into the data */
+	if (cop->mac || (cop->flags & COP_F_HASH_MORE)) {
 		if (crda == NULL) {
 			error = EINVAL;
 			dprintk("%s no crda\n", __FUNCTION__);
@@ -301,13 +357,16 @@ cryptodev_op(struct csession *cse, struct crypt_op *cop)
 		goto bail;
 	}
 
-	if (cop->mac && (error=copy_to_user(cop->mac, crp->crp_mac,
+	if (cop->mac && !(cop->flags & COP_F_HASH_MORE) &&
+			(error=copy_to_user(cop->mac, crp->crp_mac,
 					cse->info.authsize))) {
 		dprintk("%s bad mac copy\n", __FUNCTION__);
 		goto bail;
 	}
 
 bail:
+	if (crda)
+		cse->hash_open = !error && (cop->flags & COP_F_HASH_MORE);
 	if (crp)
 		crypto_freereq(crp);
 	if (cse->uio.uio_iov[0].iov_base)
@@ -465,6 +524,609 @@ fail:
 }
 
 
+static void
+cring_put(struct cring *ring)
+{
+	int i;
+
+	if (!atomic_dec_and_test(&ring->refcnt))
+		return;
+	for (i = 0; i < (1 << ring->order); i++)
+		ClearPageReserved(virt_to_page(ring->addr + i * PAGE_SIZE));
+	free_pages(ring->addr, ring->order);
+	atomic_sub(ring->size, &ring->fcr->ringmem);
+	kfree(ring);
+}
+
+static int
+cring_create(struct fcrypt *fcr, struct csession *cse, struct crypt_ring *cr)
+{
+	struct cring *ring;
+	u_int32_t size;
+	int order, i;
+
+	if (cse->ring)
+		return (EBUSY);
+	if (cr->size == 0 || cr->size > CRYPT_RING_MAX)
+		return (EINVAL);
+	if (cr->slots == 0 || cr->slots > CRYPT_RING_SLOTS)
+		cr->slots = CRYPT_RING_SLOTS;
+
+	/*
+	 * Rings are contiguous lowmem: cap what one descriptor can hold,
+	 * counting rings whose session is gone but which are still mapped.
+	 * mmap() offsets are never reused, so they must not wrap either.
+	 * ioctl() runs under the BKL, so nothing else adds meanwhile.
+	 */
+	order = get_order(cr->size);
+	size = PAGE_SIZE << order;
+	if (atomic_read(&fcr->ringmem) > CRYPT_RING_FD_MAX - size)
+		return (ENOMEM);
+	if (fcr->ringoff > (u_int32_t)~0 - size)
+		return (ENOSPC);
+
+	ring = kmalloc(sizeof(*ring) + cr->slots * sizeof(ring->req[0]),
+			GFP_KERNEL);
+	if (ring == NULL)
+		return (ENOMEM);
+	memset(ring, 0, sizeof(*ring));
+
+	ring->addr = __get_free_pages(GFP_KERNEL, order);
+	if (ring->addr == 0) {
+		kfree(ring);
+		return (ENOMEM);
+	}
+	/*
+	 * The process sees the buffer uncached; none of it may be left
+	 * dirty in the cache through the kernel mapping.
+	 */
+	memset((void *)ring->addr, 0, PAGE_SIZE << order);
+	dma_map_single(NULL, (void *)ring->addr, PAGE_SIZE << order,
+			DMA_TO_DEVICE);
+	/* remap_pfn_range() only maps reserved pages */
+	for (i = 0; i < (1 << order); i++)
+		SetPageReserved(virt_to_page(ring->addr + i * PAGE_SIZE));
+
+	atomic_set(&ring->refcnt, 1);
+	ring->fcr = fcr;
+	ring->order = order;
+	ring->size = size;
+	ring->offset = fcr->ringoff;
+	fcr->ringoff += size;
+	atomic_add(size, &fcr->ringmem);
+
+	spin_lock_init(&ring->lock);
+	INIT_LIST_HEAD(&ring->free);
+	INIT_LIST_HEAD(&ring->done);
+	ring->slots = cr->slots;
+	for (i = 0; i < ring->slots; i++) {
+		ring->req[i].ring = ring;
+		list_add_tail(&ring->req[i].list, &ring->free);
+	}
+	cse->ring = ring;
+
+	cr->size = ring->size;
+	cr->offset = ring->offset;
+	return (0);
+}
+
+/* The session goes: wait for the driver to be done with the ring. */
+static void
+cring_release(struct cring *ring)
+{
+	struct fcrypt *fcr = ring->fcr;
+	struct cring_req *req;
+	unsigned long flags;
+	int n = 0;
+
+	wait_event(fcr->waitq, ring->busy == 0);
+
+	spin_lock_irqsave(&ring->lock, flags);
+	list_for_each_entry(req, &ring->done, list)
+		n++;
+	spin_unlock_irqrestore(&ring->lock, flags);
+	atomic_sub(n, &fcr->ndone);
+
+	cring_put(ring);
+}
+
+static inline int
+cring_range(struct cring *ring, u_int32_t off, u_int32_t len)
+{
+	return (off < ring->size && len <= ring->size - off);
+}
+
+static int
+cring_cb(struct cryptop *crp)
+{
+	struct cring_req *req = (struct cring_req *)crp->crp_opaque;
+	struct cring *ring = req->ring;
+	struct fcrypt *fcr = ring->fcr;
+	unsigned long flags;
+
+	if (crp->crp_etype == EAGAIN) {
+		crp->crp_flags &= ~CRYPTO_F_DONE;
+		return crypto_dispatch(crp);
+	}
+	req->error = crp->crp_etype;
+	crypto_freereq(crp);
+
+	/* anything the driver wrote with the CPU goes out to memory */
+	dma_map_single(NULL, req->iovec.iov_base, req->iovec.iov_len,
+			DMA_TO_DEVICE);
+	if (req->mac)
+		dma_map_single(NULL, req->mac, req->maclen, DMA_TO_DEVICE);
+
+	/*
+	 * busy goes last: as soon as it drops cring_release() may go on
+	 * to free the fcrypt, and it takes ring->lock before it does.
+	 */
+	spin_lock_irqsave(&ring->lock, flags);
+	list_add_tail(&req->list, &ring->done);
+	atomic_inc(&fcr->ndone);
+	ring->busy--;
+	wake_up(&fcr->waitq);
+	spin_unlock_irqrestore(&ring->lock, flags);
+	return (0);
+}
+
+static int
+cring_op(struct csession *cse, struct crypt_ring_op *op)
+{
+	struct cring *ring = cse->ring;
+	caddr_t base = (caddr_t)ring->addr;
+	struct cryptop *crp;
+	struct cryptodesc *crde = NULL, *crda = NULL;
+	struct cring_req *req;
+	unsigned long flags;
+	int error;
+
+	if (op->len == 0 || op->len > 64*1024-4 ||
+			!cring_range(ring, op->offset, op->len))
+		return (EINVAL);
+	if (cse->info.blocksize && (op->len % cse->info.blocksize) != 0)
+		return (EINVAL);
+	if (op->iv != CRYPT_RING_NONE && (cse->info.blocksize == 0 ||
+			cse->cipher == CRYPTO_ARC4 ||
+			!cring_range(ring, op->iv, cse->info.blocksize)))
+		return (EINVAL);
+	if (cse->info.authsize && (op->mac == CRYPT_RING_NONE ||
+			!cring_range(ring, op->mac, cse->info.authsize)))
+		return (EINVAL);
+
+	spin_lock_irqsave(&ring->lock, flags);
+	if (list_empty(&ring->free)) {
+		spin_unlock_irqrestore(&ring->lock, flags);
+		return (EBUSY);
+	}
+	req = list_entry(ring->free.next, struct cring_req, list);
+	list_del(&req->list);
+	ring->busy++;
+	spin_unlock_irqrestore(&ring->lock, flags);
+
+	crp = crypto_getreq((cse->info.blocksize != 0) + (cse->info.authsize != 0));
+	if (crp == NULL) {
+		error = ENOMEM;
+		goto bail;
+	}
+	if (cse->info.authsize) {
+		crda = crp->crp_desc;
+		if (cse->info.blocksize)
+			crde = crda->crd_next;
+	} else
+		crde = crp->crp_desc;
+
+	req->id = op->id;
+	req->error = 0;
+	req->iovec.iov_base = base + op->offset;
+	req->iovec.iov_len = op->len;
+	req->uio.uio_iov = &req->iovec;
+	req->uio.uio_iovcnt = 1;
+	req->uio.uio_offset = 0;
+	req->mac = cse->info.authsize ? base + op->mac : NULL;
+	req->maclen = cse->info.authsize;
+
+	/* the process wrote around the cache, forget what it holds */
+	dma_map_single(NULL, req->iovec.iov_base, op->len, DMA_BIDIRECTIONAL);
+
+	if (crda) {
+		crda->crd_skip = 0;
+		crda->crd_len = op->len;
+		crda->crd_inject = 0;
+
+		crda->crd_alg = cse->mac;
+		crda->crd_key = cse->mackey;
+		crda->crd_klen = cse->mackeylen * 8;
+		crp->crp_mac = req->mac;
+	}
+
+	if (crde) {
+		if (op->op == COP_ENCRYPT)
+			crde->crd_flags |= CRD_F_ENCRYPT;
+		crde->crd_len = op->len;
+		crde->crd_inject = 0;
+
+		crde->crd_alg = cse->cipher;
+		crde->crd_key = cse->key;
+		crde->crd_klen = cse->keylen * 8;
+
+		if (op->iv != CRYPT_RING_NONE) {
+			dma_map_single(NULL, base + op->iv, cse->info.blocksize,
+					DMA_FROM_DEVICE);
+			memcpy(crde->crd_iv, base + op->iv, cse->info.blocksize);
+			crde->crd_flags |= CRD_F_IV_EXPLICIT | CRD_F_IV_PRESENT;
+			crde->crd_skip = 0;
+		} else if (cse->cipher == CRYPTO_ARC4) {
+			crde->crd_skip = 0;
+		} else {
+			/* encrypting, the driver writes the IV it chose */
+			if (op->op != COP_ENCRYPT)
+				crde->crd_flags |= CRD_F_IV_PRESENT;
+			crde->crd_skip = cse->info.blocksize;
+			crde->crd_len -= cse->info.blocksize;
+		}
+	}
+
+	crp->crp_ilen = op->len;
+	crp->crp_flags = CRYPTO_F_IOV | CRYPTO_F_CBIMM
+		       | (op->flags & COP_F_BATCH);
+	crp->crp_buf = (caddr_t)&req->uio;
+	crp->crp_callback = cring_cb;
+	crp->crp_sid = cse->sid;
+	crp->crp_opaque = (caddr_t)req;
+
+	error = crypto_dispatch(crp);
+	if (error == 0)
+		return (0);
+	crypto_freereq(crp);
+
+bail:
+	spin_lock_irqsave(&ring->lock, flags);
+	list_add(&req->list, &ring->free);
+	ring->busy--;
+	spin_unlock_irqrestore(&ring->lock, flags);
+	return (error);
+}
+
+static int
+cring_submit(struct csession *cse, struct crypt_ring_submit *rs)
+{
+	struct crypt_ring_op ops[CRING_CHUNK];
+	u_int32_t queued = 0, n, i;
+	int error = 0;
+
+	if (cse->ring == NULL)
+		return (EINVAL);
+
+	while (queued < rs->count) {
+		n = min(rs->count - queued, (u_int32_t)CRING_CHUNK);
+		if (copy_from_user(ops, rs->ops + queued, n * sizeof(ops[0]))) {
+			error = EFAULT;
+			break;
+		}
+		for (i = 0; i < n; i++) {
+			error = cring_op(cse, &ops[i]);
+			if (error)
+				goto out;
+			queued++;
+		}
+	}
+out:
+	/* count tells how far a batch got, only an empty one fails */
+	rs->count = queued;
+	return (queued ? 0 : error);
+}
+
+static int
+cring_reap(struct csession *cse, struct crypt_ring_reap *rr)
+{
+	struct cring *ring = cse->ring;
+	struct crypt_ring_done done[CRING_CHUNK];
+	struct cring_req *req;
+	unsigned long flags;
+	u_int32_t total = 0, n;
+	int error = 0;
+
+	if (ring == NULL)
+		return (EINVAL);
+
+	while (total < rr->count) {
+		n = 0;
+		spin_lock_irqsave(&ring->lock, flags);
+		while (n < CRING_CHUNK && total + n < rr->count &&
+				!list_empty(&ring->done)) {
+			req = list_entry(ring->done.next, struct cring_req, list);
+			list_move_tail(&req->list, &ring->free);
+			done[n].id = req->id;
+			done[n].error = req->error;
+			n++;
+		}
+		spin_unlock_irqrestore(&ring->lock, flags);
+		if (n == 0)
+			break;
+
+		atomic_sub(n, &ring->fcr->ndone);
+		if (copy_to_user(rr->done + total, done, n * sizeof(done[0]))) {
+			error = EFAULT;
+			break;
+		}
+		total += n;
+	}
+	rr->count = total;
+	return (error);
+}
+
+static void
+cring_vm_open(struct vm_area_struct *vma)
+{
+	struct cring *ring = vma->vm_private_data;
+
+	atomic_inc(&ring->refcnt);
+}
+
+static void
+cring_vm_close(struct vm_area_struct *vma)
+{
+	cring_put(vma->vm_private_data);
+}
+
+static struct vm_operations_struct cring_vm_ops = {
+	.open = cring_vm_open,
+	.close = cring_vm_close,
+};
+
+static int
+cryptodev_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct fcrypt *fcr = filp->private_data;
+	unsigned long len = vma->vm_end - vma->vm_start;
+	struct csession *cse;
+	struct cring *ring = NULL;
+	int error = -EINVAL;
+
+	dprintk("%s()\n", __FUNCTION__);
+	/* the session list belongs to ioctl(), which runs under the BKL */
+	lock_kernel();
+	list_for_each_entry(cse, &fcr->csessions, list) {
+		if (cse->ring &&
+		    (cse->ring->offset >> PAGE_SHIFT) == vma->vm_pgoff) {
+			ring = cse->ring;
+			break;
+		}
+	}
+	if (ring == NULL || len > ring->size)
+		goto out;
+
+#ifdef pgprot_writecombine
+	vma->vm_page_prot = pgprot_writecombine(vma->vm_page_prot);
+#else
+	vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
+#endif
+	if (remap_pfn_range(vma, vma->vm_start, __pa(ring->addr) >> PAGE_SHIFT,
+			len, vma->vm_page_prot)) {
+		error = -EAGAIN;
+		goto out;
+	}
+	vma->vm_ops = &cring_vm_ops;
+	vma->vm_private_data = ring;
+	cring_vm_open(vma);
+	error = 0;
+out:
+	unlock_kernel();
+	return (error);
+}
+
+static unsigned int
+cryptodev_poll(struct file *filp, poll_table *wait)
+{
+	struct fcrypt *fcr = filp->private_data;
+
+	poll_wait(filp, &fcr->waitq, wait);
+	if (atomic_read(&fcr->ndone))
+		return (POLLIN | POLLRDNORM);
+	return (0);
+}
+
+/*
+ * CIOCHASHFD: the file is read through its sendfile(), whose actor is
+ * handed the page cache pages one at a time.  They are collected, with
+ * a reference each, into requests of up to HASHFD_MAX bytes that the
+ * driver hashes in place.  A request carries a multiple of 64 bytes;
+ * the few bytes over are copied to carry[] and start the next one.
+ */
+#define HASHFD_IOV	16
+#define HASHFD_MAX	(60*1024)	/* cesa takes 64K less its digest */
+
+struct hashfd {
+	struct csession	*cse;
+	struct page	*page[HASHFD_IOV];
+	struct iovec	iov[HASHFD_IOV];
+	struct uio	uio;
+	int		n;
+	u_int32_t	bytes;
+	u_int32_t	hashed;
+	int		error;
+	char		carry[64];
+};
+
+static void
+hashfd_release(struct hashfd *h, int from)
+{
+	int i;
+
+	for (i = from; i < h->n; i++)
+		if (h->page[i])
+			page_cache_release(h->page[i]);
+	h->n = from;
+}
+
+/* hash the first len bytes collected, wait for it */
+static int
+hashfd_run(struct hashfd *h, u_int32_t len, int flags)
+{
+	struct csession *cse = h->cse;
+	struct cryptop *crp;
+	struct cryptodesc *crd;
+	int error;
+
+	crp = crypto_getreq(1);
+	if (crp == NULL)
+		return (ENOMEM);
+
+	crd = crp->crp_desc;
+	crd->crd_skip = 0;
+	crd->crd_len = len;
+	crd->crd_inject = 0;
+	crd->crd_alg = cse->mac;
+	crd->crd_key = cse->mackey;
+	crd->crd_klen = cse->mackeylen * 8;
+	crd->crd_flags = flags | (cse->hash_open ? CRD_F_HASH_CONT : 0);
+
+	h->uio.uio_iov = h->iov;
+	h->uio.uio_iovcnt = h->n;
+	h->uio.uio_offset = 0;
+
+	crp->crp_ilen = h->bytes;
+	crp->crp_flags = CRYPTO_F_IOV | CRYPTO_F_CBIMM;
+	crp->crp_buf = (caddr_t)&h->uio;
+	crp->crp_callback = (int (*) (struct cryptop *)) cryptodev_cb;
+	crp->crp_sid = cse->sid;
+	crp->crp_opaque = (void *)cse;
+	crp->crp_mac = cse->tmp_mac;
+
+	error = crypto_dispatch(crp);
+	if (error == 0) {
+		/* as in cryptodev_op(), the request can't be left behind */
+		while ((crp->crp_flags & CRYPTO_F_DONE) == 0)
+			if (wait_event_interruptible(crp->crp_waitq,
+					(crp->crp_flags & CRYPTO_F_DONE) != 0))
+				schedule();
+		error = crp->crp_etype;
+	}
+	crypto_freereq(crp);
+
+	cse->hash_open = !error && (flags & CRD_F_HASH_MORE);
+	if (!error)
+		h->hashed += len;
+	return (error);
+}
+
+/* hash what is collected but the bytes over a multiple of 64 */
+static int
+hashfd_flush(struct hashfd *h)
+{
+	u_int32_t len = h->bytes & ~63, over = h->bytes - len, left, n;
+	struct iovec *iov;
+	char tail[64];
+	int error, i;
+
+	if (len) {
+		error = hashfd_run(h, len, CRD_F_HASH_MORE);
+		if (error)
+			return (error);
+	}
+
+	/* what is over may span several short pieces, carry[] included */
+	for (left = over, i = h->n; left; left -= n) {
+		iov = &h->iov[--i];
+		n = min(left, (u_int32_t)iov->iov_len);
+		memcpy(tail + left - n, (char *)iov->iov_base + iov->iov_len - n, n);
+	}
+	hashfd_release(h, 0);
+	if (over) {
+		memcpy(h->carry, tail, over);
+		h->page[0] = NULL;
+		h->iov[0].iov_base = h->carry;
+		h->iov[0].iov_len = over;
+		h->n = 1;
+	}
+	h->bytes = over;
+	return (0);
+}
+
+static int
+hashfd_actor(read_descriptor_t *desc, struct page *page,
+		unsigned long offset, unsigned long size)
+{
+	struct hashfd *h = desc->arg.data;
+
+	if (size > desc->count)
+		size = desc->count;
+
+	page_cache_get(page);
+	h->page[h->n] = page;
+	h->iov[h->n].iov_base = page_address(page) + offset;
+	h->iov[h->n].iov_len = size;
+	h->n++;
+	h->bytes += size;
+
+	if (h->n == HASHFD_IOV || h->bytes > HASHFD_MAX - PAGE_CACHE_SIZE) {
+		h->error = hashfd_flush(h);
+		if (h->error) {
+			desc->error = -h->error;
+			desc->count = 0;
+			return (0);
+		}
+	}
+	desc->count -= size;
+	desc->written += size;
+	return (size);
+}
+
+static int
+cryptodev_hashfd(struct csession *cse, struct crypt_hashfd *hf)
+{
+	struct hashfd *h;
+	struct file *file;
+	loff_t pos = hf->offset;
+	ssize_t done;
+	int error = 0, more = hf->flags & COP_F_HASH_MORE;
+
+	if (cse->cipher || (cse->mac != CRYPTO_MD5 && cse->mac != CRYPTO_SHA1))
+		return (EINVAL);
+
+	file = fget(hf->fd);
+	if (file == NULL)
+		return (EBADF);
+	if (!(file->f_mode & FMODE_READ) || !file->f_op ||
+			!file->f_op->sendfile) {
+		fput(file);
+		return (EINVAL);
+	}
+
+	h = kmalloc(sizeof(*h), GFP_KERNEL);
+	if (h == NULL) {
+		fput(file);
+		return (ENOMEM);
+	}
+	memset(h, 0, sizeof(*h));
+	h->cse = cse;
+
+	done = hf->len ? file->f_op->sendfile(file, &pos, hf->len,
+			hashfd_actor, h) : 0;
+	if (h->error)
+		error = h->error;
+	else if (done < 0)
+		error = -done;
+	else if (more && (h->bytes & 63))
+		error = EINVAL;
+	else if (h->bytes || !more)
+		error = hashfd_run(h, h->bytes, more ? CRD_F_HASH_MORE : 0);
+	if (error)
+		cse->hash_open = 0;
+
+	hf->len = h->hashed;
+	if (!error && !more && hf->mac &&
+			copy_to_user(hf->mac, cse->tmp_mac, cse->info.authsize))
+		error = EFAULT;
+
+	hashfd_release(h, 0);
+	kfree(h);
+	fput(file);
+	return (error);
+}
+
+
 static struct csession *
 csefind(struct fcrypt *fcr, u_int ses)
 {
@@ -534,6 +1196,8 @@ csefree(struct csession *cse)
 	int error;
 
 	dprintk("%s()\n", __FUNCTION__);
+	if (cse->ring)
+		cring_release(cse->ring);
 	error = crypto_freesession(cse->sid);
 	if (cse->key)
 		kfree(cse->key);
@@ -557,6 +1221,10 @@ cryptodev_ioctl(
 	struct session_op sop;
 	struct crypt_op cop;
 	struct crypt_kop kop;
+	struct crypt_ring cr;
+	struct crypt_ring_submit rs;
+	struct crypt_ring_reap rr;
+	struct crypt_hashfd hf;
 	u_int64_t sid;
 	u_int32_t ses;
 	int feat, fd, error = 0;
@@ -777,6 +1445,65 @@ bail:
 		error = cryptodev_key(&kop);
 		copy_to_user((void*)arg, &kop, sizeof(kop));
 		break;
+	case CIOCRING:
+		dprintk("%s(CIOCRING)\n", __FUNCTION__);
+		if (copy_from_user(&cr, (void*)arg, sizeof(cr))) {
+			error = EFAULT;
+			break;
+		}
+		cse = csefind(fcr, cr.ses);
+		if (cse == NULL) {
+			error = EINVAL;
+			dprintk("%s(CIOCRING) - Fail %d\n", __FUNCTION__, error);
+			break;
+		}
+		error = cring_create(fcr, cse, &cr);
+		if (!error && copy_to_user((void*)arg, &cr, sizeof(cr)))
+			error = EFAULT;
+		break;
+	case CIOCRINGSUBMIT:
+		if (copy_from_user(&rs, (void*)arg, sizeof(rs))) {
+			error = EFAULT;
+			break;
+		}
+		cse = csefind(fcr, rs.ses);
+		if (cse == NULL) {
+			error = EINVAL;
+			break;
+		}
+		error = cring_submit(cse, &rs);
+		if (copy_to_user((void*)arg, &rs, sizeof(rs)))
+			error = EFAULT;
+		break;
+	case CIOCRINGREAP:
+		if (copy_from_user(&rr, (void*)arg, sizeof(rr))) {
+			error = EFAULT;
+			break;
+		}
+		cse = csefind(fcr, rr.ses);
+		if (cse == NULL) {
+			error = EINVAL;
+			break;
+		}
+		error = cring_reap(cse, &rr);
+		if (copy_to_user((void*)arg, &rr, sizeof(rr)))
+			error = EFAULT;
+		break;
+	case CIOCHASHFD:
+		dprintk("%s(CIOCHASHFD)\n", __FUNCTION__);
+		if (copy_from_user(&hf, (void*)arg, sizeof(hf))) {
+			error = EFAULT;
+			break;
+		}
+		cse = csefind(fcr, hf.ses);
+		if (cse == NULL) {
+			error = EINVAL;
+			break;
+		}
+		error = cryptodev_hashfd(cse, &hf);
+		if (copy_to_user((void*)arg, &hf, sizeof(hf)))
+			error = EFAULT;
+		break;
 	case CIOCASYMFEAT:
 		dprintk("%s(CIOCASYMFEAT)\n", __FUNCTION__);
 		error = crypto_getfeat(&feat);
@@ -810,6 +1537,9 @@ cryptodev_open(struct inode *inode, struct file *filp)
 	memset(fcr, 0, sizeof(*fcr));
 
 	INIT_LIST_HEAD(&fcr->csessions);
+	init_waitqueue_head(&fcr->waitq);
+	atomic_set(&fcr->ndone, 0);
+	atomic_set(&fcr->ringmem, 0);
 	filp->private_data = fcr;
 	return(0);
 }
@@ -840,6 +1570,8 @@ static struct file_operations cryptodev_fops = {
 	.open = cryptodev_open,
 	.release = cryptodev_release,
 	.ioctl = cryptodev_ioctl,
+	.mmap = cryptodev_mmap,
+	.poll = cryptodev_poll,
 };
 
 static struct miscdevice cryptodev = {
@@ -126,6 +126,7 @@ struct crypt_op {
 #define COP_DECRYPT	2
 	u_int16_t	flags;
 #define	COP_F_BATCH	0x0008		/* Batch op if possible */
+#define	COP_F_HASH_MORE	0x0010		/* Leave the hash open, see CIOCHASHFD */
 	u_int		len;
 	caddr_t		src, dst;	/* become iov[] inside kernel */
 	caddr_t		mac;		/* must be big enough for chosen MAC */
@@ -178,6 +179,85 @@ struct crypt_kop {
 
 #define CIOCASYMFEAT	_IOR('c', 105, u_int32_t)
 
+/*
+ * Zero-copy operation.  CIOCRING gives a session a buffer in kernel
+ * memory, which the process mmap()s from the same descriptor at the
+ * offset returned.  Operations name their data by offset in it and are
+ * processed in place, without a copy on either side; CIOCRINGSUBMIT
+ * queues any number of them with one call.  CIOCRINGREAP collects the
+ * completions, and poll() reports POLLIN while there are some waiting.
+ *
+ * The mapping is not cached by the CPU (write combining where the
+ * architecture has it), so that the device and the process always see
+ * the same data: fill it and read results with block copies.
+ */
+struct crypt_ring {
+	u_int32_t	ses;
+	u_int32_t	size;		/* bytes; returns: rounded up */
+	u_int32_t	slots;		/* operations in flight; returns: actual */
+	u_int32_t	offset;		/* returns: for mmap() */
+};
+
+#define CRYPT_RING_MAX		(256*1024)
+#define CRYPT_RING_FD_MAX	(1024*1024)	/* all rings of one descriptor */
+#define CRYPT_RING_SLOTS	256
+#define CRYPT_RING_NONE		0xffffffff
+
+struct crypt_ring_op {
+	u_int16_t	op;		/* COP_ENCRYPT or COP_DECRYPT */
+	u_int16_t	flags;		/* COP_F_BATCH */
+	u_int32_t	offset;		/* data in the ring */
+	u_int32_t	len;
+	u_int32_t	iv;		/* IV in the ring; or CRYPT_RING_NONE
+					   if it leads the data, and on
+					   encryption the driver fills it in */
+	u_int32_t	mac;		/* room for the MAC in the ring */
+	u_int32_t	id;		/* returned on completion */
+};
+
+struct crypt_ring_submit {
+	u_int32_t	ses;
+	u_int32_t	count;		/* returns: operations queued */
+	struct crypt_ring_op *ops;
+};
+
+struct crypt_ring_done {
+	u_int32_t	id;
+	int32_t		error;		/* 0, or an errno */
+};
+
+struct crypt_ring_reap {
+	u_int32_t	ses;
+	u_int32_t	count;		/* room in done; returns: filled */
+	struct crypt_ring_done *done;
+};
+
+#define CIOCRING	_IOWR('c', 106, struct crypt_ring)
+#define CIOCRINGSUBMIT	_IOWR('c', 107, struct crypt_ring_submit)
+#define CIOCRINGREAP	_IOWR('c', 108, struct crypt_ring_reap)
+
+/*
+ * Hashing a file.  CIOCHASHFD runs the MD5 or SHA1 of a session over
+ * len bytes of the file fd from offset, taking the pages straight from
+ * the page cache: nothing is copied to the process, and with a DMA
+ * capable driver the CPU does not read the data either.  With
+ * COP_F_HASH_MORE the hash is left open and the next CIOCHASHFD or
+ * CIOCCRYPT on the session continues it; the call without the flag
+ * writes the digest to mac.  Every part of a hash but the last must be
+ * a multiple of 64 bytes.
+ */
+struct crypt_hashfd {
+	u_int32_t	ses;
+	u_int16_t	flags;		/* COP_F_HASH_MORE */
+	u_int16_t	pad;
+	int32_t		fd;
+	u_int32_t	len;		/* returns: bytes hashed */
+	u_int64_t	offset;
+	caddr_t		mac;
+};
+
+#define CIOCHASHFD	_IOWR('c', 109, struct crypt_hashfd)
+
 struct cryptotstat {
 	struct timespec	acc;		/* total accumulated time */
 	struct timespec	min;		/* min time */
@@ -233,6 +313,15 @@ struct cryptodesc {
 #define	CRD_F_DSA_SHA_NEEDED	0x08	/* Compute SHA-1 of buffer for DSA */
 #define	CRD_F_KEY_EXPLICIT	0x10	/* Key explicitly provided */
 #define CRD_F_COMP		0x0f    /* Set when doing compression */
+#define	CRD_F_MAC_VERIFY	0x20	/* Decrypting, compare the MAC with
+					   the one at crd_inject, EBADMSG
+					   if they differ. */
+#define	CRD_F_HASH_CONT		0x40	/* Continue the hash left open in
+					   the session instead of starting
+					   a new one (MD5 and SHA1 only) */
+#define	CRD_F_HASH_MORE		0x80	/* More data follows: leave the
+					   hash open, no digest.  crd_len
+					   must be a multiple of 64 */
 
 	struct cryptoini	CRD_INI; /* Initialization/context data */
 #define crd_iv		CRD_INI.cri_iv
@@ -272,6 +361,11 @@ struct cryptop {
 #define	CRYPTO_F_CBIMM		0x0010	/* Do callback immediately */
 #define	CRYPTO_F_DONE		0x0020	/* Operation completed */
 #define	CRYPTO_F_CBIFSYNC	0x0040	/* Do CBIMM if op is synchronous */
+#define	CRYPTO_F_ALTSW		0x0080	/* internal: moved to the software
+					   session, see crypto_dispatch() */
+#define	CRYPTO_F_ALTHW		0x0100	/* internal: counted in cc_inflight */
+#define	CRYPTO_F_ORDERED	0x0200	/* Complete after the session's
+					   earlier requests */
 
 	caddr_t		crp_buf;	/* Data to be processed */
 	caddr_t		crp_opaque;	/* Opaque pointer, passed along */
@@ -280,6 +374,7 @@ struct cryptop {
 	int (*crp_callback)(struct cryptop *); /* Callback function */
 
 	caddr_t		crp_mac;
+	u_int64_t	crp_osid;	/* internal: the caller's crp_sid */
 };
 
 #define CRYPTO_BUF_CONTIG	0x0
@@ -328,6 +423,7 @@ struct cryptocap {
 	u_int8_t	cc_flags;
 	u_int8_t	cc_qblocked;		/* symmetric q blocked */
 	u_int8_t	cc_kqblocked;		/* asymmetric q blocked */
+	atomic_t	cc_inflight;		/* adaptive requests in the driver */
 #define CRYPTOCAP_F_CLEANUP	0x01		/* needs resource cleanup */
 #define CRYPTOCAP_F_SOFTWARE	0x02		/* software implementation */
 #define CRYPTOCAP_F_SYNC	0x04		/* operates synchronously */
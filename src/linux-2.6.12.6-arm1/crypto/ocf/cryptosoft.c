@@ -584,10 +584,25 @@ swcr_process(void *arg, struct cryptop *crp, int hint)
 			}
 			memset(result, 0, sizeof(result));
 
+			if ((crd->crd_flags & (CRD_F_HASH_CONT | CRD_F_HASH_MORE)) &&
+					sw->sw_type == SW_TYPE_HMAC) {
+				crp->crp_etype = EINVAL;
+				goto done;
+			}
+
 			if(sw->sw_type == SW_TYPE_HMAC)
 				crypto_hmac(sw->sw_tfm, sw->u.hmac.sw_key, &sw->u.hmac.sw_klen,
 					sg, sg_num, result);
 
+			else if (crd->crd_flags & (CRD_F_HASH_CONT | CRD_F_HASH_MORE)) {
+				/* the open hash is kept in the session's tfm */
+				if (!(crd->crd_flags & CRD_F_HASH_CONT))
+					crypto_digest_init(sw->sw_tfm);
+				crypto_digest_update(sw->sw_tfm, sg, sg_num);
+				if (crd->crd_flags & CRD_F_HASH_MORE)
+					break;
+				crypto_digest_final(sw->sw_tfm, result);
+			}
 			else /* SW_TYPE_HASH */
 				crypto_digest_digest(sw->sw_tfm, sg, sg_num, result);
 
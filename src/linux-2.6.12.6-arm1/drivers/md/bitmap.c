@@ -0,0 +1,665 @@
+/*
+ * bitmap.c : write-intent bitmap for md RAID1
+ *
+ * Every write to the array first sets the bit for its chunk, and the
+ * member writes are held back until that bit is on disk.  Bits are
+ * cleared again by bitmap_daemon_work() once a chunk has been idle for
+ * two passes of the daemon.  After an unclean shutdown only the chunks
+ * whose bits are set need to be resynced.
+ *
+ * The bitmap is stored, header first, in the unused part of the 64KB
+ * that 0.90 superblocks reserve at the end of every member device.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * (for example /usr/src/linux/COPYING); if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <linux/raid/md.h>
+#include <linux/raid/bitmap.h>
+
+#define BITMAP_PAGE_BITS	(PAGE_SIZE << 3)
+#define BITMAP_HDR_BITS		(BITMAP_SB_SIZE << 3)
+#define BITMAP_MAX_CHUNKS	((BITMAP_MAX_BYTES - BITMAP_SB_SIZE) << 3)
+#define BITMAP_MIN_CHUNK_KB	64
+
+/*
+ * Tunables, in /proc/sys/dev/raid.  A chunk size of 0 picks the smallest
+ * power of two, at least BITMAP_MIN_CHUNK_KB, that lets the bitmap fit.
+ * Both take effect the next time a bitmap is created.
+ */
+int sysctl_bitmap_chunk_kb = 0;
+int sysctl_bitmap_daemon_sleep = 5;
+
+static inline int chunk_page(unsigned long chunk)
+{
+	return (chunk + BITMAP_HDR_BITS) / BITMAP_PAGE_BITS;
+}
+
+static inline int chunk_bit(unsigned long chunk)
+{
+	return (chunk + BITMAP_HDR_BITS) & (BITMAP_PAGE_BITS - 1);
+}
+
+static inline unsigned long page_first_chunk(int page)
+{
+	if (!page)
+		return 0;
+	return page * BITMAP_PAGE_BITS - BITMAP_HDR_BITS;
+}
+
+/* called with bitmap->lock held */
+static void bitmap_set_bit(struct bitmap *bitmap, unsigned long chunk)
+{
+	int page = chunk_page(chunk);
+
+	if (!ext2_set_bit(chunk_bit(chunk), page_address(bitmap->pages[page])))
+		bitmap->bits_set++;
+	set_bit(BITMAP_PAGE_DIRTY, &bitmap->page_attr[page]);
+}
+
+/* called with bitmap->lock held */
+static void bitmap_clear_bit(struct bitmap *bitmap, unsigned long chunk)
+{
+	int page = chunk_page(chunk);
+
+	if (ext2_clear_bit(chunk_bit(chunk), page_address(bitmap->pages[page])))
+		bitmap->bits_set--;
+	set_bit(BITMAP_PAGE_NEEDWRITE, &bitmap->page_attr[page]);
+}
+
+/*
+ * What a page write needs on completion.  mddev->bitmap is not looked
+ * at from there: bitmap_destroy() clears it before the last flush.
+ */
+struct bitmap_write {
+	struct bitmap	*bitmap;
+	mdk_rdev_t	*rdev;
+};
+
+static int bitmap_end_write(struct bio *bio, unsigned int bytes_done, int error)
+{
+	struct bitmap_write *bw = bio->bi_private;
+	struct bitmap *bitmap = bw->bitmap;
+	mdk_rdev_t *rdev = bw->rdev;
+	mddev_t *mddev = rdev->mddev;
+	char b[BDEVNAME_SIZE];
+
+	if (bio->bi_size)
+		return 1;
+
+	if (!test_bit(BIO_UPTODATE, &bio->bi_flags)) {
+		printk(KERN_ERR "md: %s: bitmap write failed on %s\n",
+		       mdname(mddev), bdevname(rdev->bdev, b));
+		/* the array may be stopping, with no personality left */
+		if (mddev->pers)
+			md_error(mddev, rdev);
+	}
+	bio_put(bio);
+	if (atomic_dec_and_test(&bitmap->pending_writes))
+		wake_up(&bitmap->write_wait);
+	return 0;
+}
+
+/*
+ * Write the pages in 'which' to every working device as one batch and
+ * wait for all of them.  Called with write_sem held.
+ */
+static void bitmap_write_pages(struct bitmap *bitmap, unsigned long which)
+{
+	mddev_t *mddev = bitmap->mddev;
+	struct bitmap_write bw[MD_SB_DISKS];
+	mdk_rdev_t *rdev;
+	struct list_head *tmp;
+	unsigned long start = jiffies;
+	int i, n = 0;
+
+	atomic_set(&bitmap->pending_writes, 1);
+	ITERATE_RDEV(mddev, rdev, tmp) {
+		if (rdev->faulty || n == MD_SB_DISKS)
+			continue;
+		bw[n].bitmap = bitmap;
+		bw[n].rdev = rdev;
+		for (i = 0; i < bitmap->npages; i++) {
+			struct bio *bio;
+
+			if (!(which & (1UL << i)))
+				continue;
+			bio = bio_alloc(GFP_NOIO, 1);
+			bio->bi_bdev = rdev->bdev;
+			bio->bi_sector = (rdev->sb_offset << 1) + BITMAP_SB_OFFSET
+				+ i * (PAGE_SIZE >> 9);
+			bio_add_page(bio, bitmap->pages[i], PAGE_SIZE, 0);
+			bio->bi_private = &bw[n];
+			bio->bi_end_io = bitmap_end_write;
+			atomic_inc(&bitmap->pending_writes);
+			bitmap->page_writes++;
+			submit_bio(WRITE | (1 << BIO_RW_SYNC), bio);
+		}
+		n++;
+	}
+	if (!atomic_dec_and_test(&bitmap->pending_writes))
+		wait_event(bitmap->write_wait,
+			   !atomic_read(&bitmap->pending_writes));
+	bitmap->flush_jiffies += jiffies - start;
+}
+
+/*
+ * Write out every page that has 'attr' set.  While a page is being
+ * written it is PENDING, and bitmap_startwrite() holds back writes
+ * that depend on it.
+ */
+static void bitmap_flush(struct bitmap *bitmap, int attr)
+{
+	unsigned long which = 0;
+	int i;
+
+	down(&bitmap->write_sem);
+	spin_lock_irq(&bitmap->lock);
+	for (i = 0; i < bitmap->npages; i++) {
+		if (!test_and_clear_bit(attr, &bitmap->page_attr[i]) &&
+		    !bitmap->write_all)
+			continue;
+		if (attr == BITMAP_PAGE_DIRTY)
+			clear_bit(BITMAP_PAGE_NEEDWRITE, &bitmap->page_attr[i]);
+		set_bit(BITMAP_PAGE_PENDING, &bitmap->page_attr[i]);
+		which |= 1UL << i;
+	}
+	bitmap->write_all = 0;
+	spin_unlock_irq(&bitmap->lock);
+
+	if (which) {
+		bitmap_write_pages(bitmap, which);
+
+		spin_lock_irq(&bitmap->lock);
+		for (i = 0; i < bitmap->npages; i++)
+			if (which & (1UL << i))
+				clear_bit(BITMAP_PAGE_PENDING,
+					  &bitmap->page_attr[i]);
+		spin_unlock_irq(&bitmap->lock);
+	}
+	up(&bitmap->write_sem);
+}
+
+/*
+ * Make sure every bit set so far is on disk.  The personality calls
+ * this before submitting writes that bitmap_startwrite() held back.
+ */
+void bitmap_unplug(struct bitmap *bitmap)
+{
+	if (!bitmap)
+		return;
+	bitmap_flush(bitmap, BITMAP_PAGE_DIRTY);
+}
+
+/*
+ * Called from md_update_sb() before the superblocks are written, so
+ * that a bitmap is never older than the superblocks describing it.
+ */
+void bitmap_update_sb(struct bitmap *bitmap)
+{
+	bitmap_super_t *sb;
+
+	if (!bitmap)
+		return;
+	spin_lock_irq(&bitmap->lock);
+	sb = page_address(bitmap->pages[0]);
+	sb->events = cpu_to_le64(bitmap->mddev->events);
+	set_bit(BITMAP_PAGE_DIRTY, &bitmap->page_attr[0]);
+	spin_unlock_irq(&bitmap->lock);
+	bitmap_unplug(bitmap);
+}
+
+/*
+ * A device was added to the array: it gets a full copy of the bitmap
+ * with the next superblock update.
+ */
+void bitmap_write_all(struct bitmap *bitmap)
+{
+	unsigned long flags;
+
+	if (!bitmap)
+		return;
+	spin_lock_irqsave(&bitmap->lock, flags);
+	bitmap->write_all = 1;
+	spin_unlock_irqrestore(&bitmap->lock, flags);
+}
+
+/*
+ * Account a write of 'sectors' at 'offset'.  Returns 1 if a bit the
+ * write depends on is not on disk yet; the caller must then hold the
+ * write back until after the next bitmap_unplug().
+ */
+int bitmap_startwrite(struct bitmap *bitmap, sector_t offset,
+		      unsigned long sectors)
+{
+	unsigned long chunk, last;
+	int delay = 0;
+
+	if (!bitmap || !sectors)
+		return 0;
+	chunk = offset >> bitmap->chunkshift;
+	last = (offset + sectors - 1) >> bitmap->chunkshift;
+	if (last >= bitmap->chunks)
+		last = bitmap->chunks - 1;
+
+	spin_lock_irq(&bitmap->lock);
+	for (; chunk <= last; chunk++) {
+		bitmap_counter_t *bmc = &bitmap->counters[chunk];
+		int page = chunk_page(chunk);
+
+		wait_event_lock_irq(bitmap->overflow_wait,
+				    COUNTER(*bmc) < COUNTER_MAX,
+				    bitmap->lock, );
+		switch (COUNTER(*bmc)) {
+		case 0:
+			bitmap_set_bit(bitmap, chunk);
+			/* fall through */
+		case 1:
+			*bmc = (*bmc & ~COUNTER_MAX) | 2;
+		}
+		(*bmc)++;
+
+		if (test_bit(BITMAP_PAGE_DIRTY, &bitmap->page_attr[page]) ||
+		    test_bit(BITMAP_PAGE_PENDING, &bitmap->page_attr[page]))
+			delay = 1;
+	}
+	if (delay)
+		bitmap->writes_held++;
+	spin_unlock_irq(&bitmap->lock);
+	return delay;
+}
+
+/*
+ * A write accounted by bitmap_startwrite() has finished on all mirrors.
+ * If it did not reach all of them, the chunk must be resynced before
+ * its bit may be cleared.  May be called from interrupt context.
+ */
+void bitmap_endwrite(struct bitmap *bitmap, sector_t offset,
+		     unsigned long sectors, int success)
+{
+	unsigned long chunk, last, flags;
+
+	if (!bitmap || !sectors)
+		return;
+	chunk = offset >> bitmap->chunkshift;
+	last = (offset + sectors - 1) >> bitmap->chunkshift;
+	if (last >= bitmap->chunks)
+		last = bitmap->chunks - 1;
+
+	spin_lock_irqsave(&bitmap->lock, flags);
+	for (; chunk <= last; chunk++) {
+		bitmap_counter_t *bmc = &bitmap->counters[chunk];
+
+		if (!success)
+			*bmc |= NEEDED_MASK;
+		if (COUNTER(*bmc) == COUNTER_MAX)
+			wake_up(&bitmap->overflow_wait);
+		(*bmc)--;
+		if (COUNTER(*bmc) <= 2)
+			set_bit(BITMAP_PAGE_CLEAN,
+				&bitmap->page_attr[chunk_page(chunk)]);
+	}
+	spin_unlock_irqrestore(&bitmap->lock, flags);
+}
+
+/*
+ * Resync is about to handle 'offset'.  Returns 1 if the chunk needs to
+ * be synced, and the number of sectors to the end of the chunk in
+ * *blocks.  Without a bitmap every chunk needs syncing.
+ */
+int bitmap_start_sync(struct bitmap *bitmap, sector_t offset,
+		      sector_t *blocks)
+{
+	unsigned long chunk;
+	bitmap_counter_t *bmc;
+	int rv = 0;
+
+	if (!bitmap) {
+		*blocks = MaxSector;
+		return 1;
+	}
+	chunk = offset >> bitmap->chunkshift;
+	*blocks = ((sector_t)(chunk + 1) << bitmap->chunkshift) - offset;
+	if (chunk >= bitmap->chunks)
+		return 1;
+
+	spin_lock_irq(&bitmap->lock);
+	bmc = &bitmap->counters[chunk];
+	if (RESYNC(*bmc))
+		rv = 1;
+	else if (NEEDED(*bmc)) {
+		*bmc &= ~NEEDED_MASK;
+		*bmc |= RESYNC_MASK;
+		rv = 1;
+	}
+	spin_unlock_irq(&bitmap->lock);
+	return rv;
+}
+
+/*
+ * Resync has finished or stopped, having completed everything before
+ * 'done'.  Chunks it started but did not complete are needed again.
+ */
+void bitmap_close_sync(struct bitmap *bitmap, sector_t done)
+{
+	unsigned long chunk, last;
+	int page;
+
+	if (!bitmap)
+		return;
+	for (page = 0; page < bitmap->npages; page++) {
+		chunk = page_first_chunk(page);
+		last = page_first_chunk(page + 1);
+		if (last > bitmap->chunks)
+			last = bitmap->chunks;
+
+		spin_lock_irq(&bitmap->lock);
+		for (; chunk < last; chunk++) {
+			bitmap_counter_t *bmc = &bitmap->counters[chunk];
+
+			if (!RESYNC(*bmc))
+				continue;
+			*bmc &= ~RESYNC_MASK;
+			if (((sector_t)(chunk + 1) << bitmap->chunkshift) > done)
+				*bmc |= NEEDED_MASK;
+			else
+				set_bit(BITMAP_PAGE_CLEAN,
+					&bitmap->page_attr[page]);
+		}
+		spin_unlock_irq(&bitmap->lock);
+	}
+}
+
+/*
+ * Called by the personality's thread, which md wakes at least every
+ * daemon_sleep.  An idle chunk's counter steps from 2 to 1 on one pass
+ * and its bit is cleared on the next.  Bits of a degraded array are
+ * kept, as are those of chunks that still need a resync.
+ */
+void bitmap_daemon_work(struct bitmap *bitmap)
+{
+	unsigned long chunk, last;
+	int page, again, cleared = 0;
+
+	if (!bitmap ||
+	    time_before(jiffies, bitmap->daemon_lastrun + bitmap->daemon_sleep))
+		return;
+	bitmap->daemon_lastrun = jiffies;
+
+	for (page = 0; page < bitmap->npages; page++) {
+		if (!test_and_clear_bit(BITMAP_PAGE_CLEAN,
+					&bitmap->page_attr[page]))
+			continue;
+		chunk = page_first_chunk(page);
+		last = page_first_chunk(page + 1);
+		if (last > bitmap->chunks)
+			last = bitmap->chunks;
+
+		again = 0;
+		spin_lock_irq(&bitmap->lock);
+		for (; chunk < last; chunk++) {
+			bitmap_counter_t *bmc = &bitmap->counters[chunk];
+
+			if (NEEDED(*bmc) || RESYNC(*bmc))
+				continue;
+			switch (COUNTER(*bmc)) {
+			case 2:
+				*bmc = 1;
+				again = 1;
+				break;
+			case 1:
+				if (bitmap->mddev->degraded) {
+					again = 1;
+					break;
+				}
+				*bmc = 0;
+				bitmap_clear_bit(bitmap, chunk);
+				cleared = 1;
+				break;
+			}
+		}
+		if (again)
+			set_bit(BITMAP_PAGE_CLEAN, &bitmap->page_attr[page]);
+		spin_unlock_irq(&bitmap->lock);
+	}
+
+	/* cleared bits are not urgent, so they are written here */
+	if (cleared)
+		bitmap_flush(bitmap, BITMAP_PAGE_NEEDWRITE);
+}
+
+void bitmap_status(struct seq_file *seq, struct bitmap *bitmap)
+{
+	seq_printf(seq, "bitmap: %d pages, %luKB chunk, %lu/%lu dirty,"
+		   " %lu writes held, %lu page writes (%ums),"
+		   " %llu KB resync skipped",
+		   bitmap->npages, (1UL << bitmap->chunkshift) >> 1,
+		   bitmap->bits_set, bitmap->chunks, bitmap->writes_held,
+		   bitmap->page_writes, jiffies_to_msecs(bitmap->flush_jiffies),
+		   (unsigned long long)bitmap->sync_skipped >> 1);
+}
+
+/*
+ * Returns 1 if the header read from disk describes this array, as it is
+ * now, and no superblock was written since the bitmap was.
+ */
+static int bitmap_sb_valid(mddev_t *mddev, bitmap_super_t *sb)
+{
+	unsigned long chunksize = le32_to_cpu(sb->chunksize);
+	sector_t sectors = mddev->size << 1;
+	char *reason;
+
+	if (le32_to_cpu(sb->magic) != BITMAP_MAGIC ||
+	    le32_to_cpu(sb->version) != BITMAP_MAJOR)
+		return 0;
+
+	if (memcmp(sb->uuid, mddev->uuid, 16))
+		reason = "uuid mismatch";
+	else if (le64_to_cpu(sb->sync_size) != sectors)
+		reason = "array size changed";
+	else if (chunksize < PAGE_SIZE || (chunksize & (chunksize - 1)))
+		reason = "bad chunk size";
+	else if (((sectors - 1) >> ffz(~(chunksize >> 9))) + 1 > BITMAP_MAX_CHUNKS)
+		reason = "chunk size too small";
+	else if (le64_to_cpu(sb->events) < mddev->events)
+		reason = "bitmap is out of date";
+	else if (le32_to_cpu(sb->state) & (1 << BITMAP_STALE))
+		reason = "bitmap marked stale";
+	else
+		return 1;
+
+	printk(KERN_INFO "md: %s: ignoring bitmap: %s\n", mdname(mddev), reason);
+	return 0;
+}
+
+static unsigned long bitmap_chunkshift(sector_t sectors)
+{
+	unsigned long shift;
+	int kb = sysctl_bitmap_chunk_kb;
+
+	if (kb <= 0)
+		kb = BITMAP_MIN_CHUNK_KB;
+	shift = fls(kb * 2 - 1);
+	if (shift < PAGE_SHIFT - 9)
+		shift = PAGE_SHIFT - 9;
+	while (((sectors - 1) >> shift) + 1 > BITMAP_MAX_CHUNKS)
+		shift++;
+	return shift;
+}
+
+int bitmap_create(mddev_t *mddev)
+{
+	struct bitmap *bitmap;
+	bitmap_super_t *sb;
+	mdk_rdev_t *rdev, *src = NULL;
+	struct list_head *tmp;
+	sector_t sectors = mddev->size << 1;
+	unsigned long chunk;
+	int i, valid = 0, sleep;
+
+	if (!mddev->bitmap_offset || mddev->bitmap)
+		return 0;
+	if (mddev->level != 1 || !mddev->persistent ||
+	    mddev->major_version != 0 || !sectors) {
+		printk(KERN_WARNING "md: %s: write-intent bitmaps need raid1"
+		       " with 0.90 superblocks\n", mdname(mddev));
+		return -EINVAL;
+	}
+
+	bitmap = kmalloc(sizeof(*bitmap), GFP_KERNEL);
+	if (!bitmap)
+		return -ENOMEM;
+	memset(bitmap, 0, sizeof(*bitmap));
+	bitmap->mddev = mddev;
+	spin_lock_init(&bitmap->lock);
+	init_waitqueue_head(&bitmap->overflow_wait);
+	init_waitqueue_head(&bitmap->write_wait);
+	init_MUTEX(&bitmap->write_sem);
+	atomic_set(&bitmap->pending_writes, 0);
+
+	bitmap->pages[0] = alloc_page(GFP_KERNEL);
+	if (!bitmap->pages[0])
+		goto out_nomem;
+	bitmap->npages = 1;
+	sb = page_address(bitmap->pages[0]);
+
+	/* the bitmap on any in-sync member will do */
+	ITERATE_RDEV(mddev, rdev, tmp)
+		if (!rdev->faulty && rdev->in_sync) {
+			src = rdev;
+			break;
+		}
+	if (src && sync_page_io(src->bdev, (src->sb_offset << 1) + BITMAP_SB_OFFSET,
+				PAGE_SIZE, bitmap->pages[0], READ))
+		valid = bitmap_sb_valid(mddev, sb);
+
+	if (valid)
+		bitmap->chunkshift = ffz(~(le32_to_cpu(sb->chunksize) >> 9));
+	else
+		bitmap->chunkshift = bitmap_chunkshift(sectors);
+	bitmap->chunks = ((sectors - 1) >> bitmap->chunkshift) + 1;
+	bitmap->npages = (BITMAP_SB_SIZE + (bitmap->chunks + 7) / 8
+			  + PAGE_SIZE - 1) >> PAGE_SHIFT;
+
+	sleep = sysctl_bitmap_daemon_sleep;
+	if (sleep < 1)
+		sleep = 1;
+	bitmap->daemon_sleep = sleep * HZ;
+	bitmap->daemon_lastrun = jiffies;
+
+	bitmap->counters = vmalloc(bitmap->chunks * sizeof(bitmap_counter_t));
+	if (!bitmap->counters)
+		goto out_nomem;
+	memset(bitmap->counters, 0, bitmap->chunks * sizeof(bitmap_counter_t));
+
+	for (i = 1; i < bitmap->npages; i++) {
+		bitmap->pages[i] = alloc_page(GFP_KERNEL);
+		if (!bitmap->pages[i])
+			goto out_nomem;
+		if (valid && !sync_page_io(src->bdev,
+					   (src->sb_offset << 1) + BITMAP_SB_OFFSET
+					   + i * (PAGE_SIZE >> 9),
+					   PAGE_SIZE, bitmap->pages[i], READ)) {
+			printk(KERN_WARNING "md: %s: error reading bitmap\n",
+			       mdname(mddev));
+			valid = 0;
+		}
+	}
+
+	if (valid) {
+		/*
+		 * Set bits are chunks that may have been written when we
+		 * stopped.  If that was not a clean shutdown they need a
+		 * resync, unless resync had already got past them.
+		 */
+		for (chunk = 0; chunk < bitmap->chunks; chunk++) {
+			int page = chunk_page(chunk);
+
+			if (!ext2_test_bit(chunk_bit(chunk),
+					   page_address(bitmap->pages[page])))
+				continue;
+			bitmap->counters[chunk] = 2;
+			bitmap->bits_set++;
+			if (mddev->recovery_cp != MaxSector &&
+			    ((sector_t)(chunk + 1) << bitmap->chunkshift) >
+			    mddev->recovery_cp)
+				bitmap->counters[chunk] |= NEEDED_MASK;
+			set_bit(BITMAP_PAGE_CLEAN, &bitmap->page_attr[page]);
+		}
+	} else {
+		/*
+		 * Start from scratch.  Without a usable bitmap an array that
+		 * is not clean needs every chunk resynced.
+		 */
+		for (i = 0; i < bitmap->npages; i++)
+			memset(page_address(bitmap->pages[i]), 0, PAGE_SIZE);
+		sb->magic = cpu_to_le32(BITMAP_MAGIC);
+		sb->version = cpu_to_le32(BITMAP_MAJOR);
+		memcpy(sb->uuid, mddev->uuid, 16);
+		sb->sync_size = cpu_to_le64(sectors);
+		sb->chunksize = cpu_to_le32((1UL << bitmap->chunkshift) << 9);
+		if (mddev->recovery_cp != MaxSector)
+			for (chunk = 0; chunk < bitmap->chunks; chunk++) {
+				bitmap_set_bit(bitmap, chunk);
+				bitmap->counters[chunk] = NEEDED_MASK | 2;
+			}
+		bitmap->write_all = 1;
+	}
+	sb->events = cpu_to_le64(mddev->events);
+	sb->daemon_sleep = cpu_to_le32(sleep);
+	set_bit(BITMAP_PAGE_DIRTY, &bitmap->page_attr[0]);
+
+	mddev->bitmap = bitmap;
+	if (mddev->thread)
+		mddev->thread->timeout = bitmap->daemon_sleep;
+
+	printk(KERN_INFO "md: %s: %s bitmap, %lu chunks of %luKB, %lu dirty\n",
+	       mdname(mddev), valid ? "loaded" : "new", bitmap->chunks,
+	       (1UL << bitmap->chunkshift) >> 1, bitmap->bits_set);
+	return 0;
+
+out_nomem:
+	for (i = 0; i < bitmap->npages; i++)
+		if (bitmap->pages[i])
+			__free_page(bitmap->pages[i]);
+	if (bitmap->counters)
+		vfree(bitmap->counters);
+	kfree(bitmap);
+	return -ENOMEM;
+}
+
+void bitmap_destroy(mddev_t *mddev)
+{
+	struct bitmap *bitmap = mddev->bitmap;
+	int i;
+
+	if (!bitmap)
+		return;
+
+	/* raid1d may be halfway through bitmap_unplug() or the daemon work */
+	mddev->bitmap = NULL;
+	if (mddev->thread) {
+		mddev->thread->timeout = MAX_SCHEDULE_TIMEOUT;
+		md_thread_sync(mddev->thread);
+	}
+
+	bitmap_unplug(bitmap);
+
+	for (i = 0; i < bitmap->npages; i++)
+		__free_page(bitmap->pages[i]);
+	vfree(bitmap->counters);
+	kfree(bitmap);
+}
+
+EXPORT_SYMBOL(bitmap_startwrite);
+EXPORT_SYMBOL(bitmap_endwrite);
+EXPORT_SYMBOL(bitmap_start_sync);
+EXPORT_SYMBOL(bitmap_close_sync);
+EXPORT_SYMBOL(bitmap_unplug);
+EXPORT_SYMBOL(bitmap_daemon_work);
@@ -59,6 +59,9 @@ struct convert_context {
 	unsigned int idx_out;
 	sector_t sector;
 	int write;
+#if defined(CONFIG_OCF_DM_CRYPT)
+	struct ocf_wr_priv *wr;		/* write clone being encrypted */
+#endif
 };
 
 struct crypt_config;
@@ -269,13 +272,61 @@ static struct crypt_iv_operations crypt_iv_essiv_ops = {
 
 #if defined(CONFIG_OCF_DM_CRYPT)
 static void dec_pending(struct crypt_io *io, int error);
+static void crypt_free_buffer_pages(struct crypt_config *cc,
+                                    struct bio *bio, unsigned int bytes);
+static struct workqueue_struct *_kcryptd_workqueue;
 
+/*
+ * Sectors per OCF request.  A request carries one descriptor, with its
+ * own IV, per sector, so a page of a bio is converted in one go; 1 gives
+ * back the old request per sector.
+ */
+static int ocf_batch = PAGE_SIZE >> SECTOR_SHIFT;
+module_param(ocf_batch, int, 0);
+MODULE_PARM_DESC(ocf_batch, "sectors per OCF request");
+
+/*
+ * A write clone is encrypted asynchronously and submitted by kcryptd
+ * once its last request completes.  pending counts the requests in
+ * flight, plus one held by crypt_map() until the clone is set up.
+ */
 struct ocf_wr_priv {
-	u32 		 	dm_ocf_wr_completed;	/* Num of wr completions */
-	u32 		 	dm_ocf_wr_pending;	/* Num of wr pendings */
-	wait_queue_head_t	dm_ocf_wr_queue;	/* waiting Q, for wr completion */
+	atomic_t		pending;
+	int			error;
+	struct crypt_io		*io;
+	struct bio		*clone;
+	struct work_struct	work;
 };
 
+static void dm_ocf_wr_submit(void *data)
+{
+	struct ocf_wr_priv *wr = (struct ocf_wr_priv *)data;
+	struct crypt_io *io = wr->io;
+	struct crypt_config *cc = (struct crypt_config *) io->target->private;
+	struct bio *clone = wr->clone;
+	int error = wr->error;
+
+	kfree(wr);
+
+	if (error) {
+		crypt_free_buffer_pages(cc, clone, clone->bi_size);
+		bio_put(clone);
+		dec_pending(io, error);
+		return;
+	}
+
+	generic_make_request(clone);
+}
+
+static void dm_ocf_wr_put(struct ocf_wr_priv *wr)
+{
+	if (!atomic_dec_and_test(&wr->pending))
+		return;
+
+	INIT_WORK(&wr->work, dm_ocf_wr_submit, wr);
+	queue_work(_kcryptd_workqueue, &wr->work);
+}
+
 static int dm_ocf_wr_cb(struct cryptop *crp)
 {
 	struct ocf_wr_priv *ocf_wr_priv;
@@ -286,20 +337,19 @@ static int dm_ocf_wr_cb(struct cryptop *crp)
 	}
 
 	ocf_wr_priv = (struct ocf_wr_priv*)crp->crp_opaque;
-
-	ocf_wr_priv->dm_ocf_wr_completed++;
-	
-	/* if no more pending for read, wake up the read task. */
-	if(ocf_wr_priv->dm_ocf_wr_completed == ocf_wr_priv->dm_ocf_wr_pending)
-		wake_up(&ocf_wr_priv->dm_ocf_wr_queue);
+	if (crp->crp_etype)
+		ocf_wr_priv->error = -EIO;
 
 	crypto_freereq(crp);
+
+	dm_ocf_wr_put(ocf_wr_priv);
 	return 0;
 }
 
 static int dm_ocf_rd_cb(struct cryptop *crp)
 {
 	struct crypt_io *io;
+	int error;
 
 	if(crp == NULL) {
 		printk("dm_ocf_rd_cb: crp is NULL!! \n");
@@ -307,48 +357,57 @@ static int dm_ocf_rd_cb(struct cryptop *crp)
 	}
 
 	io = (struct crypt_io *)crp->crp_opaque;
+	error = crp->crp_etype ? -EIO : 0;
 
 	crypto_freereq(crp);
 
-	if(io != NULL)
-		dec_pending(io, 0);
+	dec_pending(io, error);
 
 	return 0;
 }
 
+/*
+ * One OCF request for len bytes starting at sector, one descriptor per
+ * sector.
+ */
 static inline int dm_ocf_process(struct crypt_config *cc, struct scatterlist *out, 
-		struct scatterlist *in, unsigned int len, u8 *iv, int iv_size, int write, void *priv)
+		struct scatterlist *in, unsigned int len, sector_t sector, int write, void *priv)
 {
 	struct cryptop *crp;
 	struct cryptodesc *crda = NULL;
+	int i, r;
 
-	if(!iv) {
+	if(!cc->iv_gen_ops) {
 		printk("dm_ocf_process: only CBC mode is supported\n");
 		return -EPERM;	
 	}
 
-	crp = crypto_getreq(1);	 /* only encryption/decryption */
+	if(cc->iv_size > EALG_MAX_BLOCK_LEN) {
+		printk("dm_ocf_process: iv is too big!!\n");
+		return -EINVAL;
+	}
+
+	crp = crypto_getreq(len >> SECTOR_SHIFT);
 	if (!crp) {
 		printk("dm_ocf_process: crypto_getreq failed!!\n");
 		return -ENOMEM;
 	}
-	
-	crda = crp->crp_desc;
 
-	crda->crd_flags  = (write)? CRD_F_ENCRYPT: 0;	
-	crda->crd_alg    = cc->cr_dm.cri_alg;
-	crda->crd_skip   = 0;
-	crda->crd_len    = len;
-	crda->crd_inject = 0; /* NA */
-	crda->crd_klen   = cc->cr_dm.cri_klen;
-	crda->crd_key    = cc->cr_dm.cri_key;
-
-	if (iv) {
+	for (i = 0, crda = crp->crp_desc; crda; crda = crda->crd_next, i++) {
+		crda->crd_flags  = (write)? CRD_F_ENCRYPT: 0;
 		crda->crd_flags |= (CRD_F_IV_EXPLICIT | CRD_F_IV_PRESENT);
-		if( iv_size > EALG_MAX_BLOCK_LEN ) {
-			printk("dm_ocf_process: iv is too big!!\n");
+		crda->crd_alg    = cc->cr_dm.cri_alg;
+		crda->crd_skip   = i << SECTOR_SHIFT;
+		crda->crd_len    = 1 << SECTOR_SHIFT;
+		crda->crd_inject = 0; /* NA */
+		crda->crd_klen   = cc->cr_dm.cri_klen;
+		crda->crd_key    = cc->cr_dm.cri_key;
+
+		r = cc->iv_gen_ops->generator(cc, crda->crd_iv, sector + i);
+		if (r < 0) {
+			crypto_freereq(crp);
+			return r;
 		}
-		memcpy(&crda->crd_iv, iv, iv_size);		
 	}
 
 	/* according to the current implementation the in and the out are the same buffer for read, and different for write*/
@@ -371,6 +430,7 @@ static inline int dm_ocf_process(struct crypt_config *cc, struct scatterlist *ou
         crp->crp_sid = cc->ocf_cryptoid;
         if(crypto_dispatch(crp) != 0) {
 		printk("dm_ocf_process: crypto_dispatch failed!!\n");
+		crypto_freereq(crp);
 		return -ENOMEM;
 	}
 
@@ -378,65 +438,44 @@ static inline int dm_ocf_process(struct crypt_config *cc, struct scatterlist *ou
 	
 }
 
-static inline int
-ocf_crypt_convert_scatterlist(struct crypt_config *cc, struct scatterlist *out,
-                          struct scatterlist *in, unsigned int length,
-                          int write, sector_t sector, void *priv)
-{
-	u8 iv[cc->iv_size];
-	int r;
-
-	if (cc->iv_gen_ops) {
-		r = cc->iv_gen_ops->generator(cc, iv, sector);
-		if (r < 0)
-			return r;
-		r = dm_ocf_process(cc, out, in, length, iv, cc->iv_size, write, priv);
-	} else {
-		r = dm_ocf_process(cc, out, in, length, NULL, 0, write, priv);
-	}
-
-	return r;
-}
-
 /*
  * Encrypt / decrypt data from one bio to another one (can be the same one)
+ *
+ * Reads: every request holds a reference on the io, dropped by its
+ * callback, so the bio ends after the last of them in whatever order
+ * they complete.  Writes: wr, set up by crypt_clone(), collects the
+ * requests of the clone.  Nothing waits for them here.
  */
 static int ocf_crypt_convert(struct crypt_config *cc,
-                         struct convert_context *ctx, struct crypt_io *io)
+                         struct convert_context *ctx, struct crypt_io *io,
+                         struct ocf_wr_priv *wr)
 {
 	int r = 0;
-	long wr_timeout = 30000;
-	long wr_tm;
-	int num = 0;
 	void *priv = NULL;
-	struct ocf_wr_priv *ocf_wr_priv = NULL;
+	unsigned int max = (ocf_batch > 0 ? ocf_batch : 1) << SECTOR_SHIFT;
 
-	if(ctx->write) {
-		ocf_wr_priv = kmalloc(sizeof(struct ocf_wr_priv),GFP_KERNEL);
-		if(!ocf_wr_priv) {
-			printk("ocf_crypt_convert: out of memory \n");
-			return -ENOMEM;
-		}
-		ocf_wr_priv->dm_ocf_wr_pending = 0;
-		ocf_wr_priv->dm_ocf_wr_completed = 0;
-		init_waitqueue_head(&ocf_wr_priv->dm_ocf_wr_queue);
-		priv = ocf_wr_priv;
-	}
+	if (max > PAGE_SIZE)
+		max = PAGE_SIZE;
 
 	while(ctx->idx_in < ctx->bio_in->bi_vcnt &&
 	      ctx->idx_out < ctx->bio_out->bi_vcnt) {
 		struct bio_vec *bv_in = bio_iovec_idx(ctx->bio_in, ctx->idx_in);
 		struct bio_vec *bv_out = bio_iovec_idx(ctx->bio_out, ctx->idx_out);
-		struct scatterlist sg_in = {
-			.page = bv_in->bv_page,
-			.offset = bv_in->bv_offset + ctx->offset_in,
-			.length = 1 << SECTOR_SHIFT
-		};
-		struct scatterlist sg_out = {
-			.page = bv_out->bv_page,
-			.offset = bv_out->bv_offset + ctx->offset_out,
-			.length = 1 << SECTOR_SHIFT
-		};
+		/* the run both bio_vecs have left, in whole sectors */
+		unsigned int len = min(bv_in->bv_len - ctx->offset_in,
+		                       bv_out->bv_len - ctx->offset_out);
+		struct scatterlist sg_in, sg_out;
+
+		len = min(len, max) & ~((1 << SECTOR_SHIFT) - 1);
+		if (!len)
+			len = 1 << SECTOR_SHIFT;
+
+		sg_in.page = bv_in->bv_page;
+		sg_in.offset = bv_in->bv_offset + ctx->offset_in;
+		sg_in.length = len;
+		sg_out.page = bv_out->bv_page;
+		sg_out.offset = bv_out->bv_offset + ctx->offset_out;
+		sg_out.length = len;
 
 		ctx->offset_in += sg_in.length;
 		if (ctx->offset_in >= bv_in->bv_len) {
@@ -451,33 +490,26 @@ static int ocf_crypt_convert(struct crypt_config *cc,
 		}
 
 		if(ctx->write) {
-			num++;
-		}
-		/* if last read in the context - send the io, so the OCF read callback will release the IO. */
-		else if(!(ctx->idx_in < ctx->bio_in->bi_vcnt && ctx->idx_out < ctx->bio_out->bi_vcnt)) {
+			atomic_inc(&wr->pending);
+			priv = wr;
+		} else {
+			atomic_inc(&io->pending);
 			priv = io;
 		}
 
-		r = ocf_crypt_convert_scatterlist(cc, &sg_out, &sg_in, sg_in.length,
-		                              ctx->write, ctx->sector, priv);
+		r = dm_ocf_process(cc, &sg_out, &sg_in, len, ctx->sector,
+		                   ctx->write, priv);
 		if (r < 0){
-			printk("ocf_crypt_convert: ocf_crypt_convert_scatterlist failed \n");
+			printk("ocf_crypt_convert: dm_ocf_process failed \n");
+			if (ctx->write) {
+				wr->error = r;
+				atomic_dec(&wr->pending);
+			} else
+				atomic_dec(&io->pending);
 			break;
 		}
 
-		ctx->sector++;
-	}
-
-	if(ctx->write) {
-		ocf_wr_priv->dm_ocf_wr_pending += num;
-		wr_tm = wait_event_timeout(ocf_wr_priv->dm_ocf_wr_queue, 
-				(ocf_wr_priv->dm_ocf_wr_pending == ocf_wr_priv->dm_ocf_wr_completed)
-									, msecs_to_jiffies(wr_timeout) );
-		if (!wr_tm) {
-			printk("ocf_crypt_convert: wr work was not finished in %ld msecs, %d pending %d completed.\n", 
-				wr_timeout, ocf_wr_priv->dm_ocf_wr_pending, ocf_wr_priv->dm_ocf_wr_completed);
-		}
-		kfree(ocf_wr_priv);
+		ctx->sector += len >> SECTOR_SHIFT;
 	}
 
 	return r;
@@ -712,7 +744,8 @@ static void dec_pending(struct crypt_io *io, int error)
  *
  * Needed because it would be very unwise to do decryption in an
  * interrupt context, so bios returning from read requests get
- * queued here.
+ * queued here.  With OCF, encrypted write clones are submitted
+ * from here too.
  */
 static struct workqueue_struct *_kcryptd_workqueue;
 
@@ -726,19 +759,10 @@ static void kcryptd_do_work(void *data)
 	crypt_convert_init(cc, &ctx, io->bio, io->bio,
 	                   io->bio->bi_sector - io->target->begin, 0);
 #if defined(CONFIG_OCF_DM_CRYPT)
-	r = ocf_crypt_convert(cc, &ctx, io);
+	r = ocf_crypt_convert(cc, &ctx, io, NULL);
 
-	if(r < 0) {
-		u32 rd_failed_timeout = 500;
-		wait_queue_head_t dm_ocf_rd_failed_queu;
-
-		init_waitqueue_head(&dm_ocf_rd_failed_queu);
-
-		/* wait a bit before freeing the io, maybe few requests are still in process */
-		wait_event_timeout(dm_ocf_rd_failed_queu, 0, msecs_to_jiffies(rd_failed_timeout) );
-
-		dec_pending(io, r); 
-	}
+	/* the clone's reference; requests in flight hold their own */
+	dec_pending(io, r);
 #else
 	r = crypt_convert(cc, &ctx);
 
@@ -1087,7 +1111,9 @@ crypt_clone(struct crypt_config *cc, struct crypt_io *io, struct bio *bio,
 		if (clone) {
 			ctx->bio_out = clone;
 #if defined(CONFIG_OCF_DM_CRYPT)
-			if (ocf_crypt_convert(cc, ctx, io) < 0) {
+			/* errors are handled when the clone would be submitted */
+			ctx->wr = kmalloc(sizeof(struct ocf_wr_priv), GFP_NOIO);
+			if (!ctx->wr) {
 #else
 			if (crypt_convert(cc, ctx) < 0) {
 #endif
@@ -1096,6 +1122,13 @@ crypt_clone(struct crypt_config *cc, struct crypt_io *io, struct bio *bio,
 				bio_put(clone);
 				return NULL;
 			}
+#if defined(CONFIG_OCF_DM_CRYPT)
+			atomic_set(&ctx->wr->pending, 1);
+			ctx->wr->error = 0;
+			ctx->wr->io = io;
+			ctx->wr->clone = clone;
+			ocf_crypt_convert(cc, ctx, io, ctx->wr);
+#endif
 		}
 	} else {
 		/*
@@ -1168,6 +1201,12 @@ static int crypt_map(struct dm_target *ti, struct bio *bio,
 		remaining -= clone->bi_size;
 		sector += bio_sectors(clone);
 
+#if defined(CONFIG_OCF_DM_CRYPT)
+		/* kcryptd submits it once encrypted */
+		if (bio_data_dir(bio) == WRITE)
+			dm_ocf_wr_put(ctx.wr);
+		else
+#endif
 		generic_make_request(clone);
 
 		/* out of memory -> run queues */
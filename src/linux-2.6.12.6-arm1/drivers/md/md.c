@@ -33,6 +33,7 @@
 #include <linux/config.h>
 #include <linux/linkage.h>
 #include <linux/raid/md.h>
+#include <linux/raid/bitmap.h>
 #include <linux/sysctl.h>
 #include <linux/devfs_fs_kernel.h>
 #include <linux/buffer_head.h> /* for invalidate_bdev */
@@ -73,11 +74,17 @@ static DEFINE_SPINLOCK(pers_lock);
  * idle IO detection.
  *
  * you can change it via /proc/sys/dev/raid/speed_limit_min and _max.
+ *
+ * Between the two, resync yields to foreground I/O on the array so that
+ * its latency grows by no more than /proc/sys/dev/raid/resync_latency_ms.
+ * Setting that to 0 falls back to backing off whenever the member disks
+ * are not idle.
  */
 
 static int sysctl_speed_limit_min = 1000;
 //static int sysctl_speed_limit_max = 200000;
 static int sysctl_speed_limit_max = 100000;
+static int sysctl_resync_latency_ms = 20;
 
 static struct ctl_table_header *raid_table_header;
 
@@ -98,6 +105,30 @@ static ctl_table raid_table[] = {
 		.mode		= 0644,
 		.proc_handler	= &proc_dointvec,
 	},
+	{
+		.ctl_name	= DEV_RAID_RESYNC_LATENCY,
+		.procname	= "resync_latency_ms",
+		.data		= &sysctl_resync_latency_ms,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= &proc_dointvec,
+	},
+	{
+		.ctl_name	= DEV_RAID_BITMAP_CHUNK_KB,
+		.procname	= "bitmap_chunk_kb",
+		.data		= &sysctl_bitmap_chunk_kb,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= &proc_dointvec,
+	},
+	{
+		.ctl_name	= DEV_RAID_BITMAP_DAEMON_SLEEP,
+		.procname	= "bitmap_daemon_sleep",
+		.data		= &sysctl_bitmap_daemon_sleep,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= &proc_dointvec,
+	},
 	{ .ctl_name = 0 }
 };
 
@@ -330,7 +361,7 @@ static int bi_complete(struct bio *bio, unsigned int bytes_done, int error)
 	return 0;
 }
 
-static int sync_page_io(struct block_device *bdev, sector_t sector, int size,
+int sync_page_io(struct block_device *bdev, sector_t sector, int size,
 		   struct page *page, int rw)
 {
 	struct bio *bio = bio_alloc(GFP_NOIO, 1);
@@ -600,6 +631,10 @@ static int super_90_validate(mddev_t *mddev, mdk_rdev_t *rdev)
 		memcpy(mddev->uuid+12,&sb->set_uuid3, 4);
 
 		mddev->max_disks = MD_SB_DISKS;
+
+		if (sb->state & (1<<MD_SB_BITMAP_PRESENT) &&
+		    mddev->level == 1)
+			mddev->bitmap_offset = BITMAP_SB_OFFSET;
 	} else {
 		__u64 ev1;
 		ev1 = md_event(sb);
@@ -680,6 +715,8 @@ static void super_90_sync(mddev_t *mddev, mdk_rdev_t *rdev)
 			sb->state = (1<< MD_SB_CLEAN);
 	} else
 		sb->recovery_cp = 0;
+	if (mddev->bitmap)
+		sb->state |= (1<<MD_SB_BITMAP_PRESENT);
 
 	sb->layout = mddev->layout;
 	sb->chunk_size = mddev->chunk_size;
@@ -1036,6 +1073,8 @@ static int bind_rdev_to_array(mdk_rdev_t * rdev, mddev_t * mddev)
 			
 	list_add(&rdev->same_set, &mddev->disks);
 	rdev->mddev = mddev;
+	/* a new member needs its own copy of the bitmap */
+	bitmap_write_all(mddev->bitmap);
 	printk(KERN_INFO "md: bind<%s>\n", bdevname(rdev->bdev,b));
 	return 0;
 }
@@ -1276,6 +1315,9 @@ repeat:
 	if (!mddev->persistent)
 		return;
 
+	/* the bitmap must never be older than the superblocks */
+	bitmap_update_sb(mddev->bitmap);
+
 	dprintk(KERN_INFO 
 		"md: updating %s RAID superblock on device (in sync %d)\n",
 		mdname(mddev),mddev->in_sync);
@@ -1608,9 +1650,16 @@ static int do_md_run(mddev_t * mddev)
 
 	mddev->resync_max_sectors = mddev->size << 1; /* may be over-ridden by personality */
 
+	if (mddev->bitmap_offset && bitmap_create(mddev)) {
+		printk(KERN_WARNING "md: %s: running without a bitmap\n",
+		       mdname(mddev));
+		mddev->bitmap_offset = 0;
+	}
+
 	err = mddev->pers->run(mddev);
 	if (err) {
 		printk(KERN_ERR "md: pers->run() failed ...\n");
+		bitmap_destroy(mddev);
 		module_put(mddev->pers->owner);
 		mddev->pers = NULL;
 		return -EINVAL;
@@ -1725,6 +1774,8 @@ static int do_md_stop(mddev_t * mddev, int ro)
 		}
 		if (ro)
 			set_disk_ro(disk, 1);
+		else
+			bitmap_destroy(mddev);
 	}
 	/*
 	 * Free resources if final stop
@@ -1736,6 +1787,7 @@ static int do_md_stop(mddev_t * mddev, int ro)
 		export_array(mddev);
 
 		mddev->array_size = 0;
+		mddev->bitmap_offset = 0;
 		disk = mddev->gendisk;
 		if (disk)
 			set_capacity(disk, 0);
@@ -1970,6 +2022,8 @@ static int get_array_info(mddev_t * mddev, void __user * arg)
 	info.state         = 0;
 	if (mddev->in_sync)
 		info.state = (1<<MD_SB_CLEAN);
+	if (mddev->bitmap)
+		info.state |= (1<<MD_SB_BITMAP_PRESENT);
 	info.active_disks  = active;
 	info.working_disks = working;
 	info.failed_disks  = failed;
@@ -2347,9 +2401,33 @@ static int update_array_info(mddev_t *mddev, mdu_array_info_t *info)
 	if (mddev->size != info->size) cnt++;
 	if (mddev->raid_disks != info->raid_disks) cnt++;
 	if (mddev->layout != info->layout) cnt++;
+	if ((mddev->bitmap != NULL) !=
+	    ((info->state & (1<<MD_SB_BITMAP_PRESENT)) != 0)) cnt++;
 	if (cnt == 0) return 0;
 	if (cnt > 1) return -EINVAL;
 
+	if ((mddev->bitmap != NULL) !=
+	    ((info->state & (1<<MD_SB_BITMAP_PRESENT)) != 0)) {
+		/* add or remove the write-intent bitmap.
+		 * All IO must be stopped while we swap it.
+		 */
+		if (mddev->pers->quiesce == NULL)
+			return -EINVAL;
+		if (mddev->sync_thread)
+			return -EBUSY;
+		mddev->pers->quiesce(mddev, 1);
+		if (info->state & (1<<MD_SB_BITMAP_PRESENT)) {
+			mddev->bitmap_offset = BITMAP_SB_OFFSET;
+			rv = bitmap_create(mddev);
+			if (rv)
+				mddev->bitmap_offset = 0;
+		} else {
+			bitmap_destroy(mddev);
+			mddev->bitmap_offset = 0;
+		}
+		mddev->pers->quiesce(mddev, 0);
+	}
+
 	if (mddev->layout != info->layout) {
 		/* Change layout
 		 * we don't need to do anything at the md level, the
@@ -2375,7 +2453,7 @@ static int update_array_info(mddev_t *mddev, mdu_array_info_t *info)
 		 * size of each device.
 		 * If size is zero, we find the largest size that fits.
 		 */
-		if (mddev->sync_thread)
+		if (mddev->sync_thread || mddev->bitmap)
 			return -EBUSY;
 		ITERATE_RDEV(mddev,rdev,tmp) {
 			sector_t avail;
@@ -2774,16 +2852,23 @@ static int md_thread(void * arg)
 	while (thread->run) {
 		void (*run)(mddev_t *);
 
-		wait_event_interruptible(thread->wqueue,
-					 test_bit(THREAD_WAKEUP, &thread->flags));
+		wait_event_interruptible_timeout(thread->wqueue,
+						 test_bit(THREAD_WAKEUP, &thread->flags),
+						 thread->timeout);
 		if (current->flags & PF_FREEZE)
 			refrigerator(PF_FREEZE);
 
 		clear_bit(THREAD_WAKEUP, &thread->flags);
 
 		run = thread->run;
-		if (run)
+		if (run) {
+			thread->passes++;
+			smp_mb();
 			run(thread->mddev);
+			smp_mb();
+			thread->passes++;
+			wake_up(&thread->wqueue);
+		}
 
 		if (signal_pending(current))
 			flush_signals(current);
@@ -2821,6 +2906,7 @@ mdk_thread_t *md_register_thread(void (*run) (mddev_t *), mddev_t *mddev,
 	thread->run = run;
 	thread->mddev = mddev;
 	thread->name = name;
+	thread->timeout = MAX_SCHEDULE_TIMEOUT;
 	ret = kernel_thread(md_thread, thread, 0);
 	if (ret < 0) {
 		kfree(thread);
@@ -2830,6 +2916,20 @@ mdk_thread_t *md_register_thread(void (*run) (mddev_t *), mddev_t *mddev,
 	return thread;
 }
 
+/*
+ * Wait for a pass of the thread that may have started before the caller
+ * changed what ->run() looks at.  One that starts later sees the change.
+ */
+void md_thread_sync(mdk_thread_t *thread)
+{
+	unsigned long passes;
+
+	smp_mb();
+	passes = thread->passes;
+	if ((passes & 1) && thread->tsk != current)
+		wait_event(thread->wqueue, thread->passes != passes);
+}
+
 void md_unregister_thread(mdk_thread_t *thread)
 {
 	struct completion event;
@@ -2942,12 +3042,31 @@ static void status_resync(struct seq_file *seq, mddev_t * mddev)
 	 */
 	dt = ((jiffies - mddev->resync_mark) / HZ);
 	if (!dt) dt++;
-	db = resync - (mddev->resync_mark_cnt/2);
+	db = (mddev->curr_mark_cnt - atomic_read(&mddev->recovery_active)
+	      - mddev->resync_mark_cnt) / 2;
 	rt = (dt * ((max_blocks-resync) / (db/100+1)))/100;
 
 	seq_printf(seq, " finish=%lu.%lumin", rt / 60, (rt % 60)/6);
 
 	seq_printf(seq, " speed=%ldK/sec", db/dt);
+
+	/*
+	 * What the resync scheduler sees: foreground latency with resync
+	 * running, how much of that resync adds, and the current limit.
+	 */
+	if (sysctl_resync_latency_ms && mddev->pers->fg_timed &&
+	    mddev->sync_thread) {
+		unsigned int lat = mddev->resync_fg_lat, base = mddev->resync_fg_base;
+		unsigned int impact = lat > base ? lat - base : 0;
+
+		if (mddev->resync_fg_idle)
+			seq_printf(seq, " fg=idle");
+		else
+			seq_printf(seq, " fglat=%u.%ums(+%u.%ums) limit=%uK/sec",
+				   lat / 1000, (lat / 100) % 10,
+				   impact / 1000, (impact / 100) % 10,
+				   mddev->resync_limit);
+	}
 }
 
 static void *md_seq_start(struct seq_file *seq, loff_t *pos)
@@ -3075,6 +3194,10 @@ static int md_seq_show(struct seq_file *seq, void *v)
 				status_resync (seq, mddev);
 			else if (mddev->curr_resync == 1 || mddev->curr_resync == 2)
 				seq_printf(seq, "	resync=DELAYED");
+			if (mddev->bitmap) {
+				seq_printf(seq, "\n      ");
+				bitmap_status(seq, mddev->bitmap);
+			}
 		}
 
 		seq_printf(seq, "\n");
@@ -3237,15 +3360,128 @@ static DECLARE_WAIT_QUEUE_HEAD(resync_wait);
 
 #define SYNC_MARKS	10
 #define	SYNC_MARK_STEP	(3*HZ)
+
+/*
+ * Resync scheduler.  Every SYNC_SAMPLE_STEP we look at the array's own
+ * disk stats and at fg_usecs, the time its requests took, which a
+ * personality with ->fg_timed keeps in microseconds since most requests
+ * finish well within a tick.  The resync traffic on the members doesn't
+ * show up in either.  The others are throttled by is_mddev_idle() alone,
+ * as before.  While there is
+ * foreground I/O the resync limit is halved each time its latency is more
+ * than resync_latency_ms above what it is with resync paused, and raised
+ * by an eighth otherwise.  The paused latency is measured by holding
+ * resync off for a sample every SYNC_PROBE_INTERVAL.  With no foreground
+ * I/O at all resync may go up to speed_limit_max.
+ */
+#define SYNC_SAMPLE_STEP	(HZ/2)
+#define SYNC_PROBE_DRAIN	(HZ/10)	/* let resync I/O in flight finish */
+#define SYNC_PROBE_TIME		(2*SYNC_SAMPLE_STEP + SYNC_PROBE_DRAIN)
+#define SYNC_PROBE_INTERVAL	(30*HZ)
+
+static void md_sync_sample_init(mddev_t *mddev)
+{
+	struct gendisk *disk = mddev->gendisk;
+
+	mddev->resync_sample = mddev->resync_probe = jiffies;
+	mddev->resync_sample_cnt = mddev->curr_mark_cnt;
+	mddev->resync_fg_ios = disk_stat_read(disk, reads) +
+		disk_stat_read(disk, writes);
+	mddev->resync_fg_usecs = atomic_read(&mddev->fg_usecs);
+	mddev->resync_probing = 0;
+	mddev->resync_fg_idle = 1;
+	mddev->resync_rate = 0;
+	mddev->resync_limit = sysctl_speed_limit_max;
+	mddev->resync_fg_lat = mddev->resync_fg_base = 0;
+	mddev->resync_fg_measured = 0;
+}
+
+static void md_sync_sample(mddev_t *mddev)
+{
+	struct gendisk *disk = mddev->gendisk;
+	unsigned long now = jiffies, prev = mddev->resync_sample;
+	unsigned long ios, usecs, dios;
+	unsigned int lat = 0, limit;
+
+	if (time_before(now, prev + SYNC_SAMPLE_STEP))
+		return;
+	mddev->resync_sample = now;
+	mddev->resync_rate = (unsigned long)(mddev->curr_mark_cnt -
+					     mddev->resync_sample_cnt) / 2
+		* HZ / (now - prev);
+	mddev->resync_sample_cnt = mddev->curr_mark_cnt;
+
+	ios = disk_stat_read(disk, reads) + disk_stat_read(disk, writes);
+	usecs = (unsigned int)atomic_read(&mddev->fg_usecs);
+	dios = ios - mddev->resync_fg_ios;
+	if (dios)
+		lat = (usecs - mddev->resync_fg_usecs) / dios;
+	mddev->resync_fg_ios = ios;
+	mddev->resync_fg_usecs = usecs;
+
+	mddev->resync_fg_idle = is_mddev_idle(mddev) && !dios;
+
+	if (mddev->resync_probing) {
+		if (!dios || time_after(now, mddev->resync_probe + SYNC_PROBE_TIME))
+			mddev->resync_probing = 0;
+		else if (time_after_eq(prev, mddev->resync_probe + SYNC_PROBE_DRAIN)) {
+			/* resync was quiet for the whole sample */
+			mddev->resync_fg_base = mddev->resync_fg_measured ?
+				(3 * mddev->resync_fg_base + lat) / 4 : lat;
+			mddev->resync_fg_measured = 1;
+			mddev->resync_probing = 0;
+		}
+		return;
+	}
+	if (!dios)
+		return;
+
+	mddev->resync_fg_lat = mddev->resync_fg_lat ?
+		(3 * mddev->resync_fg_lat + lat) / 4 : lat;
+	if (!mddev->resync_fg_measured ||
+	    time_after(now, mddev->resync_probe + SYNC_PROBE_INTERVAL)) {
+		mddev->resync_probing = 1;
+		mddev->resync_probe = now;
+		return;
+	}
+
+	limit = mddev->resync_limit;
+	if (lat > mddev->resync_fg_base + sysctl_resync_latency_ms * 1000)
+		limit /= 2;
+	else
+		limit += limit / 8 + 1;
+	if (limit < sysctl_speed_limit_min)
+		limit = sysctl_speed_limit_min;
+	if (limit > sysctl_speed_limit_max)
+		limit = sysctl_speed_limit_max;
+	mddev->resync_limit = limit;
+}
+
+/*
+ * Should resync, now above speed_limit_min, back off for a while?
+ */
+static int md_sync_throttle(mddev_t *mddev)
+{
+	if (!sysctl_resync_latency_ms || !mddev->pers->fg_timed)
+		return !is_mddev_idle(mddev);
+
+	md_sync_sample(mddev);
+	if (mddev->resync_probing)
+		return 1;
+	if (mddev->resync_fg_idle)
+		return 0;
+	return mddev->resync_rate > mddev->resync_limit;
+}
 static void md_do_sync(mddev_t *mddev)
 {
 	mddev_t *mddev2;
 	unsigned int currspeed = 0,
 		 window;
-	sector_t max_sectors,j;
+	sector_t max_sectors,j, io_sectors;
 	unsigned long mark[SYNC_MARKS];
 	sector_t mark_cnt[SYNC_MARKS];
 	int last_mark,m;
+	int skipped = 0;
 	struct list_head *tmp;
 	sector_t last_check;
 
@@ -3332,13 +3568,19 @@ static void md_do_sync(mddev_t *mddev)
 		j = mddev->recovery_cp;
 	else
 		j = 0;
+	/* rate and throttling only count sectors actually resynced, not
+	 * those the personality skipped as already in sync
+	 */
+	io_sectors = 0;
 	for (m = 0; m < SYNC_MARKS; m++) {
 		mark[m] = jiffies;
-		mark_cnt[m] = j;
+		mark_cnt[m] = io_sectors;
 	}
 	last_mark = 0;
 	mddev->resync_mark = mark[last_mark];
 	mddev->resync_mark_cnt = mark_cnt[last_mark];
+	mddev->curr_mark_cnt = io_sectors;
+	md_sync_sample_init(mddev);
 
 	/*
 	 * Tune reconstruction:
@@ -3361,19 +3603,27 @@ static void md_do_sync(mddev_t *mddev)
 	while (j < max_sectors) {
 		int sectors;
 
-		sectors = mddev->pers->sync_request(mddev, j, currspeed < sysctl_speed_limit_min);
+		skipped = 0;
+		sectors = mddev->pers->sync_request(mddev, j, &skipped,
+					currspeed < sysctl_speed_limit_min);
 		if (sectors < 0) {
 			set_bit(MD_RECOVERY_ERR, &mddev->recovery);
 			goto out;
 		}
-		atomic_add(sectors, &mddev->recovery_active);
+		if (!skipped) {
+			io_sectors += sectors;
+			atomic_add(sectors, &mddev->recovery_active);
+		}
 		j += sectors;
 		if (j>1) mddev->curr_resync = j;
+		mddev->curr_mark_cnt = io_sectors;
 
-		if (last_check + window > j || j == max_sectors)
+		if (skipped)
+			cond_resched();
+		if (last_check + window > io_sectors || j == max_sectors)
 			continue;
 
-		last_check = j;
+		last_check = io_sectors;
 
 		if (test_bit(MD_RECOVERY_INTR, &mddev->recovery) ||
 		    test_bit(MD_RECOVERY_ERR, &mddev->recovery))
@@ -3387,7 +3637,7 @@ static void md_do_sync(mddev_t *mddev)
 			mddev->resync_mark = mark[next];
 			mddev->resync_mark_cnt = mark_cnt[next];
 			mark[next] = jiffies;
-			mark_cnt[next] = j - atomic_read(&mddev->recovery_active);
+			mark_cnt[next] = io_sectors - atomic_read(&mddev->recovery_active);
 			last_mark = next;
 		}
 
@@ -3414,12 +3664,13 @@ static void md_do_sync(mddev_t *mddev)
 		mddev->queue->unplug_fn(mddev->queue);
 		cond_resched();
 
-		currspeed = ((unsigned long)(j-mddev->resync_mark_cnt))/2/((jiffies-mddev->resync_mark)/HZ +1) +1;
+		currspeed = ((unsigned long)(io_sectors-mddev->resync_mark_cnt))/2/((jiffies-mddev->resync_mark)/HZ +1) +1;
 
 		if (currspeed > sysctl_speed_limit_min) {
 			if ((currspeed > sysctl_speed_limit_max) ||
-					!is_mddev_idle(mddev)) {
-				msleep_interruptible(250);
+					md_sync_throttle(mddev)) {
+				msleep_interruptible(sysctl_resync_latency_ms ?
+						     100 : 250);
 				goto repeat;
 			}
 		}
@@ -3434,7 +3685,7 @@ static void md_do_sync(mddev_t *mddev)
 	wait_event(mddev->recovery_wait, !atomic_read(&mddev->recovery_active));
 
 	/* tell personality that we are finished */
-	mddev->pers->sync_request(mddev, max_sectors, 1);
+	mddev->pers->sync_request(mddev, max_sectors, &skipped, 1);
 
 	if (!test_bit(MD_RECOVERY_ERR, &mddev->recovery) &&
 	    mddev->curr_resync > 2 &&
@@ -3743,6 +3994,7 @@ EXPORT_SYMBOL(md_write_end);
 EXPORT_SYMBOL(md_handle_safemode);
 EXPORT_SYMBOL(md_register_thread);
 EXPORT_SYMBOL(md_unregister_thread);
+EXPORT_SYMBOL(md_thread_sync);
 EXPORT_SYMBOL(md_wakeup_thread);
 EXPORT_SYMBOL(md_print_devices);
 EXPORT_SYMBOL(md_check_recovery);
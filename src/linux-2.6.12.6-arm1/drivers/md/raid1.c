@@ -23,12 +23,63 @@
  */
 
 #include <linux/raid/raid1.h>
+#include <linux/raid/bitmap.h>
+#include <linux/sysctl.h>
 
 /*
  * Number of guaranteed r1bios in case of extreme VM load:
  */
 #define	NR_RAID1_BIOS 256
 
+/*
+ * A mirror bound to a stream keeps it until it has this many more
+ * requests in flight than the least loaded mirror:
+ */
+#define	RAID1_STREAM_MAX_SKEW	4
+
+static int raid1_read_balance = RAID1_RB_HEAD;
+static int raid1_rb_min = RAID1_RB_HEAD;
+static int raid1_rb_max = RAID1_RB_LOAD;
+
+static struct ctl_table_header *raid1_table_header;
+
+static ctl_table raid1_table[] = {
+	{
+		.ctl_name	= DEV_RAID_RAID1_READ_BALANCE,
+		.procname	= "raid1_read_balance",
+		.data		= &raid1_read_balance,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= &proc_dointvec_minmax,
+		.strategy	= &sysctl_intvec,
+		.extra1		= &raid1_rb_min,
+		.extra2		= &raid1_rb_max,
+	},
+	{ .ctl_name = 0 }
+};
+
+static ctl_table raid1_dir_table[] = {
+	{
+		.ctl_name	= DEV_RAID,
+		.procname	= "raid",
+		.maxlen		= 0,
+		.mode		= 0555,
+		.child		= raid1_table,
+	},
+	{ .ctl_name = 0 }
+};
+
+static ctl_table raid1_root_table[] = {
+	{
+		.ctl_name	= CTL_DEV,
+		.procname	= "dev",
+		.maxlen		= 0,
+		.mode		= 0555,
+		.child		= raid1_dir_table,
+	},
+	{ .ctl_name = 0 }
+};
+
 static mdk_personality_t raid1_personality;
 
 static void unplug_slaves(mddev_t *mddev);
@@ -195,6 +246,18 @@ static void reschedule_retry(r1bio_t *r1_bio)
 	md_wakeup_thread(mddev->thread);
 }
 
+/*
+ * Microseconds, for request latency: most requests finish well within
+ * a tick, and sched_clock() is not there for modules.
+ */
+static inline unsigned long long r1_clock(void)
+{
+	struct timeval tv;
+
+	do_gettimeofday(&tv);
+	return (unsigned long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
 /*
  * raid_end_bio_io() is called when we have finished servicing a mirrored
  * operation and are ready to return a success/failure code to the buffer
@@ -203,6 +266,16 @@ static void reschedule_retry(r1bio_t *r1_bio)
 static void raid_end_bio_io(r1bio_t *r1_bio)
 {
 	struct bio *bio = r1_bio->master_bio;
+	struct gendisk *disk = r1_bio->mddev->gendisk;
+	unsigned long ticks = jiffies - r1_bio->start_time;
+
+	/* md's resync scheduler watches the array's own latency */
+	atomic_add((int)(r1_clock() - r1_bio->start_us),
+		   &r1_bio->mddev->fg_usecs);
+	if (bio_data_dir(bio) == WRITE)
+		disk_stat_add(disk, write_ticks, ticks);
+	else
+		disk_stat_add(disk, read_ticks, ticks);
 
 	bio_endio(bio, bio->bi_size,
 		test_bit(R1BIO_Uptodate, &r1_bio->state) ? 0 : -EIO);
@@ -287,9 +360,10 @@ static int raid1_end_write_request(struct bio *bio, unsigned int bytes_done, int
 	/*
 	 * this branch is our 'one mirror IO has finished' event handler:
 	 */
-	if (!uptodate)
+	if (!uptodate) {
 		md_error(r1_bio->mddev, conf->mirrors[mirror].rdev);
-	else
+		set_bit(R1BIO_Degraded, &r1_bio->state);
+	} else
 		/*
 		 * Set R1BIO_Uptodate in our master bio, so that
 		 * we will return a good error code for to the higher
@@ -309,6 +383,9 @@ static int raid1_end_write_request(struct bio *bio, unsigned int bytes_done, int
 	 * already.
 	 */
 	if (atomic_dec_and_test(&r1_bio->remaining)) {
+		bitmap_endwrite(r1_bio->mddev->bitmap, r1_bio->sector,
+				r1_bio->sectors,
+				!test_bit(R1BIO_Degraded, &r1_bio->state));
 		md_write_end(r1_bio->mddev);
 		raid_end_bio_io(r1_bio);
 	}
@@ -318,6 +395,96 @@ static int raid1_end_write_request(struct bio *bio, unsigned int bytes_done, int
 }
 
 
+static inline int stream_live(struct r1_stream *s)
+{
+	return s->last && time_before(jiffies, s->last + HZ);
+}
+
+static inline int stream_follows(sector_t this_sector, sector_t next_sect)
+{
+	return this_sector >= next_sect &&
+		this_sector < next_sect + RAID1_STREAM_GAP;
+}
+
+/*
+ * Load based read balancing.  Each sequential reader is bound to one
+ * mirror, so that parallel streams are spread over the spindles instead
+ * of fighting over one.  A read that doesn't continue a known stream
+ * goes to the mirror with the fewest requests in flight plus streams
+ * bound to it; the head distance breaks ties.  It only takes a stream
+ * slot if it follows on from an earlier unbound read, so random reads
+ * mixed in with streaming ones leave the bound streams alone.
+ *
+ * Called under rcu_read_lock() with at least one operational mirror.
+ */
+static int read_balance_load(conf_t *conf, sector_t this_sector, int sectors)
+{
+	struct r1_stream *s, *stream = NULL, *oldest = NULL;
+	int disk, best = -1, min_pending = INT_MAX, i;
+	int best_load = INT_MAX, load, pending;
+	sector_t best_distance = MaxSector, distance;
+	mdk_rdev_t *rdev;
+
+	spin_lock(&conf->stream_lock);
+	for (s = conf->streams; s < conf->streams + RAID1_NR_STREAMS; s++) {
+		if (!oldest || time_before(s->last, oldest->last))
+			oldest = s;
+		if (stream_live(s) && stream_follows(this_sector, s->next_sect))
+			stream = s;
+	}
+
+	for (disk = 0; disk < conf->raid_disks; disk++) {
+		if ((rdev = conf->mirrors[disk].rdev) == NULL ||
+		    !rdev->in_sync)
+			continue;
+		pending = atomic_read(&rdev->nr_pending);
+		if (pending < min_pending)
+			min_pending = pending;
+		load = pending;
+		for (s = conf->streams; s < conf->streams + RAID1_NR_STREAMS; s++)
+			if (s != stream && s->disk == disk && stream_live(s))
+				load++;
+		distance = abs(this_sector - conf->mirrors[disk].head_position);
+		if (load < best_load ||
+		    (load == best_load && distance < best_distance)) {
+			best = disk;
+			best_load = load;
+			best_distance = distance;
+		}
+	}
+
+	if (stream) {
+		/* stay on the stream's mirror unless it fell far behind */
+		disk = stream->disk;
+		rdev = disk < conf->raid_disks ? conf->mirrors[disk].rdev : NULL;
+		if (rdev && rdev->in_sync &&
+		    atomic_read(&rdev->nr_pending) <= min_pending + RAID1_STREAM_MAX_SKEW)
+			best = disk;
+	} else {
+		for (i = 0; i < RAID1_NR_STREAMS; i++)
+			if (stream_follows(this_sector, conf->stream_cand[i]))
+				break;
+		if (i < RAID1_NR_STREAMS) {
+			/* a new stream: it is no longer a candidate */
+			conf->stream_cand[i] = MaxSector;
+			stream = oldest;
+		} else if (best >= 0) {
+			i = conf->stream_cand_next;
+			conf->stream_cand[i] = this_sector + sectors;
+			conf->stream_cand_next = (i + 1) % RAID1_NR_STREAMS;
+		}
+	}
+
+	if (best >= 0 && stream) {
+		stream->next_sect = this_sector + sectors;
+		stream->disk = best;
+		stream->last = jiffies;
+	}
+	spin_unlock(&conf->stream_lock);
+
+	return best;
+}
+
 /*
  * This routine returns the disk from which the requested read should
  * be done. There is a per-array 'next expected sequential IO' sector
@@ -378,6 +545,13 @@ static int read_balance(conf_t *conf, r1bio_t *r1_bio)
 	disk = new_disk;
 	/* now disk == new_disk == starting point for search */
 
+	if (raid1_read_balance == RAID1_RB_LOAD) {
+		new_disk = read_balance_load(conf, this_sector, sectors);
+		if (new_disk >= 0)
+			new_rdev = conf->mirrors[new_disk].rdev;
+		goto rb_out;
+	}
+
 	/*
 	 * Don't change to another disk for sequential reads:
 	 */
@@ -426,6 +600,7 @@ rb_out:
 			atomic_dec(&new_rdev->nr_pending);
 			goto retry;
 		}
+		atomic_inc(&conf->mirrors[new_disk].reads);
 	}
 	rcu_read_unlock();
 
@@ -522,7 +697,7 @@ static int make_request(request_queue_t *q, struct bio * bio)
 	mirror_info_t *mirror;
 	r1bio_t *r1_bio;
 	struct bio *read_bio;
-	int i, disks;
+	int i, disks, delay;
 	mdk_rdev_t *rdev;
 
 	/*
@@ -552,6 +727,8 @@ static int make_request(request_queue_t *q, struct bio * bio)
 
 	r1_bio->master_bio = bio;
 	r1_bio->sectors = bio->bi_size >> 9;
+	r1_bio->start_time = jiffies;
+	r1_bio->start_us = r1_clock();
 
 	r1_bio->mddev = mddev;
 	r1_bio->sector = bio->bi_sector;
@@ -603,15 +780,20 @@ static int make_request(request_queue_t *q, struct bio * bio)
 			if (rdev->faulty) {
 				atomic_dec(&rdev->nr_pending);
 				r1_bio->bios[i] = NULL;
+				set_bit(R1BIO_Degraded, &r1_bio->state);
 			} else
 				r1_bio->bios[i] = bio;
-		} else
+		} else {
 			r1_bio->bios[i] = NULL;
+			set_bit(R1BIO_Degraded, &r1_bio->state);
+		}
 	}
 	rcu_read_unlock();
 
 	atomic_set(&r1_bio->remaining, 1);
 	md_write_start(mddev);
+	delay = bitmap_startwrite(mddev->bitmap, r1_bio->sector,
+				  r1_bio->sectors);
 	for (i = 0; i < disks; i++) {
 		struct bio *mbio;
 		if (!r1_bio->bios[i])
@@ -627,10 +809,25 @@ static int make_request(request_queue_t *q, struct bio * bio)
 		mbio->bi_private = r1_bio;
 
 		atomic_inc(&r1_bio->remaining);
-		generic_make_request(mbio);
+		if (delay) {
+			unsigned long flags;
+
+			spin_lock_irqsave(&conf->device_lock, flags);
+			if (conf->pending_bio_tail)
+				conf->pending_bio_tail->bi_next = mbio;
+			else
+				conf->pending_bio_list = mbio;
+			conf->pending_bio_tail = mbio;
+			spin_unlock_irqrestore(&conf->device_lock, flags);
+		} else
+			generic_make_request(mbio);
 	}
+	if (delay)
+		md_wakeup_thread(mddev->thread);
 
 	if (atomic_dec_and_test(&r1_bio->remaining)) {
+		bitmap_endwrite(mddev->bitmap, r1_bio->sector, r1_bio->sectors,
+				!test_bit(R1BIO_Degraded, &r1_bio->state));
 		md_write_end(mddev);
 		raid_end_bio_io(r1_bio);
 	}
@@ -649,7 +846,11 @@ static void status(struct seq_file *seq, mddev_t *mddev)
 		seq_printf(seq, "%s",
 			      conf->mirrors[i].rdev &&
 			      conf->mirrors[i].rdev->in_sync ? "U" : "_");
-	seq_printf(seq, "]");
+	seq_printf(seq, "] balance=%s reads=",
+		   raid1_read_balance == RAID1_RB_LOAD ? "load" : "head");
+	for (i = 0; i < conf->raid_disks; i++)
+		seq_printf(seq, "%s%d", i ? "/" : "",
+			   atomic_read(&conf->mirrors[i].reads));
 }
 
 
@@ -932,6 +1133,23 @@ static void raid1d(mddev_t *mddev)
 
 	md_check_recovery(mddev);
 	md_handle_safemode(mddev);
+
+	if (conf->pending_bio_list) {
+		spin_lock_irqsave(&conf->device_lock, flags);
+		bio = conf->pending_bio_list;
+		conf->pending_bio_list = conf->pending_bio_tail = NULL;
+		spin_unlock_irqrestore(&conf->device_lock, flags);
+
+		/* the bits covering these writes must reach disk first */
+		bitmap_unplug(mddev->bitmap);
+		while (bio) {
+			struct bio *next = bio->bi_next;
+			bio->bi_next = NULL;
+			generic_make_request(bio);
+			bio = next;
+		}
+		unplug = 1;
+	}
 	
 	for (;;) {
 		char b[BDEVNAME_SIZE];
@@ -981,6 +1199,8 @@ static void raid1d(mddev_t *mddev)
 	spin_unlock_irqrestore(&conf->device_lock, flags);
 	if (unplug)
 		unplug_slaves(mddev);
+
+	bitmap_daemon_work(mddev->bitmap);
 }
 
 
@@ -1009,13 +1229,13 @@ static int init_resync(conf_t *conf)
  * that can be installed to exclude normal IO requests.
  */
 
-static int sync_request(mddev_t *mddev, sector_t sector_nr, int go_faster)
+static int sync_request(mddev_t *mddev, sector_t sector_nr, int *skipped, int go_faster)
 {
 	conf_t *conf = mddev_to_conf(mddev);
 	mirror_info_t *mirror;
 	r1bio_t *r1_bio;
 	struct bio *bio;
-	sector_t max_sector, nr_sectors;
+	sector_t max_sector, nr_sectors, sync_blocks;
 	int disk;
 	int i;
 	int write_targets = 0;
@@ -1026,10 +1246,30 @@ static int sync_request(mddev_t *mddev, sector_t sector_nr, int go_faster)
 
 	max_sector = mddev->size << 1;
 	if (sector_nr >= max_sector) {
+		/* chunks the resync did not get through stay needed */
+		bitmap_close_sync(mddev->bitmap,
+				  test_bit(MD_RECOVERY_ERR, &mddev->recovery) ?
+				  0 : mddev->curr_resync);
 		close_sync(conf);
 		return 0;
 	}
 
+	/*
+	 * A resync can skip chunks the bitmap knows to be in sync; a
+	 * recovery must copy everything.  Either way, don't cross a
+	 * bitmap chunk in one request.
+	 */
+	if (!bitmap_start_sync(mddev->bitmap, sector_nr, &sync_blocks) &&
+	    test_bit(MD_RECOVERY_SYNC, &mddev->recovery)) {
+		if (sync_blocks > max_sector - sector_nr)
+			sync_blocks = max_sector - sector_nr;
+		mddev->bitmap->sync_skipped += sync_blocks;
+		*skipped = 1;
+		return sync_blocks;
+	}
+	if (sync_blocks < max_sector - sector_nr)
+		max_sector = sector_nr + sync_blocks;
+
 	/*
 	 * If there is non-resync activity waiting for us then
 	 * put in a delay to throttle resync.
@@ -1223,6 +1463,9 @@ static int run(mddev_t *mddev)
 	conf->raid_disks = mddev->raid_disks;
 	conf->mddev = mddev;
 	spin_lock_init(&conf->device_lock);
+	spin_lock_init(&conf->stream_lock);
+	for (i = 0; i < RAID1_NR_STREAMS; i++)
+		conf->stream_cand[i] = MaxSector;
 	INIT_LIST_HEAD(&conf->retry_list);
 	if (conf->working_disks == 1)
 		mddev->recovery_cp = MaxSector;
@@ -1269,6 +1512,8 @@ static int run(mddev_t *mddev)
 			goto out_free_conf;
 		}
 	}
+	if (mddev->bitmap)
+		mddev->thread->timeout = mddev->bitmap->daemon_sleep;
 	printk(KERN_INFO 
 		"raid1: raid set %s active with %d out of %d mirrors\n",
 		mdname(mddev), mddev->raid_disks - mddev->degraded, 
@@ -1414,6 +1659,28 @@ static int raid1_reshape(mddev_t *mddev, int raid_disks)
 	return 0;
 }
 
+static void raid1_quiesce(mddev_t *mddev, int state)
+{
+	conf_t *conf = mddev_to_conf(mddev);
+
+	switch(state) {
+	case 1:
+		spin_lock_irq(&conf->resync_lock);
+		conf->barrier++;
+		wait_event_lock_irq(conf->wait_idle, !conf->nr_pending,
+				    conf->resync_lock, unplug_slaves(mddev));
+		spin_unlock_irq(&conf->resync_lock);
+		break;
+	case 0:
+		spin_lock_irq(&conf->resync_lock);
+		conf->barrier--;
+		spin_unlock_irq(&conf->resync_lock);
+		wake_up(&conf->wait_resume);
+		wake_up(&conf->wait_idle);
+		break;
+	}
+}
+
 
 static mdk_personality_t raid1_personality =
 {
@@ -1430,15 +1697,24 @@ static mdk_personality_t raid1_personality =
 	.sync_request	= sync_request,
 	.resize		= raid1_resize,
 	.reshape	= raid1_reshape,
+	.quiesce	= raid1_quiesce,
+	.fg_timed	= 1,
 };
 
 static int __init raid_init(void)
 {
-	return register_md_personality(RAID1, &raid1_personality);
+	int err;
+
+	err = register_md_personality(RAID1, &raid1_personality);
+	if (!err)
+		raid1_table_header = register_sysctl_table(raid1_root_table, 1);
+	return err;
 }
 
 static void raid_exit(void)
 {
+	if (raid1_table_header)
+		unregister_sysctl_table(raid1_table_header);
 	unregister_md_personality(RAID1);
 }
 
@@ -13,6 +13,7 @@
 
 #include <linux/config.h>
 #include <linux/time.h>
+#include <linux/sched.h>
 #include <linux/fs.h>
 #include <linux/jbd.h>
 #include <linux/ext3_fs.h>
@@ -649,12 +650,17 @@ claim_block(spinlock_t *lock, int block, struct buffer_head *bh)
  * If we failed to allocate the desired block then we may end up crossing to a
  * new bitmap.  In that case we must release write access to the old one via
  * ext3_journal_release_buffer(), else we'll run out of credits.
+ *
+ * Up to *count blocks are claimed, contiguous with the first one and inside
+ * the window; *count is set to the number actually claimed.
  */
 static int
 ext3_try_to_allocate(struct super_block *sb, handle_t *handle, int group,
-	struct buffer_head *bitmap_bh, int goal, struct ext3_reserve_window *my_rsv)
+	struct buffer_head *bitmap_bh, int goal, unsigned long *count,
+	struct ext3_reserve_window *my_rsv)
 {
 	int group_first_block, start, end;
+	unsigned long num = 0;
 
 	/* we do allocation within the reservation window if we have a window */
 	if (my_rsv) {
@@ -712,8 +718,18 @@ repeat:
 			goto fail_access;
 		goto repeat;
 	}
-	return goal;
+	num++;
+	goal++;
+	while (num < *count && goal < end &&
+	       ext3_test_allocatable(goal, bitmap_bh) &&
+	       claim_block(sb_bgl_lock(EXT3_SB(sb), group), goal, bitmap_bh)) {
+		num++;
+		goal++;
+	}
+	*count = num;
+	return goal - num;
 fail_access:
+	*count = num;
 	return -1;
 }
 
@@ -817,6 +833,41 @@ static struct ext3_reserve_window_node *find_next_reservable_window(
 	return prev;
 }
 
+/**
+ *	try_to_extend_reservation()--grow the window in place
+ *
+ *		Push the end of @my_rsv out by @size blocks, or as far as the
+ *		next window allows.  Used when a multi-block request starting
+ *		inside the window runs past its end, so a streaming writer
+ *		keeps allocating contiguously instead of hopping to a new
+ *		window.  Only done if the tree lock is free; the caller falls
+ *		back to a short allocation otherwise.
+ */
+static void try_to_extend_reservation(struct ext3_reserve_window_node *my_rsv,
+			struct super_block *sb, int size)
+{
+	struct ext3_reserve_window_node *next_rsv;
+	struct rb_node *next;
+	spinlock_t *rsv_lock = &EXT3_SB(sb)->s_rsv_window_lock;
+
+	if (!spin_trylock(rsv_lock))
+		return;
+
+	next = rb_next(&my_rsv->rsv_node);
+	if (!next)
+		my_rsv->rsv_end += size;
+	else {
+		next_rsv = list_entry(next, struct ext3_reserve_window_node,
+				      rsv_node);
+		if ((next_rsv->rsv_start - my_rsv->rsv_end - 1) >= size)
+			my_rsv->rsv_end += size;
+		else
+			my_rsv->rsv_end = next_rsv->rsv_start - 1;
+	}
+	EXT3_SB(sb)->s_alloc_stats.rsv_extends++;
+	spin_unlock(rsv_lock);
+}
+
 /**
  * 	alloc_new_reservation()--allocate a new reservation window
  *
@@ -863,7 +914,7 @@ static int alloc_new_reservation(struct ext3_reserve_window_node *my_rsv,
 	int reservable_space_start;
 	struct ext3_reserve_window_node *prev_rsv;
 	struct rb_root *fs_rsv_root = &EXT3_SB(sb)->s_rsv_window_root;
-	unsigned long size;
+	unsigned long size, max;
 
 	group_first_block = le32_to_cpu(EXT3_SB(sb)->s_es->s_first_data_block) +
 				group * EXT3_BLOCKS_PER_GROUP(sb);
@@ -900,12 +951,20 @@ static int alloc_new_reservation(struct ext3_reserve_window_node *my_rsv,
 			/*
 			 * if we previously allocation hit ration is greater than half
 			 * we double the size of reservation window next time
-			 * otherwise keep the same
+			 * otherwise keep the same.  A writer that ran off the
+			 * end of the window it used up is streaming, and may
+			 * grow further than the rest.
 			 */
-			size = size * 2;
-			if (size > EXT3_MAX_RESERVE_BLOCKS)
-				size = EXT3_MAX_RESERVE_BLOCKS;
-			my_rsv->rsv_goal_size= size;
+			max = EXT3_MAX_RESERVE_BLOCKS;
+			if (start_block == my_rsv->rsv_end + 1)
+				max = EXT3_MAX_STREAM_RESERVE_BLOCKS;
+			if (size < max) {
+				size = size * 2;
+				if (size > max)
+					size = max;
+				my_rsv->rsv_goal_size= size;
+				EXT3_SB(sb)->s_alloc_stats.rsv_grows++;
+			}
 		}
 	}
 	/*
@@ -984,6 +1043,7 @@ found_rsv_window:
 	if (my_rsv != prev_rsv)  {
 		ext3_rsv_window_add(sb, my_rsv);
 	}
+	EXT3_SB(sb)->s_alloc_stats.rsv_windows++;
 	return 0;		/* succeed */
 failed:
 	/*
@@ -1021,10 +1081,11 @@ static int
 ext3_try_to_allocate_with_rsv(struct super_block *sb, handle_t *handle,
 			unsigned int group, struct buffer_head *bitmap_bh,
 			int goal, struct ext3_reserve_window_node * my_rsv,
-			int *errp)
+			unsigned long *count, int *errp)
 {
 	spinlock_t *rsv_lock;
 	unsigned long group_first_block;
+	unsigned long num = *count;
 	int ret = 0;
 	int fatal;
 
@@ -1049,7 +1110,8 @@ ext3_try_to_allocate_with_rsv(struct super_block *sb, handle_t *handle,
 	 * or last attempt to allocate a block with reservation turned on failed
 	 */
 	if (my_rsv == NULL ) {
-		ret = ext3_try_to_allocate(sb, handle, group, bitmap_bh, goal, NULL);
+		ret = ext3_try_to_allocate(sb, handle, group, bitmap_bh, goal,
+					   count, NULL);
 		goto out;
 	}
 	rsv_lock = &EXT3_SB(sb)->s_rsv_window_lock;
@@ -1085,6 +1147,10 @@ ext3_try_to_allocate_with_rsv(struct super_block *sb, handle_t *handle,
 
 		if (rsv_is_empty(&rsv_copy) || (ret < 0) ||
 			!goal_in_my_reservation(&rsv_copy, goal, group, sb)) {
+			/* make the window big enough for the whole request */
+			if (my_rsv->rsv_goal_size < *count)
+				my_rsv->rsv_goal_size = min_t(unsigned long, *count,
+						EXT3_MAX_STREAM_RESERVE_BLOCKS);
 			spin_lock(rsv_lock);
 			ret = alloc_new_reservation(my_rsv, goal, sb,
 							group, bitmap_bh);
@@ -1096,14 +1162,25 @@ ext3_try_to_allocate_with_rsv(struct super_block *sb, handle_t *handle,
 
 			if (!goal_in_my_reservation(&rsv_copy, goal, group, sb))
 				goal = -1;
+		} else if (goal >= 0) {
+			int curr = rsv_copy._rsv_end -
+					(goal + group_first_block) + 1;
+
+			if (curr < *count) {
+				try_to_extend_reservation(my_rsv, sb,
+							  *count - curr);
+				rsv_copy._rsv_end = my_rsv->rsv_end;
+			}
 		}
 		if ((rsv_copy._rsv_start >= group_first_block + EXT3_BLOCKS_PER_GROUP(sb))
 		    || (rsv_copy._rsv_end < group_first_block))
 			BUG();
+		num = *count;
 		ret = ext3_try_to_allocate(sb, handle, group, bitmap_bh, goal,
-					   &rsv_copy);
+					   &num, &rsv_copy);
 		if (ret >= 0) {
-			my_rsv->rsv_alloc_hit++;
+			my_rsv->rsv_alloc_hit += num;
+			*count = num;
 			break;				/* succeed */
 		}
 	}
@@ -1155,15 +1232,17 @@ int ext3_should_retry_alloc(struct super_block *sb, int *retries)
 }
 
 /*
- * ext3_new_block uses a goal block to assist allocation.  If the goal is
+ * ext3_new_blocks uses a goal block to assist allocation.  If the goal is
  * free, or there is a free block within 32 blocks of the goal, that block
  * is allocated.  Otherwise a forward search is made for a free block; within 
  * each block group the search first looks for an entire free byte in the block
  * bitmap, and then for any free bit if that fails.
+ * Up to *count blocks following the first one are allocated along with it
+ * if they are free; *count is set to the number allocated.
  * This function also updates quota and i_blocks field.
  */
-int ext3_new_block(handle_t *handle, struct inode *inode,
-			unsigned long goal, int *errp)
+static int do_new_blocks(handle_t *handle, struct inode *inode,
+			unsigned long goal, unsigned long *count, int *errp)
 {
 	struct buffer_head *bitmap_bh = NULL;
 	struct buffer_head *gdp_bh;
@@ -1175,6 +1254,7 @@ int ext3_new_block(handle_t *handle, struct inode *inode,
 	int fatal = 0, err;
 	int performed_allocation = 0;
 	int free_blocks;
+	unsigned long num = *count;
 	struct super_block *sb;
 	struct ext3_group_desc *gdp;
 	struct ext3_super_block *es;
@@ -1195,12 +1275,15 @@ int ext3_new_block(handle_t *handle, struct inode *inode,
 	}
 
 	/*
-	 * Check quota for allocation of this block.
+	 * Check quota for allocation of these blocks.
 	 */
-	if (DQUOT_ALLOC_BLOCK(inode, 1)) {
+	while (num && DQUOT_ALLOC_BLOCK(inode, num))
+		num--;
+	if (!num) {
 		*errp = -EDQUOT;
 		return 0;
 	}
+	*count = num;
 
 	sbi = EXT3_SB(sb);
 	es = EXT3_SB(sb)->s_es;
@@ -1251,8 +1334,10 @@ retry:
 		bitmap_bh = read_block_bitmap(sb, group_no);
 		if (!bitmap_bh)
 			goto io_error;
+		num = *count;
 		ret_block = ext3_try_to_allocate_with_rsv(sb, handle, group_no,
-					bitmap_bh, ret_block, my_rsv, &fatal);
+					bitmap_bh, ret_block, my_rsv, &num,
+					&fatal);
 		if (fatal)
 			goto out;
 		if (ret_block >= 0)
@@ -1288,8 +1373,9 @@ retry:
 		bitmap_bh = read_block_bitmap(sb, group_no);
 		if (!bitmap_bh)
 			goto io_error;
+		num = *count;
 		ret_block = ext3_try_to_allocate_with_rsv(sb, handle, group_no,
-					bitmap_bh, -1, my_rsv, &fatal);
+					bitmap_bh, -1, my_rsv, &num, &fatal);
 		if (fatal)
 			goto out;
 		if (ret_block >= 0) 
@@ -1324,13 +1410,15 @@ allocated:
 	target_block = ret_block + group_no * EXT3_BLOCKS_PER_GROUP(sb)
 				+ le32_to_cpu(es->s_first_data_block);
 
-	if (target_block == le32_to_cpu(gdp->bg_block_bitmap) ||
-	    target_block == le32_to_cpu(gdp->bg_inode_bitmap) ||
+	if (in_range(le32_to_cpu(gdp->bg_block_bitmap), target_block, num) ||
+	    in_range(le32_to_cpu(gdp->bg_inode_bitmap), target_block, num) ||
 	    in_range(target_block, le32_to_cpu(gdp->bg_inode_table),
+		      EXT3_SB(sb)->s_itb_per_group) ||
+	    in_range(target_block + num - 1, le32_to_cpu(gdp->bg_inode_table),
 		      EXT3_SB(sb)->s_itb_per_group))
 		ext3_error(sb, "ext3_new_block",
 			    "Allocating block in system zone - "
-			    "block = %u", target_block);
+			    "blocks from %u, length %lu", target_block, num);
 
 	performed_allocation = 1;
 
@@ -1349,10 +1437,14 @@ allocated:
 	jbd_lock_bh_state(bitmap_bh);
 	spin_lock(sb_bgl_lock(sbi, group_no));
 	if (buffer_jbd(bitmap_bh) && bh2jh(bitmap_bh)->b_committed_data) {
-		if (ext3_test_bit(ret_block,
-				bh2jh(bitmap_bh)->b_committed_data)) {
-			printk("%s: block was unexpectedly set in "
-				"b_committed_data\n", __FUNCTION__);
+		int i;
+
+		for (i = 0; i < num; i++) {
+			if (ext3_test_bit(ret_block + i,
+					bh2jh(bitmap_bh)->b_committed_data)) {
+				printk("%s: block was unexpectedly set in "
+					"b_committed_data\n", __FUNCTION__);
+			}
 		}
 	}
 	ext3_debug("found bit %d\n", ret_block);
@@ -1363,7 +1455,7 @@ allocated:
 	/* ret_block was blockgroup-relative.  Now it becomes fs-relative */
 	ret_block = target_block;
 
-	if (ret_block >= le32_to_cpu(es->s_blocks_count)) {
+	if (ret_block + num - 1 >= le32_to_cpu(es->s_blocks_count)) {
 		ext3_error(sb, "ext3_new_block",
 			    "block(%d) >= blocks count(%d) - "
 			    "block_group = %d, es == %p ", ret_block,
@@ -1381,9 +1473,9 @@ allocated:
 
 	spin_lock(sb_bgl_lock(sbi, group_no));
 	gdp->bg_free_blocks_count =
-			cpu_to_le16(le16_to_cpu(gdp->bg_free_blocks_count) - 1);
+			cpu_to_le16(le16_to_cpu(gdp->bg_free_blocks_count) - num);
 	spin_unlock(sb_bgl_lock(sbi, group_no));
-	percpu_counter_mod(&sbi->s_freeblocks_counter, -1);
+	percpu_counter_mod(&sbi->s_freeblocks_counter, -num);
 
 	BUFFER_TRACE(gdp_bh, "journal_dirty_metadata for group descriptor");
 	err = ext3_journal_dirty_metadata(handle, gdp_bh);
@@ -1396,6 +1488,10 @@ allocated:
 
 	*errp = 0;
 	brelse(bitmap_bh);
+	/* give back the quota we took for blocks we didn't get */
+	if (num < *count)
+		DQUOT_FREE_BLOCK(inode, *count - num);
+	*count = num;
 	return ret_block;
 
 io_error:
@@ -1409,11 +1505,51 @@ out:
 	 * Undo the block allocation
 	 */
 	if (!performed_allocation)
-		DQUOT_FREE_BLOCK(inode, 1);
+		DQUOT_FREE_BLOCK(inode, *count);
 	brelse(bitmap_bh);
 	return 0;
 }
 
+/*
+ * For the allocstat times.  sched_clock() is not exported to modules;
+ * the wall clock only has microseconds, but the truncation averages out
+ * over many calls.
+ */
+static inline unsigned long long ext3_clock_ns(void)
+{
+	struct timeval tv;
+
+	do_gettimeofday(&tv);
+	return ((unsigned long long)tv.tv_sec * 1000000 + tv.tv_usec) * 1000;
+}
+
+int ext3_new_blocks(handle_t *handle, struct inode *inode,
+			unsigned long goal, unsigned long *count, int *errp)
+{
+	struct ext3_alloc_stats *stats = &EXT3_SB(inode->i_sb)->s_alloc_stats;
+	unsigned long long start = ext3_clock_ns();
+	int block;
+
+	block = do_new_blocks(handle, inode, goal, count, errp);
+
+	stats->calls++;
+	if (block) {
+		stats->blocks += *count;
+		if (*count > 1)
+			stats->multi++;
+	}
+	stats->ns += ext3_clock_ns() - start;
+	return block;
+}
+
+int ext3_new_block(handle_t *handle, struct inode *inode,
+			unsigned long goal, int *errp)
+{
+	unsigned long count = 1;
+
+	return ext3_new_blocks(handle, inode, goal, &count, errp);
+}
+
 unsigned long ext3_count_free_blocks(struct super_block *sb)
 {
 	unsigned long desc_count;
@@ -233,16 +233,6 @@ no_delete:
 	clear_inode(inode);	/* We must guarantee clearing of inode... */
 }
 
-static int ext3_alloc_block (handle_t *handle,
-			struct inode * inode, unsigned long goal, int *err)
-{
-	unsigned long result;
-
-	result = ext3_new_block(handle, inode, goal, err);
-	return result;
-}
-
-
 typedef struct {
 	__le32	*p;
 	__le32	key;
@@ -267,8 +257,10 @@ static inline int verify_chain(Indirect *from, Indirect *to)
  *	@inode: inode in question (we are only interested in its superblock)
  *	@i_block: block number to be parsed
  *	@offsets: array to store the offsets in
- *      @boundary: set this non-zero if the referred-to block is likely to be
- *             followed (on disk) by an indirect block.
+ *      @boundary: set this to the number of blocks after the referred-to
+ *             one in the same indirect block (or in the inode); the last
+ *             of them is likely to be followed (on disk) by an indirect
+ *             block.
  *
  *	To store the locations of file's data ext3 uses a data structure common
  *	for UNIX filesystems - tree of pointers anchored in the inode, with
@@ -328,7 +320,7 @@ static int ext3_block_to_path(struct inode *inode,
 		ext3_warning (inode->i_sb, "ext3_block_to_path", "block > big");
 	}
 	if (boundary)
-		*boundary = (i_block & (ptrs - 1)) == (final - 1);
+		*boundary = final - 1 - (i_block & (ptrs - 1));
 	return n;
 }
 
@@ -475,95 +467,189 @@ static unsigned long ext3_find_goal(struct inode *inode, long block,
 	return ext3_find_near(inode, partial);
 }
 
+/**
+ *	ext3_blks_to_allocate - count the data blocks to allocate in one go
+ *	@branch: chain of indirect blocks, @branch[0] being the missing link
+ *	@k: number of indirect blocks that have to be allocated
+ *	@blks: number of blocks the caller would like mapped
+ *	@blocks_to_boundary: data blocks left in the leaf indirect block
+ *		after the first one
+ *
+ *	All the blocks must end up in the same leaf indirect block.  If that
+ *	block is being allocated as well it is empty; otherwise we count the
+ *	run of holes that starts at the requested block.
+ */
+static int ext3_blks_to_allocate(Indirect *branch, int k, unsigned long blks,
+		int blocks_to_boundary)
+{
+	unsigned long count = 0;
+
+	if (k > 0) {
+		if (blks < blocks_to_boundary + 1)
+			count += blks;
+		else
+			count += blocks_to_boundary + 1;
+		return count;
+	}
+
+	count++;
+	while (count < blks && count <= blocks_to_boundary &&
+		le32_to_cpu(*(branch[0].p + count)) == 0)
+		count++;
+	return count;
+}
+
+/**
+ *	ext3_alloc_blocks - allocate the indirect blocks and data blocks
+ *	@indirect_blks: number of indirect blocks needed
+ *	@blks: number of data blocks wanted
+ *	@new_blocks: where the indirect blocks and the first data block go
+ *
+ *	The indirect blocks come first so that the data blocks follow them
+ *	on disk.  Returns the number of data blocks allocated (at least one,
+ *	contiguous from new_blocks[@indirect_blks]) or 0 with *@err set.
+ */
+static int ext3_alloc_blocks(handle_t *handle, struct inode *inode,
+			unsigned long goal, int indirect_blks, int blks,
+			unsigned long new_blocks[4], int *err)
+{
+	int target, i;
+	unsigned long count = 0;
+	int index = 0;
+	unsigned long current_block = 0;
+
+	/*
+	 * One call is usually enough.  If the first run got only the
+	 * indirect blocks (or not even all of them), go back for the rest;
+	 * we are happy with however many data blocks the next call gets.
+	 */
+	target = blks + indirect_blks;
+
+	while (1) {
+		count = target;
+		current_block = ext3_new_blocks(handle, inode, goal, &count, err);
+		if (*err)
+			goto failed_out;
+
+		target -= count;
+		/* allocate blocks for indirect blocks */
+		while (index < indirect_blks && count) {
+			new_blocks[index++] = current_block++;
+			count--;
+		}
+
+		if (count > 0)
+			break;
+	}
+
+	/* save the new block number for the first direct block */
+	new_blocks[index] = current_block;
+
+	return count;
+failed_out:
+	for (i = 0; i < index; i++)
+		ext3_free_blocks(handle, inode, new_blocks[i], 1);
+	return 0;
+}
+
 /**
  *	ext3_alloc_branch - allocate and set up a chain of blocks.
  *	@inode: owner
- *	@num: depth of the chain (number of blocks to allocate)
+ *	@indirect_blks: number of indirect blocks to allocate
+ *	@blks: in: number of data blocks wanted, out: number allocated
  *	@offsets: offsets (in the blocks) to store the pointers to next.
  *	@branch: place to store the chain in.
  *
- *	This function allocates @num blocks, zeroes out all but the last one,
- *	links them into chain and (if we are synchronous) writes them to disk.
- *	In other words, it prepares a branch that can be spliced onto the
- *	inode. It stores the information about that chain in the branch[], in
- *	the same format as ext3_get_branch() would do. We are calling it after
- *	we had read the existing part of chain and partial points to the last
- *	triple of that (one with zero ->key). Upon the exit we have the same
- *	picture as after the successful ext3_get_block(), excpet that in one
- *	place chain is disconnected - *branch->p is still zero (we did not
- *	set the last link), but branch->key contains the number that should
- *	be placed into *branch->p to fill that gap.
+ *	This function allocates the indirect blocks and a run of data blocks,
+ *	zeroes out the indirect blocks, links them into chain and fills in the
+ *	pointers to all the data blocks in the last one.  In other words, it
+ *	prepares a branch that can be spliced onto the inode.  It stores the
+ *	information about that chain in the branch[], in the same format as
+ *	ext3_get_branch() would do. We are calling it after we had read the
+ *	existing part of chain and partial points to the last triple of that
+ *	(one with zero ->key). Upon the exit we have the same picture as after
+ *	the successful ext3_get_block(), excpet that in one place chain is
+ *	disconnected - *branch->p is still zero (we did not set the last link),
+ *	but branch->key contains the number that should be placed into
+ *	*branch->p to fill that gap.
  *
  *	If allocation fails we free all blocks we've allocated (and forget
  *	their buffer_heads) and return the error value the from failed
- *	ext3_alloc_block() (normally -ENOSPC). Otherwise we set the chain
+ *	ext3_alloc_blocks() (normally -ENOSPC). Otherwise we set the chain
  *	as described above and return 0.
  */
 
 static int ext3_alloc_branch(handle_t *handle, struct inode *inode,
-			     int num,
+			     int indirect_blks, int *blks,
 			     unsigned long goal,
 			     int *offsets,
 			     Indirect *branch)
 {
 	int blocksize = inode->i_sb->s_blocksize;
-	int n = 0, keys = 0;
+	int i, n = 0;
 	int err = 0;
-	int i;
-	int parent = ext3_alloc_block(handle, inode, goal, &err);
-
-	branch[0].key = cpu_to_le32(parent);
-	if (parent) {
-		for (n = 1; n < num; n++) {
-			struct buffer_head *bh;
-			/* Allocate the next block */
-			int nr = ext3_alloc_block(handle, inode, parent, &err);
-			if (!nr)
-				break;
-			branch[n].key = cpu_to_le32(nr);
-			keys = n+1;
+	struct buffer_head *bh;
+	int num;
+	unsigned long new_blocks[4];
+	unsigned long current_block;
 
-			/*
-			 * Get buffer_head for parent block, zero it out
-			 * and set the pointer to new one, then send
-			 * parent to disk.  
-			 */
-			bh = sb_getblk(inode->i_sb, parent);
-			branch[n].bh = bh;
-			lock_buffer(bh);
-			BUFFER_TRACE(bh, "call get_create_access");
-			err = ext3_journal_get_create_access(handle, bh);
-			if (err) {
-				unlock_buffer(bh);
-				brelse(bh);
-				break;
-			}
+	num = ext3_alloc_blocks(handle, inode, goal, indirect_blks,
+				*blks, new_blocks, &err);
+	if (err)
+		return err;
 
-			memset(bh->b_data, 0, blocksize);
-			branch[n].p = (__le32*) bh->b_data + offsets[n];
-			*branch[n].p = branch[n].key;
-			BUFFER_TRACE(bh, "marking uptodate");
-			set_buffer_uptodate(bh);
+	branch[0].key = cpu_to_le32(new_blocks[0]);
+	for (n = 1; n <= indirect_blks; n++) {
+		/*
+		 * Get buffer_head for parent block, zero it out
+		 * and set the pointer to new one, then send
+		 * parent to disk.  
+		 */
+		bh = sb_getblk(inode->i_sb, new_blocks[n-1]);
+		branch[n].bh = bh;
+		lock_buffer(bh);
+		BUFFER_TRACE(bh, "call get_create_access");
+		err = ext3_journal_get_create_access(handle, bh);
+		if (err) {
 			unlock_buffer(bh);
+			brelse(bh);
+			goto failed;
+		}
 
-			BUFFER_TRACE(bh, "call ext3_journal_dirty_metadata");
-			err = ext3_journal_dirty_metadata(handle, bh);
-			if (err)
-				break;
+		memset(bh->b_data, 0, blocksize);
+		branch[n].p = (__le32*) bh->b_data + offsets[n];
+		branch[n].key = cpu_to_le32(new_blocks[n]);
+		*branch[n].p = branch[n].key;
+		if (n == indirect_blks) {
+			/* the leaf: point at the rest of the data blocks */
+			current_block = new_blocks[n];
+			for (i = 1; i < num; i++)
+				*(branch[n].p + i) = cpu_to_le32(++current_block);
+		}
+		BUFFER_TRACE(bh, "marking uptodate");
+		set_buffer_uptodate(bh);
+		unlock_buffer(bh);
 
-			parent = nr;
+		BUFFER_TRACE(bh, "call ext3_journal_dirty_metadata");
+		err = ext3_journal_dirty_metadata(handle, bh);
+		if (err) {
+			n++;
+			goto failed;
 		}
 	}
-	if (n == num)
-		return 0;
-
+	*blks = num;
+	return err;
+failed:
 	/* Allocation failed, free what we already allocated */
-	for (i = 1; i < keys; i++) {
+	for (i = 1; i < n; i++) {
 		BUFFER_TRACE(branch[i].bh, "call journal_forget");
 		ext3_journal_forget(handle, branch[i].bh);
 	}
-	for (i = 0; i < keys; i++)
-		ext3_free_blocks(handle, inode, le32_to_cpu(branch[i].key), 1);
+	for (i = 0; i < indirect_blks; i++)
+		ext3_free_blocks(handle, inode, new_blocks[i], 1);
+
+	ext3_free_blocks(handle, inode, new_blocks[i], num);
+
 	return err;
 }
 
@@ -571,10 +657,9 @@ static int ext3_alloc_branch(handle_t *handle, struct inode *inode,
  *	ext3_splice_branch - splice the allocated branch onto inode.
  *	@inode: owner
  *	@block: (logical) number of block we are adding
- *	@chain: chain of indirect blocks (with a missing link - see
- *		ext3_alloc_branch)
  *	@where: location of missing link
- *	@num:   number of blocks we are adding
+ *	@num:   number of indirect blocks we are adding
+ *	@blks:  number of direct blocks we are adding
  *
  *	This function fills the missing link and does all housekeeping needed in
  *	inode (->i_blocks, etc.). In case of success we end up with the full
@@ -582,11 +667,12 @@ static int ext3_alloc_branch(handle_t *handle, struct inode *inode,
  */
 
 static int ext3_splice_branch(handle_t *handle, struct inode *inode, long block,
-			      Indirect chain[4], Indirect *where, int num)
+			      Indirect *where, int num, int blks)
 {
 	int i;
 	int err = 0;
 	struct ext3_block_alloc_info *block_i = EXT3_I(inode)->i_block_alloc_info;
+	unsigned long current_block;
 
 	/*
 	 * If we're splicing into a [td]indirect block (as opposed to the
@@ -603,14 +689,25 @@ static int ext3_splice_branch(handle_t *handle, struct inode *inode, long block,
 
 	*where->p = where->key;
 
+	/*
+	 * Update the host buffer_head or inode to point to the rest of
+	 * the just allocated direct blocks
+	 */
+	if (num == 0 && blks > 1) {
+		current_block = le32_to_cpu(where->key) + 1;
+		for (i = 1; i < blks; i++)
+			*(where->p + i) = cpu_to_le32(current_block++);
+	}
+
 	/*
 	 * update the most recently allocated logical & physical block
 	 * in i_block_alloc_info, to assist find the proper goal block for next
 	 * allocation
 	 */
 	if (block_i) {
-		block_i->last_alloc_logical_block = block;
-		block_i->last_alloc_physical_block = le32_to_cpu(where[num-1].key);
+		block_i->last_alloc_logical_block = block + blks - 1;
+		block_i->last_alloc_physical_block =
+				le32_to_cpu(where[num].key) + blks - 1;
 	}
 
 	/* We are done with atomic stuff, now do the rest of housekeeping */
@@ -643,10 +740,13 @@ static int ext3_splice_branch(handle_t *handle, struct inode *inode, long block,
 	return err;
 
 err_out:
-	for (i = 1; i < num; i++) {
+	for (i = 1; i <= num; i++) {
 		BUFFER_TRACE(where[i].bh, "call journal_forget");
 		ext3_journal_forget(handle, where[i].bh);
+		ext3_free_blocks(handle, inode, le32_to_cpu(where[i-1].key), 1);
 	}
+	ext3_free_blocks(handle, inode, le32_to_cpu(where[num].key), blks);
+
 	return err;
 }
 
@@ -662,26 +762,37 @@ err_out:
  * allocations is needed - we simply release blocks and do not touch anything
  * reachable from inode.
  *
+ * Up to @maxblocks blocks are mapped (or allocated, for a hole) in one call,
+ * as long as they are contiguous on disk and share the leaf indirect block.
+ * Returns the number of blocks mapped, 0 for a hole when !create, or a
+ * negative error.  bh_result describes the first of them.
+ *
  * akpm: `handle' can be NULL if create == 0.
  *
  * The BKL may not be held on entry here.  Be sure to take it early.
  */
 
 static int
-ext3_get_block_handle(handle_t *handle, struct inode *inode, sector_t iblock,
-		struct buffer_head *bh_result, int create, int extend_disksize)
+ext3_get_blocks_handle(handle_t *handle, struct inode *inode, sector_t iblock,
+		unsigned long maxblocks, struct buffer_head *bh_result,
+		int create, int extend_disksize)
 {
 	int err = -EIO;
 	int offsets[4];
 	Indirect chain[4];
 	Indirect *partial;
 	unsigned long goal;
-	int left;
-	int boundary = 0;
-	const int depth = ext3_block_to_path(inode, iblock, offsets, &boundary);
+	int indirect_blks;
+	int blocks_to_boundary = 0;
+	int depth;
 	struct ext3_inode_info *ei = EXT3_I(inode);
+	struct ext3_block_alloc_info *block_i;
+	int count = 0;
+	int seq;
+	unsigned long first_block = 0;
 
 	J_ASSERT(handle != NULL || create == 0);
+	depth = ext3_block_to_path(inode, iblock, offsets, &blocks_to_boundary);
 
 	if (depth == 0)
 		goto out;
@@ -690,7 +801,22 @@ ext3_get_block_handle(handle_t *handle, struct inode *inode, sector_t iblock,
 
 	/* Simplest case - block found, no allocation needed */
 	if (!partial) {
+		first_block = le32_to_cpu(chain[depth - 1].key);
 		clear_buffer_new(bh_result);
+		count++;
+		/*
+		 * Map the rest of the run, stopping if a truncate
+		 * changed the chain under us.
+		 */
+		while (count < maxblocks && count <= blocks_to_boundary) {
+			unsigned long blk;
+
+			blk = le32_to_cpu(*(chain[depth-1].p + count));
+			if (blk != first_block + count ||
+			    !verify_chain(chain, chain + depth - 1))
+				break;
+			count++;
+		}
 		goto got_it;
 	}
 
@@ -723,6 +849,7 @@ ext3_get_block_handle(handle_t *handle, struct inode *inode, sector_t iblock,
 			if (err)
 				goto cleanup;
 			clear_buffer_new(bh_result);
+			count = 1;
 			goto got_it;
 		}
 	}
@@ -734,14 +861,24 @@ ext3_get_block_handle(handle_t *handle, struct inode *inode, sector_t iblock,
 	if (S_ISREG(inode->i_mode) && (!ei->i_block_alloc_info))
 		ext3_init_block_alloc_info(inode);
 
+	block_i = ei->i_block_alloc_info;
+	seq = block_i && iblock == block_i->last_alloc_logical_block + 1 &&
+		block_i->last_alloc_physical_block != 0;
 	goal = ext3_find_goal(inode, iblock, chain, partial);
 
-	left = (chain + depth) - partial;
+	/* the number of blocks need to allocate for [d,t]indirect blocks */
+	indirect_blks = (chain + depth) - partial - 1;
 
+	/*
+	 * Next look up the indirect map to count the total number of
+	 * direct blocks to allocate for this branch.
+	 */
+	count = ext3_blks_to_allocate(partial, indirect_blks,
+					maxblocks, blocks_to_boundary);
 	/*
 	 * Block out ext3_truncate while we alter the tree
 	 */
-	err = ext3_alloc_branch(handle, inode, left, goal,
+	err = ext3_alloc_branch(handle, inode, indirect_blks, &count, goal,
 				offsets + (partial - chain), partial);
 
 	/*
@@ -752,8 +889,16 @@ ext3_get_block_handle(handle_t *handle, struct inode *inode, sector_t iblock,
 	 * may need to return -EAGAIN upwards in the worst case.  --sct
 	 */
 	if (!err)
-		err = ext3_splice_branch(handle, inode, iblock, chain,
-					 partial, left);
+		err = ext3_splice_branch(handle, inode, iblock,
+					 partial, indirect_blks, count);
+	if (!err && seq) {
+		struct ext3_alloc_stats *stats =
+				&EXT3_SB(inode->i_sb)->s_alloc_stats;
+
+		stats->seq++;
+		if (le32_to_cpu(chain[depth-1].key) != goal)
+			stats->seq_breaks++;
+	}
 	/*
 	 * i_disksize growing is protected by truncate_sem.  Don't forget to
 	 * protect it if you're about to implement concurrent
@@ -768,8 +913,9 @@ ext3_get_block_handle(handle_t *handle, struct inode *inode, sector_t iblock,
 	set_buffer_new(bh_result);
 got_it:
 	map_bh(bh_result, inode->i_sb, le32_to_cpu(chain[depth-1].key));
-	if (boundary)
+	if (count > blocks_to_boundary)
 		set_buffer_boundary(bh_result);
+	err = count;
 	/* Clean up and exit */
 	partial = chain + depth - 1;	/* the whole chain */
 cleanup:
@@ -783,6 +929,17 @@ out:
 	return err;
 }
 
+static int
+ext3_get_block_handle(handle_t *handle, struct inode *inode, sector_t iblock,
+		struct buffer_head *bh_result, int create, int extend_disksize)
+{
+	int ret;
+
+	ret = ext3_get_blocks_handle(handle, inode, iblock, 1, bh_result,
+				     create, extend_disksize);
+	return ret > 0 ? 0 : ret;
+}
+
 static int ext3_get_block(struct inode *inode, sector_t iblock,
 			struct buffer_head *bh_result, int create)
 {
@@ -838,9 +995,13 @@ ext3_direct_io_get_blocks(struct inode *inode, sector_t iblock,
 
 get_block:
 	if (ret == 0)
-		ret = ext3_get_block_handle(handle, inode, iblock,
-					bh_result, create, 0);
-	bh_result->b_size = (1 << inode->i_blkbits);
+		ret = ext3_get_blocks_handle(handle, inode, iblock,
+					max_blocks, bh_result, create, 0);
+	if (ret > 0) {
+		bh_result->b_size = (ret << inode->i_blkbits);
+		ret = 0;
+	} else
+		bh_result->b_size = (1 << inode->i_blkbits);
 	return ret;
 }
 
@@ -35,7 +35,9 @@
 #include <linux/mount.h>
 #include <linux/namei.h>
 #include <linux/quotaops.h>
+#include <linux/proc_fs.h>
 #include <asm/uaccess.h>
+#include <asm/div64.h>
 #include "xattr.h"
 #include "acl.h"
 
@@ -379,12 +381,76 @@ static void dump_orphan_list(struct super_block *sb, struct ext3_sb_info *sbi)
 	}
 }
 
+static struct proc_dir_entry *ext3_proc_root;	/* /proc/fs/ext3 */
+
+/*
+ * /proc/fs/ext3/<dev>/allocstat: what the block allocator has cost and
+ * how well it kept files contiguous since mount.
+ */
+static int ext3_allocstat_read(char *page, char **start, off_t off,
+			       int count, int *eof, void *data)
+{
+	struct super_block *sb = data;
+	struct ext3_alloc_stats *stats = &EXT3_SB(sb)->s_alloc_stats;
+	unsigned long long us = stats->ns;
+	unsigned long long per_block;
+	int len;
+
+	do_div(us, 1000);
+	per_block = stats->ns;
+	if (stats->blocks)
+		do_div(per_block, stats->blocks);
+	len = sprintf(page,
+		"calls %lu blocks %lu multi %lu\n"
+		"cpu_us %llu ns_per_block %llu\n"
+		"sequential %lu breaks %lu\n"
+		"rsv_windows %lu grows %lu extends %lu\n",
+		stats->calls, stats->blocks, stats->multi,
+		us, stats->blocks ? per_block : 0ULL,
+		stats->seq, stats->seq_breaks,
+		stats->rsv_windows, stats->rsv_grows, stats->rsv_extends);
+
+	if (len <= off + count)
+		*eof = 1;
+	*start = page + off;
+	len -= off;
+	if (len > count)
+		len = count;
+	if (len < 0)
+		len = 0;
+	return len;
+}
+
+static void ext3_proc_register(struct super_block *sb)
+{
+	struct ext3_sb_info *sbi = EXT3_SB(sb);
+
+	if (!ext3_proc_root)
+		return;
+	sbi->s_proc = proc_mkdir(sb->s_id, ext3_proc_root);
+	if (sbi->s_proc)
+		create_proc_read_entry("allocstat", 0, sbi->s_proc,
+				       ext3_allocstat_read, sb);
+}
+
+static void ext3_proc_unregister(struct super_block *sb)
+{
+	struct ext3_sb_info *sbi = EXT3_SB(sb);
+
+	if (!sbi->s_proc)
+		return;
+	remove_proc_entry("allocstat", sbi->s_proc);
+	remove_proc_entry(sb->s_id, ext3_proc_root);
+	sbi->s_proc = NULL;
+}
+
 static void ext3_put_super (struct super_block * sb)
 {
 	struct ext3_sb_info *sbi = EXT3_SB(sb);
 	struct ext3_super_block *es = sbi->s_es;
 	int i;
 
+	ext3_proc_unregister(sb);
 	ext3_xattr_put_super(sb);
 	journal_destroy(sbi->s_journal);
 	if (!(sb->s_flags & MS_RDONLY)) {
@@ -1639,6 +1705,8 @@ static int ext3_fill_super (struct super_block *sb, void *data, int silent)
 	percpu_counter_mod(&sbi->s_dirs_counter,
 		ext3_count_dirs(sb));
 
+	ext3_proc_register(sb);
+
 	lock_kernel();
 	return 0;
 
@@ -2511,7 +2579,7 @@ static struct file_system_type ext3_fs_type = {
 	.name		= "ext3",
 	.get_sb		= ext3_get_sb,
 	.kill_sb	= kill_block_super,
-	.fs_flags	= FS_REQUIRES_DEV,
+	.fs_flags	= FS_REQUIRES_DEV | FS_PAGECACHE_WRITE,
 };
 
 static int __init init_ext3_fs(void)
@@ -2525,6 +2593,7 @@ static int __init init_ext3_fs(void)
         err = register_filesystem(&ext3_fs_type);
 	if (err)
 		goto out;
+	ext3_proc_root = proc_mkdir("fs/ext3", NULL);
 	return 0;
 out:
 	destroy_inodecache();
@@ -2536,6 +2605,8 @@ out1:
 static void __exit exit_ext3_fs(void)
 {
 	unregister_filesystem(&ext3_fs_type);
+	if (ext3_proc_root)
+		remove_proc_entry("fs/ext3", NULL);
 	destroy_inodecache();
 	exit_ext3_xattr();
 }
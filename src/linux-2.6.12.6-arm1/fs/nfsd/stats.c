@@ -12,6 +12,10 @@
  *			statistics for filehandle lookup
  *	io <bytes-read> <bytes-writtten>
  *			statistics for IO throughput
+ *	wc <copied-once> <copied-twice>
+ *			write bytes moved from the receive skbs straight into
+ *			the page cache, and write bytes that took the extra
+ *			copy through the request pages
  *	th <threads> <fullcnt> <10%-20%> <20%-30%> ... <90%-100%> <100%> 
  *			time (seconds) when nfsd thread usage above thresholds
  *			and number of times that all threads were in use
@@ -55,6 +59,7 @@ static int nfsd_proc_show(struct seq_file *seq, void *v)
 		      nfsdstats.fh_nocache_nondir,
 		      nfsdstats.io_read,
 		      nfsdstats.io_write);
+	seq_printf(seq, "wc %u %u\n", nfsdstats.io_wcopy1, nfsdstats.io_wcopy2);
 	/* thread usage: */
 	seq_printf(seq, "th %u %u", nfsdstats.th_cnt, nfsdstats.th_fullcnt);
 	for (i=0; i<10; i++) {
@@ -32,6 +32,7 @@
 #include <linux/unistd.h>
 #include <linux/slab.h>
 #include <linux/pagemap.h>
+#include <linux/writeback.h>
 #include <linux/in.h>
 #include <linux/module.h>
 #include <linux/namei.h>
@@ -868,6 +869,136 @@ out:
 	return err;
 }
 
+/*
+ * Can the data of a write be copied from the request's receive skbs
+ * straight into the page cache, bypassing ->write()?  Only for plain
+ * buffered writes, and only on filesystems that say, with
+ * FS_PAGECACHE_WRITE, that their ->write() adds nothing to the
+ * prepare_write/commit_write pair for those.  ext2 and ext3 do; ext3
+ * journals from within the pair.
+ */
+static inline int
+nfsd_can_write_skbs(struct file *file)
+{
+	struct inode	*inode = file->f_dentry->d_inode;
+	struct address_space_operations *a_ops = file->f_mapping->a_ops;
+
+	if (!S_ISREG(inode->i_mode) || !a_ops->prepare_write
+	 || !a_ops->commit_write)
+		return 0;
+	if ((file->f_flags & (O_SYNC|O_DIRECT)) || IS_SYNC(inode))
+		return 0;
+	return (inode->i_sb->s_type->fs_flags & FS_PAGECACHE_WRITE) != 0;
+}
+
+/*
+ * Copy len bytes at offset pos of the write data into to.  The first
+ * vec[0].iov_len bytes are in the head of the request, the remainder
+ * is still in the receive skbs.
+ */
+static inline int
+nfsd_copy_write_data(struct svc_rqst *rqstp, struct kvec *vec,
+		     unsigned long pos, char *to, unsigned long len)
+{
+	unsigned long	n;
+
+	if (pos < vec[0].iov_len) {
+		n = min(len, vec[0].iov_len - pos);
+		memcpy(to, vec[0].iov_base + pos, n);
+		to += n;
+		pos += n;
+		len -= n;
+	}
+	if (!len)
+		return 0;
+	return svc_copy_argskbs(rqstp, pos - vec[0].iov_len, to, len);
+}
+
+/*
+ * Single-copy write: move the data from the head and the receive skbs
+ * directly into page cache pages.  Modelled on
+ * generic_file_buffered_write().
+ */
+static int
+nfsd_write_skbs(struct svc_rqst *rqstp, struct file *file, loff_t *offp,
+		struct kvec *vec, unsigned long cnt)
+{
+	struct address_space	*mapping = file->f_mapping;
+	struct address_space_operations *a_ops = mapping->a_ops;
+	struct inode		*inode = mapping->host;
+	loff_t			pos = *offp;
+	size_t			count = cnt;
+	unsigned long		written = 0;
+	struct page		*page;
+	char			*kaddr;
+	int			err;
+
+	down(&inode->i_sem);
+	err = generic_write_checks(file, &pos, &count, 0);
+	if (err || !count)
+		goto out;
+	err = remove_suid(file->f_dentry);
+	if (err)
+		goto out;
+	inode_update_time(inode, 1);
+
+	while (written < count) {
+		unsigned long index = pos >> PAGE_CACHE_SHIFT;
+		unsigned long offset = pos & (PAGE_CACHE_SIZE - 1);
+		unsigned long bytes = PAGE_CACHE_SIZE - offset;
+
+		if (bytes > count - written)
+			bytes = count - written;
+
+		page = grab_cache_page(mapping, index);
+		if (!page) {
+			err = -ENOMEM;
+			break;
+		}
+		err = a_ops->prepare_write(file, page, offset, offset+bytes);
+		if (unlikely(err)) {
+			loff_t isize = i_size_read(inode);
+
+			unlock_page(page);
+			page_cache_release(page);
+			if (pos + bytes > isize)
+				vmtruncate(inode, isize);
+			break;
+		}
+		kaddr = kmap(page);
+		err = nfsd_copy_write_data(rqstp, vec, written,
+					   kaddr + offset, bytes);
+		flush_dcache_page(page);
+		kunmap(page);
+		if (unlikely(err)) {
+			loff_t isize = i_size_read(inode);
+
+			/* close what prepare_write() opened, then trim */
+			a_ops->commit_write(file, page, offset, offset);
+			unlock_page(page);
+			page_cache_release(page);
+			if (pos + bytes > isize)
+				vmtruncate(inode, isize);
+			break;
+		}
+		err = a_ops->commit_write(file, page, offset, offset+bytes);
+		unlock_page(page);
+		mark_page_accessed(page);
+		page_cache_release(page);
+		if (err < 0)
+			break;
+		err = 0;
+		written += bytes;
+		pos += bytes;
+		balance_dirty_pages_ratelimited(mapping);
+		cond_resched();
+	}
+	*offp = pos;
+out:
+	up(&inode->i_sem);
+	return written ? written : err;
+}
+
 static inline int
 nfsd_vfs_write(struct svc_rqst *rqstp, struct svc_fh *fhp, struct file *file,
 				loff_t offset, struct kvec *vec, int vlen,
@@ -912,9 +1043,28 @@ nfsd_vfs_write(struct svc_rqst *rqstp, struct svc_fh *fhp, struct file *file,
 		file->f_flags |= O_SYNC;
 
 	/* Write the data. */
-	oldfs = get_fs(); set_fs(KERNEL_DS);
-	err = vfs_writev(file, (struct iovec __user *)vec, vlen, &offset);
-	set_fs(oldfs);
+	if (rqstp->rq_argskblen && nfsd_can_write_skbs(file)) {
+		/* the checks vfs_writev() would have made */
+		err = rw_verify_area(WRITE, file, &offset, cnt);
+		if (!err)
+			err = security_file_permission(file, MAY_WRITE);
+		if (!err)
+			err = nfsd_write_skbs(rqstp, file, &offset, vec, cnt);
+		if (err > 0)
+			nfsdstats.io_wcopy1 += err;
+	} else {
+		err = 0;
+		if (rqstp->rq_argskblen)
+			err = svc_flush_argskbs(rqstp);
+		if (!err) {
+			oldfs = get_fs(); set_fs(KERNEL_DS);
+			err = vfs_writev(file, (struct iovec __user *)vec, vlen,
+					 &offset);
+			set_fs(oldfs);
+		}
+		if (err > 0)
+			nfsdstats.io_wcopy2 += err;
+	}
 	if (err >= 0) {
 		nfsdstats.io_write += cnt;
 		fsnotify_modify(file->f_dentry);
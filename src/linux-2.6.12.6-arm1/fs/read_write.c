@@ -203,6 +203,8 @@ Einval:
 	return -EINVAL;
 }
 
+EXPORT_SYMBOL(rw_verify_area);
+
 ssize_t do_sync_read(struct file *filp, char __user *buf, size_t len, loff_t *ppos)
 {
 	struct kiocb kiocb;
@@ -0,0 +1,385 @@
+/*
+ *  linux/fs/recvfile.c
+ *
+ * recvfile(): sendfile() the other way round.  Data is taken off the
+ * receive queue of a TCP socket and copied from the skbs straight into
+ * the page cache of a regular file, through ->prepare_write() and
+ * ->commit_write() as write() would, but without the trip through a
+ * user buffer.  This is what an SMB or FTP server does with an upload:
+ * the length is known from the protocol, and all of it goes to one
+ * place in one file.
+ *
+ * Only what has been written is taken off the socket.  A short count
+ * (error, EOF, timeout, signal) leaves the rest in the receive queue,
+ * so the caller can recv() and discard it to keep its stream in sync.
+ */
+
+#include <linux/config.h>
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/mm.h>
+#include <linux/highmem.h>
+#include <linux/pagemap.h>
+#include <linux/writeback.h>
+#include <linux/fsnotify.h>
+#include <linux/security.h>
+#include <linux/syscalls.h>
+#include <linux/net.h>
+#include <linux/in.h>
+#include <linux/skbuff.h>
+#include <net/sock.h>
+#include <net/tcp.h>
+
+#include <asm/uaccess.h>
+
+/* /proc/sys/fs/recvfile-stat */
+struct recvfile_stat_struct recvfile_stat;
+
+struct recvfile_state {
+	struct file	*file;
+	loff_t		pos;		/* where the next byte goes */
+	struct page	*page;		/* locked, prepared for [from, to) */
+	unsigned	from, to;
+	int		overwrite;	/* commit all of [from, to), copied or not */
+};
+
+/*
+ * Lock and prepare the page under rs->pos.  @chunk is what the current
+ * skb has to give, @count what is left of the whole call.
+ *
+ * Where nothing in the prepared range can be left holding the wrong
+ * bytes, the page is prepared once up to its end (or the end of the
+ * call) and filled from as many skbs as it takes.  That is the case if
+ * the page is uptodate and the range lies inside i_size, since what is
+ * not overwritten is committed as it was, and if the page lies wholly
+ * beyond i_size, since what is not overwritten is trimmed off again.
+ * A partial overwrite of data that is not in memory goes one skb chunk
+ * at a time: prepare_write() and commit_write() cover exactly the bytes
+ * copied, and the rest of the page is never touched.
+ */
+static int recvfile_prepare(struct recvfile_state *rs, size_t chunk,
+			    size_t count)
+{
+	struct address_space *mapping = rs->file->f_mapping;
+	struct inode *inode = mapping->host;
+	loff_t isize = i_size_read(inode);
+	unsigned from = rs->pos & (PAGE_CACHE_SIZE - 1);
+	loff_t start = rs->pos - from;
+	unsigned to = PAGE_CACHE_SIZE;
+	struct page *page;
+	int err;
+
+	page = grab_cache_page(mapping, rs->pos >> PAGE_CACHE_SHIFT);
+	if (!page)
+		return -ENOMEM;
+
+	if (to - from > count)
+		to = from + count;
+	rs->overwrite = PageUptodate(page) && start + to <= isize;
+	if (!rs->overwrite && start < isize && to - from > chunk)
+		to = from + chunk;
+
+	err = mapping->a_ops->prepare_write(rs->file, page, from, to);
+	if (unlikely(err)) {
+		/*
+		 * prepare_write() may have instantiated a few blocks
+		 * outside i_size.  Trim these off again.
+		 */
+		unlock_page(page);
+		page_cache_release(page);
+		if (start + to > isize)
+			vmtruncate(inode, isize);
+		return err;
+	}
+
+	rs->page = page;
+	rs->from = from;
+	rs->to = to;
+	return 0;
+}
+
+/*
+ * Commit and drop the page taken by recvfile_prepare(), whether or not
+ * all of it has been filled.  A page beyond i_size is committed up to
+ * rs->pos only, and blocks prepared past that are trimmed off again.
+ */
+static int recvfile_commit(struct recvfile_state *rs)
+{
+	struct address_space *mapping = rs->file->f_mapping;
+	struct inode *inode = mapping->host;
+	struct page *page = rs->page;
+	loff_t start = (loff_t)page->index << PAGE_CACHE_SHIFT;
+	loff_t isize = i_size_read(inode);
+	unsigned end = rs->overwrite ? rs->to : rs->pos - start;
+	int err;
+
+	rs->page = NULL;
+	err = mapping->a_ops->commit_write(rs->file, page, rs->from, end);
+	unlock_page(page);
+	mark_page_accessed(page);
+	page_cache_release(page);
+	if (end < rs->to && start + rs->to > isize)
+		vmtruncate(inode, i_size_read(inode));
+	balance_dirty_pages_ratelimited(mapping);
+	return err < 0 ? err : 0;
+}
+
+static int recvfile_actor(read_descriptor_t *desc, struct sk_buff *skb,
+			  unsigned int offset, size_t len)
+{
+	struct recvfile_state *rs = desc->arg.data;
+	size_t copied = 0;
+	unsigned from, n;
+	char *kaddr;
+	int err;
+
+	if (len > desc->count)
+		len = desc->count;
+	while (copied < len) {
+		if (!rs->page) {
+			err = recvfile_prepare(rs, len - copied, desc->count);
+			if (unlikely(err)) {
+				desc->error = err;
+				break;
+			}
+		}
+
+		from = rs->pos & (PAGE_CACHE_SIZE - 1);
+		n = rs->to - from;
+		if (n > len - copied)
+			n = len - copied;
+
+		kaddr = kmap(rs->page);
+		err = skb_copy_bits(skb, offset + copied, kaddr + from, n);
+		kunmap(rs->page);
+		flush_dcache_page(rs->page);
+		if (unlikely(err)) {
+			recvfile_commit(rs);
+			desc->error = -EFAULT;
+			break;
+		}
+
+		rs->pos += n;
+		copied += n;
+		desc->count -= n;
+		desc->written += n;
+
+		if (from + n == rs->to) {
+			err = recvfile_commit(rs);
+			if (err) {
+				desc->error = err;
+				break;
+			}
+		}
+	}
+	return copied;
+}
+
+/* Commit a part-filled page before sleeping for more data, or at the end. */
+static void recvfile_flush(read_descriptor_t *desc)
+{
+	struct recvfile_state *rs = desc->arg.data;
+	int err;
+
+	if (!rs->page)
+		return;
+	err = recvfile_commit(rs);
+	if (err && !desc->error)
+		desc->error = err;
+}
+
+/*
+ * Feed the receive queue to the actor until desc->count is used up,
+ * waiting for data as tcp_recvmsg() does.  Returns bytes taken off the
+ * socket, or an error if there were none.
+ */
+static ssize_t recvfile_tcp(struct socket *sock, read_descriptor_t *desc)
+{
+	struct sock *sk = sock->sk;
+	struct tcp_sock *tp = tcp_sk(sk);
+	ssize_t copied = 0;
+	long timeo;
+	int err = 0;
+	int used;
+
+	lock_sock(sk);
+	timeo = sock_rcvtimeo(sk, sock->file->f_flags & O_NONBLOCK);
+
+	for (;;) {
+		used = tcp_read_sock(sk, desc, recvfile_actor);
+		if (used < 0) {
+			err = used;
+			break;
+		}
+		copied += used;
+		if (!desc->count || desc->error)
+			break;
+
+		/* urgent data is for recv(MSG_OOB) to sort out */
+		if (tp->urg_data && tp->urg_seq == tp->copied_seq)
+			break;
+
+		if (sock_flag(sk, SOCK_DONE))
+			break;
+		if (sk->sk_err) {
+			err = sock_error(sk);
+			break;
+		}
+		if (sk->sk_shutdown & RCV_SHUTDOWN)
+			break;
+		if (sk->sk_state == TCP_CLOSE) {
+			err = -ENOTCONN;
+			break;
+		}
+		if (!timeo) {
+			err = -EAGAIN;
+			break;
+		}
+		if (signal_pending(current)) {
+			err = sock_intr_errno(timeo);
+			break;
+		}
+
+		recvfile_flush(desc);
+		if (desc->error)
+			break;
+		sk_wait_data(sk, &timeo);
+	}
+
+	release_sock(sk);
+	return copied ? copied : err;
+}
+
+static ssize_t do_recvfile(struct socket *sock, struct file *file,
+			   loff_t *ppos, size_t count)
+{
+	struct address_space *mapping = file->f_mapping;
+	struct inode *inode = mapping->host;
+	struct recvfile_state rs;
+	read_descriptor_t desc;
+	ssize_t ret;
+
+	vfs_check_frozen(inode->i_sb, SB_FREEZE_WRITE);
+	current->backing_dev_info = mapping->backing_dev_info;
+
+	rs.pos = *ppos;
+	ret = generic_write_checks(file, &rs.pos, &count, 0);
+	if (ret || !count)
+		goto out;
+	ret = remove_suid(file->f_dentry);
+	if (ret)
+		goto out;
+	inode_update_time(inode, 1);
+
+	rs.file = file;
+	rs.page = NULL;
+
+	desc.written = 0;
+	desc.count = count;
+	desc.arg.data = &rs;
+	desc.error = 0;
+
+	ret = recvfile_tcp(sock, &desc);
+	recvfile_flush(&desc);
+	*ppos = rs.pos;
+
+	if (desc.written)
+		ret = desc.written;
+	else if (desc.error)
+		ret = desc.error;
+
+	recvfile_stat.calls++;
+	recvfile_stat.bytes += desc.written;
+	if (desc.written < count)
+		recvfile_stat.short_calls++;
+out:
+	current->backing_dev_info = NULL;
+	return ret;
+}
+
+asmlinkage ssize_t sys_recvfile(int out_fd, int in_fd, loff_t __user *offset,
+				size_t count)
+{
+	struct socket *sock;
+	struct sock *sk;
+	struct file *file;
+	struct inode *inode;
+	loff_t pos, *ppos;
+	ssize_t ret;
+	int fput_needed, err;
+
+	if (offset && unlikely(copy_from_user(&pos, offset, sizeof(loff_t))))
+		return -EFAULT;
+
+	/*
+	 * Get the socket: connected TCP only..
+	 */
+	sock = sockfd_lookup(in_fd, &err);
+	if (!sock)
+		return err;
+	ret = -EINVAL;
+	sk = sock->sk;
+	if (sock->type != SOCK_STREAM || sk->sk_protocol != IPPROTO_TCP ||
+	    (sk->sk_family != PF_INET && sk->sk_family != PF_INET6))
+		goto out_sock;
+	ret = security_file_permission(sock->file, MAY_READ);
+	if (ret)
+		goto out_sock;
+
+	/*
+	 * Get the output file: a regular file written through the page cache..
+	 */
+	ret = -EBADF;
+	file = fget_light(out_fd, &fput_needed);
+	if (!file)
+		goto out_sock;
+	if (!(file->f_mode & FMODE_WRITE))
+		goto out_file;
+	ret = -EINVAL;
+	inode = file->f_dentry->d_inode;
+	if (!S_ISREG(inode->i_mode) || (file->f_flags & O_DIRECT) ||
+	    !file->f_mapping->a_ops->prepare_write ||
+	    !file->f_mapping->a_ops->commit_write)
+		goto out_file;
+	ret = -ESPIPE;
+	if (!offset)
+		ppos = &file->f_pos;
+	else if (!(file->f_mode & FMODE_PWRITE))
+		goto out_file;
+	else
+		ppos = &pos;
+	ret = rw_verify_area(WRITE, file, ppos, count);
+	if (ret)
+		goto out_file;
+	ret = security_file_permission(file, MAY_WRITE);
+	if (ret)
+		goto out_file;
+
+	down(&inode->i_sem);
+	ret = do_recvfile(sock, file, ppos, count);
+	up(&inode->i_sem);
+
+	if (ret > 0) {
+		if ((file->f_flags & O_SYNC) || IS_SYNC(inode)) {
+			err = sync_page_range(inode, file->f_mapping,
+					      *ppos - ret, ret);
+			if (err < 0)
+				ret = err;
+		}
+		fsnotify_modify(file->f_dentry);
+		current->rchar += ret;
+		current->wchar += ret;
+	}
+	current->syscr++;
+	current->syscw++;
+
+	if (offset && unlikely(put_user(pos, offset)))
+		ret = -EFAULT;
+
+out_file:
+	fput_light(file, fput_needed);
+out_sock:
+	sockfd_put(sock);
+	return ret;
+}
@@ -110,4 +110,11 @@ int LzmaDecode(CLzmaDecoderState *vs,
     #endif
     unsigned char *outStream, SizeT outSize, SizeT *outSizeProcessed);
 
+#if !defined(_LZMA_IN_CB) && !defined(_LZMA_OUT_READ)
+/* whole-buffer decoder for squashfs, see LzmaDecodeFast.c */
+int LzmaDecodeFast(CLzmaDecoderState *vs,
+    const unsigned char *inStream, SizeT inSize, SizeT *inSizeProcessed,
+    unsigned char *outStream, SizeT outSize, SizeT *outSizeProcessed);
+#endif
+
 #endif
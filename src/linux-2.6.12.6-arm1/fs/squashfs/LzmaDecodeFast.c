@@ -0,0 +1,412 @@
+/*
+  LzmaDecodeFast.c
+  LZMA decoder for squashfs blocks, tuned for ARMv5
+
+  Derived from LzmaDecode.c, LZMA SDK 4.40 Copyright (c) 1999-2006
+  Igor Pavlov (2006-05-01), http://www.7-zip.org/, and licensed under
+  the same terms (GNU LGPL or CPL).
+
+  Squashfs always decodes a whole block from one buffer into another,
+  so this decoder drops the streaming and callback variants and keeps
+  everything it needs in locals:
+
+  - the output is a pointer rather than an index, and the positions
+    that select probabilities are taken from it with a mask;
+  - bits that build up a symbol (literals, lengths, distances) are
+    decoded with a mask instead of a branch, which the ARM926 core
+    without branch prediction pays 3 cycles for each time;
+  - literals are decoded with the 8 tree steps unrolled, and matched
+    literals with the offset trick, so neither has a data dependent
+    exit;
+  - the state machine steps through a table;
+  - matches that do not overlap themselves are copied with memcpy();
+  - the probabilities are reset a word at a time.
+
+  The input is still bounds checked on every refill, so corrupt blocks
+  fail with LZMA_RESULT_DATA_ERROR exactly where LzmaDecode() would.
+*/
+
+#ifdef __KERNEL__
+#include <linux/string.h>
+#else
+#include <string.h>
+#endif
+
+#include "LzmaDecode.h"
+
+#define kNumTopBits 24
+#define kTopValue ((UInt32)1 << kNumTopBits)
+
+#define kNumBitModelTotalBits 11
+#define kBitModelTotal (1 << kNumBitModelTotalBits)
+#define kNumMoveBits 5
+
+#define kNumPosBitsMax 4
+#define kNumPosStatesMax (1 << kNumPosBitsMax)
+
+#define kLenNumLowBits 3
+#define kLenNumLowSymbols (1 << kLenNumLowBits)
+#define kLenNumMidBits 3
+#define kLenNumMidSymbols (1 << kLenNumMidBits)
+#define kLenNumHighBits 8
+#define kLenNumHighSymbols (1 << kLenNumHighBits)
+
+#define LenChoice 0
+#define LenChoice2 (LenChoice + 1)
+#define LenLow (LenChoice2 + 1)
+#define LenMid (LenLow + (kNumPosStatesMax << kLenNumLowBits))
+#define LenHigh (LenMid + (kNumPosStatesMax << kLenNumMidBits))
+#define kNumLenProbs (LenHigh + kLenNumHighSymbols)
+
+#define kNumStates 12
+#define kNumLitStates 7
+
+#define kStartPosModelIndex 4
+#define kEndPosModelIndex 14
+#define kNumFullDistances (1 << (kEndPosModelIndex >> 1))
+
+#define kNumPosSlotBits 6
+#define kNumLenToPosStates 4
+
+#define kNumAlignBits 4
+#define kAlignTableSize (1 << kNumAlignBits)
+
+#define kMatchMinLen 2
+
+#define IsMatch 0
+#define IsRep (IsMatch + (kNumStates << kNumPosBitsMax))
+#define IsRepG0 (IsRep + kNumStates)
+#define IsRepG1 (IsRepG0 + kNumStates)
+#define IsRepG2 (IsRepG1 + kNumStates)
+#define IsRep0Long (IsRepG2 + kNumStates)
+#define PosSlot (IsRep0Long + (kNumStates << kNumPosBitsMax))
+#define SpecPos (PosSlot + (kNumLenToPosStates << kNumPosSlotBits))
+#define Align (SpecPos + kNumFullDistances - kEndPosModelIndex)
+#define LenCoder (Align + kAlignTableSize)
+#define RepLenCoder (LenCoder + kNumLenProbs)
+#define Literal (RepLenCoder + kNumLenProbs)
+
+#if Literal != LZMA_BASE_SIZE
+StopCompilingDueBUG
+#endif
+
+/* only a corrupt block runs out of input */
+#define RC_NORMALIZE \
+  if (range < kTopValue) { \
+    if (__builtin_expect(buf == bufLim, 0)) goto data_error; \
+    range <<= 8; code = (code << 8) | *buf++; }
+
+/* decision bits, where the branch is wanted anyway */
+#define IfBit0(p) RC_NORMALIZE; bound = (range >> kNumBitModelTotalBits) * *(p); if (code < bound)
+#define UpdateBit0(p) range = bound; *(p) += (kBitModelTotal - *(p)) >> kNumMoveBits;
+#define UpdateBit1(p) range -= bound; code -= bound; *(p) -= (*(p)) >> kNumMoveBits;
+
+/*
+  Decode a bit into mask (0 or all ones) without branching on it.  The
+  probability update is the exact one of UpdateBit0/UpdateBit1.
+*/
+#define RC_BIT_MASK(p, mask) { \
+  UInt32 prob_ = *(p); \
+  RC_NORMALIZE; \
+  bound = (range >> kNumBitModelTotalBits) * prob_; \
+  mask = 0 - (UInt32)(code >= bound); \
+  range = (bound & ~mask) | ((range - bound) & mask); \
+  code -= bound & mask; \
+  *(p) = (CProb)(prob_ + (((kBitModelTotal - prob_) >> kNumMoveBits) & ~mask) \
+    - ((prob_ >> kNumMoveBits) & mask)); }
+
+/* shift the decoded bit into sym */
+#define RC_BIT_TREE(p, sym) { UInt32 m_; RC_BIT_MASK(p, m_); sym = (sym << 1) - m_; }
+
+#define RC_TREE_DECODE(probs, numLevels, res) { \
+  UInt32 i_ = numLevels; res = 1; \
+  do { RC_BIT_TREE((probs) + res, res) } while (--i_ != 0); \
+  res -= (1 << (numLevels)); }
+
+/* matches shorter than this are copied a byte at a time */
+#define kMinMemcpyLen 16
+
+static const Byte kLiteralNextStates[kNumStates] =
+  { 0, 0, 0, 0, 1, 2, 3, 4, 5, 6, 4, 5 };
+
+int LzmaDecodeFast(CLzmaDecoderState *vs,
+    const unsigned char *inStream, SizeT inSize, SizeT *inSizeProcessed,
+    unsigned char *outStream, SizeT outSize, SizeT *outSizeProcessed)
+{
+  CProb *p = vs->Probs;
+  Byte *out = outStream;
+  Byte *const outLim = outStream + outSize;
+  const Byte *buf = inStream;
+  const Byte *const bufLim = inStream + inSize;
+  UInt32 range, code, bound;
+  UInt32 rep0 = 1, rep1 = 1, rep2 = 1, rep3 = 1;
+  UInt32 state = 0, len;
+  UInt32 previousByte = 0;
+  const UInt32 posStateMask = (1 << (vs->Properties.pb)) - 1;
+  const UInt32 literalPosMask = (1 << (vs->Properties.lp)) - 1;
+  const UInt32 lc = vs->Properties.lc;
+  const UInt32 litShift = 8 - lc;
+
+  *inSizeProcessed = 0;
+  *outSizeProcessed = 0;
+
+  {
+    UInt32 numProbs = Literal + ((UInt32)LZMA_LIT_SIZE << (lc + vs->Properties.lp));
+    UInt32 i = 0;
+
+    if (((unsigned long)p & 3) == 0 && sizeof(CProb) == 2)
+    {
+      UInt32 *p32 = (UInt32 *)p;
+      const UInt32 half = kBitModelTotal >> 1;
+      for (; i + 1 < numProbs; i += 2)
+        *p32++ = half | (half << 16);
+    }
+    for (; i < numProbs; i++)
+      p[i] = kBitModelTotal >> 1;
+  }
+
+  code = 0;
+  range = 0xFFFFFFFF;
+  {
+    int i;
+    for (i = 0; i < 5; i++)
+    {
+      if (buf == bufLim)
+        return LZMA_RESULT_DATA_ERROR;
+      code = (code << 8) | *buf++;
+    }
+  }
+
+  while (out < outLim)
+  {
+    CProb *prob;
+    UInt32 pos = (UInt32)(out - outStream);
+    UInt32 posState = pos & posStateMask;
+
+    prob = p + IsMatch + (state << kNumPosBitsMax) + posState;
+    IfBit0(prob)
+    {
+      UInt32 symbol = 1;
+
+      UpdateBit0(prob)
+      prob = p + Literal + LZMA_LIT_SIZE *
+        (((pos & literalPosMask) << lc) + (previousByte >> litShift));
+
+      if (state >= kNumLitStates)
+      {
+        UInt32 matchByte = out[-(int)rep0];
+        UInt32 offs = 0x100;
+
+        do
+        {
+          UInt32 matchBit, mask;
+          matchByte <<= 1;
+          matchBit = matchByte & offs;
+          RC_BIT_MASK(prob + offs + matchBit + symbol, mask);
+          symbol = (symbol << 1) - mask;
+          offs &= matchBit ^ ~mask;
+        }
+        while (symbol < 0x100);
+      }
+      else
+      {
+        RC_BIT_TREE(prob + symbol, symbol)
+        RC_BIT_TREE(prob + symbol, symbol)
+        RC_BIT_TREE(prob + symbol, symbol)
+        RC_BIT_TREE(prob + symbol, symbol)
+        RC_BIT_TREE(prob + symbol, symbol)
+        RC_BIT_TREE(prob + symbol, symbol)
+        RC_BIT_TREE(prob + symbol, symbol)
+        RC_BIT_TREE(prob + symbol, symbol)
+      }
+      previousByte = symbol & 0xFF;
+      *out++ = (Byte)previousByte;
+      state = kLiteralNextStates[state];
+      continue;
+    }
+
+    UpdateBit1(prob);
+    prob = p + IsRep + state;
+    IfBit0(prob)
+    {
+      UpdateBit0(prob);
+      rep3 = rep2;
+      rep2 = rep1;
+      rep1 = rep0;
+      state = state < kNumLitStates ? 0 : 3;
+      prob = p + LenCoder;
+    }
+    else
+    {
+      UpdateBit1(prob);
+      if (out == outStream)
+        return LZMA_RESULT_DATA_ERROR;
+      prob = p + IsRepG0 + state;
+      IfBit0(prob)
+      {
+        UpdateBit0(prob);
+        prob = p + IsRep0Long + (state << kNumPosBitsMax) + posState;
+        IfBit0(prob)
+        {
+          /* short rep: one byte at rep0 */
+          UpdateBit0(prob);
+          state = state < kNumLitStates ? 9 : 11;
+          previousByte = out[-(int)rep0];
+          *out++ = (Byte)previousByte;
+          continue;
+        }
+        UpdateBit1(prob);
+      }
+      else
+      {
+        UInt32 distance;
+        UpdateBit1(prob);
+        prob = p + IsRepG1 + state;
+        IfBit0(prob)
+        {
+          UpdateBit0(prob);
+          distance = rep1;
+        }
+        else
+        {
+          UpdateBit1(prob);
+          prob = p + IsRepG2 + state;
+          IfBit0(prob)
+          {
+            UpdateBit0(prob);
+            distance = rep2;
+          }
+          else
+          {
+            UpdateBit1(prob);
+            distance = rep3;
+            rep3 = rep2;
+          }
+          rep2 = rep1;
+        }
+        rep1 = rep0;
+        rep0 = distance;
+      }
+      state = state < kNumLitStates ? 8 : 11;
+      prob = p + RepLenCoder;
+    }
+
+    {
+      CProb *probLen = prob + LenChoice;
+      IfBit0(probLen)
+      {
+        UpdateBit0(probLen);
+        probLen = prob + LenLow + (posState << kLenNumLowBits);
+        RC_TREE_DECODE(probLen, kLenNumLowBits, len);
+      }
+      else
+      {
+        UpdateBit1(probLen);
+        probLen = prob + LenChoice2;
+        IfBit0(probLen)
+        {
+          UpdateBit0(probLen);
+          probLen = prob + LenMid + (posState << kLenNumMidBits);
+          RC_TREE_DECODE(probLen, kLenNumMidBits, len);
+          len += kLenNumLowSymbols;
+        }
+        else
+        {
+          UpdateBit1(probLen);
+          probLen = prob + LenHigh;
+          RC_TREE_DECODE(probLen, kLenNumHighBits, len);
+          len += kLenNumLowSymbols + kLenNumMidSymbols;
+        }
+      }
+    }
+
+    if (state < 4)
+    {
+      UInt32 posSlot;
+      state += kNumLitStates;
+      prob = p + PosSlot +
+          ((len < kNumLenToPosStates ? len : kNumLenToPosStates - 1) <<
+          kNumPosSlotBits);
+      RC_TREE_DECODE(prob, kNumPosSlotBits, posSlot);
+      if (posSlot >= kStartPosModelIndex)
+      {
+        UInt32 numDirectBits = (posSlot >> 1) - 1;
+        rep0 = 2 | (posSlot & 1);
+        if (posSlot < kEndPosModelIndex)
+        {
+          rep0 <<= numDirectBits;
+          prob = p + SpecPos + rep0 - posSlot - 1;
+        }
+        else
+        {
+          numDirectBits -= kNumAlignBits;
+          do
+          {
+            UInt32 t;
+            RC_NORMALIZE
+            range >>= 1;
+            code -= range;
+            t = 0 - (code >> 31);
+            code += range & t;
+            rep0 = (rep0 << 1) + (t + 1);
+          }
+          while (--numDirectBits != 0);
+          prob = p + Align;
+          rep0 <<= kNumAlignBits;
+          numDirectBits = kNumAlignBits;
+        }
+        {
+          UInt32 i = 1, mi = 1;
+          do
+          {
+            UInt32 mask;
+            RC_BIT_MASK(prob + mi, mask);
+            mi = (mi << 1) - mask;
+            rep0 |= i & mask;
+            i <<= 1;
+          }
+          while (--numDirectBits != 0);
+        }
+      }
+      else
+        rep0 = posSlot;
+      if (++rep0 == (UInt32)(0))
+      {
+        /* end marker */
+        break;
+      }
+    }
+
+    len += kMatchMinLen;
+    if (rep0 > (UInt32)(out - outStream))
+      return LZMA_RESULT_DATA_ERROR;
+
+    {
+      const Byte *src = out - rep0;
+      UInt32 rem = (UInt32)(outLim - out);
+
+      if (len > rem)
+        len = rem;
+      if (len >= kMinMemcpyLen && rep0 >= len)
+      {
+        memcpy(out, src, len);
+        out += len;
+      }
+      else
+      {
+        do
+          *out++ = *src++;
+        while (--len != 0);
+      }
+      previousByte = out[-1];
+    }
+  }
+  RC_NORMALIZE;
+
+  *inSizeProcessed = (SizeT)(buf - inStream);
+  *outSizeProcessed = (SizeT)(out - outStream);
+  return LZMA_RESULT_OK;
+
+data_error:
+  return LZMA_RESULT_DATA_ERROR;
+}
@@ -39,26 +39,27 @@
 #include <linux/wait.h>
 #include <linux/blkdev.h>
 #include <linux/vmalloc.h>
+#include <linux/proc_fs.h>
+#include <linux/sched.h>
 #include <asm/uaccess.h>
 #include <asm/semaphore.h>
+#include <asm/div64.h>
 
 #include "squashfs.h"
 #include "sqlzma.h"
 #include "sqmagic.h"
 
-#undef KeepPreemptive
-#if defined(CONFIG_PREEMPT) && !defined(UnsquashNoPreempt)
-#define KeepPreemptive
-#endif
-
-struct sqlzma {
-#ifdef KeepPreemptive
-	struct mutex mtx;
-#endif
-	unsigned char read_data[SQUASHFS_FILE_MAX_SIZE];
-	struct sqlzma_un un;
+/*
+ * A decompressor context.  Each mounted filesystem has a pool of
+ * SQUASHFS_DECOMPRESSORS of them, so that readers of different blocks
+ * decompress concurrently and one reader's I/O overlaps another's
+ * decompression.
+ */
+struct squashfs_decomp {
+	struct list_head	list;
+	unsigned char		*read_data;	/* compressed block, gathered */
+	struct sqlzma_un	un;
 };
-static DEFINE_PER_CPU(struct sqlzma *, sqlzma);
 
 #define dpri(fmt, args...) /* printk("%s:%d: " fmt, __func__, __LINE__, ##args) */
 #define dpri_un(un)	dpri("un{%d, {%d %p}, {%d %p}, {%d %p}}\n", \
@@ -66,7 +67,7 @@ static DEFINE_PER_CPU(struct sqlzma *, sqlzma);
 			     (un)->un_a[1].sz, (un)->un_a[1].buf, \
 			     (un)->un_a[2].sz, (un)->un_a[2].buf)
 
-static int squashfs_cached_blks;
+static struct proc_dir_entry *squashfs_proc_root;	/* /proc/fs/squashfs */
 
 static void vfs_read_inode(struct inode *i);
 static struct dentry *squashfs_get_parent(struct dentry *child);
@@ -149,6 +150,106 @@ static void *kzalloc(int size, int flags)
 }
 
 
+static void free_decomp(struct squashfs_decomp *decomp)
+{
+	sqlzma_fin(&decomp->un);
+	vfree(decomp->read_data);
+	vfree(decomp);
+}
+
+
+static void squashfs_free_decomp_pool(struct squashfs_sb_info *msblk)
+{
+	struct squashfs_decomp *decomp;
+
+	while (!list_empty(&msblk->decomp_free)) {
+		decomp = list_entry(msblk->decomp_free.next,
+					struct squashfs_decomp, list);
+		list_del(&decomp->list);
+		free_decomp(decomp);
+	}
+}
+
+
+static int squashfs_init_decomp_pool(struct squashfs_sb_info *msblk)
+{
+	struct squashfs_decomp *decomp;
+	unsigned int block_size = msblk->sblk.block_size;
+	int i;
+
+	for (i = 0; i < SQUASHFS_DECOMPRESSORS; i++) {
+		decomp = vmalloc(sizeof(struct squashfs_decomp));
+		if (decomp == NULL)
+			goto failed;
+		memset(decomp, 0, sizeof(struct squashfs_decomp));
+
+		/* metadata blocks can be bigger than small data blocks */
+		decomp->read_data = vmalloc(max_t(unsigned int, block_size,
+						SQUASHFS_METADATA_SIZE));
+		if (decomp->read_data == NULL ||
+				sqlzma_init(&decomp->un, 1, 0)) {
+			vfree(decomp->read_data);
+			vfree(decomp);
+			goto failed;
+		}
+		list_add(&decomp->list, &msblk->decomp_free);
+	}
+	return 1;
+
+failed:
+	ERROR("Failed to allocate decompressor\n");
+	squashfs_free_decomp_pool(msblk);
+	return 0;
+}
+
+
+/* for the stats: sched_clock() is not exported, and we may be a module */
+static inline unsigned long long squashfs_clock_ns(void)
+{
+	struct timeval tv;
+
+	do_gettimeofday(&tv);
+	return ((unsigned long long)tv.tv_sec * 1000000 + tv.tv_usec) * 1000;
+}
+
+
+static struct squashfs_decomp *squashfs_get_decomp(struct squashfs_sb_info
+					*msblk)
+{
+	struct squashfs_decomp *decomp;
+	unsigned long long start = 0;
+
+	spin_lock(&msblk->decomp_lock);
+	while (list_empty(&msblk->decomp_free)) {
+		spin_unlock(&msblk->decomp_lock);
+		if (!start) {
+			start = squashfs_clock_ns();
+			msblk->stats.decomp_waits++;
+		}
+		wait_event(msblk->decomp_wait, !list_empty(&msblk->decomp_free));
+		spin_lock(&msblk->decomp_lock);
+	}
+	decomp = list_entry(msblk->decomp_free.next, struct squashfs_decomp,
+				list);
+	list_del(&decomp->list);
+	spin_unlock(&msblk->decomp_lock);
+
+	if (start)
+		msblk->stats.decomp_wait_ns += squashfs_clock_ns() - start;
+	return decomp;
+}
+
+
+static void squashfs_put_decomp(struct squashfs_sb_info *msblk,
+				struct squashfs_decomp *decomp)
+{
+	spin_lock(&msblk->decomp_lock);
+	list_add(&decomp->list, &msblk->decomp_free);
+	spin_unlock(&msblk->decomp_lock);
+	wake_up(&msblk->decomp_wait);
+}
+
+
 static struct buffer_head *get_block_length(struct super_block *s,
 				int *cur_index, int *offset, int *c_byte)
 {
@@ -216,9 +317,15 @@ out:
 }
 
 
-SQSH_EXTERN unsigned int squashfs_read_data(struct super_block *s, char *buffer,
+/*
+ * Read, and decompress if need be, the block at @index into @buffer.  A
+ * compressed block is decompressed with @decomp if the caller holds one,
+ * otherwise with one taken from the pool once the I/O has completed.
+ */
+static unsigned int read_data(struct super_block *s, char *buffer,
 			long long index, unsigned int length,
-			long long *next_index, int srclength)
+			long long *next_index, int srclength,
+			struct squashfs_decomp *decomp)
 {
 	struct squashfs_sb_info *msblk = s->s_fs_info;
 	struct squashfs_super_block *sblk = &msblk->sblk;
@@ -288,7 +395,8 @@ SQSH_EXTERN unsigned int squashfs_read_data(struct super_block *s, char *buffer,
 		int start;
 		enum {Src, Dst};
 		struct sized_buf sbuf[2];
-		struct sqlzma *percpu;
+		struct squashfs_decomp *own = NULL;
+		unsigned long long t;
 		unsigned char *p;
 
 		/*
@@ -304,13 +412,9 @@ SQSH_EXTERN unsigned int squashfs_read_data(struct super_block *s, char *buffer,
 				goto release_mutex;
 		}
 
-		/* it disables preemption */
-		percpu = get_cpu_var(sqlzma);
-#ifdef KeepPreemptive
-		put_cpu_var(sqlzma);
-		mutex_lock(&percpu->mtx);
-#endif
-		p = percpu->read_data;
+		if (decomp == NULL)
+			decomp = own = squashfs_get_decomp(msblk);
+		p = decomp->read_data;
 		k = start;
 		for (bytes = 0; k < b; k++) {
 			avail_bytes = min(c_byte - bytes, msblk->devblksize - offset);
@@ -329,31 +433,27 @@ SQSH_EXTERN unsigned int squashfs_read_data(struct super_block *s, char *buffer,
 
 			memcpy(p, bh[k]->b_data + offset, avail_bytes);
 			p += avail_bytes;
-#if 0
-			BUG_ON(percpu->read_data + sizeof(percpu->read_data)
-			       < p);
-#endif
 
 			bytes += avail_bytes;
 			offset = 0;
 			brelse(bh[k]);
 		}
 
-		sbuf[Src].buf = percpu->read_data;
+		sbuf[Src].buf = decomp->read_data;
 		sbuf[Src].sz = bytes;
 		sbuf[Dst].buf = buffer;
 		sbuf[Dst].sz = srclength;
-		dpri_un(&percpu->un);
+		dpri_un(&decomp->un);
 		dpri("src %d %p, dst %d %p\n", sbuf[Src].sz, sbuf[Src].buf,
 		     sbuf[Dst].sz, sbuf[Dst].buf);
-		zlib_err = sqlzma_un(&percpu->un, sbuf + Src, sbuf + Dst);
-		bytes = percpu->un.un_reslen;
-
-#ifdef KeepPreemptive
-		mutex_unlock(&percpu->mtx);
-#else
-		put_cpu_var(sqlzma);
-#endif
+		t = squashfs_clock_ns();
+		zlib_err = sqlzma_un(&decomp->un, sbuf + Src, sbuf + Dst);
+		bytes = decomp->un.un_reslen;
+		msblk->stats.decomp_ns += squashfs_clock_ns() - t;
+		msblk->stats.decomp_calls++;
+
+		if (own)
+			squashfs_put_decomp(msblk, own);
 		if (unlikely(zlib_err)) {
 			dpri("zlib_err %d\n", zlib_err);
 			goto release_mutex;
@@ -399,108 +499,267 @@ read_failure:
 }
 
 
-SQSH_EXTERN int squashfs_get_cached_block(struct super_block *s, void *buffer,
-				long long block, unsigned int offset,
-				int length, long long *next_block,
-				unsigned int *next_offset)
+SQSH_EXTERN unsigned int squashfs_read_data(struct super_block *s, char *buffer,
+			long long index, unsigned int length,
+			long long *next_index, int srclength)
 {
-	struct squashfs_sb_info *msblk = s->s_fs_info;
-	int n, i, bytes, return_length = length;
-	long long next_index;
+	return read_data(s, buffer, index, length, next_index, srclength, NULL);
+}
 
-	TRACE("Entered squashfs_get_cached_block [%llx:%x]\n", block, offset);
 
-	while (1) {
-		for (i = 0; i < squashfs_cached_blks; i++) 
-			if (msblk->block_cache[i].block == block)
-				break; 
-		
-		down(&msblk->block_cache_mutex);
+/*
+ * Find @block in the block cache and take a reference to it.  Called
+ * with cache_mutex held.
+ */
+static struct squashfs_cache_entry *squashfs_cache_find(struct
+				squashfs_sb_info *msblk, long long block)
+{
+	struct squashfs_cache_entry *entry;
+
+	list_for_each_entry(entry, &msblk->cache_lru, lru)
+		if (entry->block == block) {
+			if (entry->refcount++ == 0)
+				msblk->cache_idle--;
+			list_move(&entry->lru, &msblk->cache_lru);
+			return entry;
+		}
+	return NULL;
+}
 
-		if (i == squashfs_cached_blks) {
-			/* read inode header block */
-			if (msblk->unused_cache_blks == 0) {
-				up(&msblk->block_cache_mutex);
-				wait_event(msblk->waitq, msblk->unused_cache_blks);
-				continue;
-			}
 
-			i = msblk->next_cache;
-			for (n = 0; n < squashfs_cached_blks; n++) {
-				if (msblk->block_cache[i].block != SQUASHFS_USED_BLK)
-					break;
-				i = (i + 1) % squashfs_cached_blks;
-			}
+static void squashfs_cache_put(struct squashfs_sb_info *msblk,
+				struct squashfs_cache_entry *entry)
+{
+	int wake = 0;
+
+	down(&msblk->cache_mutex);
+	if (--entry->refcount == 0) {
+		if (entry->error) {
+			/* already off the LRU list */
+			vfree(entry->data);
+			kfree(entry);
+		} else {
+			msblk->cache_idle++;
+			wake = 1;
+		}
+	}
+	up(&msblk->cache_mutex);
+	if (wake)
+		wake_up(&msblk->cache_wait);
+}
 
-			msblk->next_cache = (i + 1) % squashfs_cached_blks;
 
-			if (msblk->block_cache[i].block == SQUASHFS_INVALID_BLK) {
-				msblk->block_cache[i].data = vmalloc(SQUASHFS_METADATA_SIZE);
-				if (msblk->block_cache[i].data == NULL) {
-					ERROR("Failed to allocate cache block\n");
-					up(&msblk->block_cache_mutex);
-					goto out;
-				}
-			}
-	
-			msblk->block_cache[i].block = SQUASHFS_USED_BLK;
-			msblk->unused_cache_blks --;
-			up(&msblk->block_cache_mutex);
-
-			msblk->block_cache[i].length = squashfs_read_data(s,
-				msblk->block_cache[i].data, block, 0, &next_index,
-				SQUASHFS_METADATA_SIZE);
-
-			if (msblk->block_cache[i].length == 0) {
-				ERROR("Unable to read cache block [%llx:%x]\n", block, offset);
-				down(&msblk->block_cache_mutex);
-				msblk->block_cache[i].block = SQUASHFS_INVALID_BLK;
-				msblk->unused_cache_blks ++;
-				smp_mb();
-				vfree(msblk->block_cache[i].data);
-				wake_up(&msblk->waitq);
-				up(&msblk->block_cache_mutex);
-				goto out;
-			}
+/*
+ * Wait for a referenced entry that another reader may still be filling.
+ * Returns the entry, or NULL (and drops the reference) if the read failed.
+ */
+static struct squashfs_cache_entry *squashfs_cache_wait(struct
+				squashfs_sb_info *msblk,
+				struct squashfs_cache_entry *entry)
+{
+	if (entry->pending)
+		wait_event(msblk->cache_wait, !entry->pending);
+	if (entry->error) {
+		squashfs_cache_put(msblk, entry);
+		return NULL;
+	}
+	return entry;
+}
 
-			down(&msblk->block_cache_mutex);
-			msblk->block_cache[i].block = block;
-			msblk->block_cache[i].next_index = next_index;
-			msblk->unused_cache_blks ++;
-			smp_mb();
-			wake_up(&msblk->waitq);
-			TRACE("Read cache block [%llx:%x]\n", block, offset);
-		}
 
-		if (msblk->block_cache[i].block != block) {
-			up(&msblk->block_cache_mutex);
+/*
+ * Evict unreferenced entries, least recently used first, until @size
+ * more bytes fit in the cache.  An evicted buffer of exactly @size is
+ * handed back for reuse rather than freed.  Called with cache_mutex
+ * held; returns -1 if everything left is in use.
+ */
+static int squashfs_cache_evict(struct squashfs_sb_info *msblk,
+				unsigned int size,
+				struct squashfs_cache_entry **reuse)
+{
+	struct squashfs_cache_entry *entry;
+	struct list_head *p, *prev;
+
+	for (p = msblk->cache_lru.prev; p != &msblk->cache_lru &&
+			msblk->cache_bytes + size > msblk->cache_max; p = prev) {
+		prev = p->prev;
+		entry = list_entry(p, struct squashfs_cache_entry, lru);
+		if (entry->refcount)
 			continue;
+		list_del(&entry->lru);
+		msblk->cache_bytes -= entry->size;
+		msblk->cache_idle--;
+		msblk->stats.cache_evictions++;
+		if (*reuse == NULL && entry->size == size)
+			*reuse = entry;
+		else {
+			vfree(entry->data);
+			kfree(entry);
+		}
+	}
+	return msblk->cache_bytes + size <= msblk->cache_max ? 0 : -1;
+}
+
+
+/*
+ * Return the decompressed block at @block from the block cache, reading
+ * it with read_data() on a miss.  @length and @srclength are as for
+ * read_data(), @length 0 meaning a metadata block.  The entry comes back
+ * referenced and must be released with squashfs_cache_put().
+ */
+static struct squashfs_cache_entry *squashfs_cache_get(struct super_block *s,
+				long long block, unsigned int length,
+				int srclength)
+{
+	struct squashfs_sb_info *msblk = s->s_fs_info;
+	struct squashfs_cache_entry *entry;
+	unsigned int size = length ? msblk->sblk.block_size :
+				SQUASHFS_METADATA_SIZE;
+
+	while (1) {
+		down(&msblk->cache_mutex);
+		entry = squashfs_cache_find(msblk, block);
+		if (entry) {
+			if (length)
+				msblk->stats.data_hits++;
+			else
+				msblk->stats.meta_hits++;
+			up(&msblk->cache_mutex);
+			return squashfs_cache_wait(msblk, entry);
+		}
+
+		if (squashfs_cache_evict(msblk, size, &entry) == 0)
+			break;
+		/* every entry is in use, wait for one to be released */
+		up(&msblk->cache_mutex);
+		if (entry) {
+			vfree(entry->data);
+			kfree(entry);
+		}
+		wait_event(msblk->cache_wait, msblk->cache_idle);
+	}
+
+	if (entry == NULL) {
+		entry = kmalloc(sizeof(struct squashfs_cache_entry), GFP_KERNEL);
+		if (entry && (entry->data = vmalloc(size)) == NULL) {
+			kfree(entry);
+			entry = NULL;
+		}
+		if (entry == NULL) {
+			ERROR("Failed to allocate cache block\n");
+			up(&msblk->cache_mutex);
+			goto out;
+		}
+	}
+	entry->block = block;
+	entry->size = size;
+	entry->refcount = 1;
+	entry->pending = 1;
+	entry->error = 0;
+	list_add(&entry->lru, &msblk->cache_lru);
+	msblk->cache_bytes += size;
+	if (length)
+		msblk->stats.data_misses++;
+	else
+		msblk->stats.meta_misses++;
+	up(&msblk->cache_mutex);
+
+	entry->length = read_data(s, entry->data, block, length,
+				&entry->next_index, srclength, NULL);
+
+	down(&msblk->cache_mutex);
+	if (entry->length == 0) {
+		list_del(&entry->lru);
+		msblk->cache_bytes -= size;
+		entry->block = SQUASHFS_INVALID_BLK;
+		entry->error = 1;
+	}
+	entry->pending = 0;
+	up(&msblk->cache_mutex);
+	wake_up_all(&msblk->cache_wait);
+
+	return squashfs_cache_wait(msblk, entry);
+
+out:
+	return NULL;
+}
+
+
+/*
+ * Like squashfs_cache_get(), but only returns blocks already cached.
+ */
+static struct squashfs_cache_entry *squashfs_cache_peek(struct
+				squashfs_sb_info *msblk, long long block)
+{
+	struct squashfs_cache_entry *entry;
+
+	down(&msblk->cache_mutex);
+	entry = squashfs_cache_find(msblk, block);
+	if (entry)
+		msblk->stats.data_hits++;
+	up(&msblk->cache_mutex);
+
+	return entry ? squashfs_cache_wait(msblk, entry) : NULL;
+}
+
+
+static void squashfs_cache_destroy(struct squashfs_sb_info *msblk)
+{
+	struct squashfs_cache_entry *entry;
+
+	while (!list_empty(&msblk->cache_lru)) {
+		entry = list_entry(msblk->cache_lru.next,
+					struct squashfs_cache_entry, lru);
+		list_del(&entry->lru);
+		vfree(entry->data);
+		kfree(entry);
+	}
+	msblk->cache_bytes = 0;
+}
+
+
+SQSH_EXTERN int squashfs_get_cached_block(struct super_block *s, void *buffer,
+				long long block, unsigned int offset,
+				int length, long long *next_block,
+				unsigned int *next_offset)
+{
+	struct squashfs_sb_info *msblk = s->s_fs_info;
+	struct squashfs_cache_entry *entry;
+	int bytes, return_length = length;
+
+	TRACE("Entered squashfs_get_cached_block [%llx:%x]\n", block, offset);
+
+	while (1) {
+		entry = squashfs_cache_get(s, block, 0, SQUASHFS_METADATA_SIZE);
+		if (entry == NULL) {
+			ERROR("Unable to read cache block [%llx:%x]\n", block, offset);
+			goto out;
 		}
 
-		bytes = msblk->block_cache[i].length - offset;
+		bytes = entry->length - offset;
 
 		if (bytes < 1) {
-			up(&msblk->block_cache_mutex);
+			squashfs_cache_put(msblk, entry);
 			goto out;
 		} else if (bytes >= length) {
 			if (buffer)
-				memcpy(buffer, msblk->block_cache[i].data + offset, length);
-			if (msblk->block_cache[i].length - offset == length) {
-				*next_block = msblk->block_cache[i].next_index;
+				memcpy(buffer, entry->data + offset, length);
+			if (entry->length - offset == length) {
+				*next_block = entry->next_index;
 				*next_offset = 0;
 			} else {
 				*next_block = block;
 				*next_offset = offset + length;
 			}
-			up(&msblk->block_cache_mutex);
+			squashfs_cache_put(msblk, entry);
 			goto finish;
 		} else {
 			if (buffer) {
-				memcpy(buffer, msblk->block_cache[i].data + offset, bytes);
+				memcpy(buffer, entry->data + offset, bytes);
 				buffer = (char *) buffer + bytes;
 			}
-			block = msblk->block_cache[i].next_index;
-			up(&msblk->block_cache_mutex);
+			block = entry->next_index;
+			squashfs_cache_put(msblk, entry);
 			length -= bytes;
 			offset = 0;
 		}
@@ -546,98 +805,24 @@ out:
 
 
 SQSH_EXTERN void release_cached_fragment(struct squashfs_sb_info *msblk,
-				struct squashfs_fragment_cache *fragment)
+				struct squashfs_cache_entry *fragment)
 {
-	down(&msblk->fragment_mutex);
-	fragment->locked --;
-	if (fragment->locked == 0) {
-		msblk->unused_frag_blks ++;
-		smp_mb();
-		wake_up(&msblk->fragment_wait_queue);
-	}
-	up(&msblk->fragment_mutex);
+	squashfs_cache_put(msblk, fragment);
 }
 
 
 SQSH_EXTERN
-struct squashfs_fragment_cache *get_cached_fragment(struct super_block *s,
+struct squashfs_cache_entry *get_cached_fragment(struct super_block *s,
 				long long start_block, int length)
 {
-	int i, n;
 	struct squashfs_sb_info *msblk = s->s_fs_info;
-	struct squashfs_super_block *sblk = &msblk->sblk;
-
-	while (1) {
-		down(&msblk->fragment_mutex);
-
-		for (i = 0; i < SQUASHFS_CACHED_FRAGMENTS &&
-				msblk->fragment[i].block != start_block; i++);
-
-		if (i == SQUASHFS_CACHED_FRAGMENTS) {
-			if (msblk->unused_frag_blks == 0) {
-				up(&msblk->fragment_mutex);
-				wait_event(msblk->fragment_wait_queue, msblk->unused_frag_blks);
-				continue;
-			}
-
-			i = msblk->next_fragment;
-			for (n = 0; n < SQUASHFS_CACHED_FRAGMENTS; n++) {
-				if (msblk->fragment[i].locked == 0)
-					break;
-				i = (i + 1) % SQUASHFS_CACHED_FRAGMENTS;
-			}
-
-			msblk->next_fragment = (msblk->next_fragment + 1) %
-				SQUASHFS_CACHED_FRAGMENTS;
-			
-			if (msblk->fragment[i].data == NULL) {
-				msblk->fragment[i].data = vmalloc(sblk->block_size);
-				if (msblk->fragment[i].data == NULL) {
-					ERROR("Failed to allocate fragment cache block\n");
-					up(&msblk->fragment_mutex);
-					goto out;
-				}
-			}
+	struct squashfs_cache_entry *fragment;
 
-			msblk->unused_frag_blks --;
-			msblk->fragment[i].block = SQUASHFS_INVALID_BLK;
-			msblk->fragment[i].locked = 1;
-			up(&msblk->fragment_mutex);
-
-			msblk->fragment[i].length = squashfs_read_data(s,
-				msblk->fragment[i].data, start_block, length, NULL,
-				sblk->block_size);
-
-			if (msblk->fragment[i].length == 0) {
-				ERROR("Unable to read fragment cache block [%llx]\n", start_block);
-				msblk->fragment[i].locked = 0;
-				msblk->unused_frag_blks ++;
-				smp_mb();
-				wake_up(&msblk->fragment_wait_queue);
-				goto out;
-			}
-
-			down(&msblk->fragment_mutex);
-			msblk->fragment[i].block = start_block;
-			TRACE("New fragment %d, start block %lld, locked %d\n",
-				i, msblk->fragment[i].block, msblk->fragment[i].locked);
-			up(&msblk->fragment_mutex);
-			break;
-		}
-
-		if (msblk->fragment[i].locked == 0)
-			msblk->unused_frag_blks --;
-		msblk->fragment[i].locked++;
-		up(&msblk->fragment_mutex);
-		TRACE("Got fragment %d, start block %lld, locked %d\n", i,
-			msblk->fragment[i].block, msblk->fragment[i].locked);
-		break;
-	}
-
-	return &msblk->fragment[i];
-
-out:
-	return NULL;
+	fragment = squashfs_cache_get(s, start_block, length,
+					msblk->sblk.block_size);
+	if (fragment == NULL)
+		ERROR("Unable to read fragment cache block [%llx]\n", start_block);
+	return fragment;
 }
 
 
@@ -800,6 +985,8 @@ static int squashfs_read_inode(struct inode *i, squashfs_inode_t inode)
 			SQUASHFS_I(i)->u.s1.fragment_offset = inodep->offset;
 			SQUASHFS_I(i)->start_block = inodep->start_block;
 			SQUASHFS_I(i)->u.s1.block_list_start = next_block;
+			SQUASHFS_I(i)->u.s1.ra_index = 0;
+			SQUASHFS_I(i)->u.s1.ra_end = 0;
 			SQUASHFS_I(i)->offset = next_offset;
 			i->i_data.a_ops = &squashfs_aops;
 
@@ -844,6 +1031,8 @@ static int squashfs_read_inode(struct inode *i, squashfs_inode_t inode)
 			SQUASHFS_I(i)->u.s1.fragment_offset = inodep->offset;
 			SQUASHFS_I(i)->start_block = inodep->start_block;
 			SQUASHFS_I(i)->u.s1.block_list_start = next_block;
+			SQUASHFS_I(i)->u.s1.ra_index = 0;
+			SQUASHFS_I(i)->u.s1.ra_end = 0;
 			SQUASHFS_I(i)->offset = next_offset;
 			i->i_data.a_ops = &squashfs_aops;
 
@@ -1081,34 +1270,6 @@ static int read_fragment_index_table(struct super_block *s)
 }
 
 
-static int readahead_metadata(struct super_block *s)
-{
-	struct squashfs_sb_info *msblk = s->s_fs_info;
-	int i;
-
-	squashfs_cached_blks = SQUASHFS_CACHED_BLKS;
-
-	/* Init inode_table block pointer array */
-	msblk->block_cache = kmalloc(sizeof(struct squashfs_cache) *
-					squashfs_cached_blks, GFP_KERNEL);
-	if (msblk->block_cache == NULL) {
-		ERROR("Failed to allocate block cache\n");
-		goto failed;
-	}
-
-	for (i = 0; i < squashfs_cached_blks; i++)
-		msblk->block_cache[i].block = SQUASHFS_INVALID_BLK;
-
-	msblk->next_cache = 0;
-	msblk->unused_cache_blks = squashfs_cached_blks;
-
-	return 1;
-
-failed:
-	return 0;
-}
-
-
 static int supported_squashfs_filesystem(struct squashfs_sb_info *msblk, int silent)
 {
 	struct squashfs_super_block *sblk = &msblk->sblk;
@@ -1143,11 +1304,98 @@ static int supported_squashfs_filesystem(struct squashfs_sb_info *msblk, int sil
 }
 
 
+static unsigned long hit_percent(unsigned long hits, unsigned long misses)
+{
+	unsigned long total = hits + misses;
+
+	if (total == 0)
+		return 0;
+	if (hits > ~0UL / 100)
+		return hits / (total / 100);
+	return hits * 100 / total;
+}
+
+
+/*
+ * /proc/fs/squashfs/<dev>/stats
+ */
+static int squashfs_stats_read(char *page, char **start, off_t off,
+			       int count, int *eof, void *data)
+{
+	struct super_block *s = data;
+	struct squashfs_sb_info *msblk = s->s_fs_info;
+	struct squashfs_stats *stats = &msblk->stats;
+	unsigned long long decomp_us = stats->decomp_ns;
+	unsigned long long wait_us = stats->decomp_wait_ns;
+	/* blocks decompressed into the page cache missed the cache too */
+	unsigned long data_misses = stats->data_misses + stats->direct_blocks;
+	int len;
+
+	do_div(decomp_us, 1000);
+	do_div(wait_us, 1000);
+	len = sprintf(page,
+		"decompressors %d\n"
+		"decompress %lu %llu us\n"
+		"decompressor_wait %lu %llu us\n"
+		"data_blocks direct %lu bounce %lu\n"
+		"cache %uK/%uK evictions %lu\n"
+		"cache_meta hits %lu misses %lu %lu%%\n"
+		"cache_data hits %lu misses %lu %lu%%\n"
+		"readahead_blocks %lu\n",
+		SQUASHFS_DECOMPRESSORS,
+		stats->decomp_calls, decomp_us,
+		stats->decomp_waits, wait_us,
+		stats->direct_blocks, stats->bounce_blocks,
+		msblk->cache_bytes >> 10, msblk->cache_max >> 10,
+		stats->cache_evictions,
+		stats->meta_hits, stats->meta_misses,
+		hit_percent(stats->meta_hits, stats->meta_misses),
+		stats->data_hits, data_misses,
+		hit_percent(stats->data_hits, data_misses),
+		stats->ra_blocks);
+
+	if (len <= off + count)
+		*eof = 1;
+	*start = page + off;
+	len -= off;
+	if (len > count)
+		len = count;
+	if (len < 0)
+		len = 0;
+	return len;
+}
+
+
+static void squashfs_proc_register(struct super_block *s)
+{
+	struct squashfs_sb_info *msblk = s->s_fs_info;
+
+	if (squashfs_proc_root == NULL)
+		return;
+	msblk->proc = proc_mkdir(s->s_id, squashfs_proc_root);
+	if (msblk->proc)
+		create_proc_read_entry("stats", 0, msblk->proc,
+					squashfs_stats_read, s);
+}
+
+
+static void squashfs_proc_unregister(struct super_block *s)
+{
+	struct squashfs_sb_info *msblk = s->s_fs_info;
+
+	if (msblk->proc == NULL)
+		return;
+	remove_proc_entry("stats", msblk->proc);
+	remove_proc_entry(s->s_id, squashfs_proc_root);
+	msblk->proc = NULL;
+}
+
+
 static int squashfs_fill_super(struct super_block *s, void *data, int silent)
 {
 	struct squashfs_sb_info *msblk;
 	struct squashfs_super_block *sblk;
-	int i, err;
+	int err;
 	char b[BDEVNAME_SIZE];
 	struct inode *root;
 
@@ -1167,13 +1415,13 @@ static int squashfs_fill_super(struct super_block *s, void *data, int silent)
 	msblk->devblksize_log2 = ffz(~msblk->devblksize);
 
 	/* init_MUTEX(&msblk->read_data_mutex); */
-	init_MUTEX(&msblk->read_page_mutex);
-	init_MUTEX(&msblk->block_cache_mutex);
-	init_MUTEX(&msblk->fragment_mutex);
+	INIT_LIST_HEAD(&msblk->decomp_free);
+	spin_lock_init(&msblk->decomp_lock);
+	init_waitqueue_head(&msblk->decomp_wait);
+	INIT_LIST_HEAD(&msblk->cache_lru);
+	init_MUTEX(&msblk->cache_mutex);
+	init_waitqueue_head(&msblk->cache_wait);
 	init_MUTEX(&msblk->meta_index_mutex);
-	
-	init_waitqueue_head(&msblk->waitq);
-	init_waitqueue_head(&msblk->fragment_wait_queue);
 
 	/* sblk->bytes_used is checked in squashfs_read_data to ensure reads are not
  	 * beyond filesystem end.  As we're using squashfs_read_data to read sblk here,
@@ -1213,17 +1461,18 @@ static int squashfs_fill_super(struct super_block *s, void *data, int silent)
 		goto failed_mount;
 	}
 
-	{
-		struct sqlzma *p;
-		dpri("block_size %d, devblksize %d\n",
-		     sblk->block_size, msblk->devblksize);
-		BUG_ON(sblk->block_size > sizeof(p->read_data));
-	}
+	dpri("block_size %d, devblksize %d\n",
+	     sblk->block_size, msblk->devblksize);
 
 	/* Check the MAJOR & MINOR versions */
 	if(!supported_squashfs_filesystem(msblk, silent))
 		goto failed_mount;
 
+	if (sblk->block_size > SQUASHFS_FILE_MAX_SIZE) {
+		SERROR("Block size %d too big\n", sblk->block_size);
+		goto failed_mount;
+	}
+
 	/* Check the filesystem does not extend beyond the end of the
 	   block device */
 	if(sblk->bytes_used < 0 || sblk->bytes_used > i_size_read(s->s_bdev->bd_inode))
@@ -1257,16 +1506,14 @@ static int squashfs_fill_super(struct super_block *s, void *data, int silent)
 	s->s_flags |= MS_RDONLY;
 	s->s_op = &squashfs_super_ops;
 
-	if (readahead_metadata(s) == 0)
-		goto failed_mount;
-
-	/* Allocate read_page block */
+	/* Decompressors, needed before any metadata can be read */
 	err = -ENOMEM;
-	msblk->read_page = vmalloc(sblk->block_size);
-	if (msblk->read_page == NULL) {
-		ERROR("Failed to allocate read_page block\n");
+	if (squashfs_init_decomp_pool(msblk) == 0)
 		goto failed_mount;
-	}
+
+	/* room for the metadata blocks and fragments the old caches held */
+	msblk->cache_max = SQUASHFS_CACHED_BLKS * SQUASHFS_METADATA_SIZE +
+				SQUASHFS_CACHED_FRAGMENTS * sblk->block_size;
 
 	/* Allocate uid and gid tables */
 	msblk->uid = kmalloc((sblk->no_uids + sblk->no_guids) *
@@ -1314,21 +1561,6 @@ static int squashfs_fill_super(struct super_block *s, void *data, int silent)
 	if (sblk->s_major == 1 && squashfs_1_0_supported(msblk))
 		goto allocate_root;
 
-	err = -ENOMEM;
-	msblk->fragment = kzalloc(sizeof(struct squashfs_fragment_cache) *
-				SQUASHFS_CACHED_FRAGMENTS, GFP_KERNEL);
-	if (msblk->fragment == NULL) {
-		ERROR("Failed to allocate fragment block cache\n");
-		goto failed_mount;
-	}
-
-	for (i = 0; i < SQUASHFS_CACHED_FRAGMENTS; i++) {
-		msblk->fragment[i].block = SQUASHFS_INVALID_BLK;
-	}
-
-	msblk->next_fragment = 0;
-	msblk->unused_frag_blks = SQUASHFS_CACHED_FRAGMENTS;
-
 	/* Allocate and read fragment index table */
 	if (msblk->read_fragment_index_table(s) == 0)
 		goto failed_mount;
@@ -1359,16 +1591,17 @@ allocate_root:
 		goto failed_mount;
 	}
 
+	squashfs_proc_register(s);
+
 	TRACE("Leaving squashfs_fill_super\n");
 	return 0;
 
 failed_mount:
 	kfree(msblk->inode_lookup_table);
 	kfree(msblk->fragment_index);
-	kfree(msblk->fragment);
 	kfree(msblk->uid);
-	vfree(msblk->read_page);
-	kfree(msblk->block_cache);
+	squashfs_cache_destroy(msblk);
+	squashfs_free_decomp_pool(msblk);
 	kfree(msblk->fragment_index_2);
 	kfree(s->s_fs_info);
 	s->s_fs_info = NULL;
@@ -1701,7 +1934,9 @@ static long long read_blocklist(struct inode *inode, int index,
 		index -= blocks;
 	}
 
-	if (read_block_index(inode->i_sb, 1, block_list, &block_ptr, &offset) == -1)
+	/* the caller may want the sizes of following blocks too */
+	if (read_block_index(inode->i_sb, readahead_blks, block_list, &block_ptr,
+				&offset) == -1)
 		goto failure;
 	*bsize = *((unsigned int *) block_list);
 
@@ -1712,6 +1947,137 @@ failure:
 }
 
 
+/*
+ * Start reading the compressed blocks after @index, which is at @block,
+ * so that their I/O overlaps the decompression of @index.  @block_list
+ * holds the sizes of @index and the @blocks - 1 blocks following it.
+ * The buffers are read with READA into the block device's page cache,
+ * where read_data() will find them.
+ */
+static void squashfs_readahead(struct inode *inode, int index, long long block,
+				unsigned int *block_list, int blocks)
+{
+	struct super_block *s = inode->i_sb;
+	struct squashfs_sb_info *msblk = s->s_fs_info;
+	struct squashfs_inode_info *ei = SQUASHFS_I(inode);
+	struct buffer_head **bh;
+	unsigned int c_byte;
+	int i, b, n;
+
+	bh = kmalloc(((msblk->sblk.block_size >> msblk->devblksize_log2) + 1) *
+				sizeof(struct buffer_head *), GFP_KERNEL);
+	if (bh == NULL)
+		return;
+
+	for (i = 0; i < blocks; i++, block += c_byte) {
+		long long first, last;
+
+		c_byte = SQUASHFS_COMPRESSED_SIZE_BLOCK(block_list[i]);
+		if (i == 0 || index + i <= ei->u.s1.ra_end || c_byte == 0)
+			continue;
+		if (block + c_byte > msblk->sblk.bytes_used)
+			break;
+
+		first = block >> msblk->devblksize_log2;
+		last = (block + c_byte - 1) >> msblk->devblksize_log2;
+		for (n = 0; first + n <= last; n++) {
+			bh[n] = sb_getblk(s, first + n);
+			if (bh[n] == NULL)
+				break;
+		}
+		ll_rw_block(READA, n, bh);
+		for (b = 0; b < n; b++)
+			brelse(bh[b]);
+		msblk->stats.ra_blocks++;
+	}
+	ei->u.s1.ra_end = index + blocks - 1;
+	kfree(bh);
+}
+
+
+/*
+ * Decompress a whole data block straight into its page cache pages,
+ * mapped contiguously with vmap(), instead of into a decompressor's
+ * output buffer and then copying.  Returns 0, leaving @page locked, if
+ * not all the pages could be had, or one of them is already uptodate
+ * and must not be written over; the caller then goes through the
+ * bounce buffer.  Otherwise the block has been read (or has failed) and
+ * all the pages, @page included, are unlocked.
+ */
+static int squashfs_readpage_direct(struct page *page, long long block,
+				unsigned int bsize, int start_index, int npages)
+{
+	struct inode *inode = page->mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	struct squashfs_decomp *decomp;
+	struct page **pages;
+	void *vaddr;
+	int i, n, bytes = 0, mapped = 0;
+
+	pages = kmalloc(npages * sizeof(struct page *), GFP_KERNEL);
+	if (pages == NULL)
+		return 0;
+
+	for (n = 0; n < npages; n++) {
+		if (start_index + n == page->index)
+			pages[n] = page;
+		else {
+			pages[n] = grab_cache_page_nowait(page->mapping,
+							start_index + n);
+			if (pages[n] == NULL)
+				goto release;
+			if (PageUptodate(pages[n])) {
+				n++;
+				goto release;
+			}
+		}
+	}
+
+	vaddr = vmap(pages, npages, VM_MAP, PAGE_KERNEL);
+	if (vaddr == NULL)
+		goto release;
+	mapped = 1;
+
+	decomp = squashfs_get_decomp(msblk);
+	bytes = read_data(inode->i_sb, vaddr, block, bsize, NULL,
+				npages << PAGE_CACHE_SHIFT, decomp);
+	squashfs_put_decomp(msblk, decomp);
+	if (bytes)
+		memset(vaddr + bytes, 0, (npages << PAGE_CACHE_SHIFT) - bytes);
+	else
+		ERROR("Unable to read page, block %llx, size %x\n", block, bsize);
+	/* on ARM this also writes the data back from the vmap alias */
+	vunmap(vaddr);
+
+release:
+	for (i = 0; i < n; i++) {
+		/* only pages the block actually reached are uptodate */
+		int filled = (i << PAGE_CACHE_SHIFT) < bytes;
+
+		if (pages[i] == page) {
+			if (!mapped)
+				continue;
+			if (!filled)
+				SetPageError(page);
+		}
+		if (filled) {
+			flush_dcache_page(pages[i]);
+			SetPageUptodate(pages[i]);
+		}
+		unlock_page(pages[i]);
+		if (pages[i] != page)
+			page_cache_release(pages[i]);
+	}
+	kfree(pages);
+
+	if (mapped)
+		msblk->stats.direct_blocks++;
+	else
+		msblk->stats.bounce_blocks++;
+	return mapped;
+}
+
+
 static int squashfs_readpage(struct file *file, struct page *page)
 {
 	struct inode *inode = page->mapping->host;
@@ -1723,8 +2089,8 @@ static int squashfs_readpage(struct file *file, struct page *page)
 	int bytes;
 	int index = page->index >> (sblk->block_log - PAGE_CACHE_SHIFT);
  	void *pageaddr;
-	struct squashfs_fragment_cache *fragment = NULL;
-	char *data_ptr = msblk->read_page;
+	struct squashfs_cache_entry *fragment = NULL, *entry = NULL;
+	char *data_ptr = NULL;
 	
 	int mask = (1 << (sblk->block_log - PAGE_CACHE_SHIFT)) - 1;
 	int start_index = page->index & ~mask;
@@ -1741,31 +2107,68 @@ static int squashfs_readpage(struct file *file, struct page *page)
 
 	if (SQUASHFS_I(inode)->u.s1.fragment_start_block == SQUASHFS_INVALID_BLK
 					|| index < file_end) {
+		struct squashfs_inode_info *ei = SQUASHFS_I(inode);
+		int blocks = SQUASHFS_I(inode)->u.s1.fragment_start_block ==
+			SQUASHFS_INVALID_BLK ? (i_size_read(inode) +
+			sblk->block_size - 1) >> sblk->block_log : file_end;
+		int readahead = 1;
+
 		block_list = kmalloc(SIZE, GFP_KERNEL);
 		if (block_list == NULL) {
 			ERROR("Failed to allocate block_list\n");
 			goto error_out;
 		}
 
-		block = (msblk->read_blocklist)(inode, index, 1, block_list, NULL, &bsize);
+		/*
+		 * Sequential access: once less than half the read-ahead
+		 * window is left in flight, also fetch the sizes of the
+		 * following blocks and start reading them.
+		 */
+		if (index == ei->u.s1.ra_index) {
+			if (ei->u.s1.ra_end < index + (SQUASHFS_READAHEAD_BLOCKS + 1) / 2)
+				readahead = min_t(int, min(SQUASHFS_READAHEAD_BLOCKS + 1,
+						SIZE >> 2), blocks - index);
+		} else if (index != ei->u.s1.ra_index - 1)
+			ei->u.s1.ra_end = index;
+		ei->u.s1.ra_index = index + 1;
+
+		block = (msblk->read_blocklist)(inode, index, readahead, block_list,
+					NULL, &bsize);
 		if (block == 0)
 			goto error_out;
 
+		if (readahead > 1)
+			squashfs_readahead(inode, index, block,
+					(unsigned int *) block_list, readahead);
+
 		if (bsize == 0) { /* hole */
 			bytes = index == file_end ?
 				(i_size_read(inode) & (sblk->block_size - 1)) : sblk->block_size;
 			sparse = 1;
 		} else {
-			down(&msblk->read_page_mutex);
-		
-			bytes = squashfs_read_data(inode->i_sb, msblk->read_page, block,
-				bsize, NULL, sblk->block_size);
+			int pages = (i_size_read(inode) + PAGE_CACHE_SIZE - 1)
+						>> PAGE_CACHE_SHIFT;
+
+			/* left in the block cache by an earlier bounced read? */
+			entry = squashfs_cache_peek(msblk, block);
+
+			if (entry == NULL) {
+				if (squashfs_readpage_direct(page, block, bsize,
+						start_index,
+						min(end_index, pages - 1) - start_index + 1)) {
+					kfree(block_list);
+					return 0;
+				}
 
-			if (bytes == 0) {
-				ERROR("Unable to read page, block %llx, size %x\n", block, bsize);
-				up(&msblk->read_page_mutex);
-				goto error_out;
+				entry = squashfs_cache_get(inode->i_sb, block, bsize,
+						sblk->block_size);
+				if (entry == NULL) {
+					ERROR("Unable to read page, block %llx, size %x\n", block, bsize);
+					goto error_out;
+				}
 			}
+			bytes = entry->length;
+			data_ptr = entry->data;
 		}
 	} else {
 		fragment = get_cached_fragment(inode->i_sb,
@@ -1813,7 +2216,7 @@ skip_page:
 	if (SQUASHFS_I(inode)->u.s1.fragment_start_block == SQUASHFS_INVALID_BLK
 					|| index < file_end) {
 		if (!sparse)
-			up(&msblk->read_page_mutex);
+			squashfs_cache_put(msblk, entry);
 		kfree(block_list);
 	} else
 		release_cached_fragment(msblk, fragment);
@@ -2174,20 +2577,11 @@ static int squashfs_remount(struct super_block *s, int *flags, char *data)
 
 static void squashfs_put_super(struct super_block *s)
 {
-	int i;
-
 	if (s->s_fs_info) {
 		struct squashfs_sb_info *sbi = s->s_fs_info;
-		if (sbi->block_cache)
-			for (i = 0; i < squashfs_cached_blks; i++)
-				if (sbi->block_cache[i].block != SQUASHFS_INVALID_BLK)
-					vfree(sbi->block_cache[i].data);
-		if (sbi->fragment)
-			for (i = 0; i < SQUASHFS_CACHED_FRAGMENTS; i++) 
-				vfree(sbi->fragment[i].data);
-		kfree(sbi->fragment);
-		kfree(sbi->block_cache);
-		vfree(sbi->read_page);
+		squashfs_proc_unregister(s);
+		squashfs_cache_destroy(sbi);
+		squashfs_free_decomp_pool(sbi);
 		kfree(sbi->uid);
 		kfree(sbi->fragment_index);
 		kfree(sbi->fragment_index_2);
@@ -2204,63 +2598,22 @@ static struct super_block *squashfs_get_sb(struct file_system_type *fs_type, int
 	return get_sb_bdev(fs_type, flags, dev_name, data, squashfs_fill_super);
 }
 
-static void free_sqlzma(void)
-{
-	int cpu;
-	struct sqlzma *p;
-
-	for_each_online_cpu(cpu) {
-		p = per_cpu(sqlzma, cpu);
-		if (p) {
-#ifdef KeepPreemptive
-			mutex_destroy(&p->mtx);
-#endif
-			sqlzma_fin(&p->un);
-			vfree(p);
-		}
-	}
-}
-
 static int __init init_squashfs_fs(void)
 {
-	struct sqlzma *p;
-	int cpu;
 	int err = init_inodecache();
 	if (err)
 		goto out;
 
-	for_each_online_cpu(cpu) {
-		dpri("%d: %p\n", cpu, per_cpu(sqlzma, cpu));
-		err = -ENOMEM;
-		p = vmalloc(sizeof(struct sqlzma));
-		if (p) {
-#ifdef KeepPreemptive
-			mutex_init(&p->mtx);
-#endif
-			err = sqlzma_init(&p->un, 1, 0);
-			if (unlikely(err)) {
-				ERROR("Failed to intialize uncompress workspace\n");
-				break;
-			}
-			per_cpu(sqlzma, cpu) = p;
-			err = 0;
-		} else
-			break;
-	}
-	if (unlikely(err)) {
-		free_sqlzma();
-		goto out;
-	}
-
 	printk(KERN_INFO "squashfs: version 3.3 (2007/10/31) "
 		"Phillip Lougher\n"
 		"squashfs: LZMA suppport for slax.org by jro\n");
 
 	err = register_filesystem(&squashfs_fs_type);
 	if (err) {
-		free_sqlzma();
 		destroy_inodecache();
+		goto out;
 	}
+	squashfs_proc_root = proc_mkdir("fs/squashfs", NULL);
 
 out:
 	return err;
@@ -2270,7 +2623,8 @@ out:
 static void __exit exit_squashfs_fs(void)
 {
 	unregister_filesystem(&squashfs_fs_type);
-	free_sqlzma();
+	if (squashfs_proc_root)
+		remove_proc_entry("fs/squashfs", NULL);
 	destroy_inodecache();
 }
 
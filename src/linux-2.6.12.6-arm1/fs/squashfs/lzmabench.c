@@ -0,0 +1,247 @@
+/*
+ * lzmabench - compare the LZMA decoders used by squashfs
+ *
+ * Userspace harness, not part of the kernel build:
+ *
+ *	cc -O2 -o lzmabench lzmabench.c LzmaDecode.c LzmaDecodeFast.c
+ *	arm-linux-gcc -O2 -mcpu=arm926ej-s -o lzmabench \
+ *		lzmabench.c LzmaDecode.c LzmaDecodeFast.c
+ *
+ *	lzmabench [-n loops] image...
+ *
+ * Every LZMA block in the given files (squashfs images, or anything else
+ * holding sqlzma blocks: 5 property bytes, a 64-bit size and the stream)
+ * is found by scanning for the property byte and checking that the
+ * reference decoder accepts what follows.  All blocks are then decoded
+ * @loops times by LzmaDecode() and LzmaDecodeFast(), their output is
+ * compared and the throughput of each is reported.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2,
+ * or (at your option) any later version.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "sqlzma.h"
+#include "LzmaDecode.h"
+
+/* squashfs blocks are at most 1M, and the header is 13 bytes */
+#define MAX_BLOCK	(1 << 20)
+#define HEADER_SIZE	(LZMA_PROPERTIES_SIZE + 8)
+
+typedef int (*decode_fn)(CLzmaDecoderState *vs,
+		const unsigned char *inStream, SizeT inSize,
+		SizeT *inSizeProcessed, unsigned char *outStream,
+		SizeT outSize, SizeT *outSizeProcessed);
+
+struct block {
+	const unsigned char	*data;		/* header and stream */
+	unsigned int		len;
+	unsigned int		outlen;
+};
+
+static struct block *blocks;
+static int nr_blocks, max_blocks;
+static unsigned long long in_bytes, out_bytes;
+
+static CProb *probs;
+static unsigned char *out, *out_ref;
+
+static int decode(decode_fn fn, const struct block *b, unsigned char *dst,
+		  SizeT *in_done)
+{
+	CLzmaDecoderState state;
+	SizeT in, done;
+	int err;
+
+	if (LzmaDecodeProperties(&state.Properties, b->data,
+				 LZMA_PROPERTIES_SIZE) != LZMA_RESULT_OK)
+		return -1;
+	state.Probs = probs;
+	err = fn(&state, b->data + HEADER_SIZE, b->len - HEADER_SIZE, &in,
+		 dst, b->outlen, &done);
+	if (err != LZMA_RESULT_OK || done != b->outlen)
+		return -1;
+	if (in_done)
+		*in_done = in;
+	return 0;
+}
+
+static void add_block(const unsigned char *data, unsigned int len,
+		      unsigned int outlen)
+{
+	if (nr_blocks == max_blocks) {
+		max_blocks = max_blocks ? max_blocks * 2 : 256;
+		blocks = realloc(blocks, max_blocks * sizeof(*blocks));
+		if (blocks == NULL) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	blocks[nr_blocks].data = data;
+	blocks[nr_blocks].len = len;
+	blocks[nr_blocks].outlen = outlen;
+	nr_blocks++;
+	in_bytes += len;
+	out_bytes += outlen;
+}
+
+/*
+ * A block starts with the properties byte 0x5d (lc 3, lp 0, pb 2, the
+ * only ones sqlzma writes), a power of two dictionary size and a 64-bit
+ * uncompressed size of at most 1M.
+ */
+static int scan(const unsigned char *img, size_t size)
+{
+	size_t off = 0;
+	int found = 0;
+
+	while (off + HEADER_SIZE < size) {
+		const unsigned char *h = img + off;
+		unsigned int dict, outlen;
+		struct block b;
+		SizeT in;
+
+		if (!is_lzma(h[0]))
+			goto next;
+		dict = h[1] | h[2] << 8 | h[3] << 16 | (unsigned int)h[4] << 24;
+		outlen = h[5] | h[6] << 8 | h[7] << 16 | (unsigned int)h[8] << 24;
+		if (dict == 0 || (dict & (dict - 1)) || h[9] || h[10] ||
+		    h[11] || h[12] || outlen == 0 || outlen > MAX_BLOCK)
+			goto next;
+
+		b.data = h;
+		b.len = size - off < MAX_BLOCK + HEADER_SIZE ?
+			size - off : MAX_BLOCK + HEADER_SIZE;
+		b.outlen = outlen;
+		if (decode(LzmaDecode, &b, out_ref, &in))
+			goto next;
+
+		add_block(h, HEADER_SIZE + in, outlen);
+		found++;
+		off += HEADER_SIZE + in;
+		continue;
+next:
+		off++;
+	}
+	return found;
+}
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static double run(const char *name, decode_fn fn, int loops)
+{
+	double start, secs;
+	int i, n, errors = 0;
+
+	start = now();
+	for (n = 0; n < loops; n++)
+		for (i = 0; i < nr_blocks; i++)
+			if (decode(fn, &blocks[i], out, NULL))
+				errors++;
+	secs = now() - start;
+
+	printf("%-16s %8.3f s %8.2f MB/s %8.1f us/block",
+	       name, secs, out_bytes * loops / secs / 1e6,
+	       secs * 1e6 / ((double)nr_blocks * loops));
+	if (errors)
+		printf("  %d ERRORS", errors);
+	printf("\n");
+	return secs;
+}
+
+static unsigned char *load(const char *path, size_t *size)
+{
+	unsigned char *img;
+	FILE *f;
+	long len;
+
+	f = fopen(path, "rb");
+	if (f == NULL || fseek(f, 0, SEEK_END) || (len = ftell(f)) < 0) {
+		perror(path);
+		exit(1);
+	}
+	rewind(f);
+	img = malloc(len + 1);
+	if (img == NULL || fread(img, 1, len, f) != (size_t)len) {
+		perror(path);
+		exit(1);
+	}
+	fclose(f);
+	*size = len;
+	return img;
+}
+
+int main(int argc, char *argv[])
+{
+	int i, c, loops = 10, mismatches = 0;
+	double ref, fast;
+
+	while ((c = getopt(argc, argv, "n:")) != -1) {
+		switch (c) {
+		case 'n':
+			loops = atoi(optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind == argc || loops < 1)
+		goto usage;
+
+	/* the largest lc + lp sqlzma allows */
+	probs = malloc((LZMA_BASE_SIZE + (LZMA_LIT_SIZE << 12)) * sizeof(CProb));
+	out = malloc(MAX_BLOCK);
+	out_ref = malloc(MAX_BLOCK);
+	if (probs == NULL || out == NULL || out_ref == NULL) {
+		perror("malloc");
+		return 1;
+	}
+
+	for (i = optind; i < argc; i++) {
+		unsigned char *img;
+		size_t size;
+
+		img = load(argv[i], &size);
+		printf("%s: %d LZMA blocks\n", argv[i], scan(img, size));
+	}
+	if (nr_blocks == 0) {
+		fprintf(stderr, "no LZMA blocks found\n");
+		return 1;
+	}
+	printf("%d blocks, %llu bytes compressed, %llu decompressed\n",
+	       nr_blocks, in_bytes, out_bytes);
+
+	/* the fast decoder must produce exactly the reference output */
+	for (i = 0; i < nr_blocks; i++) {
+		memset(out, 0, blocks[i].outlen);
+		if (decode(LzmaDecode, &blocks[i], out_ref, NULL) ||
+		    decode(LzmaDecodeFast, &blocks[i], out, NULL) ||
+		    memcmp(out, out_ref, blocks[i].outlen)) {
+			fprintf(stderr, "block %d: output differs\n", i);
+			mismatches++;
+		}
+	}
+
+	ref = run("LzmaDecode", LzmaDecode, loops);
+	fast = run("LzmaDecodeFast", LzmaDecodeFast, loops);
+	printf("speedup %.2fx\n", ref / fast);
+
+	return mismatches ? 1 : 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-n loops] image...\n", argv[0]);
+	return 2;
+}
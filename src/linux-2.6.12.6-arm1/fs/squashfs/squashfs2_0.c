@@ -227,6 +227,8 @@ static int squashfs_read_inode_2(struct inode *i, squashfs_inode_t inode)
 			SQUASHFS_I(i)->u.s1.fragment_offset = inodep->offset;
 			SQUASHFS_I(i)->start_block = inodep->start_block;
 			SQUASHFS_I(i)->u.s1.block_list_start = next_block;
+			SQUASHFS_I(i)->u.s1.ra_index = 0;
+			SQUASHFS_I(i)->u.s1.ra_end = 0;
 			SQUASHFS_I(i)->offset = next_offset;
 			i->i_data.a_ops = &squashfs_aops;
 
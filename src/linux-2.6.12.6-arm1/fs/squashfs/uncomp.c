@@ -90,8 +90,13 @@ static int LzmaUncompress(struct sqlzma_un *un)
 	srclen = un->un_cmlen - (src - un->un_cmbuf);
 
 	/* Decompress */
+#ifdef CONFIG_SQUASHFS_LZMA_FAST
+	err = LzmaDecodeFast(&state, src, srclen, &inProcessed, dst, outSize,
+			     &outProcessed);
+#else
 	err = LzmaDecode(&state, src, srclen, &inProcessed, dst, outSize,
 			 &outProcessed);
+#endif
 	if (unlikely(err))
 		err = -EINVAL;
 
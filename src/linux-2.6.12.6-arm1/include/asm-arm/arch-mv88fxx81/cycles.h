@@ -0,0 +1,62 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef __ASM_ARCH_CYCLES_H
+#define __ASM_ARCH_CYCLES_H
+
+/*
+ * Tclk cycle timestamps from the free running SoC counter (the watchdog
+ * counter, started by mvCntmrFreeRunStart() from mv_time_init()).
+ *
+ * mv_cycles() is a single register read.  It wraps every 2^32 cycles,
+ * about 25s at 166MHz, so it is meant for intervals: end - start.
+ * mv_cycles64() never wraps.  The conversions are a multiply and a
+ * shift, with no division.
+ */
+#include <linux/types.h>
+#include <asm/hardware.h>
+#include <asm/io.h>
+
+/* CNTMR_VAL_REG(WATCHDOG_NUM) */
+#define MV_CYCLES_VAL_REG	(INTER_REGS_BASE + 0x20324)
+
+#define MV_CYCLES_NS_SHIFT	22
+
+extern u32 mv_cycles_ns_mult;		/* ns per cycle << MV_CYCLES_NS_SHIFT */
+extern u32 mv_cycles_us_mult;		/* us per cycle << 32 */
+
+extern void mv_cycles_init(void);
+extern unsigned long long mv_cycles64(void);
+
+/* the counter counts down */
+static inline u32 mv_cycles(void)
+{
+	return ~readl(MV_CYCLES_VAL_REG);
+}
+
+static inline u32 mv_cycles_to_us(u32 cycles)
+{
+	return ((u64)cycles * mv_cycles_us_mult) >> 32;
+}
+
+static inline unsigned long long mv_cycles_to_ns(unsigned long long cycles)
+{
+	u32 low = cycles & ((1 << MV_CYCLES_NS_SHIFT) - 1);
+
+	return (cycles >> MV_CYCLES_NS_SHIFT) * mv_cycles_ns_mult +
+	       (((u64)low * mv_cycles_ns_mult) >> MV_CYCLES_NS_SHIFT);
+}
+
+#endif /* __ASM_ARCH_CYCLES_H */
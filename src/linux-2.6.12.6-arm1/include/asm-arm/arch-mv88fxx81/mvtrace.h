@@ -0,0 +1,113 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+#ifndef __ASM_ARCH_MVTRACE_H
+#define __ASM_ARCH_MVTRACE_H
+
+/*
+ * Hot path event tracing for the mv88fxx81 drivers.
+ *
+ * Every subsystem owns a ring of fixed size binary records, stamped
+ * with mv_cycles() (asm/arch/cycles.h).  /proc/mvtrace/<subsystem>
+ * returns a snapshot of a ring: a struct mv_trace_hdr followed by the
+ * records, oldest first.  LSP/mvtrace_decode.c turns one or more
+ * snapshots into a merged, time ordered listing.
+ *
+ * This file is also included by the userspace decoder, which provides
+ * __u16 and __u32 itself.
+ */
+#ifdef __KERNEL__
+#include <linux/config.h>
+#include <linux/types.h>
+#endif
+
+enum mv_trace_subsys {
+	MV_TRACE_NET,
+	MV_TRACE_SATA,
+	MV_TRACE_CESA,
+	MV_TRACE_IDMA,
+	MV_TRACE_NR
+};
+
+/*
+ * Events, numbered per subsystem.  The two arguments are listed after
+ * each; a pointer argument identifies the request a start and its end
+ * belong to.  The decoder has a name table for these: keep it in sync.
+ */
+enum {
+	MV_TRACE_NET_RX_POLL,		/* port, rx << 16 | tx_done */
+	MV_TRACE_NET_TX_KICK,		/* port, bytes */
+};
+
+enum {
+	MV_TRACE_SATA_QUEUE,		/* scsi_cmnd, channel << 24 | bytes */
+	MV_TRACE_SATA_COMPLETE,		/* scsi_cmnd, result */
+};
+
+enum {
+	MV_TRACE_CESA_SUBMIT,		/* cryptop, bytes */
+	MV_TRACE_CESA_DONE,		/* cryptop, error */
+};
+
+enum {
+	MV_TRACE_IDMA_START,		/* channel, bytes */
+	MV_TRACE_IDMA_END,		/* channel, poll loops */
+};
+
+#define MV_TRACE_MAGIC		0x4d565452	/* "MVTR" */
+#define MV_TRACE_VERSION	1
+
+struct mv_trace_rec {
+	__u32	stamp;			/* Tclk cycles, wraps */
+	__u16	seq;			/* low bits of the ring position */
+	__u16	event;
+	__u32	arg0;
+	__u32	arg1;
+};
+
+struct mv_trace_hdr {
+	__u32	magic;
+	__u16	version;
+	__u16	subsys;
+	__u32	tclk;			/* stamp frequency, Hz */
+	__u32	now_hi;			/* clock at the snapshot, 64 bits */
+	__u32	now_lo;
+	__u32	head;			/* records ever written */
+	__u32	nr;			/* records that follow */
+	__u32	pad;
+};
+
+#ifdef __KERNEL__
+#ifdef CONFIG_MV_TRACE
+extern unsigned long mv_trace_mask;
+extern void __mv_trace(unsigned int subsys, unsigned int event,
+		       u32 arg0, u32 arg1);
+
+/* only a test and a not taken branch while the subsystem is off */
+static inline void mv_trace(unsigned int subsys, unsigned int event,
+			    u32 arg0, u32 arg1)
+{
+	if (unlikely(mv_trace_mask & (1 << subsys)))
+		__mv_trace(subsys, event, arg0, arg1);
+}
+#else
+static inline void mv_trace(unsigned int subsys, unsigned int event,
+			    u32 arg0, u32 arg1)
+{
+}
+#endif /* CONFIG_MV_TRACE */
+#endif /* __KERNEL__ */
+
+#endif /* __ASM_ARCH_MVTRACE_H */
@@ -16,9 +16,9 @@
 #include <asm/system.h>
 #include <asm/leds.h>
 #include <asm/mach-types.h>
+#include <asm/arch/cycles.h>
 
 #define LSP_CNTMR 0
-#define TICKS2USECS(x) ((x)/(mvTclk/1000000))
  
 extern  u32 mvTclk;
 /* redefine from mvCntmr */
@@ -31,23 +31,30 @@ struct _mvCntmrCtrl
 extern u32 mvCntmrStart(u32, u32, struct _mvCntmrCtrl *);
 extern u32 mvCntmrRead(u32);
 
+static u32 mv_tick_reload;	/* cycles per tick */
+static u32 mv_tick_cycles;	/* free running count at the last tick */
+
 /*
  * Returns number of usec since last clock interrupt.  Note that interrupts
  * will have been disabled by do_gettimeoffset()
+ *
+ * The free running counter keeps counting while the tick is pending, so
+ * this needs no check of the cause bit and no division.
  */
 static unsigned long mv_gettimeoffset(void)
 {
-	unsigned int ticks;
-	volatile u32 cause;
-	ticks = (mvTclk / HZ) - mvCntmrRead(LSP_CNTMR);
-	cause  = *(volatile u32*)(INTER_REGS_BASE + BRIDGE_INT_CAUSE_REG);	
-	/* check if we got an interrupt meanwhile */
-	cause = MV_ARM_32BIT_LE(cause);
-	if (cause & TIMER_BIT_MASK(LSP_CNTMR))
-	{
-		ticks += (mvTclk / HZ);
-	}
-	return TICKS2USECS(ticks);			
+	return mv_cycles_to_us(mv_cycles() - mv_tick_cycles);
+}
+
+/*
+ * The tick happened when the tick timer last reloaded, however late the
+ * interrupt is served.
+ */
+static inline void mv_tick_stamp(void)
+{
+	u32 now = mv_cycles();
+
+	mv_tick_cycles = now - (mv_tick_reload - mvCntmrRead(LSP_CNTMR));
 }
 
 
@@ -69,9 +76,15 @@ mv_timer_interrupt(int irq, void *dev_id, struct pt_regs *regs)
 	/* check if we realy received a timer irq. */
 	if( ((cause & mask) & TIMER_BIT_MASK(LSP_CNTMR)) != 0 )
 	{
-		/* clear the timer irq */
-		cause = (cause & ~(TIMER_BIT_MASK(LSP_CNTMR)));		
-		*(volatile u32*)(INTER_REGS_BASE + BRIDGE_INT_CAUSE_REG) = MV_ARM_32BIT_LE(cause);		
+		/*
+		 * clear the timer irq.  The cause bits are write 0 to clear:
+		 * write back the tick's bit only, so that a profiler bit raised
+		 * since the read above is not lost.
+		 */
+		*(volatile u32*)(INTER_REGS_BASE + BRIDGE_INT_CAUSE_REG) =
+			MV_ARM_32BIT_LE(~TIMER_BIT_MASK(LSP_CNTMR));
+		mv_tick_stamp();
+		mv_cycles64();		/* follows the counter's wraps */
 //		if(led_counter++ > HZ)
 //		{
 //			led_counter = 0;		
@@ -82,17 +95,17 @@ mv_timer_interrupt(int irq, void *dev_id, struct pt_regs *regs)
 //		}	
 		timer_tick(regs);
 	}
-	else /* no support for other irqs. */
+	else /* another bridge interrupt, e.g. the oprofile timer */
 	{
-		printk("Error IRQ not supported ??\n");
 		return IRQ_NONE;
 	}
 	return IRQ_HANDLED;
 }
 
+/* shared with the oprofile sampling timer, arch/arm/oprofile */
 static struct irqaction mv_timer_irq = {
         .name           = "Mv Timer Tick",
-        .flags          = SA_INTERRUPT,
+        .flags          = SA_INTERRUPT | SA_SHIRQ,
         .handler        = mv_timer_interrupt
 };
  
@@ -108,8 +121,12 @@ void __init mv_time_init(void)
         cntmr.enable = 1;
         cntmr.autoEnable = 1;
 
+	mv_cycles_init();
+
 	timer_reload = mvTclk / HZ;
+	mv_tick_reload = timer_reload;
         mvCntmrStart(LSP_CNTMR, timer_reload, &cntmr);
+	mv_tick_stamp();
 
 	mv_timer_irq.handler = mv_timer_interrupt;
 
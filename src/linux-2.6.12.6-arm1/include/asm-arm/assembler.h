@@ -47,13 +47,17 @@
 #endif
 
 /*
- * Data preload for architectures that support it
+ * Data preload for architectures that support it.  A source file may
+ * define PLD itself before including this one, to build preloading
+ * variants of a routine regardless of CONFIG_USE_DSP.
  */
+#ifndef PLD
 #if __LINUX_ARM_ARCH__ >= 5 && defined(CONFIG_USE_DSP)
 #define PLD(code...)	code
 #else
 #define PLD(code...)
 #endif
+#endif
 
 #define MODE_USR	USR_MODE
 #define MODE_FIQ	FIQ_MODE
@@ -9,6 +9,7 @@
 #ifndef __ASM_ARM_CHECKSUM_H
 #define __ASM_ARM_CHECKSUM_H
 
+#include <linux/config.h>
 #include <linux/in6.h>
 
 /*
@@ -39,6 +40,23 @@ csum_partial_copy_nocheck(const char *src, char *dst, int len, int sum);
 unsigned int
 csum_partial_copy_from_user(const char __user *src, char *dst, int len, int sum, int *err_ptr);
 
+#ifdef CONFIG_MV_FAST_UACCESS
+/* chosen at boot along with copy_to/from_user, see asm/uaccess.h */
+struct cpu_csum_fns {
+	unsigned int (*copy_nocheck)(const char *src, char *dst, int len,
+				     int sum);
+	unsigned int (*copy_from_user)(const char __user *src, char *dst,
+				       int len, int sum, int *err_ptr);
+};
+
+extern struct cpu_csum_fns cpu_csum;
+
+#define csum_partial_copy_nocheck(src,dst,len,sum)			\
+	cpu_csum.copy_nocheck(src,dst,len,sum)
+#define csum_partial_copy_from_user(src,dst,len,sum,err_ptr)		\
+	cpu_csum.copy_from_user(src,dst,len,sum,err_ptr)
+#endif
+
 /*
  * This is the old (and unsafe) way of doing checksums, a warning message will
  * be printed if it is used and an exception occurs.
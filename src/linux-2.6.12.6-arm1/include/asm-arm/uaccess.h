@@ -369,8 +369,34 @@ extern unsigned long __arch_clear_user(void __user *addr, unsigned long n);
 extern unsigned long __arch_strncpy_from_user(char *to, const char __user *from, unsigned long count);
 extern unsigned long __arch_strnlen_user(const char __user *s, long n);
 
+/*
+ * On Orion the copy routines are picked at boot, between the generic
+ * ones and variants tuned for its cache (arch/arm/mm/uaccess-mrvl.c).
+ */
+#ifdef CONFIG_MV_FAST_UACCESS
+struct cpu_uaccess_fns {
+	unsigned long (*cpu_copy_from_user)(void *to, const void __user *from,
+					    unsigned long n);
+	unsigned long (*cpu_copy_to_user)(void __user *to, const void *from,
+					  unsigned long n);
+};
+
+extern struct cpu_uaccess_fns cpu_uaccess;
+
+#define __cpu_copy_from_user	cpu_uaccess.cpu_copy_from_user
+#define __cpu_copy_to_user	cpu_uaccess.cpu_copy_to_user
+#else
+#define __cpu_copy_from_user	__arch_copy_from_user
+#define __cpu_copy_to_user	__arch_copy_to_user
+#endif
+
 #ifdef CONFIG_MV_DMA_COPYUSER
-#define IDMA_MIN_COPY 	1260
+/*
+ * Copies up to IDMA_MIN_COPY bytes are always done by the CPU.  For larger
+ * ones dma_copy_to/from_user() choose between the CPU and the IDMA engine
+ * against thresholds calibrated at boot (arch/arm/mach-mv88fxx81/LSP/dma.c).
+ */
+#define IDMA_MIN_COPY 	256
 #endif
 
 extern unsigned long dma_copy_from_user(void *to, const void __user *from, unsigned long n);
@@ -384,7 +410,7 @@ static inline unsigned long copy_from_user(void *to, const void __user *from, un
 		if(n > IDMA_MIN_COPY)
 			return dma_copy_from_user(to,from,n);
 #endif
-		return __arch_copy_from_user(to, from, n);
+		return __cpu_copy_from_user(to, from, n);
 	}
 	else /* security hole - plug it */
 		memzero(to, n);
@@ -398,7 +424,7 @@ static inline unsigned long __copy_from_user(void *to, const void __user *from,
 	if(n > IDMA_MIN_COPY)
 		return dma_copy_from_user(to,from,n);
 #endif
-	return __arch_copy_from_user(to, from, n);
+	return __cpu_copy_from_user(to, from, n);
 }
 
 static inline unsigned long copy_to_user(void __user *to, const void *from, unsigned long n)
@@ -408,7 +434,7 @@ static inline unsigned long copy_to_user(void __user *to, const void *from, unsi
 		if(n > IDMA_MIN_COPY)
 			return dma_copy_to_user(to,from,n);
 #endif
-		return __arch_copy_to_user(to, from, n);
+		return __cpu_copy_to_user(to, from, n);
 	}
 	return n;
 }
@@ -419,7 +445,7 @@ static inline unsigned long __copy_to_user(void __user *to, const void *from, un
 	if(n > IDMA_MIN_COPY)
 		return dma_copy_to_user(to,from,n);
 #endif
-	return __arch_copy_to_user(to, from, n);
+	return __cpu_copy_to_user(to, from, n);
 }
 
 #define __copy_to_user_inatomic __copy_to_user
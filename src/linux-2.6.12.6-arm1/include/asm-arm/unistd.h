@@ -351,6 +351,13 @@
 
 #define __NR_vserver			(__NR_SYSCALL_BASE+313)
 
+/*
+ * Private to this kernel, not an upstream allocation.  It sits in the
+ * last slot of the table, away from the numbers upstream hands out
+ * next; userspace must expect ENOSYS and fall back to recv()/write().
+ */
+#define __NR_recvfile			(__NR_SYSCALL_BASE+319)
+
 /*
  * The following SWIs are ARM private.
  */
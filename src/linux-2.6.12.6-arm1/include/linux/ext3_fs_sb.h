@@ -24,6 +24,22 @@
 #endif
 #include <linux/rbtree.h>
 
+/*
+ * Block allocator statistics, /proc/fs/ext3/<dev>/allocstat.  Updated
+ * without locking; they are only a guide.
+ */
+struct ext3_alloc_stats {
+	unsigned long calls;		/* ext3_new_blocks() calls */
+	unsigned long blocks;		/* blocks they allocated */
+	unsigned long multi;		/* calls that got more than one block */
+	unsigned long long ns;		/* time spent in them */
+	unsigned long seq;		/* allocations extending a file sequentially */
+	unsigned long seq_breaks;	/* ... that didn't land right after the last */
+	unsigned long rsv_windows;	/* reservation windows (re)placed */
+	unsigned long rsv_grows;	/* window size doublings */
+	unsigned long rsv_extends;	/* windows extended in place */
+};
+
 /*
  * third extended-fs super-block data in memory
  */
@@ -63,6 +79,8 @@ struct ext3_sb_info {
 	spinlock_t s_rsv_window_lock;
 	struct rb_root s_rsv_window_root;
 	struct ext3_reserve_window_node s_rsv_window_head;
+	struct ext3_alloc_stats s_alloc_stats;
+	struct proc_dir_entry *s_proc;
 
 	/* Journaling */
 	struct inode * s_journal_inode;
@@ -36,6 +36,13 @@ struct files_stat_struct {
 };
 extern struct files_stat_struct files_stat;
 
+struct recvfile_stat_struct {
+	unsigned long calls;		/* read only */
+	unsigned long bytes;		/* read only, socket to page cache */
+	unsigned long short_calls;	/* read only, returned less than asked */
+};
+extern struct recvfile_stat_struct recvfile_stat;
+
 struct inodes_stat_t {
 	int nr_inodes;
 	int nr_unused;
@@ -81,6 +88,10 @@ extern int dir_notify_enable;
 /* public flags for file_system_type */
 #define FS_REQUIRES_DEV 1 
 #define FS_BINARY_MOUNTDATA 2
+#define FS_PAGECACHE_WRITE 4	/* ->prepare_write/->commit_write on their
+				 * own do all a buffered write needs, see
+				 * nfsd_can_write_skbs()
+				 */
 #define FS_REVAL_DOT	16384	/* Check the paths ".", ".." for staleness */
 #define FS_ODD_RENAME	32768	/* Temporary stuff; will go away as soon
 				  * as nfs_rename() will be cleaned up
@@ -20,6 +20,8 @@ struct nfsd_stats {
 	unsigned int	fh_nocache_nondir;	/* filehandle not found in dcache */
 	unsigned int	io_read;	/* bytes returned to read requests */
 	unsigned int	io_write;	/* bytes passed in write requests */
+	unsigned int	io_wcopy1;	/* write bytes copied once (skb to page cache) */
+	unsigned int	io_wcopy2;	/* write bytes copied twice (via rq_argpages) */
 	unsigned int	th_cnt;		/* number of available threads */
 	unsigned int	th_usage[10];	/* number of ticks during which n perdeciles
 					 * of available threads were in use */
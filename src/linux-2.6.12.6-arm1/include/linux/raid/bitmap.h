@@ -0,0 +1,121 @@
+/*
+ * bitmap.h: write-intent bitmap for md RAID1
+ *
+ * The bitmap lives in the 60KB that 0.90 superblocks leave unused after
+ * the superblock, on every member device.  Each bit covers one "chunk"
+ * of the array.  A bit is set (and on disk) before any write to its
+ * chunk is started, and cleared lazily once the chunk has been idle for
+ * a while, so after an unclean shutdown only chunks with set bits need
+ * to be resynced.
+ */
+#ifndef _BITMAP_H
+#define _BITMAP_H
+
+#define BITMAP_MAGIC	0x6d746962	/* "bitm" */
+#define BITMAP_MAJOR	3
+
+/*
+ * The bitmap starts MD_SB_SECTORS after the superblock and runs to the
+ * end of the reserved area.
+ */
+#define BITMAP_SB_OFFSET	MD_SB_SECTORS
+#define BITMAP_MAX_BYTES	(MD_RESERVED_BYTES - MD_SB_BYTES)
+#define BITMAP_MAX_PAGES	(BITMAP_MAX_BYTES / PAGE_SIZE)
+
+/* on-disk bitmap header, stored little-endian in front of the bits */
+typedef struct bitmap_super_s {
+	__u32 magic;		/*  0  BITMAP_MAGIC */
+	__u32 version;		/*  4  BITMAP_MAJOR */
+	__u8  uuid[16];		/*  8  128 bit uuid - must match md device uuid */
+	__u64 events;		/* 24  md superblock events when last written */
+	__u64 sync_size;	/* 32  the size of the md device in sectors */
+	__u32 state;		/* 40  bitmap state information */
+	__u32 chunksize;	/* 44  the bitmap chunk size in bytes */
+	__u32 daemon_sleep;	/* 48  seconds between clearing passes */
+	__u8  pad[256 - 52];	/* set to zero */
+} bitmap_super_t;
+
+#define BITMAP_SB_SIZE		sizeof(bitmap_super_t)
+
+/* bitmap state bits */
+#define BITMAP_STALE		1	/* bits don't describe the array */
+
+#ifdef __KERNEL__
+
+/*
+ * In-memory state is one 16-bit counter per chunk:
+ *
+ *	NEEDED	- chunk must be resynced before its bit may be cleared
+ *	RESYNC	- resync of the chunk is in progress
+ *	COUNT	- 0:	 bit clear
+ *		  1, 2:	 bit set, chunk idle; the daemon counts down and
+ *			 clears the bit when it reaches 0
+ *		  2 + n: bit set, n writes in flight
+ */
+typedef __u16 bitmap_counter_t;
+
+#define NEEDED_MASK	((bitmap_counter_t)0x8000)
+#define RESYNC_MASK	((bitmap_counter_t)0x4000)
+#define COUNTER_MAX	((bitmap_counter_t)0x3fff)
+#define NEEDED(x)	(((bitmap_counter_t)(x)) & NEEDED_MASK)
+#define RESYNC(x)	(((bitmap_counter_t)(x)) & RESYNC_MASK)
+#define COUNTER(x)	(((bitmap_counter_t)(x)) & COUNTER_MAX)
+
+/* per-page attributes of the bitmap "file" */
+#define BITMAP_PAGE_DIRTY	0	/* must be written before new writes start */
+#define BITMAP_PAGE_CLEAN	1	/* has idle chunks the daemon may clear */
+#define BITMAP_PAGE_NEEDWRITE	2	/* has cleared bits; write lazily */
+#define BITMAP_PAGE_PENDING	3	/* being written */
+
+struct bitmap {
+	mddev_t *mddev;
+
+	unsigned long chunks;		/* number of chunks in the array */
+	unsigned long chunkshift;	/* log2(chunk size in sectors) */
+	unsigned long daemon_sleep;	/* jiffies between clearing passes */
+	unsigned long daemon_lastrun;
+
+	spinlock_t lock;
+	bitmap_counter_t *counters;	/* one per chunk, vmalloc'd */
+
+	/* the bitmap "file": header followed by the bits */
+	struct page *pages[BITMAP_MAX_PAGES];
+	unsigned long page_attr[BITMAP_MAX_PAGES];
+	int npages;
+	int write_all;			/* rewrite every page on every device */
+
+	wait_queue_head_t overflow_wait;
+	struct semaphore write_sem;	/* serialises page writes */
+	atomic_t pending_writes;	/* page writes in flight */
+	wait_queue_head_t write_wait;
+
+	/* statistics */
+	unsigned long bits_set;		/* bits currently set */
+	unsigned long writes_held;	/* array writes that waited for the bitmap */
+	unsigned long page_writes;	/* bitmap pages written (per device) */
+	unsigned long flush_jiffies;	/* time spent writing bitmap pages */
+	sector_t sync_skipped;		/* resync sectors skipped as clean */
+};
+
+extern int sysctl_bitmap_chunk_kb;
+extern int sysctl_bitmap_daemon_sleep;
+
+extern int bitmap_create(mddev_t *mddev);
+extern void bitmap_destroy(mddev_t *mddev);
+extern void bitmap_status(struct seq_file *seq, struct bitmap *bitmap);
+extern void bitmap_update_sb(struct bitmap *bitmap);
+extern void bitmap_write_all(struct bitmap *bitmap);
+
+extern int bitmap_startwrite(struct bitmap *bitmap, sector_t offset,
+			     unsigned long sectors);
+extern void bitmap_endwrite(struct bitmap *bitmap, sector_t offset,
+			    unsigned long sectors, int success);
+extern int bitmap_start_sync(struct bitmap *bitmap, sector_t offset,
+			     sector_t *blocks);
+extern void bitmap_close_sync(struct bitmap *bitmap, sector_t done);
+
+extern void bitmap_unplug(struct bitmap *bitmap);
+extern void bitmap_daemon_work(struct bitmap *bitmap);
+
+#endif /* __KERNEL__ */
+#endif /* _BITMAP_H */
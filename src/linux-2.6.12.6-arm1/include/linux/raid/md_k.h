@@ -222,6 +222,22 @@ struct mddev_s
 	sector_t			curr_resync;	/* blocks scheduled */
 	unsigned long			resync_mark;	/* a recent timestamp */
 	sector_t			resync_mark_cnt;/* blocks written at resync_mark */
+	sector_t			curr_mark_cnt; /* blocks scheduled now */
+
+	/* resync scheduler, see md_sync_sample() */
+	unsigned long			resync_sample;	/* jiffies of last sample */
+	sector_t			resync_sample_cnt; /* curr_mark_cnt then */
+	unsigned long			resync_fg_ios;	/* array reads+writes then */
+	unsigned long			resync_fg_usecs;/* and fg_usecs then */
+	atomic_t			fg_usecs;	/* request time, usec, wraps */
+	unsigned long			resync_probe;	/* jiffies last probe started */
+	int				resync_probing;	/* holding resync off to measure */
+	int				resync_fg_idle;	/* no foreground I/O last sample */
+	unsigned int			resync_rate;	/* KB/sec over last sample */
+	unsigned int			resync_limit;	/* current limit, KB/sec */
+	unsigned int			resync_fg_lat;	/* foreground latency, usec */
+	unsigned int			resync_fg_base;	/* same with resync paused */
+	int				resync_fg_measured; /* resync_fg_base is set */
 
 	sector_t			resync_max_sectors; /* may be set by personality */
 	/* recovery/resync flags 
@@ -260,6 +276,9 @@ struct mddev_s
 	atomic_t			writes_pending; 
 	request_queue_t			*queue;	/* for plugging ... */
 
+	struct bitmap			*bitmap; /* the bitmap for the device */
+	sector_t			bitmap_offset; /* sectors after the sb, 0 if none */
+
 	struct list_head		all_mddevs;
 };
 
@@ -291,10 +310,17 @@ struct mdk_personality_s
 	int (*hot_add_disk) (mddev_t *mddev, mdk_rdev_t *rdev);
 	int (*hot_remove_disk) (mddev_t *mddev, int number);
 	int (*spare_active) (mddev_t *mddev);
-	int (*sync_request)(mddev_t *mddev, sector_t sector_nr, int go_faster);
+	int (*sync_request)(mddev_t *mddev, sector_t sector_nr, int *skipped, int go_faster);
 	int (*resize) (mddev_t *mddev, sector_t sectors);
 	int (*reshape) (mddev_t *mddev, int raid_disks);
 	int (*reconfig) (mddev_t *mddev, int layout, int chunk_size);
+	/* quiesce moves between quiescence states
+	 * 0 - fully active
+	 * 1 - no new requests allowed, and all pending ones completed
+	 */
+	void (*quiesce) (mddev_t *mddev, int state);
+	/* adds the time each array request took to mddev->fg_usecs */
+	int fg_timed;
 };
 
 
@@ -335,6 +361,8 @@ typedef struct mdk_thread_s {
 	struct completion	*event;
 	struct task_struct	*tsk;
 	const char		*name;
+	unsigned long		timeout;	/* run at least this often */
+	unsigned long		passes;		/* odd while ->run() is running */
 } mdk_thread_t;
 
 #define THREAD_WAKEUP  0
@@ -8,6 +8,33 @@ typedef struct mirror_info mirror_info_t;
 struct mirror_info {
 	mdk_rdev_t	*rdev;
 	sector_t	head_position;
+	atomic_t	reads;		/* read requests sent to this mirror */
+};
+
+/*
+ * Read balancing policies, selected with /proc/sys/dev/raid/raid1_read_balance
+ *
+ * RAID1_RB_HEAD: pick the mirror whose head is closest (classic)
+ * RAID1_RB_LOAD: bind sequential streams to a mirror and send new
+ *		  streams to the mirror with the fewest requests in flight
+ */
+#define	RAID1_RB_HEAD		0
+#define	RAID1_RB_LOAD		1
+
+/*
+ * A sequential reader, as seen by RAID1_RB_LOAD.  A read that starts
+ * within RAID1_STREAM_GAP sectors after next_sect continues the stream.
+ * A read that starts that close after the end of an earlier unbound
+ * read starts a new one; the ends of the last RAID1_NR_STREAMS unbound
+ * reads are kept in stream_cand[] to catch these.
+ */
+#define	RAID1_NR_STREAMS	8
+#define	RAID1_STREAM_GAP	256
+
+struct r1_stream {
+	sector_t	next_sect;	/* where the stream is expected next */
+	int		disk;		/* mirror the stream is bound to */
+	unsigned long	last;		/* jiffies of the last read */
 };
 
 /*
@@ -35,7 +62,20 @@ struct r1_private_data_s {
 	sector_t		next_seq_sect;
 	spinlock_t		device_lock;
 
+	/* for RAID1_RB_LOAD read balancing: */
+	spinlock_t		stream_lock;
+	struct r1_stream	streams[RAID1_NR_STREAMS];
+	sector_t		stream_cand[RAID1_NR_STREAMS];
+	int			stream_cand_next;
+
 	struct list_head	retry_list;
+
+	/* writes held back until the bitmap is on disk; raid1d submits
+	 * them after bitmap_unplug().  Linked through bi_next.
+	 */
+	struct bio		*pending_bio_list;
+	struct bio		*pending_bio_tail;
+
 	/* for use when syncing mirrors: */
 
 	spinlock_t		resync_lock;
@@ -79,6 +119,8 @@ struct r1bio_s {
 	 * original bio going to /dev/mdx
 	 */
 	struct bio		*master_bio;
+	unsigned long		start_time;	/* jiffies, for the disk stats */
+	unsigned long long	start_us;	/* r1_clock(), for md's latency */
 	/*
 	 * if the IO is in READ direction, then this is where we read
 	 */
@@ -95,4 +137,6 @@ struct r1bio_s {
 /* bits for r1bio.state */
 #define	R1BIO_Uptodate	0
 #define	R1BIO_IsSync	1
+/* some mirror missed this write, so its bitmap chunk must stay dirty */
+#define	R1BIO_Degraded	2
 #endif
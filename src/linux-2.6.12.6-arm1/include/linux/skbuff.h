@@ -199,6 +199,7 @@ struct skb_shared_info {
  *	@tc_index: Traffic control index
  *	@tc_verd: traffic control verdict
  *	@tc_classid: traffic control classid
+ *	@recycle: Pool the buffer goes back to when freed, see skb_recycle_alloc()
  */
 
 struct sk_buff {
@@ -284,6 +285,7 @@ struct sk_buff {
 #endif
 
 #endif
+	struct skb_recycle_pool	*recycle;
 
 
 	/* These elements must be at the end, see alloc_skb() for details.  */
@@ -1011,6 +1013,33 @@ static inline struct sk_buff *dev_alloc_skb(unsigned int length)
 	return __dev_alloc_skb(length, GFP_ATOMIC);
 }
 
+/*
+ * A per-device cache of receive buffers.  Buffers taken from it with
+ * skb_recycle_alloc() go back to it from __kfree_skb() instead of to
+ * slab, as long as they come back clean: not shared, no fragments and
+ * the data area not reallocated.  /proc/net/skb_recycle has the counts.
+ */
+struct skb_recycle_pool {
+	struct sk_buff_head	list;
+	struct list_head	all;
+	struct net_device	*dev;
+	unsigned int		size;		/* as for dev_alloc_skb() */
+	unsigned int		max;		/* buffers kept at most */
+	atomic_t		refcnt;		/* buffers out there, +1 until destroyed */
+	int			dead;
+	unsigned long		allocs;
+	unsigned long		hits;		/* allocs served from the list */
+	unsigned long		recycled;	/* frees that went to the list */
+	unsigned long		released;	/* frees that went to slab */
+};
+
+extern struct skb_recycle_pool *skb_recycle_pool_create(struct net_device *dev,
+							unsigned int size,
+							unsigned int max,
+							int gfp_mask);
+extern void skb_recycle_pool_destroy(struct skb_recycle_pool *pool);
+extern struct sk_buff *skb_recycle_alloc(struct skb_recycle_pool *pool);
+
 /**
  *	skb_cow - copy header of skb when it is required
  *	@skb: buffer to cow
@@ -29,6 +29,8 @@
 #endif
 
 #define SQUASHFS_CACHED_FRAGMENTS	CONFIG_SQUASHFS_FRAGMENT_CACHE_SIZE	
+#define SQUASHFS_DECOMPRESSORS		CONFIG_SQUASHFS_DECOMPRESSORS
+#define SQUASHFS_READAHEAD_BLOCKS	CONFIG_SQUASHFS_READAHEAD_BLOCKS
 #define SQUASHFS_MAJOR			3
 #define SQUASHFS_MINOR			1
 #define SQUASHFS_MAGIC			0x73717368
@@ -32,6 +32,8 @@ struct squashfs_inode_info {
 			unsigned int	fragment_size;
 			unsigned int	fragment_offset;
 			long long	block_list_start;
+			int		ra_index;	/* next block if sequential */
+			int		ra_end;		/* read ahead up to here */
 		} s1;
 		struct {
 			long long	directory_index_start;
@@ -25,18 +25,36 @@
 
 #include <linux/squashfs_fs.h>
 
-struct squashfs_cache {
-	long long	block;
-	int		length;
-	long long	next_index;
-	char		*data;
+/*
+ * A decompressed block in the block cache.  Metadata blocks, fragments
+ * and data blocks that could not be decompressed straight into the page
+ * cache share one cache, kept in LRU order and bounded in bytes.
+ */
+struct squashfs_cache_entry {
+	struct list_head	lru;
+	long long		block;
+	int			length;
+	long long		next_index;
+	int			refcount;
+	int			pending;	/* being read */
+	int			error;
+	unsigned int		size;		/* allocated size of data */
+	char			*data;
 };
 
-struct squashfs_fragment_cache {
-	long long	block;
-	int		length;
-	unsigned int	locked;
-	char		*data;
+struct squashfs_stats {
+	unsigned long		decomp_calls;	/* blocks decompressed */
+	unsigned long long	decomp_ns;	/* time spent decompressing */
+	unsigned long		decomp_waits;	/* waits for a free decompressor */
+	unsigned long long	decomp_wait_ns;	/* time spent waiting */
+	unsigned long		direct_blocks;	/* data blocks read into the page cache */
+	unsigned long		bounce_blocks;	/* ... and through a bounce buffer */
+	unsigned long		meta_hits;	/* block cache lookups */
+	unsigned long		meta_misses;
+	unsigned long		data_hits;
+	unsigned long		data_misses;
+	unsigned long		cache_evictions;
+	unsigned long		ra_blocks;	/* compressed blocks read ahead */
 };
 
 struct squashfs_sb_info {
@@ -44,28 +62,26 @@ struct squashfs_sb_info {
 	int			devblksize;
 	int			devblksize_log2;
 	int			swap;
-	struct squashfs_cache	*block_cache;
-	struct squashfs_fragment_cache	*fragment;
-	int			next_cache;
-	int			next_fragment;
 	int			next_meta_index;
 	unsigned int		*uid;
 	unsigned int		*guid;
 	long long		*fragment_index;
 	unsigned int		*fragment_index_2;
-	char			*read_page;
-	struct semaphore		read_data_mutex;
-	struct semaphore		read_page_mutex;
-	struct semaphore		block_cache_mutex;
-	struct semaphore		fragment_mutex;
+	struct list_head	decomp_free;	/* idle decompressors */
+	spinlock_t		decomp_lock;
+	wait_queue_head_t	decomp_wait;
+	struct list_head	cache_lru;	/* most recently used first */
+	struct semaphore	cache_mutex;
+	wait_queue_head_t	cache_wait;
+	unsigned int		cache_bytes;	/* allocated to cached blocks */
+	unsigned int		cache_max;
+	int			cache_idle;	/* unreferenced entries */
 	struct semaphore		meta_index_mutex;
-	wait_queue_head_t	waitq;
-	wait_queue_head_t	fragment_wait_queue;
 	struct meta_index	*meta_index;
 	z_stream		stream;
 	long long		*inode_lookup_table;
-	int			unused_cache_blks;
-	int			unused_frag_blks;
+	struct squashfs_stats	stats;
+	struct proc_dir_entry	*proc;
 	int			(*read_inode)(struct inode *i,  squashfs_inode_t \
 				inode);
 	long long		(*read_blocklist)(struct inode *inode, int \
@@ -16,6 +16,7 @@
 #include <linux/sunrpc/svcauth.h>
 #include <linux/wait.h>
 #include <linux/mm.h>
+#include <linux/skbuff.h>
 
 /*
  * RPC service.
@@ -125,6 +126,8 @@ struct svc_rqst {
 	struct xdr_buf		rq_res;
 	struct page *		rq_argpages[RPCSVC_MAXPAGES];
 	struct page *		rq_respages[RPCSVC_MAXPAGES];
+	struct sk_buff_head	rq_argskbs;	/* TCP skbs holding the arg pages */
+	unsigned int		rq_argskblen;	/* bytes of rq_arg pages in rq_argskbs */
 	int			rq_restailpage;
 	short			rq_argused;	/* pages used for argument */
 	short			rq_arghi;	/* pages available in argument page list */
@@ -284,6 +287,7 @@ struct svc_procedure {
 	unsigned int		pc_count;	/* call count */
 	unsigned int		pc_cachetype;	/* cache info (NFS) */
 	unsigned int		pc_xdrressize;	/* maximum size of XDR reply */
+	unsigned int		pc_skbargs;	/* arg pages may be left in skbs */
 };
 
 /*
@@ -302,5 +306,7 @@ int		   svc_process(struct svc_serv *, struct svc_rqst *);
 int		   svc_register(struct svc_serv *, int, unsigned short);
 void		   svc_wake_up(struct svc_serv *);
 void		   svc_reserve(struct svc_rqst *rqstp, int space);
+int		   svc_copy_argskbs(struct svc_rqst *, unsigned int, void *, unsigned int);
+int		   svc_flush_argskbs(struct svc_rqst *);
 
 #endif /* SUNRPC_SVC_H */
@@ -680,6 +680,8 @@ enum
 	FS_XFS=17,	/* struct: control xfs parameters */
 	FS_AIO_NR=18,	/* current system-wide number of aio requests */
 	FS_AIO_MAX_NR=19,	/* system-wide maximum number of aio requests */
+	/* private to this kernel: kept well clear of upstream numbers */
+	FS_RECVFILE=1000,	/* recvfile() statistics */
 };
 
 /* /proc/sys/fs/quota/ */
@@ -725,7 +727,11 @@ enum {
 /* /proc/sys/dev/raid */
 enum {
 	DEV_RAID_SPEED_LIMIT_MIN=1,
-	DEV_RAID_SPEED_LIMIT_MAX=2
+	DEV_RAID_SPEED_LIMIT_MAX=2,
+	DEV_RAID_RAID1_READ_BALANCE=3,
+	DEV_RAID_BITMAP_CHUNK_KB=4,
+	DEV_RAID_BITMAP_DAEMON_SLEEP=5,
+	DEV_RAID_RESYNC_LATENCY=6
 };
 
 /* /proc/sys/dev/parport/default */
@@ -36,6 +36,15 @@ struct esp_data
 		                               int offset, int len, u8 *icv);
 		struct crypto_tfm	*tfm;
 	} auth;
+
+#ifdef CONFIG_OCF_XFRM
+	/* OCF hardware session; cipher is 0 while the state is software only */
+	struct {
+		u64			sid;
+		int			cipher;		/* CRYPTO_*_CBC */
+		int			mac;		/* CRYPTO_*_HMAC, or 0 */
+	} ocf;
+#endif
 };
 
 extern int skb_to_sgvec(struct sk_buff *skb, struct scatterlist *sg, int offset, int len);
@@ -825,6 +825,15 @@ extern int xfrm_state_check(struct xfrm_state *x, struct sk_buff *skb);
 extern int xfrm_state_mtu(struct xfrm_state *x, int mtu);
 extern int xfrm4_rcv(struct sk_buff *skb);
 extern int xfrm4_output(struct sk_buff *skb);
+#ifdef CONFIG_OCF_XFRM
+/*
+ * x->type->input() and ->output() may return -EINPROGRESS: the skb then
+ * belongs to the transform until it hands it back, with the result of
+ * the operation, to one of these.
+ */
+extern void xfrm4_rcv_resume(struct sk_buff *skb, int err);
+extern void xfrm4_output_resume(struct sk_buff *skb, int err);
+#endif
 extern int xfrm4_tunnel_register(struct xfrm_tunnel *handler);
 extern int xfrm4_tunnel_deregister(struct xfrm_tunnel *handler);
 extern int xfrm6_rcv_spi(struct sk_buff **pskb, unsigned int *nhoffp, u32 spi);
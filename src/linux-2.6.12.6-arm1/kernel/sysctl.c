@@ -949,6 +949,16 @@ static ctl_table fs_table[] = {
 		.mode		= 0644,
 		.proc_handler	= &proc_dointvec,
 	},
+#endif
+#ifdef CONFIG_INET
+	{
+		.ctl_name	= FS_RECVFILE,
+		.procname	= "recvfile-stat",
+		.data		= &recvfile_stat,
+		.maxlen		= sizeof(recvfile_stat),
+		.mode		= 0444,
+		.proc_handler	= &proc_doulongvec_minmax,
+	},
 #endif
 	{ .ctl_name = 0 }
 };
@@ -58,6 +58,7 @@
 #include <linux/rtnetlink.h>
 #include <linux/init.h>
 #include <linux/highmem.h>
+#include <linux/proc_fs.h>
 
 #include <net/protocol.h>
 #include <net/dst.h>
@@ -67,9 +68,13 @@
 
 #include <asm/uaccess.h>
 #include <asm/system.h>
+#include <asm/div64.h>
 
 static kmem_cache_t *skbuff_head_cache;
 
+static LIST_HEAD(skb_recycle_pools);
+static DEFINE_SPINLOCK(skb_recycle_lock);
+
 /*
  *	Keep out-of-line to prevent kernel bloat.
  *	__builtin_return_address is not used because it is not always
@@ -260,13 +265,62 @@ void skb_release_data(struct sk_buff *skb)
 	}
 }
 
+static inline void skb_recycle_pool_put(struct skb_recycle_pool *pool)
+{
+	if (atomic_dec_and_test(&pool->refcnt))
+		kfree(pool);
+}
+
 /*
  *	Free an skbuff by memory without cleaning the state.
  */
 void kfree_skbmem(struct sk_buff *skb)
 {
+	struct skb_recycle_pool *pool = skb->recycle;
+
 	skb_release_data(skb);
 	kmem_cache_free(skbuff_head_cache, skb);
+	if (pool)
+		skb_recycle_pool_put(pool);
+}
+
+/*
+ *	Put a buffer that is being freed back on its pool, as it came out
+ *	of alloc_skb().  Returns 0 if it has to go to slab after all.
+ */
+static int skb_recycle(struct sk_buff *skb)
+{
+	struct skb_recycle_pool *pool = skb->recycle;
+	struct skb_shared_info *shinfo = skb_shinfo(skb);
+	unsigned long flags;
+	int ok;
+
+	ok = (!skb->cloned || atomic_read(&shinfo->dataref) == 1) &&
+	     !shinfo->nr_frags && !shinfo->frag_list &&
+	     skb->end - skb->head == SKB_DATA_ALIGN(pool->size + 16);
+	if (ok) {
+		memset(skb, 0, offsetof(struct sk_buff, truesize));
+		skb->recycle = pool;
+		skb->truesize = (skb->end - skb->head) + sizeof(struct sk_buff);
+		atomic_set(&skb->users, 1);
+		skb->data = skb->head;
+		skb->tail = skb->head;
+
+		atomic_set(&shinfo->dataref, 1);
+		shinfo->tso_size = 0;
+		shinfo->tso_segs = 0;
+	}
+
+	spin_lock_irqsave(&pool->list.lock, flags);
+	if (ok && !pool->dead && skb_queue_len(&pool->list) < pool->max) {
+		__skb_queue_head(&pool->list, skb);
+		pool->recycled++;
+	} else {
+		pool->released++;
+		ok = 0;
+	}
+	spin_unlock_irqrestore(&pool->list.lock, flags);
+	return ok;
 }
 
 /**
@@ -305,9 +359,133 @@ void __kfree_skb(struct sk_buff *skb)
 #endif
 #endif
 
+	if (skb->recycle && skb_recycle(skb))
+		return;
 	kfree_skbmem(skb);
 }
 
+/**
+ *	skb_recycle_pool_create	-	set up a receive buffer pool
+ *	@dev: device the pool is reported under
+ *	@size: buffer size, as would be passed to dev_alloc_skb()
+ *	@max: number of free buffers kept at most
+ *	@gfp_mask: allocation mask for the pool itself
+ *
+ *	Returns %NULL if out of memory; dev_alloc_skb() does the job then.
+ */
+struct skb_recycle_pool *skb_recycle_pool_create(struct net_device *dev,
+						 unsigned int size,
+						 unsigned int max,
+						 int gfp_mask)
+{
+	struct skb_recycle_pool *pool;
+	unsigned long flags;
+
+	pool = kmalloc(sizeof(*pool), gfp_mask);
+	if (!pool)
+		return NULL;
+	memset(pool, 0, sizeof(*pool));
+	skb_queue_head_init(&pool->list);
+	pool->dev = dev;
+	pool->size = size;
+	pool->max = max;
+	atomic_set(&pool->refcnt, 1);
+
+	spin_lock_irqsave(&skb_recycle_lock, flags);
+	list_add_tail(&pool->all, &skb_recycle_pools);
+	spin_unlock_irqrestore(&skb_recycle_lock, flags);
+	return pool;
+}
+
+/**
+ *	skb_recycle_pool_destroy	-	take down a receive buffer pool
+ *	@pool: pool to destroy
+ *
+ *	The free buffers go to slab.  Buffers still in use go there too
+ *	when freed; the pool itself goes away with the last of them.
+ */
+void skb_recycle_pool_destroy(struct skb_recycle_pool *pool)
+{
+	struct sk_buff *skb;
+	unsigned long flags;
+
+	spin_lock_irqsave(&skb_recycle_lock, flags);
+	list_del(&pool->all);
+	spin_unlock_irqrestore(&skb_recycle_lock, flags);
+
+	spin_lock_irqsave(&pool->list.lock, flags);
+	pool->dead = 1;
+	spin_unlock_irqrestore(&pool->list.lock, flags);
+
+	while ((skb = skb_dequeue(&pool->list)) != NULL)
+		kfree_skbmem(skb);
+	skb_recycle_pool_put(pool);
+}
+
+/**
+ *	skb_recycle_alloc	-	allocate a receive buffer from a pool
+ *	@pool: pool to allocate from
+ *
+ *	Like dev_alloc_skb(@pool->size), but a recycled buffer is handed
+ *	out if there is one.  Can be called from an interrupt.
+ */
+struct sk_buff *skb_recycle_alloc(struct skb_recycle_pool *pool)
+{
+	struct sk_buff *skb;
+	unsigned long flags;
+
+	spin_lock_irqsave(&pool->list.lock, flags);
+	skb = __skb_dequeue(&pool->list);
+	pool->allocs++;
+	if (skb)
+		pool->hits++;
+	spin_unlock_irqrestore(&pool->list.lock, flags);
+
+	if (!skb) {
+		skb = alloc_skb(pool->size + 16, GFP_ATOMIC);
+		if (!skb)
+			return NULL;
+		skb->recycle = pool;
+		atomic_inc(&pool->refcnt);
+	}
+	skb_reserve(skb, 16);
+	return skb;
+}
+
+#ifdef CONFIG_PROC_FS
+static int skb_recycle_read_proc(char *page, char **start, off_t off,
+				 int count, int *eof, void *data)
+{
+	struct skb_recycle_pool *pool;
+	unsigned long flags;
+	u64 ratio;
+	int len;
+
+	len = sprintf(page, "%-8s %5s %5s %5s %10s %10s %10s %10s %4s\n",
+		      "dev", "size", "max", "free", "allocs", "hits",
+		      "recycled", "released", "hit%");
+
+	spin_lock_irqsave(&skb_recycle_lock, flags);
+	list_for_each_entry(pool, &skb_recycle_pools, all) {
+		if (len > PAGE_SIZE - 80)
+			break;
+		ratio = (u64)pool->hits * 100;
+		if (pool->allocs)
+			do_div(ratio, pool->allocs);
+		len += sprintf(page + len,
+			       "%-8s %5u %5u %5u %10lu %10lu %10lu %10lu %4u\n",
+			       pool->dev->name, pool->size, pool->max,
+			       skb_queue_len(&pool->list), pool->allocs,
+			       pool->hits, pool->recycled, pool->released,
+			       (unsigned int)ratio);
+	}
+	spin_unlock_irqrestore(&skb_recycle_lock, flags);
+
+	*eof = 1;
+	return len;
+}
+#endif
+
 /**
  *	skb_clone	-	duplicate an sk_buff
  *	@skb: buffer to clone
@@ -359,6 +537,7 @@ struct sk_buff *skb_clone(struct sk_buff *skb, int gfp_mask)
 	C(protocol);
 	C(security);
 	n->destructor = NULL;
+	n->recycle = NULL;
 #ifdef CONFIG_NETFILTER
 	C(nfmark);
 	C(nfcache);
@@ -1515,6 +1694,10 @@ void __init skb_init(void)
 					      NULL, NULL);
 	if (!skbuff_head_cache)
 		panic("cannot create skbuff cache");
+#ifdef CONFIG_PROC_FS
+	create_proc_read_entry("skb_recycle", 0, proc_net,
+			       skb_recycle_read_proc, NULL);
+#endif
 }
 
 EXPORT_SYMBOL(___pskb_trim);
@@ -1534,6 +1717,9 @@ EXPORT_SYMBOL(skb_copy_expand);
 EXPORT_SYMBOL(skb_over_panic);
 EXPORT_SYMBOL(skb_pad);
 EXPORT_SYMBOL(skb_realloc_headroom);
+EXPORT_SYMBOL(skb_recycle_alloc);
+EXPORT_SYMBOL(skb_recycle_pool_create);
+EXPORT_SYMBOL(skb_recycle_pool_destroy);
 EXPORT_SYMBOL(skb_under_panic);
 EXPORT_SYMBOL(skb_dequeue);
 EXPORT_SYMBOL(skb_dequeue_tail);
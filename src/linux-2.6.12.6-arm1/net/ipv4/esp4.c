@@ -10,6 +10,11 @@
 #include <net/icmp.h>
 #include <net/udp.h>
 
+#if defined(CONFIG_OCF_XFRM)
+#include <linux/interrupt.h>
+#include <../crypto/ocf/cryptodev.h>
+#endif
+
 /* decapsulation data for use when post-processing */
 struct esp_decap_data {
 	xfrm_address_t	saddr;
@@ -17,6 +22,223 @@ struct esp_decap_data {
 	__u8		proto;
 };
 
+static int esp_input_done(struct xfrm_state *x, struct xfrm_decap_state *decap,
+			  struct sk_buff *skb);
+
+#if defined(CONFIG_OCF_XFRM)
+/*
+ * ESP on an OCF hardware driver.  Encryption and authentication are one
+ * request, ordered by the session: encrypt then MAC on the way out, MAC
+ * then decrypt on the way in.  Requests complete in interrupt context;
+ * a tasklet hands the packets back to xfrm4 in the order they finished.
+ */
+static LIST_HEAD(esp_ocf_done_list);
+static DEFINE_SPINLOCK(esp_ocf_lock);
+
+static void esp_ocf_tasklet_fn(unsigned long data);
+static DECLARE_TASKLET(esp_ocf_tasklet, esp_ocf_tasklet_fn, 0);
+
+static int esp_ocf_cb(struct cryptop *crp)
+{
+	unsigned long flags;
+
+	/* a done request is on no OCF list, so crp_list is ours */
+	spin_lock_irqsave(&esp_ocf_lock, flags);
+	list_add_tail(&crp->crp_list, &esp_ocf_done_list);
+	spin_unlock_irqrestore(&esp_ocf_lock, flags);
+
+	tasklet_schedule(&esp_ocf_tasklet);
+	return 0;
+}
+
+static void esp_ocf_output_done(struct cryptop *crp)
+{
+	struct sk_buff *skb = (struct sk_buff *)crp->crp_buf;
+	int err = crp->crp_etype ? -EIO : 0;
+
+	crypto_freereq(crp);
+	xfrm4_output_resume(skb, err);
+}
+
+static void esp_ocf_input_done(struct cryptop *crp)
+{
+	struct sk_buff *skb = (struct sk_buff *)crp->crp_buf;
+	struct sec_decap_state *xs = &skb->sp->x[skb->sp->len - 1];
+	struct xfrm_state *x = xs->xvec;
+	int err = crp->crp_etype;
+
+	crypto_freereq(crp);
+
+	if (err == EBADMSG) {
+		spin_lock(&x->lock);
+		x->stats.integrity_failed++;
+		spin_unlock(&x->lock);
+	}
+	if (err == 0)
+		err = esp_input_done(x, &xs->decap, skb);
+	else
+		err = -EINVAL;
+	xfrm4_rcv_resume(skb, err);
+}
+
+static void esp_ocf_tasklet_fn(unsigned long data)
+{
+	struct cryptop *crp;
+	unsigned long flags;
+	LIST_HEAD(done);
+
+	spin_lock_irqsave(&esp_ocf_lock, flags);
+	list_splice_init(&esp_ocf_done_list, &done);
+	spin_unlock_irqrestore(&esp_ocf_lock, flags);
+
+	while (!list_empty(&done)) {
+		crp = list_entry(done.next, struct cryptop, crp_list);
+		list_del(&crp->crp_list);
+
+		/* the cipher descriptor comes first */
+		if (crp->crp_desc->crd_flags & CRD_F_ENCRYPT)
+			esp_ocf_output_done(crp);
+		else
+			esp_ocf_input_done(crp);
+	}
+}
+
+static int esp_ocf_dispatch(struct esp_data *esp, struct cryptop *crp,
+			    struct sk_buff *skb)
+{
+	crp->crp_ilen = skb->len;
+	/* the replay window and the receive path want packet order */
+	crp->crp_flags = CRYPTO_F_SKBUF | CRYPTO_F_CBIMM | CRYPTO_F_ORDERED;
+	crp->crp_buf = (caddr_t)skb;
+	crp->crp_callback = esp_ocf_cb;
+	crp->crp_sid = esp->ocf.sid;
+
+	if (crypto_dispatch(crp)) {
+		crypto_freereq(crp);
+		return -ENOBUFS;
+	}
+	return -EINPROGRESS;
+}
+
+/*
+ * The packet is linear, padded and has its headers; the driver writes
+ * its IV in front of the payload and the ICV behind the trailer.
+ */
+static int esp_ocf_output(struct xfrm_state *x, struct sk_buff *skb,
+			  struct ip_esp_hdr *esph, int clen)
+{
+	struct esp_data *esp = x->data;
+	struct cryptop *crp;
+	struct cryptodesc *crde, *crda;
+
+	crp = crypto_getreq(esp->ocf.mac ? 2 : 1);
+	if (crp == NULL)
+		return -ENOMEM;
+
+	crde = crp->crp_desc;
+	crde->crd_alg = esp->ocf.cipher;
+	crde->crd_flags = CRD_F_ENCRYPT;
+	crde->crd_skip = esph->enc_data + esp->conf.ivlen - skb->data;
+	crde->crd_len = clen;
+	crde->crd_inject = esph->enc_data - skb->data;
+
+	if (esp->ocf.mac) {
+		crda = crde->crd_next;
+		crda->crd_alg = esp->ocf.mac;
+		crda->crd_skip = (u8 *)esph - skb->data;
+		crda->crd_len = sizeof(struct ip_esp_hdr) + esp->conf.ivlen + clen;
+		crda->crd_inject = crda->crd_skip + crda->crd_len;
+		skb_put(skb, esp->auth.icv_trunc_len);
+	}
+
+	ip_send_check(skb->nh.iph);
+
+	return esp_ocf_dispatch(esp, crp, skb);
+}
+
+/* The packet is linear and writable, skb->data is the ESP header. */
+static int esp_ocf_input(struct xfrm_state *x, struct sk_buff *skb, int elen)
+{
+	struct esp_data *esp = x->data;
+	int alen = esp->auth.icv_trunc_len;
+	struct cryptop *crp;
+	struct cryptodesc *crde, *crda;
+
+	crp = crypto_getreq(esp->ocf.mac ? 2 : 1);
+	if (crp == NULL)
+		return -ENOMEM;
+
+	skb->ip_summed = CHECKSUM_NONE;
+
+	crde = crp->crp_desc;
+	crde->crd_alg = esp->ocf.cipher;
+	crde->crd_skip = sizeof(struct ip_esp_hdr) + esp->conf.ivlen;
+	crde->crd_len = elen;
+	crde->crd_inject = sizeof(struct ip_esp_hdr);
+
+	if (esp->ocf.mac) {
+		crda = crde->crd_next;
+		crda->crd_alg = esp->ocf.mac;
+		crda->crd_flags = CRD_F_MAC_VERIFY;
+		crda->crd_skip = 0;
+		crda->crd_len = skb->len - alen;
+		crda->crd_inject = skb->len - alen;
+	}
+
+	return esp_ocf_dispatch(esp, crp, skb);
+}
+
+/* A hardware session for the state, if the driver can do all of it. */
+static void esp_ocf_init(struct xfrm_state *x, struct esp_data *esp)
+{
+	struct cryptoini crie, cria;
+
+	memset(&crie, 0, sizeof(crie));
+	memset(&cria, 0, sizeof(cria));
+
+	switch (x->props.ealgo) {
+	case SADB_EALG_DESCBC:
+		crie.cri_alg = CRYPTO_DES_CBC;
+		break;
+	case SADB_EALG_3DESCBC:
+		crie.cri_alg = CRYPTO_3DES_CBC;
+		break;
+	case SADB_X_EALG_AESCBC:
+		crie.cri_alg = CRYPTO_AES_CBC;
+		break;
+	default:
+		return;
+	}
+	crie.cri_klen = x->ealg->alg_key_len;
+	crie.cri_key = x->ealg->alg_key;
+
+	if (x->aalg) {
+		/* OCF drivers produce the 96 bit HMACs of RFC 2403/2404 */
+		if (esp->auth.icv_trunc_len != 12)
+			return;
+		switch (x->props.aalgo) {
+		case SADB_AALG_MD5HMAC:
+			cria.cri_alg = CRYPTO_MD5_HMAC;
+			break;
+		case SADB_AALG_SHA1HMAC:
+			cria.cri_alg = CRYPTO_SHA1_HMAC;
+			break;
+		default:
+			return;
+		}
+		cria.cri_klen = x->aalg->alg_key_len;
+		cria.cri_key = x->aalg->alg_key;
+		crie.cri_next = &cria;
+	}
+
+	/* hardware only, the CryptoAPI already is our software path */
+	if (crypto_newsession(&esp->ocf.sid, &crie, 1))
+		return;
+	esp->ocf.cipher = crie.cri_alg;
+	esp->ocf.mac = cria.cri_alg;
+}
+#endif /* CONFIG_OCF_XFRM */
+
 static int esp_output(struct xfrm_state *x, struct sk_buff *skb)
 {
 	int err;
@@ -96,6 +318,12 @@ static int esp_output(struct xfrm_state *x, struct sk_buff *skb)
 	esph->spi = x->id.spi;
 	esph->seq_no = htonl(++x->replay.oseq);
 
+#if defined(CONFIG_OCF_XFRM)
+	/* skb_cow_data() leaves no pages behind, only a frag_list */
+	if (esp->ocf.cipher && nfrags == 1)
+		return esp_ocf_output(x, skb, esph, clen);
+#endif
+
 	if (esp->conf.ivlen)
 		crypto_cipher_set_iv(tfm, esp->conf.ivec, crypto_tfm_alg_ivsize(tfm));
 
@@ -139,7 +367,6 @@ error:
  */
 static int esp_input(struct xfrm_state *x, struct xfrm_decap_state *decap, struct sk_buff *skb)
 {
-	struct iphdr *iph;
 	struct ip_esp_hdr *esph;
 	struct esp_data *esp = x->data;
 	struct sk_buff *trailer;
@@ -147,7 +374,6 @@ static int esp_input(struct xfrm_state *x, struct xfrm_decap_state *decap, struc
 	int alen = esp->auth.icv_trunc_len;
 	int elen = skb->len - sizeof(struct ip_esp_hdr) - esp->conf.ivlen - alen;
 	int nfrags;
-	int encap_len = 0;
 
 	if (!pskb_may_pull(skb, sizeof(struct ip_esp_hdr)))
 		goto out;
@@ -155,6 +381,15 @@ static int esp_input(struct xfrm_state *x, struct xfrm_decap_state *decap, struc
 	if (elen <= 0 || (elen & (blksize-1)))
 		goto out;
 
+#if defined(CONFIG_OCF_XFRM)
+	if (esp->ocf.cipher) {
+		if ((nfrags = skb_cow_data(skb, 0, &trailer)) < 0)
+			goto out;
+		if (nfrags == 1)
+			return esp_ocf_input(x, skb, elen);
+	}
+#endif
+
 	/* If integrity check is required, do this. */
 	if (esp->auth.icv_full_len) {
 		u8 sum[esp->auth.icv_full_len];
@@ -177,17 +412,13 @@ static int esp_input(struct xfrm_state *x, struct xfrm_decap_state *decap, struc
 	skb->ip_summed = CHECKSUM_NONE;
 
 	esph = (struct ip_esp_hdr*)skb->data;
-	iph = skb->nh.iph;
 
 	/* Get ivec. This can be wrong, check against another impls. */
 	if (esp->conf.ivlen)
 		crypto_cipher_set_iv(esp->conf.tfm, esph->enc_data, crypto_tfm_alg_ivsize(esp->conf.tfm));
 
         {
-		u8 nexthdr[2];
 		struct scatterlist *sg = &esp->sgbuf[0];
-		u8 workbuf[60];
-		int padlen;
 
 		if (unlikely(nfrags > ESP_NUM_FAST_SG)) {
 			sg = kmalloc(sizeof(struct scatterlist)*nfrags, GFP_ATOMIC);
@@ -198,46 +429,66 @@ static int esp_input(struct xfrm_state *x, struct xfrm_decap_state *decap, struc
 		crypto_cipher_decrypt(esp->conf.tfm, sg, sg, elen);
 		if (unlikely(sg != &esp->sgbuf[0]))
 			kfree(sg);
+	}
 
-		if (skb_copy_bits(skb, skb->len-alen-2, nexthdr, 2))
-			BUG();
+	return esp_input_done(x, decap, skb);
 
-		padlen = nexthdr[0];
-		if (padlen+2 >= elen)
-			goto out;
+out:
+	return -EINVAL;
+}
 
-		/* ... check padding bits here. Silly. :-) */ 
+/* Authenticated and decrypted: strip the ESP header, IV and trailer. */
+static int esp_input_done(struct xfrm_state *x, struct xfrm_decap_state *decap,
+			  struct sk_buff *skb)
+{
+	struct iphdr *iph = skb->nh.iph;
+	struct ip_esp_hdr *esph = (struct ip_esp_hdr*)skb->data;
+	struct esp_data *esp = x->data;
+	int alen = esp->auth.icv_trunc_len;
+	int elen = skb->len - sizeof(struct ip_esp_hdr) - esp->conf.ivlen - alen;
+	int encap_len = 0;
+	u8 nexthdr[2];
+	u8 workbuf[60];
+	int padlen;
 
-		if (x->encap && decap && decap->decap_type) {
-			struct esp_decap_data *encap_data;
-			struct udphdr *uh = (struct udphdr *) (iph+1);
+	if (skb_copy_bits(skb, skb->len-alen-2, nexthdr, 2))
+		BUG();
 
-			encap_data = (struct esp_decap_data *) (decap->decap_data);
-			encap_data->proto = 0;
+	padlen = nexthdr[0];
+	if (padlen+2 >= elen)
+		goto out;
 
-			switch (decap->decap_type) {
-			case UDP_ENCAP_ESPINUDP:
-			case UDP_ENCAP_ESPINUDP_NON_IKE:
-				encap_data->proto = AF_INET;
-				encap_data->saddr.a4 = iph->saddr;
-				encap_data->sport = uh->source;
-				encap_len = (void*)esph - (void*)uh;
-				break;
+	/* ... check padding bits here. Silly. :-) */ 
 
-			default:
-				goto out;
-			}
-		}
+	if (x->encap && decap && decap->decap_type) {
+		struct esp_decap_data *encap_data;
+		struct udphdr *uh = (struct udphdr *) (iph+1);
+
+		encap_data = (struct esp_decap_data *) (decap->decap_data);
+		encap_data->proto = 0;
+
+		switch (decap->decap_type) {
+		case UDP_ENCAP_ESPINUDP:
+		case UDP_ENCAP_ESPINUDP_NON_IKE:
+			encap_data->proto = AF_INET;
+			encap_data->saddr.a4 = iph->saddr;
+			encap_data->sport = uh->source;
+			encap_len = (void*)esph - (void*)uh;
+			break;
 
-		iph->protocol = nexthdr[1];
-		pskb_trim(skb, skb->len - alen - padlen - 2);
-		memcpy(workbuf, skb->nh.raw, iph->ihl*4);
-		skb->h.raw = skb_pull(skb, sizeof(struct ip_esp_hdr) + esp->conf.ivlen);
-		skb->nh.raw += encap_len + sizeof(struct ip_esp_hdr) + esp->conf.ivlen;
-		memcpy(skb->nh.raw, workbuf, iph->ihl*4);
-		skb->nh.iph->tot_len = htons(skb->len);
+		default:
+			goto out;
+		}
 	}
 
+	iph->protocol = nexthdr[1];
+	pskb_trim(skb, skb->len - alen - padlen - 2);
+	memcpy(workbuf, skb->nh.raw, iph->ihl*4);
+	skb->h.raw = skb_pull(skb, sizeof(struct ip_esp_hdr) + esp->conf.ivlen);
+	skb->nh.raw += encap_len + sizeof(struct ip_esp_hdr) + esp->conf.ivlen;
+	memcpy(skb->nh.raw, workbuf, iph->ihl*4);
+	skb->nh.iph->tot_len = htons(skb->len);
+
 	return 0;
 
 out:
@@ -343,6 +594,12 @@ static void esp_destroy(struct xfrm_state *x)
 	if (!esp)
 		return;
 
+#if defined(CONFIG_OCF_XFRM)
+	if (esp->ocf.cipher) {
+		crypto_freesession(esp->ocf.sid);
+		esp->ocf.cipher = 0;
+	}
+#endif
 	if (esp->conf.tfm) {
 		crypto_free_tfm(esp->conf.tfm);
 		esp->conf.tfm = NULL;
@@ -446,6 +703,9 @@ static int esp_init_state(struct xfrm_state *x, void *args)
 	}
 	x->data = esp;
 	x->props.trailer_len = esp4_get_max_size(x, 0) - x->props.header_len;
+#if defined(CONFIG_OCF_XFRM)
+	esp_ocf_init(x, esp);
+#endif
 	return 0;
 
 error:
@@ -503,6 +763,9 @@ static void __exit esp4_fini(void)
 		printk(KERN_INFO "ip esp close: can't remove protocol\n");
 	if (xfrm_unregister_type(&esp_type, AF_INET) < 0)
 		printk(KERN_INFO "ip esp close: can't remove xfrm type\n");
+#if defined(CONFIG_OCF_XFRM)
+	tasklet_kill(&esp_ocf_tasklet);
+#endif
 }
 
 module_init(esp4_init);
@@ -9,8 +9,10 @@
  * 	
  */
 
+#include <linux/config.h>
 #include <linux/module.h>
 #include <linux/string.h>
+#include <linux/netfilter_ipv4.h>
 #include <net/inet_ecn.h>
 #include <net/ip.h>
 #include <net/xfrm.h>
@@ -45,28 +47,64 @@ static int xfrm4_parse_spi(struct sk_buff *skb, u8 nexthdr, u32 *spi, u32 *seq)
 	return xfrm_parse_spi(skb, nexthdr, spi, seq);
 }
 
-int xfrm4_rcv_encap(struct sk_buff *skb, __u16 encap_type)
+/*
+ * A transform may complete x->type->input() later: it returns
+ * -EINPROGRESS, keeps the skb and gives it back to xfrm4_rcv_resume().
+ * Everything the rest of the loop needs travels with the skb for that:
+ * the states are entered into its secpath as they are looked up, and
+ * the sequence number waits in the control block.
+ */
+struct xfrm4_skb_cb {
+	struct inet_skb_parm	header;
+	u32			seq;
+};
+
+#define XFRM4_SKB_CB(__skb) ((struct xfrm4_skb_cb *)&((__skb)->cb[0]))
+
+static int __xfrm4_rcv(struct sk_buff *skb, __u16 encap_type, int async, int err)
 {
-	int err;
 	u32 spi, seq;
-	struct sec_decap_state xfrm_vec[XFRM_MAX_DEPTH];
 	struct xfrm_state *x;
-	int xfrm_nr = 0;
 	int decaps = 0;
 
+	if (async) {
+		x = skb->sp->x[skb->sp->len - 1].xvec;
+		seq = XFRM4_SKB_CB(skb)->seq;
+		spin_lock(&x->lock);
+		goto resume;
+	}
+
+	/* Allocate new secpath or COW existing one. */
+
+	if (!skb->sp || atomic_read(&skb->sp->refcnt) != 1) {
+		struct sec_path *sp;
+		sp = secpath_dup(skb->sp);
+		if (!sp)
+			goto drop;
+		if (skb->sp)
+			secpath_put(skb->sp);
+		skb->sp = sp;
+	}
+
 	if ((err = xfrm4_parse_spi(skb, skb->nh.iph->protocol, &spi, &seq)) != 0)
 		goto drop;
 
 	do {
 		struct iphdr *iph = skb->nh.iph;
+		struct sec_decap_state *xs;
 
-		if (xfrm_nr == XFRM_MAX_DEPTH)
+		if (skb->sp->len == XFRM_MAX_DEPTH)
 			goto drop;
 
 		x = xfrm_state_lookup((xfrm_address_t *)&iph->daddr, spi, iph->protocol, AF_INET);
 		if (x == NULL)
 			goto drop;
 
+		/* the secpath owns the reference from here on */
+		xs = &skb->sp->x[skb->sp->len++];
+		xs->xvec = x;
+		xs->decap.decap_type = encap_type;
+
 		spin_lock(&x->lock);
 		if (unlikely(x->km.state != XFRM_STATE_VALID))
 			goto drop_unlock;
@@ -77,9 +115,24 @@ int xfrm4_rcv_encap(struct sk_buff *skb, __u16 encap_type)
 		if (xfrm_state_check_expire(x))
 			goto drop_unlock;
 
-		xfrm_vec[xfrm_nr].decap.decap_type = encap_type;
-		if (x->type->input(x, &(xfrm_vec[xfrm_nr].decap), skb))
+		XFRM4_SKB_CB(skb)->seq = seq;
+		err = x->type->input(x, &xs->decap, skb);
+		if (err == -EINPROGRESS) {
+			spin_unlock(&x->lock);
+			return 0;
+		}
+resume:
+		if (err)
+			goto drop_unlock;
+
+		/*
+		 * A copy of the packet may have been through here while this
+		 * one was away: check again now that the window is ours.
+		 */
+		if (async && x->props.replay_window &&
+		    xfrm_replay_check(x, seq))
 			goto drop_unlock;
+		async = 0;
 
 		/* only the first xfrm gets the encap type */
 		encap_type = 0;
@@ -92,8 +145,6 @@ int xfrm4_rcv_encap(struct sk_buff *skb, __u16 encap_type)
 
 		spin_unlock(&x->lock);
 
-		xfrm_vec[xfrm_nr++].xvec = x;
-
 		iph = skb->nh.iph;
 
 		if (x->props.mode) {
@@ -120,23 +171,6 @@ int xfrm4_rcv_encap(struct sk_buff *skb, __u16 encap_type)
 			goto drop;
 	} while (!err);
 
-	/* Allocate new secpath or COW existing one. */
-
-	if (!skb->sp || atomic_read(&skb->sp->refcnt) != 1) {
-		struct sec_path *sp;
-		sp = secpath_dup(skb->sp);
-		if (!sp)
-			goto drop;
-		if (skb->sp)
-			secpath_put(skb->sp);
-		skb->sp = sp;
-	}
-	if (xfrm_nr + skb->sp->len > XFRM_MAX_DEPTH)
-		goto drop;
-
-	memcpy(skb->sp->x+skb->sp->len, xfrm_vec, xfrm_nr*sizeof(struct sec_decap_state));
-	skb->sp->len += xfrm_nr;
-
 	if (decaps) {
 		if (!(skb->dev->flags&IFF_LOOPBACK)) {
 			dst_release(skb->dst);
@@ -150,11 +184,49 @@ int xfrm4_rcv_encap(struct sk_buff *skb, __u16 encap_type)
 
 drop_unlock:
 	spin_unlock(&x->lock);
-	xfrm_state_put(x);
 drop:
-	while (--xfrm_nr >= 0)
-		xfrm_state_put(xfrm_vec[xfrm_nr].xvec);
-
 	kfree_skb(skb);
 	return 0;
 }
+
+int xfrm4_rcv_encap(struct sk_buff *skb, __u16 encap_type)
+{
+	return __xfrm4_rcv(skb, encap_type, 0, 0);
+}
+
+#ifdef CONFIG_OCF_XFRM
+static int xfrm4_rcv_encap_finish(struct sk_buff *skb)
+{
+	struct iphdr *iph = skb->nh.iph;
+
+	if (skb->dst == NULL &&
+	    ip_route_input(skb, iph->daddr, iph->saddr, iph->tos, skb->dev)) {
+		kfree_skb(skb);
+		return NET_RX_DROP;
+	}
+	return dst_input(skb);
+}
+
+/*
+ * The rest of xfrm4_rcv_encap() for a transform that completed later,
+ * called in softirq context.  In transport mode there is no
+ * ip_local_deliver_finish() below us to take the next protocol from the
+ * return value, so the packet goes through the input path once more.
+ */
+void xfrm4_rcv_resume(struct sk_buff *skb, int err)
+{
+	struct iphdr *iph;
+
+	if (__xfrm4_rcv(skb, 0, 1, err) >= 0)
+		return;
+
+	iph = skb->nh.iph;
+	__skb_push(skb, skb->data - skb->nh.raw);
+	iph->tot_len = htons(skb->len);
+	ip_send_check(iph);
+	NF_HOOK(PF_INET, NF_IP_PRE_ROUTING, skb, skb->dev, NULL,
+		xfrm4_rcv_encap_finish);
+}
+
+EXPORT_SYMBOL(xfrm4_rcv_resume);
+#endif
@@ -8,6 +8,8 @@
  * 2 of the License, or (at your option) any later version.
  */
 
+#include <linux/config.h>
+#include <linux/module.h>
 #include <linux/skbuff.h>
 #include <linux/spinlock.h>
 #include <net/inet_ecn.h>
@@ -117,6 +119,11 @@ int xfrm4_output(struct sk_buff *skb)
 	xfrm4_encap(skb);
 
 	err = x->type->output(x, skb);
+	if (err == -EINPROGRESS) {
+		/* xfrm4_output_resume() takes it from here */
+		spin_unlock_bh(&x->lock);
+		return 0;
+	}
 	if (err)
 		goto error;
 
@@ -139,3 +146,34 @@ error_nolock:
 	kfree_skb(skb);
 	goto out_exit;
 }
+
+#ifdef CONFIG_OCF_XFRM
+/*
+ * The rest of xfrm4_output() for a transform that completed later.  The
+ * skb still holds the xfrm dst, and through it the state.  dst_output()
+ * walks on through the bundle as if we had returned NET_XMIT_BYPASS.
+ */
+void xfrm4_output_resume(struct sk_buff *skb, int err)
+{
+	struct dst_entry *dst = skb->dst;
+	struct xfrm_state *x = dst->xfrm;
+
+	if (err)
+		goto error;
+
+	spin_lock_bh(&x->lock);
+	x->curlft.bytes += skb->len;
+	x->curlft.packets++;
+	spin_unlock_bh(&x->lock);
+
+	if (!(skb->dst = dst_pop(dst)))
+		goto error;
+	dst_output(skb);
+	return;
+
+error:
+	kfree_skb(skb);
+}
+
+EXPORT_SYMBOL(xfrm4_output_resume);
+#endif
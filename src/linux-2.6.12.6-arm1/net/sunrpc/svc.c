@@ -147,6 +147,8 @@ svc_release_buffer(struct svc_rqst *rqstp)
 		put_page(rqstp->rq_respages[rqstp->rq_resused]);
 	}
 	rqstp->rq_argused = 0;
+	skb_queue_purge(&rqstp->rq_argskbs);
+	rqstp->rq_argskblen = 0;
 }
 
 /*
@@ -164,6 +166,7 @@ svc_create_thread(svc_thread_fn func, struct svc_serv *serv)
 
 	memset(rqstp, 0, sizeof(*rqstp));
 	init_waitqueue_head(&rqstp->rq_wait);
+	skb_queue_head_init(&rqstp->rq_argskbs);
 
 	if (!(rqstp->rq_argp = (u32 *) kmalloc(serv->sv_xdrsize, GFP_KERNEL))
 	 || !(rqstp->rq_resp = (u32 *) kmalloc(serv->sv_xdrsize, GFP_KERNEL))
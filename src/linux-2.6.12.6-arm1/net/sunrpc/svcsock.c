@@ -31,6 +31,7 @@
 #include <linux/slab.h>
 #include <linux/netdevice.h>
 #include <linux/skbuff.h>
+#include <linux/moduleparam.h>
 #include <net/sock.h>
 #include <net/checksum.h>
 #include <net/ip.h>
@@ -62,6 +63,21 @@
 
 #define RPCDBG_FACILITY	RPCDBG_SVCSOCK
 
+/*
+ * When set, the page part of large TCP records for procedures that
+ * declare pc_skbargs is left in (cloned) receive skbs instead of being
+ * copied into rq_argpages.  The consumer then copies it exactly once.
+ */
+static int svc_tcp_skbrecv = 1;
+module_param(svc_tcp_skbrecv, bool, 0644);
+
+/* Where an skb on rq_argskbs keeps the part of it that belongs to the record */
+struct svc_skb_cb {
+	unsigned int		offset;
+	unsigned int		len;
+};
+#define SVC_SKB_CB(skb)	((struct svc_skb_cb *)&((skb)->cb[0]))
+
 
 static struct svc_sock *svc_setup_socket(struct svc_serv *, struct socket *,
 					 int *errp, int pmap_reg);
@@ -113,6 +129,80 @@ svc_release_skb(struct svc_rqst *rqstp)
 		rqstp->rq_deferred = NULL;
 		kfree(dr);
 	}
+	if (rqstp->rq_argskblen) {
+		skb_queue_purge(&rqstp->rq_argskbs);
+		rqstp->rq_argskblen = 0;
+	}
+}
+
+/*
+ * Copy len bytes, starting at offset into the page part of the
+ * arguments, out of the skbs that were left on rq_argskbs.
+ */
+int
+svc_copy_argskbs(struct svc_rqst *rqstp, unsigned int offset,
+		 void *to, unsigned int len)
+{
+	struct sk_buff	*skb;
+	unsigned int	n;
+
+	if (offset + len > rqstp->rq_argskblen)
+		return -EINVAL;
+
+	skb_queue_walk(&rqstp->rq_argskbs, skb) {
+		if (!len)
+			break;
+		if (offset >= SVC_SKB_CB(skb)->len) {
+			offset -= SVC_SKB_CB(skb)->len;
+			continue;
+		}
+		n = SVC_SKB_CB(skb)->len - offset;
+		if (n > len)
+			n = len;
+		if (skb_copy_bits(skb, SVC_SKB_CB(skb)->offset + offset, to, n))
+			return -EFAULT;
+		to += n;
+		len -= n;
+		offset = 0;
+	}
+	return len ? -EFAULT : 0;
+}
+
+/*
+ * Give up on the single-copy path: move the data held in rq_argskbs
+ * into rq_argpages, so that rq_arg looks like any other TCP request.
+ */
+int
+svc_flush_argskbs(struct svc_rqst *rqstp)
+{
+	struct sk_buff	*skb;
+	unsigned int	len = rqstp->rq_argskblen;
+	unsigned int	done = 0, n;
+	int		err = 0;
+
+	while ((skb = __skb_dequeue(&rqstp->rq_argskbs)) != NULL) {
+		unsigned int	offset = SVC_SKB_CB(skb)->offset;
+		unsigned int	left = SVC_SKB_CB(skb)->len;
+
+		while (!err && left) {
+			struct page *page = rqstp->rq_arg.pages[done >> PAGE_SHIFT];
+
+			n = PAGE_SIZE - (done & ~PAGE_MASK);
+			if (n > left)
+				n = left;
+			err = skb_copy_bits(skb, offset,
+					    page_address(page) + (done & ~PAGE_MASK),
+					    n);
+			offset += n;
+			left -= n;
+			done += n;
+		}
+		kfree_skb(skb);
+	}
+	rqstp->rq_argskblen = 0;
+	if (!err && done != len)
+		err = -EFAULT;
+	return err;
 }
 
 /*
@@ -883,6 +973,114 @@ failed:
 	return;
 }
 
+/*
+ * Check whether the RPC call at the start of the record in rq_arg.head
+ * is for a procedure that can take its page data straight from skbs.
+ * Only the flavours that leave the arguments untouched qualify; GSS
+ * integrity and privacy need to see the whole record.
+ */
+static int
+svc_tcp_want_argskbs(struct svc_rqst *rqstp)
+{
+	struct svc_program	*progp = rqstp->rq_server->sv_program;
+	struct svc_version	*versp;
+	u32			*p = rqstp->rq_arg.head[0].iov_base;
+	u32			vers, proc;
+
+	if (ntohl(p[1]) != 0 /* CALL */ || ntohl(p[2]) != 2
+	 || ntohl(p[3]) != progp->pg_prog)
+		return 0;
+	vers = ntohl(p[4]);
+	proc = ntohl(p[5]);
+	if (vers >= progp->pg_nvers || !(versp = progp->pg_vers[vers])
+	 || proc >= versp->vs_nproc)
+		return 0;
+	if (ntohl(p[6]) != RPC_AUTH_NULL && ntohl(p[6]) != RPC_AUTH_UNIX)
+		return 0;
+	return versp->vs_proc[proc].pc_skbargs;
+}
+
+/*
+ * tcp_read_sock() actor: take a reference to the skb data instead of
+ * copying it.
+ */
+static int
+svc_tcp_skb_actor(read_descriptor_t *desc, struct sk_buff *skb,
+		  unsigned int offset, size_t len)
+{
+	struct svc_rqst	*rqstp = desc->arg.data;
+	struct sk_buff	*clone;
+
+	if (len > desc->count)
+		len = desc->count;
+	clone = skb_clone(skb, GFP_KERNEL);
+	if (!clone) {
+		desc->error = -ENOMEM;
+		desc->count = 0;
+		return 0;
+	}
+	SVC_SKB_CB(clone)->offset = offset;
+	SVC_SKB_CB(clone)->len = len;
+	__skb_queue_tail(&rqstp->rq_argskbs, clone);
+	rqstp->rq_argskblen += len;
+	desc->count -= len;
+	return len;
+}
+
+/*
+ * Receive a complete record of len bytes that is larger than the head.
+ * The head is always copied.  If the call qualifies, the remainder is
+ * left in the socket's skbs; otherwise it goes into rq_argpages.
+ */
+static int
+svc_tcp_recv_argskbs(struct svc_rqst *rqstp, int len)
+{
+	struct sock	*sk = rqstp->rq_sock->sk_sk;
+	struct kvec	vec[RPCSVC_MAXPAGES];
+	read_descriptor_t desc;
+	int		hlen, vlen, pnum, got;
+
+	hlen = rqstp->rq_arg.head[0].iov_len;
+	vec[0] = rqstp->rq_arg.head[0];
+	got = svc_recvfrom(rqstp, vec, 1, hlen);
+	if (got != hlen)
+		return got < 0 ? got : -EIO;
+
+	if (!svc_tcp_want_argskbs(rqstp)) {
+		vlen = 0;
+		pnum = 0;
+		while (vlen < len - hlen) {
+			vec[pnum].iov_base = page_address(rqstp->rq_argpages[rqstp->rq_argused++]);
+			vec[pnum].iov_len = PAGE_SIZE;
+			pnum++;
+			vlen += PAGE_SIZE;
+		}
+		got = svc_recvfrom(rqstp, vec, pnum, len - hlen);
+		if (got != len - hlen)
+			return got < 0 ? got : -EIO;
+		return len;
+	}
+
+	desc.arg.data = rqstp;
+	desc.count = len - hlen;
+	desc.error = 0;
+	desc.written = 0;
+	lock_sock(sk);
+	got = tcp_read_sock(sk, &desc, svc_tcp_skb_actor);
+	release_sock(sk);
+
+	/* The reply pages still come from rq_argpages */
+	rqstp->rq_argused += (len - hlen + PAGE_SIZE - 1) >> PAGE_SHIFT;
+
+	if (desc.error || got != len - hlen) {
+		skb_queue_purge(&rqstp->rq_argskbs);
+		rqstp->rq_argskblen = 0;
+		return desc.error ? desc.error : -EIO;
+	}
+	dprintk("svc: TCP record, %d bytes left in skbs\n", got);
+	return len;
+}
+
 /*
  * Receive data from a TCP socket.
  */
@@ -985,6 +1183,17 @@ svc_tcp_recvfrom(struct svc_rqst *rqstp)
 	len = svsk->sk_reclen;
 	set_bit(SK_DATA, &svsk->sk_flags);
 
+	if (svc_tcp_skbrecv && len > rqstp->rq_arg.head[0].iov_len) {
+		len = svc_tcp_recv_argskbs(rqstp, len);
+		if (len < 0) {
+			/* part of the record is gone; we are out of sync */
+			printk(KERN_NOTICE "%s: TCP record receive failed (%d)\n",
+			       svsk->sk_server->sv_name, len);
+			goto err_delete;
+		}
+		goto received;
+	}
+
 	vec[0] = rqstp->rq_arg.head[0];
 	vlen = PAGE_SIZE;
 	pnum = 1;
@@ -1000,6 +1209,7 @@ svc_tcp_recvfrom(struct svc_rqst *rqstp)
 	if (len < 0)
 		goto error;
 
+ received:
 	dprintk("svc: TCP complete record (%d bytes)\n", len);
 	rqstp->rq_arg.len = len;
 	rqstp->rq_arg.page_base = 0;
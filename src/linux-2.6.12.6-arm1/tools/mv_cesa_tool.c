@@ -38,6 +38,11 @@ void show_usage(int badarg)
                 "                   1 - Full verify                                                     \n"
                 "                   2 - without verify (for performence)                                \n"
 		"											\n"
+		" mv_cesa_tool -test -f <iter> <session_id> <data_id> <checkmode>			\n"
+		"       (can be used only in Test Mode)                                                 \n"
+		"	requests larger than the SRAM buffer, serial and pipelined fragments	\n"
+		"	session_id, data_id, checkmode: as for -s					\n"
+		"											\n"
 		" mv_cesa_tool -debug <debug_mode> [-i index] [-v] [-s size]				\n"
 		"	(Tst_req and Tst_ses can be used only in Test Mode)				\n"
 		"	debug_mode: Sts - display general status 					\n"
@@ -153,6 +158,16 @@ static void parse_test_cmdline(int argc, char **argv, CESA_TEST *cesa_test)
 		cesa_test->data_id = atoi(argv[i++]);
                 cesa_test->checkmode = atoi(argv[i++]);
 	}
+	else if(!strcmp(argv[i], "-f")) { /* fragment pipelining test */
+		i++;
+		if(argc != 7)
+                	show_usage(1);
+		cesa_test->test = FRAG_PIPE;
+		cesa_test->iter = atoi(argv[i++]);
+		cesa_test->session_id = atoi(argv[i++]);
+		cesa_test->data_id = atoi(argv[i++]);
+                cesa_test->checkmode = atoi(argv[i++]);
+	}
         else {
 		if(argc != 6)
                         show_usage(1);